@@ -31,6 +31,7 @@
 // Power Management
 #define SLEEP_DURATION_SECONDS 300
 #define WIFI_TIMEOUT_MS 15000
+#define NTP_SERVER "pool.ntp.org"
 
 // Special Characters for KeyInput
 #define REMOVE_CHAR 127
@@ -43,4 +44,7 @@
 #define DFPLAYER_RX_PIN 21
 #define LED_PIN 4
 
+// Real-Time Clock
+#define RTC_INT_PIN -1
+
 #endif // CONFIG_H
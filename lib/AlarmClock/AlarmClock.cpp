@@ -3,11 +3,83 @@
 #include "configs.h"
 #include "NotificationManager.h"
 #include "PushNotifier.h"
+#include "ExpiryScheduler.h"
+#include "TimeService.h"
+#include "TimeZone.h"
 
 extern NotificationManager notificationManager;
+extern ExpiryScheduler expiryScheduler;
+extern TimeService timeService;
+extern TimeZone timeZone;
 
-AlarmClock::AlarmClock(Adafruit_SSD1306* displayInstance, RTC_DS3231* rtcInstance, PushNotifier* notifier) 
-    : display(displayInstance), rtc(rtcInstance), pushNotifier(notifier), lastAlarmCheck(0), alarmTriggerTime(0), currentAlarmIndex(-1), isRinging(false), lastDisplayUpdate(0) {
+// Re-read the RTC at least this often while waiting for the next alarm, to
+// absorb millis() drift and clock changes
+#define ALARM_RESYNC_MS 600000UL
+#define SECONDS_PER_DAY 86400UL
+// Alarms whose minute passed while we were not looking (long frame, blocking
+// flow, reset) still ring if they are at most this late
+#define ALARM_CATCHUP_SECONDS 1800UL
+// With the DS3231 interrupt wired, the RTC is only read this long after the
+// head was due if the interrupt never came
+#define ALARM_INT_GRACE_MS 5000UL
+#define ALARM_MAX_SNOOZE_MINUTES 30
+
+// Repeat choices offered by the setup screen
+struct RepeatPreset {
+    const char* label;
+    uint8_t days;
+    bool oneShot;
+};
+static const RepeatPreset REPEAT_PRESETS[] = {
+    {"Daily", ALARM_EVERY_DAY, false}, {"Mon-Fri", ALARM_WEEKDAYS, false}, {"Sat-Sun", ALARM_WEEKEND, false},
+    {"Once", ALARM_EVERY_DAY, true},   {"Sun", 0x01, false}, {"Mon", 0x02, false}, {"Tue", 0x04, false},
+    {"Wed", 0x08, false},              {"Thu", 0x10, false}, {"Fri", 0x20, false}, {"Sat", 0x40, false},
+};
+static const int REPEAT_PRESET_COUNT = sizeof(REPEAT_PRESETS) / sizeof(REPEAT_PRESETS[0]);
+
+// Last evaluated RTC time, kept across resets so a reboot cannot swallow an alarm
+RTC_DATA_ATTR static uint32_t rtcLastAlarmCheck = 0;
+
+// Set on the falling edge of the DS3231 INT line (Alarm1 matched)
+static volatile bool rtcAlarmFired = false;
+
+// Starts the alarm sound from the alert task right away, even if the main
+// loop is stuck in a long flow; the loop picks up the rest on its next pass
+static void IRAM_ATTR onRtcAlarmInterrupt() {
+    rtcAlarmFired = true;
+    expiryScheduler.triggerFromIsr(EXPIRY_ALARM);
+}
+
+AlarmClock::AlarmClock(Adafruit_SSD1306* displayInstance, RTC_DS3231* rtcInstance, PushNotifier* notifier, ModelRepository* modelRepository) 
+    : display(displayInstance), rtc(rtcInstance), pushNotifier(notifier), models(modelRepository), alarms(modelRepository->getAlarms()), lastAlarmCheck(0), alarmTriggerTime(0),
+      scheduleDirty(true), headDueMillis(0), lastCheckedUnix(rtcLastAlarmCheck), catchUpPending(true), hwAlarm(false), programmedFireAt(0), currentAlarmIndex(-1), isRinging(false), lastDisplayUpdate(0) {
+    models->addListener(&AlarmClock::onModelChanged, this);
+}
+
+void AlarmClock::onModelChanged(ModelKind kind, ModelChange change, uint16_t id, void* context) {
+    if (kind == MODEL_ALARM) static_cast<AlarmClock*>(context)->scheduleDirty = true;
+}
+
+void AlarmClock::begin() {
+    if (RTC_INT_PIN < 0 || !rtc) return;
+    // INTCN=1: the shared INT/SQW pin signals alarms instead of a square wave
+    rtc->writeSqwPinMode(DS3231_OFF);
+    rtc->disable32K();
+    rtc->clearAlarm(1);
+    rtc->clearAlarm(2);
+    rtc->disableAlarm(2);
+    // Open drain and active low; the DS3231 holds it low until the flag is cleared
+    pinMode(RTC_INT_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(RTC_INT_PIN), onRtcAlarmInterrupt, FALLING);
+    hwAlarm = true;
+    scheduleDirty = true;
+    Serial.println("[Alarm] DS3231 Alarm1 interrupt enabled");
+}
+
+void AlarmClock::rescheduleAlarms() {
+    scheduleDirty = true;
+    catchUpPending = true;
+    headDueMillis = millis(); // re-plan on the next update
 }
 
 void AlarmClock::startSetup() {
@@ -15,6 +87,8 @@ void AlarmClock::startSetup() {
     tempHour = 7;
     tempMinute = 30;
     tempSoundTrack = 3;
+    tempRepeat = 0;
+    tempSnooze = 9;
     // Default no-op; use addAlarm to create alarms
     drawSetupScreen();
 }
@@ -25,9 +99,9 @@ void AlarmClock::handleSetupInput() {
         int y_move = get_y_movement();
         if (y_move != 0) {
             if (y_move == -1) {
-                setupState = (setupState == 0) ? 2 : setupState - 1;
+                setupState = (setupState == 0) ? 4 : setupState - 1;
             } else if (y_move == 1) {
-                setupState = (setupState == 2) ? 0 : setupState + 1;
+                setupState = (setupState == 4) ? 0 : setupState + 1;
             }
             drawSetupScreen();
         }
@@ -50,6 +124,14 @@ void AlarmClock::handleSetupInput() {
                     if (x_move == 1) tempSoundTrack = (tempSoundTrack < 50) ? tempSoundTrack + 1 : 1;
                     else tempSoundTrack = (tempSoundTrack > 1) ? tempSoundTrack - 1 : 50;
                     break;
+                case 3: // repeat
+                    if (x_move == 1) tempRepeat = (tempRepeat + 1) % REPEAT_PRESET_COUNT;
+                    else tempRepeat = (tempRepeat + REPEAT_PRESET_COUNT - 1) % REPEAT_PRESET_COUNT;
+                    break;
+                case 4: // snooze
+                    if (x_move == 1) tempSnooze = (tempSnooze < ALARM_MAX_SNOOZE_MINUTES) ? tempSnooze + 1 : 0;
+                    else tempSnooze = (tempSnooze > 0) ? tempSnooze - 1 : ALARM_MAX_SNOOZE_MINUTES;
+                    break;
             }
             drawSetupScreen();
         }
@@ -61,19 +143,24 @@ bool AlarmClock::isSetupComplete() const {
 }
 
 void AlarmClock::loadAlarms(StorageManager& storage) {
-    alarms = storage.loadAlarms();
+    models->setAlarms(storage.loadAlarms());
 }
 
 void AlarmClock::addAlarm(const Alarm& newAlarm) {
     // Check duplicates
     for (const auto& a : alarms) {
-        if (a.hour == newAlarm.hour && a.minute == newAlarm.minute) return;
+        if (a.hour == newAlarm.hour && a.minute == newAlarm.minute && a.days == newAlarm.days &&
+            a.one_shot == newAlarm.one_shot) return;
     }
-    alarms.push_back(newAlarm);
+    models->addAlarm(newAlarm);
 }
 
 void AlarmClock::removeAlarm(int index) {
-    if (index >= 0 && index < (int)alarms.size()) alarms.erase(alarms.begin() + index);
+    models->removeAlarm(models->alarmId(index));
+}
+
+void AlarmClock::toggleAlarm(int index) {
+    models->updateAlarm(models->alarmId(index), [](Alarm& a) { a.enabled = !a.enabled; });
 }
 
 const std::vector<Alarm>& AlarmClock::getAlarms() const {
@@ -81,11 +168,14 @@ const std::vector<Alarm>& AlarmClock::getAlarms() const {
 }
 
 void AlarmClock::enableAlarm(bool enable) {
-    for (auto& a : alarms) a.enabled = enable;
+    for (size_t i = 0; i < alarms.size(); ++i) {
+        if (alarms[i].enabled == enable) continue;
+        models->updateAlarm(models->alarmId((int)i), [enable](Alarm& a) { a.enabled = enable; });
+    }
 }
 
 void AlarmClock::disableAlarm() {
-    for (auto& a : alarms) a.enabled = false;
+    enableAlarm(false);
     isRinging = false;
     currentAlarmIndex = -1;
 }
@@ -104,48 +194,205 @@ bool AlarmClock::isAlarmTriggered() const {
 }
 
 void AlarmClock::updateAlarm() {
-    // Always check alarms if alarms exist
-    if (alarms.empty()) return;
+    if (!rtc) return;
+    if (!scheduleDirty && schedule.empty()) return;
     unsigned long currentTime = millis();
-    
-    // Check alarm time every second
-    if (currentTime - lastAlarmCheck >= 1000) {
-        checkAlarmTime();
-        lastAlarmCheck = currentTime;
+
+    // Sleep until the head alarm is due (no I2C, no scan), with a periodic resync.
+    // With Alarm1 programmed the interrupt wakes us instead; no resync needed.
+    bool interrupted = rtcAlarmFired;
+    if (!scheduleDirty && !interrupted && (long)(currentTime - headDueMillis) < 0 &&
+        (hwAlarm || currentTime - lastAlarmCheck < ALARM_RESYNC_MS)) return;
+
+    bool alertStarted = false;
+    if (interrupted) {
+        rtcAlarmFired = false;
+        rtc->clearAlarm(1); // releases the INT line for the next match
+        alertStarted = expiryScheduler.takeExpired(EXPIRY_ALARM);
+        timeService.sampleRtc(); // Alarm1 matched: make sure "now" has reached it
     }
-    
-    // Update display periodically
-    if (currentTime - lastDisplayUpdate >= displayUpdateInterval) {
-        drawCurrentScreen();
-        lastDisplayUpdate = currentTime;
+    uint32_t nowUnix = readRtcUnix();
+    // Every fire time is less than a day ahead when computed; more means the clock went back
+    if (scheduleDirty || (!schedule.empty() && schedule.front().fireAt > nowUnix + SECONDS_PER_DAY)) {
+        rebuildSchedule(nowUnix);
     }
+    // Crossing detection: everything scheduled at or before now is due, however
+    // long ago the previous check was. One alarm rings at a time.
+    if (!isRinging && !schedule.empty() && schedule.front().fireAt <= nowUnix) fireDueAlarms(nowUnix, alertStarted);
+    // Alarms still waiting behind a ringing one stay inside the checked window
+    bool pending = !schedule.empty() && schedule.front().fireAt <= nowUnix;
+    lastCheckedUnix = pending ? schedule.front().fireAt - 1 : nowUnix;
+    rtcLastAlarmCheck = lastCheckedUnix;
+    planWake(nowUnix);
+    programHardwareAlarm(nowUnix);
 }
 
-void AlarmClock::checkAlarmTime() {
-    if (!rtc) return;
-    
-    DateTime now = rtc->now();
-    
-    // Iterate alarms and trigger when a matching enabled alarm is found at exact 0 seconds
+// Start of the window a rebuilt schedule still fires for. Falls back to now
+// after a long gap (device was off) or when the clock moved backwards.
+uint32_t AlarmClock::catchUpFrom(uint32_t lastCheckedUnix, uint32_t nowUnix) {
+    if (lastCheckedUnix == 0 || lastCheckedUnix > nowUnix) return nowUnix;
+    if (nowUnix - lastCheckedUnix > ALARM_CATCHUP_SECONDS) return nowUnix;
+    return lastCheckedUnix;
+}
+
+uint32_t AlarmClock::readRtcUnix() {
+    lastAlarmCheck = millis();
+    return timeService.nowUnix();
+}
+
+// Next time alarm's HH:MM:00 comes up on one of its weekdays strictly after
+// the local time localNow. The mask is rotated so bit d means "d days from
+// today"; bit 7 is today's weekday again next week, and the lowest set bit is the answer.
+static uint32_t nextLocalFireAfter(const Alarm& alarm, uint32_t localNow) {
+    DateTime now(localNow);
+    uint32_t today = DateTime(now.year(), now.month(), now.day(), alarm.hour, alarm.minute, 0).unixtime();
+    uint8_t weekday = now.dayOfTheWeek();
+    uint8_t mask = (alarm.days & ALARM_EVERY_DAY) ? (alarm.days & ALARM_EVERY_DAY) : ALARM_EVERY_DAY;
+    uint16_t ahead = ((mask >> weekday) | (mask << (7 - weekday))) & ALARM_EVERY_DAY;
+    ahead |= (uint16_t)((mask >> weekday) & 1) << 7;
+    if (today <= localNow) ahead &= ~1u;
+    return today + (uint32_t)__builtin_ctz(ahead) * SECONDS_PER_DAY;
+}
+
+// Alarm times are wall-clock; the schedule is UTC. A time in the hour repeated
+// at the end of DST maps to its first pass, which may already be behind us.
+uint32_t AlarmClock::nextFireAfter(const Alarm& alarm, uint32_t nowUnix) {
+    uint32_t local = nextLocalFireAfter(alarm, timeZone.toLocal(nowUnix));
+    uint32_t fireAt = timeZone.toUtc(local);
+    if (fireAt <= nowUnix) fireAt = timeZone.toUtc(nextLocalFireAfter(alarm, local));
+    return fireAt;
+}
+
+void AlarmClock::insertFire(const AlarmFire& fire) {
+    size_t pos = 0;
+    while (pos < schedule.size() && schedule[pos].fireAt <= fire.fireAt) pos++;
+    schedule.insert(schedule.begin() + pos, fire);
+}
+
+// After a boot or an RTC step, alarms that came up in (lastChecked, now] are
+// scheduled in the past and fire at once. An edit schedules from now: the
+// last check may be long ago (nothing to wait for, or Alarm1 armed), and an
+// alarm set for a minute already past must not ring for it. Pending snoozes
+// survive unless their alarm was removed or switched off, and so do fires
+// already due behind a ringing alarm whose time is unchanged.
+void AlarmClock::rebuildSchedule(uint32_t nowUnix) {
+    bool catchUp = catchUpPending;
+    uint32_t from = catchUp ? catchUpFrom(lastCheckedUnix, nowUnix) : nowUnix;
+    size_t kept = 0;
+    for (size_t i = 0; i < schedule.size(); ++i) {
+        const AlarmFire& fire = schedule[i];
+        int index = models->alarmIndex(fire.alarmId);
+        if (index < 0) continue;
+        const Alarm& alarm = alarms[index];
+        bool keep;
+        if (fire.snooze) keep = alarm.enabled || alarm.one_shot;
+        else keep = !catchUp && fire.fireAt <= nowUnix && alarm.enabled && nextFireAfter(alarm, fire.fireAt - 1) == fire.fireAt;
+        if (keep) schedule[kept++] = fire;
+    }
+    schedule.resize(kept);
     for (size_t i = 0; i < alarms.size(); ++i) {
-        const Alarm& a = alarms[i];
-        if (!a.enabled) continue;
-        if (now.hour() == a.hour && now.minute() == a.minute && now.second() == 0) {
-            // Trigger the first matching alarm
-            isRinging = true;
-            currentAlarmIndex = (int)i;
-            alarmTriggerTime = millis();
-            Serial.println("ALARM TRIGGERED (multi)!");
-            // Play alarm sound (use current volume)
-            notificationManager.playAlert(a.sound_track);
-            // Push notification
-            if (pushNotifier) pushNotifier->sendAll("Chrono-Cubo Alarm", "Time to wake up!");
-            drawAlarmTriggeredScreen();
-            return;
+        if (!alarms[i].enabled) continue;
+        uint16_t id = models->alarmId((int)i);
+        bool due = false;
+        for (const AlarmFire& fire : schedule) due = due || (fire.alarmId == id && !fire.snooze);
+        if (!due) insertFire(AlarmFire{nextFireAfter(alarms[i], from), id, false});
+    }
+    catchUpPending = false;
+    scheduleDirty = false;
+    programmedFireAt = 0; // head or its sound may have changed
+    headDueMillis = millis(); // evaluate the new head on the next update
+}
+
+void AlarmClock::planWake(uint32_t nowUnix) {
+    if (schedule.empty()) return;
+    uint32_t fireAt = schedule.front().fireAt;
+    // An overdue head is waiting for the ringing alarm; look again in a second
+    uint32_t secondsLeft = (fireAt > nowUnix) ? fireAt - nowUnix : 1;
+    headDueMillis = lastAlarmCheck + secondsLeft * 1000UL;
+    // The interrupt is the primary wake; millis() is only the backstop
+    if (hwAlarm && fireAt > nowUnix) headDueMillis += ALARM_INT_GRACE_MS;
+}
+
+// Keep DS3231 Alarm1 set to the schedule head (full date match, so it fires once)
+void AlarmClock::programHardwareAlarm(uint32_t nowUnix) {
+    if (!hwAlarm) return;
+    if (schedule.empty()) {
+        if (programmedFireAt != 0) {
+            rtc->disableAlarm(1);
+            expiryScheduler.cancel(EXPIRY_ALARM);
+            programmedFireAt = 0;
+        }
+        return;
+    }
+    const AlarmFire& head = schedule.front();
+    // An overdue head waits behind the ringing alarm; the 1 s recheck covers it
+    if (head.fireAt <= nowUnix || head.fireAt == programmedFireAt) return;
+    int index = models->alarmIndex(head.alarmId);
+    rtc->clearAlarm(1);
+    if (!rtc->setAlarm1(DateTime(head.fireAt), DS3231_A1_Date)) return;
+    expiryScheduler.armExternal(EXPIRY_ALARM, index >= 0 ? alarms[index].sound_track : 0);
+    programmedFireAt = head.fireAt;
+}
+
+// Ring the earliest due alarm (merged with any set for the same minute) and
+// move it to its next day. Snoozes are dropped once due and one-shot alarms
+// switch themselves off. Later due alarms ring after this one is acknowledged.
+void AlarmClock::fireDueAlarms(uint32_t nowUnix, bool alertStarted) {
+    while (!schedule.empty() && schedule.front().fireAt <= nowUnix) {
+        uint32_t fireAt = schedule.front().fireAt;
+        bool tooLate = nowUnix - fireAt > ALARM_CATCHUP_SECONDS;
+        int ringIndex = -1;
+        while (!schedule.empty() && schedule.front().fireAt == fireAt) {
+            AlarmFire due = schedule.front();
+            schedule.erase(schedule.begin());
+            int index = models->alarmIndex(due.alarmId);
+            if (index < 0) continue;
+            if (ringIndex < 0) ringIndex = index;
+            if (due.snooze) continue;
+            if (alarms[index].one_shot) {
+                models->updateAlarm(due.alarmId, [](Alarm& a) { a.enabled = false; });
+                continue;
+            }
+            insertFire(AlarmFire{nextFireAfter(alarms[index], nowUnix), due.alarmId, false});
+        }
+        if (ringIndex < 0) continue;
+        if (tooLate) {
+            Serial.println("Alarm skipped: more than the catch-up window late");
+            continue;
         }
+        ring(ringIndex, alertStarted);
+        return;
     }
 }
 
+void AlarmClock::ring(int index, bool alertStarted) {
+    isRinging = true;
+    currentAlarmIndex = index;
+    alarmTriggerTime = millis();
+    Serial.println("ALARM TRIGGERED (multi)!");
+    // Play alarm sound (use current volume) unless the interrupt already did
+    if (!alertStarted) notificationManager.playAlert(alarms[index].sound_track);
+    // Push notification
+    if (pushNotifier) pushNotifier->sendAll("Chrono-Cubo Alarm", "Time to wake up!");
+    drawAlarmTriggeredScreen();
+}
+
+bool AlarmClock::canSnooze() const {
+    return isRinging && currentAlarmIndex >= 0 && currentAlarmIndex < (int)alarms.size() &&
+           alarms[currentAlarmIndex].snooze_minutes > 0;
+}
+
+bool AlarmClock::snoozeAlarm() {
+    if (!rtc || !canSnooze()) return false;
+    uint32_t nowUnix = readRtcUnix();
+    uint32_t fireAt = nowUnix + alarms[currentAlarmIndex].snooze_minutes * 60UL;
+    insertFire(AlarmFire{fireAt, models->alarmId(currentAlarmIndex), true});
+    acknowledgeAlarm();
+    planWake(nowUnix);
+    programHardwareAlarm(nowUnix);
+    return true;
+}
+
 void AlarmClock::acknowledgeAlarm() {
     isRinging = false;
     currentAlarmIndex = -1;
@@ -173,30 +420,34 @@ void AlarmClock::drawSetupScreen() {
     // Title
     display->setCursor(0, 0);
     display->println("Sleep Alarm Setup");
-    display->println("================");
     
-    // Instructions
-    display->setCursor(0, 16);
-    display->println("Y: Select field");
-    display->println("X: Adjust value");
-    display->println("Btn: Set alarm");
-    
-    // Time display
+    // Time display, active digits underlined
     display->setTextSize(2);
-    display->setCursor(12, 36);
+    display->setCursor(12, 10);
     display->print(formatTime(tempHour, tempMinute));
+    if (setupState == 0) display->drawFastHLine(12, 27, 22, SSD1306_WHITE);
+    else if (setupState == 1) display->drawFastHLine(48, 27, 22, SSD1306_WHITE);
 
-    // Sound display
+    // Sound, repeat and snooze, active field marked
     display->setTextSize(1);
-    display->setCursor(0, 54);
-    display->print("Sound: < Track ");
+    display->setCursor(0, 32);
+    display->print(setupState == 2 ? ">" : " ");
+    display->print("Sound:  < ");
     display->print(tempSoundTrack);
     display->print(" >");
-
-    // Active field indicator
-    display->setCursor(0, 28);
-    if (setupState == 0) display->print("^ Hour");
-    else if (setupState == 1) display->print("      ^ Minute");
+    display->setCursor(0, 42);
+    display->print(setupState == 3 ? ">" : " ");
+    display->print("Repeat: ");
+    display->print(REPEAT_PRESETS[tempRepeat].label);
+    display->setCursor(0, 52);
+    display->print(setupState == 4 ? ">" : " ");
+    display->print("Snooze: ");
+    if (tempSnooze == 0) {
+        display->print("off");
+    } else {
+        display->print(tempSnooze);
+        display->print(" min");
+    }
     
     display->display();
 }
@@ -204,7 +455,8 @@ void AlarmClock::drawSetupScreen() {
 void AlarmClock::drawAlarmStatusScreen() {
     if (!display || !rtc) return;
     
-    DateTime now = rtc->now();
+    uint32_t nowUnix = timeService.nowUnix();
+    DateTime now(timeZone.toLocal(nowUnix));
     
     display->clearDisplay();
     display->setTextSize(1);
@@ -222,27 +474,17 @@ void AlarmClock::drawAlarmStatusScreen() {
     sprintf(currentTimeStr, "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
     display->println(currentTimeStr);
     
-    // Next alarm time (find next enabled alarm)
+    // Next alarm comes straight from the schedule head
+    if (scheduleDirty) rebuildSchedule(nowUnix);
+    int nextIdx = schedule.empty() ? -1 : models->alarmIndex(schedule.front().alarmId);
     display->setCursor(0, 28);
     display->print("Next Alarm: ");
-    if (alarms.empty()) {
+    if (nextIdx < 0) {
         display->print("- none -");
     } else {
-        // Find next alarm chronologically
-        int nowMinutes = now.hour() * 60 + now.minute();
-        int bestIdx = -1; int bestMinutes = 24*60;
-        for (size_t i = 0; i < alarms.size(); ++i) {
-            if (!alarms[i].enabled) continue;
-            int am = alarms[i].hour * 60 + alarms[i].minute;
-            int delta = am - nowMinutes;
-            if (delta < 0) delta += 24*60;
-            if (bestIdx == -1 || delta < bestMinutes) { bestMinutes = delta; bestIdx = (int)i; }
-        }
-        if (bestIdx == -1) {
-            display->print("- none -");
-        } else {
-            display->print(formatTime(alarms[bestIdx].hour, alarms[bestIdx].minute));
-        }
+        DateTime next(timeZone.toLocal(schedule.front().fireAt));
+        display->print(formatTime(next.hour(), next.minute()));
+        if (schedule.front().snooze) display->print(" zz");
     }
     
     // Status
@@ -253,32 +495,20 @@ void AlarmClock::drawAlarmStatusScreen() {
         display->print("Status: DISABLED");
     }
     
-    // Time until alarm
     // Time until next alarm
+    display->setCursor(0, 52);
     if (alarms.empty()) {
-        display->setCursor(0, 52);
         display->print("No alarms set");
+    } else if (nextIdx < 0) {
+        display->print("No enabled alarms");
     } else {
-        int nowMinutes = now.hour() * 60 + now.minute();
-        int bestIdx = -1; int bestDelta = 24*60;
-        for (size_t i = 0; i < alarms.size(); ++i) {
-            if (!alarms[i].enabled) continue;
-            int am = alarms[i].hour * 60 + alarms[i].minute;
-            int delta = am - nowMinutes;
-            if (delta < 0) delta += 24*60;
-            if (bestIdx == -1 || delta < bestDelta) { bestDelta = delta; bestIdx = (int)i; }
-        }
-        if (bestIdx == -1) {
-            display->setCursor(0, 52);
-            display->print("No enabled alarms");
-        } else {
-            display->setCursor(0, 52);
-            display->print("Time until: ");
-            display->print(bestDelta / 60);
-            display->print("h ");
-            display->print(bestDelta % 60);
-            display->print("m");
-        }
+        uint32_t fireAt = schedule.front().fireAt;
+        uint32_t minutesLeft = (fireAt > nowUnix) ? (fireAt - nowUnix + 59) / 60 : 0;
+        display->print("Time until: ");
+        display->print(minutesLeft / 60);
+        display->print("h ");
+        display->print(minutesLeft % 60);
+        display->print("m");
     }
     
     display->display();
@@ -316,7 +546,7 @@ void AlarmClock::drawAlarmTriggeredScreen() {
         }
         
         display->setCursor(20, 50);
-        display->println("Press button to stop");
+        display->println(canSnooze() ? "Btn:stop X:snooze" : "Press button to stop");
     }
     
     display->display();
@@ -329,12 +559,14 @@ String AlarmClock::formatTime(int hour, int minute) const {
 }
 
 void AlarmClock::reset() {
-    alarms.clear();
+    models->setAlarms(std::vector<Alarm>());
     isRinging = false;
     currentAlarmIndex = -1;
     setupState = 0;
     lastAlarmCheck = 0;
     alarmTriggerTime = 0;
+    schedule.clear();
+    scheduleDirty = true;
 }
 
 int AlarmClock::getAlarmHour() const {
@@ -362,3 +594,21 @@ int AlarmClock::getAlarmSoundTrack() const {
 int AlarmClock::getSetupHour() const { return tempHour; }
 int AlarmClock::getSetupMinute() const { return tempMinute; }
 int AlarmClock::getSetupSoundTrack() const { return tempSoundTrack; }
+uint8_t AlarmClock::getSetupDays() const { return REPEAT_PRESETS[tempRepeat].days; }
+bool AlarmClock::getSetupOneShot() const { return REPEAT_PRESETS[tempRepeat].oneShot; }
+uint8_t AlarmClock::getSetupSnooze() const { return (uint8_t)tempSnooze; }
+
+String AlarmClock::describeDays(const Alarm& alarm) {
+    for (int i = 0; i < REPEAT_PRESET_COUNT; ++i) {
+        if (REPEAT_PRESETS[i].days == alarm.days && REPEAT_PRESETS[i].oneShot == alarm.one_shot) {
+            return REPEAT_PRESETS[i].label;
+        }
+    }
+    if (alarm.one_shot) return "Once";
+    // Custom mask: one letter per day, '-' when off
+    static const char letters[] = "SMTWTFS";
+    char buf[8];
+    for (int d = 0; d < 7; ++d) buf[d] = (alarm.days & (1 << d)) ? letters[d] : '-';
+    buf[7] = '\0';
+    return String(buf);
+}
@@ -7,6 +7,7 @@
 #include "KeyInput.h"
 #include "PushNotifier.h"
 #include "DataModels.h"
+#include "ModelRepository.h"
 
 // Forward declaration
 class StorageManager;
@@ -16,19 +17,36 @@ private:
     Adafruit_SSD1306* display;
     RTC_DS3231* rtc;
     PushNotifier* pushNotifier;
+    ModelRepository* models;
     
-    // Alarms list
-    std::vector<Alarm> alarms;
-    unsigned long lastAlarmCheck;
+    // Alarms list, owned by the model repository
+    const std::vector<Alarm>& alarms;
+    unsigned long lastAlarmCheck; // millis() of the last RTC read by the engine
     unsigned long alarmTriggerTime;
+
+    // Next-fire schedule: enabled alarms ordered by next absolute fire time
+    struct AlarmFire {
+        uint32_t fireAt;  // RTC unixtime of the next ring
+        uint16_t alarmId; // ModelRepository id
+        bool snooze;      // transient re-ring, never persisted
+    };
+    std::vector<AlarmFire> schedule;
+    bool scheduleDirty;          // alarms changed; rebuild before the next use
+    unsigned long headDueMillis; // millis() at which the head is expected due
+    uint32_t lastCheckedUnix;    // RTC time of the last evaluation; alarms fire in (last, now]
+    bool catchUpPending;         // next rebuild follows a boot or an RTC step, and fires what was missed
+    bool hwAlarm;                // head is programmed into DS3231 Alarm1 (RTC_INT_PIN wired)
+    uint32_t programmedFireAt;   // fire time currently in Alarm1, 0 = none
     int currentAlarmIndex;
     
     // Setup state
-    int setupState; // 0 for hour, 1 for minute, 2 for sound
+    int setupState; // 0 hour, 1 minute, 2 sound, 3 repeat, 4 snooze
     // Temporary setup values when creating a new alarm
     int tempHour;
     int tempMinute;
     int tempSoundTrack;
+    int tempRepeat; // index into the repeat presets
+    int tempSnooze; // minutes, 0 = off
     
     // Display variables
     unsigned long lastDisplayUpdate;
@@ -39,12 +57,24 @@ private:
     void drawAlarmStatusScreen();
     void drawAlarmTriggeredScreen();
     String formatTime(int hour, int minute) const;
-    void checkAlarmTime();
+    static uint32_t nextFireAfter(const Alarm& alarm, uint32_t nowUnix);
+    static uint32_t catchUpFrom(uint32_t lastCheckedUnix, uint32_t nowUnix);
+    void rebuildSchedule(uint32_t nowUnix);
+    void insertFire(const AlarmFire& fire);
+    void planWake(uint32_t nowUnix);
+    uint32_t readRtcUnix();
+    void programHardwareAlarm(uint32_t nowUnix);
+    void fireDueAlarms(uint32_t nowUnix, bool alertStarted);
+    void ring(int index, bool alertStarted);
+    static void onModelChanged(ModelKind kind, ModelChange change, uint16_t id, void* context);
     
 public:
     // Constructor
-    AlarmClock(Adafruit_SSD1306* displayInstance, RTC_DS3231* rtcInstance, PushNotifier* notifier);
+    AlarmClock(Adafruit_SSD1306* displayInstance, RTC_DS3231* rtcInstance, PushNotifier* notifier, ModelRepository* modelRepository);
     
+    // Set up the DS3231 alarm interrupt (no-op when RTC_INT_PIN is -1)
+    void begin();
+
     // Setup methods
     void startSetup();
     void handleSetupInput();
@@ -55,6 +85,9 @@ public:
     void loadAlarms(StorageManager& storage);
     void addAlarm(const Alarm& newAlarm);
     void removeAlarm(int index);
+    void toggleAlarm(int index);
+    // Recompute fire times after the RTC was set
+    void rescheduleAlarms();
     const std::vector<Alarm>& getAlarms() const;
 
     // Ringing status
@@ -69,6 +102,9 @@ public:
     // Running methods
     void updateAlarm();
     void acknowledgeAlarm();
+    // Silence the ringing alarm and ring it again after its snooze time
+    bool canSnooze() const;
+    bool snoozeAlarm();
 
     // Alarm sound info for currently ringing alarm
     int getAlarmSoundTrack() const;
@@ -89,6 +125,12 @@ public:
     int getSetupHour() const;
     int getSetupMinute() const;
     int getSetupSoundTrack() const;
+    uint8_t getSetupDays() const;
+    bool getSetupOneShot() const;
+    uint8_t getSetupSnooze() const;
+
+    // Short repeat label ("Daily", "Mon-Fri", "Once", "-MTWTF-", ...)
+    static String describeDays(const Alarm& alarm);
 };
 
 #endif // ALARMCLOCK_H
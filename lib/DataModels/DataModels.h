@@ -18,18 +18,34 @@ struct TimerPhase {
 	std::vector<uint8_t> alertzy_key_indices; // Indices of keys to notify
 };
 
+// A run of phases played several times in a row (e.g. 4x work/break)
+struct RepeatBlock {
+	uint8_t first_phase; // Index of the first phase in the block
+	uint8_t last_phase;  // Index of the last phase in the block (inclusive)
+	uint8_t count;       // Number of times the block runs (>= 1)
+};
+
 // Structure for a complete custom timer routine
 struct CustomTimer {
 	String name;
 	std::vector<TimerPhase> phases;
+	std::vector<RepeatBlock> repeats; // Properly nested, never partially overlapping
 };
 
+// Weekday bits for Alarm::days (bit 0 = Sunday, matching DateTime::dayOfTheWeek())
+#define ALARM_EVERY_DAY 0x7F
+#define ALARM_WEEKDAYS 0x3E
+#define ALARM_WEEKEND 0x41
+
 // Simple alarm definition for clock
 struct Alarm {
 	uint8_t hour;
 	uint8_t minute;
 	bool enabled;
 	uint8_t sound_track;
+	uint8_t days = ALARM_EVERY_DAY; // Weekdays the alarm rings on
+	bool one_shot = false;          // Disables itself after ringing once
+	uint8_t snooze_minutes = 0;     // 0 = snooze off (max 63)
 };
 
 #endif
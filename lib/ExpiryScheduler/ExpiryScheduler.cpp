@@ -0,0 +1,182 @@
+#include "ExpiryScheduler.h"
+#include "NotificationManager.h"
+
+extern NotificationManager notificationManager;
+
+// Above the Arduino loop task (priority 1) so UI work cannot delay alerts
+#define EXPIRY_ALERT_TASK_PRIORITY 5
+#define EXPIRY_ALERT_TASK_STACK 4096
+
+// Passed to the esp_timer callback: which slot of which scheduler fired
+struct ExpiryTimerArg {
+    ExpiryScheduler* owner;
+    uint8_t source;
+};
+static ExpiryTimerArg timerArgs[EXPIRY_SOURCE_COUNT];
+// Guards slot state and stats shared by the timer, alert task and loop
+static portMUX_TYPE expiryLock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* sourceName(uint8_t source) {
+    if (source == EXPIRY_SINGLE_TIMER) return "single";
+    if (source == EXPIRY_MULTI_PHASE) return "phase";
+    return "alarm";
+}
+
+ExpiryScheduler::ExpiryScheduler() : alertQueue(nullptr), alertTask(nullptr), ready(false) {
+    memset(slots, 0, sizeof(slots));
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool ExpiryScheduler::begin() {
+    if (ready) return true;
+    alertQueue = xQueueCreate(EXPIRY_SOURCE_COUNT * 2, sizeof(AlertRequest));
+    if (!alertQueue) return false;
+    for (uint8_t i = 0; i < EXPIRY_SOURCE_COUNT; ++i) {
+        timerArgs[i].owner = this;
+        timerArgs[i].source = i;
+        esp_timer_create_args_t args = {};
+        args.callback = &ExpiryScheduler::onTimer;
+        args.arg = &timerArgs[i];
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "expiry";
+        if (esp_timer_create(&args, &slots[i].timer) != ESP_OK) {
+            Serial.println("[Expiry] esp_timer_create failed; falling back to polling");
+            return false;
+        }
+    }
+    if (xTaskCreate(&ExpiryScheduler::alertTaskMain, "expiry_alert", EXPIRY_ALERT_TASK_STACK, this,
+                    EXPIRY_ALERT_TASK_PRIORITY, &alertTask) != pdPASS) {
+        Serial.println("[Expiry] alert task start failed; falling back to polling");
+        return false;
+    }
+    ready = true;
+    return true;
+}
+
+bool ExpiryScheduler::isReady() const {
+    return ready;
+}
+
+bool ExpiryScheduler::arm(ExpirySource source, uint64_t delayUs, uint8_t soundTrack) {
+    if (!ready || source >= EXPIRY_SOURCE_COUNT) return false;
+    Slot& slot = slots[source];
+    esp_timer_stop(slot.timer); // not running is fine
+    portENTER_CRITICAL(&expiryLock);
+    slot.generation++;
+    slot.deadlineUs = esp_timer_get_time() + (int64_t)delayUs;
+    slot.soundTrack = soundTrack;
+    slot.expired = false;
+    portEXIT_CRITICAL(&expiryLock);
+    return esp_timer_start_once(slot.timer, delayUs) == ESP_OK;
+}
+
+bool ExpiryScheduler::armExternal(ExpirySource source, uint8_t soundTrack) {
+    if (!ready || source >= EXPIRY_SOURCE_COUNT) return false;
+    Slot& slot = slots[source];
+    esp_timer_stop(slot.timer);
+    portENTER_CRITICAL(&expiryLock);
+    slot.generation++;
+    slot.deadlineUs = 0; // unknown
+    slot.soundTrack = soundTrack;
+    slot.expired = false;
+    portEXIT_CRITICAL(&expiryLock);
+    return true;
+}
+
+void IRAM_ATTR ExpiryScheduler::triggerFromIsr(ExpirySource source) {
+    if (!ready || source >= EXPIRY_SOURCE_COUNT) return;
+    AlertRequest request;
+    request.source = source;
+    request.firedUs = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&expiryLock);
+    request.generation = slots[source].generation;
+    portEXIT_CRITICAL_ISR(&expiryLock);
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(alertQueue, &request, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+void ExpiryScheduler::cancel(ExpirySource source) {
+    if (!ready || source >= EXPIRY_SOURCE_COUNT) return;
+    Slot& slot = slots[source];
+    esp_timer_stop(slot.timer);
+    portENTER_CRITICAL(&expiryLock);
+    slot.generation++;
+    slot.expired = false;
+    portEXIT_CRITICAL(&expiryLock);
+}
+
+bool ExpiryScheduler::takeExpired(ExpirySource source) {
+    if (source >= EXPIRY_SOURCE_COUNT) return false;
+    portENTER_CRITICAL(&expiryLock);
+    bool expired = slots[source].expired;
+    slots[source].expired = false;
+    portEXIT_CRITICAL(&expiryLock);
+    return expired;
+}
+
+ExpiryLatencyStats ExpiryScheduler::getStats() const {
+    portENTER_CRITICAL(&expiryLock);
+    ExpiryLatencyStats copy = stats;
+    portEXIT_CRITICAL(&expiryLock);
+    return copy;
+}
+
+// esp_timer task context: stamp and hand off, nothing slow here
+void ExpiryScheduler::onTimer(void* arg) {
+    ExpiryTimerArg* timerArg = static_cast<ExpiryTimerArg*>(arg);
+    ExpiryScheduler* self = timerArg->owner;
+    AlertRequest request;
+    request.source = timerArg->source;
+    request.firedUs = esp_timer_get_time();
+    portENTER_CRITICAL(&expiryLock);
+    request.generation = self->slots[request.source].generation;
+    portEXIT_CRITICAL(&expiryLock);
+    xQueueSend(self->alertQueue, &request, 0);
+}
+
+void ExpiryScheduler::alertTaskMain(void* arg) {
+    ExpiryScheduler* self = static_cast<ExpiryScheduler*>(arg);
+    AlertRequest request;
+    for (;;) {
+        if (xQueueReceive(self->alertQueue, &request, portMAX_DELAY) == pdTRUE) {
+            self->runAlert(request);
+        }
+    }
+}
+
+void ExpiryScheduler::runAlert(const AlertRequest& request) {
+    Slot& slot = slots[request.source];
+    portENTER_CRITICAL(&expiryLock);
+    bool current = (slot.generation == request.generation);
+    int64_t deadlineUs = slot.deadlineUs;
+    uint8_t track = slot.soundTrack;
+    portEXIT_CRITICAL(&expiryLock);
+    if (!current) return; // cancelled or re-armed after the timer fired
+
+    if (track > 0) notificationManager.playAlert(track);
+    int64_t alertUs = esp_timer_get_time();
+    if (deadlineUs == 0) {
+        portENTER_CRITICAL(&expiryLock);
+        if (slot.generation == request.generation) slot.expired = true;
+        portEXIT_CRITICAL(&expiryLock);
+        Serial.printf("[Expiry] %s: interrupt->alert %lu us\n", sourceName(request.source),
+                      (unsigned long)(alertUs - request.firedUs));
+        return;
+    }
+
+    uint32_t dispatchLatency = (uint32_t)(request.firedUs - deadlineUs);
+    uint32_t alertLatency = (uint32_t)(alertUs - deadlineUs);
+    portENTER_CRITICAL(&expiryLock);
+    if (slot.generation == request.generation) slot.expired = true;
+    stats.count++;
+    stats.lastDispatchUs = dispatchLatency;
+    stats.lastAlertUs = alertLatency;
+    if (alertLatency > stats.maxAlertUs) stats.maxAlertUs = alertLatency;
+    stats.totalAlertUs += alertLatency;
+    portEXIT_CRITICAL(&expiryLock);
+
+    Serial.printf("[Expiry] %s: deadline->callback %lu us, deadline->alert %lu us (max %lu)\n",
+                  sourceName(request.source), (unsigned long)dispatchLatency, (unsigned long)alertLatency,
+                  (unsigned long)stats.maxAlertUs);
+}
@@ -0,0 +1,74 @@
+#ifndef EXPIRYSCHEDULER_H
+#define EXPIRYSCHEDULER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+// Countdowns that can be armed at the same time
+enum ExpirySource : uint8_t {
+    EXPIRY_SINGLE_TIMER = 0,
+    EXPIRY_MULTI_PHASE = 1,
+    EXPIRY_ALARM = 2, // fired by the DS3231 INT line, not by an esp_timer
+    EXPIRY_SOURCE_COUNT
+};
+
+// Deadline-to-alert latency of fired expiries, in microseconds
+struct ExpiryLatencyStats {
+    uint32_t count;
+    uint32_t lastDispatchUs; // deadline -> esp_timer callback
+    uint32_t lastAlertUs;    // deadline -> alert started (sound + LED)
+    uint32_t maxAlertUs;
+    uint64_t totalAlertUs;
+};
+
+// Fires countdown expiries from an esp_timer at the exact deadline. The
+// callback hands the expiry to a dedicated alert task, which starts the
+// sound and LED right away and then posts it to the main loop, so neither
+// depends on how long the current screen takes to draw or block.
+class ExpiryScheduler {
+private:
+    struct Slot {
+        esp_timer_handle_t timer;
+        uint32_t generation; // bumped on every arm/cancel to drop stale expiries
+        int64_t deadlineUs;
+        uint8_t soundTrack;  // 0 = no sound
+        bool expired;        // posted to the main loop, not yet taken
+    };
+    struct AlertRequest {
+        uint8_t source;
+        uint32_t generation;
+        int64_t firedUs;
+    };
+
+    Slot slots[EXPIRY_SOURCE_COUNT];
+    QueueHandle_t alertQueue;
+    TaskHandle_t alertTask;
+    ExpiryLatencyStats stats;
+    bool ready;
+
+    static void onTimer(void* arg);
+    static void alertTaskMain(void* arg);
+    void runAlert(const AlertRequest& request);
+
+public:
+    ExpiryScheduler();
+    bool begin();
+
+    // Arm (or re-arm) a countdown to expire delayUs from now
+    bool arm(ExpirySource source, uint64_t delayUs, uint8_t soundTrack);
+    // Arm a source whose expiry is signalled by an interrupt (triggerFromIsr);
+    // it has no esp_timer deadline, so it is left out of the latency stats
+    bool armExternal(ExpirySource source, uint8_t soundTrack);
+    void triggerFromIsr(ExpirySource source);
+    void cancel(ExpirySource source);
+    bool isReady() const;
+    // True once per fired expiry; the alert has already been started
+    bool takeExpired(ExpirySource source);
+
+    ExpiryLatencyStats getStats() const;
+};
+
+#endif // EXPIRYSCHEDULER_H
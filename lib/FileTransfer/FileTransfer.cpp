@@ -0,0 +1,232 @@
+#include "FileTransfer.h"
+#include <LittleFS.h>
+
+static const char* const TRANSFER_FILES[] = {TRANSFER_ALARMS_FILE, TRANSFER_ACCOUNTS_FILE, TRANSFER_ROUTINES_FILE}; // by ModelKind
+// Accounts before routines, whose notify masks index the account list
+static const ModelKind TRANSFER_ORDER[] = {MODEL_ACCOUNT, MODEL_ALARM, MODEL_ROUTINE};
+
+// Feeds a RecordReader from an open file, a chunk at a time, up to the CRC
+// trailer; the CRC runs over the bytes as they pass
+class FileRecordSource : public RecordSource {
+private:
+    fs::File& file;
+    size_t length;    // payload, without the trailer
+    size_t remaining;
+    uint32_t crc;
+
+public:
+    explicit FileRecordSource(fs::File& source)
+        : file(source), length(source.size() >= 4 ? source.size() - 4 : 0), remaining(length), crc(0) {}
+
+    size_t read(uint8_t* buffer, size_t size) override {
+        size_t n = file.read(buffer, size < remaining ? size : remaining);
+        remaining -= n;
+        crc = recordCrc32(crc, buffer, n);
+        return n;
+    }
+
+    size_t totalSize() const override { return length; }
+
+    // Reads whatever the decoder left, then checks the trailer
+    bool intact() {
+        uint8_t buffer[64];
+        while (remaining > 0 && read(buffer, sizeof(buffer)) > 0) {}
+        uint8_t trailer[4];
+        if (remaining > 0 || length == 0 || file.read(trailer, 4) != 4) return false;
+        uint32_t stored = trailer[0] | (uint32_t)trailer[1] << 8 | (uint32_t)trailer[2] << 16 | (uint32_t)trailer[3] << 24;
+        return stored == crc;
+    }
+};
+
+// Appends blob to the file and empties it for the next record
+static bool writeBlob(fs::File& file, std::vector<uint8_t>& blob, uint32_t& crc, TransferResult& result) {
+    crc = recordCrc32(crc, blob.data(), blob.size());
+    size_t written = file.write(blob.data(), blob.size());
+    result.bytes += written;
+    bool ok = written == blob.size();
+    blob.clear();
+    if (!ok) result.error = "Flash full";
+    return ok;
+}
+
+FileTransfer::FileTransfer(ModelRepository* repository, StorageManager* storageManager)
+    : models(repository), storage(storageManager), mounted(false) {}
+
+// Mounted on first use; an unformatted partition is formatted
+bool FileTransfer::mount(TransferResult& result) {
+    if (!mounted) mounted = LittleFS.begin(true);
+    if (!mounted) result.error = "No filesystem";
+    return mounted;
+}
+
+TransferResult FileTransfer::exportAll() {
+    TransferResult result = {};
+    uint32_t start = millis();
+    result.ok = mount(result);
+    for (ModelKind kind : TRANSFER_ORDER) {
+        if (result.ok) result.ok = exportFile(TRANSFER_FILES[kind], kind, result);
+    }
+    result.elapsedMs = millis() - start;
+    return result;
+}
+
+// Written as "<path>.tmp" and renamed over the old file, so a reset mid-way
+// leaves the previous export whole
+bool FileTransfer::exportFile(const char* path, ModelKind kind, TransferResult& result) {
+    char temp[TRANSFER_PATH_MAX];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    fs::File file = LittleFS.open(temp, FILE_WRITE);
+    if (!file) {
+        result.error = "Cannot create file";
+        return false;
+    }
+    uint32_t crc = 0;
+    bool ok = writeEntries(file, kind, crc, result);
+    if (ok) {
+        uint8_t trailer[4] = {(uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24)};
+        ok = file.write(trailer, sizeof(trailer)) == sizeof(trailer);
+        result.bytes += sizeof(trailer);
+        if (!ok) result.error = "Flash full";
+    }
+    file.close();
+    if (ok && !LittleFS.rename(temp, path)) {
+        LittleFS.remove(path);
+        ok = LittleFS.rename(temp, path);
+        if (!ok) result.error = "Cannot rename file";
+    }
+    if (!ok) LittleFS.remove(temp);
+    return ok;
+}
+
+bool FileTransfer::writeEntries(fs::File& file, ModelKind kind, uint32_t& crc, TransferResult& result) {
+    std::vector<uint8_t> blob;
+    if (kind == MODEL_ALARM) {
+        const std::vector<Alarm>& alarms = models->getAlarms();
+        StorageManager::encodeCollectionHeader(blob, kind, alarms.size());
+        if (!writeBlob(file, blob, crc, result)) return false;
+        for (const Alarm& alarm : alarms) {
+            StorageManager::encodeRecord(blob, alarm);
+            if (!writeBlob(file, blob, crc, result)) return false;
+            result.alarms++;
+        }
+    } else if (kind == MODEL_ACCOUNT) {
+        const std::vector<AlertzyAccount>& accounts = models->getAccounts();
+        StorageManager::encodeCollectionHeader(blob, kind, accounts.size());
+        if (!writeBlob(file, blob, crc, result)) return false;
+        for (const AlertzyAccount& account : accounts) {
+            StorageManager::encodeRecord(blob, account);
+            if (!writeBlob(file, blob, crc, result)) return false;
+            result.accounts++;
+        }
+    } else {
+        // The phase total comes from the index; there is no name-byte hint
+        // without reading every body first
+        const RoutineIndex& index = models->getRoutines();
+        uint32_t phases = 0;
+        for (size_t i = 0; i < index.size(); ++i) phases += index.phaseCount(i);
+        StorageManager::encodeCollectionHeader(blob, kind, index.size(), phases);
+        if (!writeBlob(file, blob, crc, result)) return false;
+        for (size_t i = 0; i < index.size(); ++i) {
+            const RoutineStore* body = models->routine(models->routineId(i));
+            if (!body) {
+                result.error = "Routine unreadable";
+                return false;
+            }
+            StorageManager::encodeRecord(blob, (*body)[0]);
+            if (!writeBlob(file, blob, crc, result)) return false;
+            result.routines++;
+        }
+    }
+    return true;
+}
+
+TransferResult FileTransfer::importAll() {
+    TransferResult result = {};
+    uint32_t start = millis();
+    result.ok = mount(result);
+    bool present[3] = {false, false, false}; // by ModelKind
+    bool any = false;
+    for (ModelKind kind : TRANSFER_ORDER) {
+        if (!result.ok) break;
+        present[kind] = LittleFS.exists(TRANSFER_FILES[kind]);
+        if (present[kind]) result.ok = readFile(TRANSFER_FILES[kind], kind, false, result);
+        any = any || present[kind];
+    }
+    if (result.ok && !any) {
+        result.ok = false;
+        result.error = "No files to import";
+    }
+    if (result.ok) {
+        // The bodies go to NVS as they are read, the lists that name them
+        // only at the end, so a reset before then keeps the old collections
+        result.bytes = 0;
+        storage->beginBatch();
+        for (ModelKind kind : TRANSFER_ORDER) {
+            if (!present[kind]) continue;
+            clear(kind);
+            // The file read cleanly a moment ago, so this only fails if flash did
+            if (!readFile(TRANSFER_FILES[kind], kind, true, result)) result.ok = false;
+        }
+        storage->commitBatch();
+    }
+    if (!result.ok) Serial.printf("FileTransfer: import failed: %s\n", result.error);
+    result.elapsedMs = millis() - start;
+    return result;
+}
+
+bool FileTransfer::readFile(const char* path, ModelKind kind, bool apply, TransferResult& result) {
+    fs::File file = LittleFS.open(path, FILE_READ);
+    if (!file) {
+        result.error = "Cannot open file";
+        return false;
+    }
+    FileRecordSource source(file);
+    RecordReader in(source);
+    uint32_t count = 0;
+    bool ok = StorageManager::readCollectionHeader(in, kind, &count);
+    Alarm alarm;
+    AlertzyAccount account;
+    RoutineStore routine;
+    for (uint32_t i = 0; i < count && ok; ++i) {
+        if (kind == MODEL_ALARM) {
+            ok = StorageManager::readRecord(in, alarm);
+            if (ok && apply) {
+                models->addAlarm(alarm);
+                result.alarms++;
+            }
+        } else if (kind == MODEL_ACCOUNT) {
+            ok = StorageManager::readRecord(in, account);
+            if (ok && apply) {
+                models->addAccount(std::move(account));
+                result.accounts++;
+            }
+        } else {
+            routine.clear();
+            ok = StorageManager::readRecord(in, routine);
+            if (ok && apply) {
+                models->saveRoutine(MODEL_INVALID_ID, routine.unpack(0));
+                result.routines++;
+                if (result.routines % TRANSFER_FLUSH_EVERY == 0) storage->flush();
+            }
+        }
+    }
+    ok = ok && source.intact();
+    if (apply) result.bytes += file.size();
+    file.close();
+    if (!ok) {
+        Serial.printf("FileTransfer: corrupt file %s\n", path);
+        result.error = "Corrupt file";
+    }
+    return ok;
+}
+
+// Removed from the end, so no entry shifts down on the way
+void FileTransfer::clear(ModelKind kind) {
+    if (kind == MODEL_ALARM) {
+        while (!models->getAlarms().empty()) models->removeAlarm(models->alarmId(models->getAlarms().size() - 1));
+    } else if (kind == MODEL_ACCOUNT) {
+        while (!models->getAccounts().empty()) models->removeAccount(models->accountId(models->getAccounts().size() - 1));
+    } else {
+        while (models->getRoutines().size() > 0) models->removeRoutine(models->routineId(models->getRoutines().size() - 1));
+    }
+}
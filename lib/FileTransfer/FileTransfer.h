@@ -0,0 +1,59 @@
+#ifndef FILETRANSFER_H
+#define FILETRANSFER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "ModelRepository.h"
+#include "StorageManager.h"
+
+// One file per collection on the LittleFS partition (label "spiffs"), in the
+// storage record layout (header, count, one record per entry) followed by a
+// little-endian CRC32 of all of it
+#define TRANSFER_ROUTINES_FILE "/routines.rec"
+#define TRANSFER_ALARMS_FILE "/alarms.rec"
+#define TRANSFER_ACCOUNTS_FILE "/accounts.rec"
+#define TRANSFER_PATH_MAX 24
+// Imported routines are flushed to NVS every this many, so the write queue
+// never holds the whole library
+#define TRANSFER_FLUSH_EVERY 8
+
+struct TransferResult {
+    bool ok;
+    uint16_t alarms;
+    uint16_t accounts;
+    uint16_t routines;
+    uint32_t bytes;      // file bytes written or read
+    uint32_t elapsedMs;
+    const char* error;   // what went wrong, short enough for the screen
+};
+
+// Copies alarms, Alertzy accounts and routines between the model repository
+// and files on flash. Entries stream through one record at a time: routine
+// bodies come from the repository's cache on export and go straight back
+// through it on import, so a large library is never in RAM at once.
+class FileTransfer {
+private:
+    ModelRepository* models;
+    StorageManager* storage;
+    bool mounted;
+
+    bool mount(TransferResult& result);
+    bool exportFile(const char* path, ModelKind kind, TransferResult& result);
+    bool writeEntries(fs::File& file, ModelKind kind, uint32_t& crc, TransferResult& result);
+    // One pass over a file; with apply false it only checks every record
+    bool readFile(const char* path, ModelKind kind, bool apply, TransferResult& result);
+    void clear(ModelKind kind);
+
+public:
+    FileTransfer(ModelRepository* repository, StorageManager* storageManager);
+
+    // Writes all three files, each under a temporary name first
+    TransferResult exportAll();
+    // Replaces each collection that has a file, once every file present has
+    // been read through cleanly; accounts first, since routines refer to them
+    // by position. Storage switches to the new collections in one flush at
+    // the end.
+    TransferResult importAll();
+};
+
+#endif // FILETRANSFER_H
@@ -4,6 +4,7 @@
 #include <Adafruit_GFX.h>
 #include "KeyInput.h"
 #include "configs.h"
+#include <esp_timer.h>
 
 // Global display object
 extern Adafruit_SSD1306 display;
@@ -14,6 +15,22 @@ static char password_buffer[50] = "";
 // Movement timing variables
 static unsigned long last_move_time = 0;
 
+// Select press timestamps written by the button ISR
+static portMUX_TYPE select_isr_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile int64_t select_press_us = 0;
+static volatile bool select_press_pending = false;
+
+static void IRAM_ATTR select_button_isr() {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&select_isr_mux);
+    // Same 200ms debounce as select_button_pressed()
+    if (now - select_press_us > 200000) {
+        select_press_us = now;
+        select_press_pending = true;
+    }
+    portEXIT_CRITICAL_ISR(&select_isr_mux);
+}
+
 const char keyMap[6][18] = {
     {REMOVE_CHAR, LEFT_CHAR, RIGHT_CHAR, 'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O'},
     {'P','Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f','g'},
@@ -26,6 +43,7 @@ const char keyMap[6][18] = {
 // Initialize potentiometers and button
 void init_controls() {
     pinMode(BTN_SELECT, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(BTN_SELECT), select_button_isr, FALLING);
     
     // Set ADC resolution to 12 bits (0-4095)
     analogReadResolution(12);
@@ -136,6 +154,15 @@ bool select_button_pressed() {
     return false;
 }
 
+bool take_select_press_time(int64_t* pressUs) {
+    portENTER_CRITICAL(&select_isr_mux);
+    bool pending = select_press_pending;
+    if (pending && pressUs) *pressUs = select_press_us;
+    select_press_pending = false;
+    portEXIT_CRITICAL(&select_isr_mux);
+    return pending;
+}
+
 // Check if enough time has passed for movement
 bool can_move() {
     unsigned long current_time = millis();
@@ -17,6 +17,10 @@ int get_y_movement();
 // Check if the select button was pressed with debouncing
 bool select_button_pressed();
 
+// Microsecond timestamp (esp_timer) of the latest select press, captured in
+// the button ISR. Returns false if no press was seen since the last call.
+bool take_select_press_time(int64_t* pressUs);
+
 // Rate limit helper used by UI loops
 bool can_move();
 
@@ -0,0 +1,200 @@
+#include "ModelRepository.h"
+
+ModelRepository::ModelRepository()
+    : nextId(1), cacheClock(0), routineLoader(nullptr), loaderContext(nullptr), listenerCount(0) {
+    memset(&cacheStats, 0, sizeof(cacheStats));
+    for (auto& c : routineCache) {
+        c.id = MODEL_INVALID_ID;
+        c.lastUse = 0;
+    }
+}
+
+bool ModelRepository::addListener(ModelListener fn, void* context) {
+    if (!fn || listenerCount >= MODEL_MAX_LISTENERS) return false;
+    listeners[listenerCount].fn = fn;
+    listeners[listenerCount].context = context;
+    listenerCount++;
+    return true;
+}
+
+void ModelRepository::setRoutineLoader(RoutineLoader fn, void* context) {
+    routineLoader = fn;
+    loaderContext = context;
+}
+
+uint16_t ModelRepository::allocateId() {
+    uint16_t id = nextId++;
+    if (nextId == MODEL_INVALID_ID) nextId = 1;
+    return id;
+}
+
+void ModelRepository::assignIds(std::vector<uint16_t>& ids, size_t count) {
+    ids.clear();
+    ids.reserve(count);
+    for (size_t i = 0; i < count; ++i) ids.push_back(allocateId());
+}
+
+int ModelRepository::findIndex(const std::vector<uint16_t>& ids, uint16_t id) {
+    if (id == MODEL_INVALID_ID) return -1;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] == id) return (int)i;
+    }
+    return -1;
+}
+
+void ModelRepository::notify(ModelKind kind, ModelChange change, uint16_t id) {
+    for (uint8_t i = 0; i < listenerCount; ++i) {
+        listeners[i].fn(kind, change, id, listeners[i].context);
+    }
+}
+
+void ModelRepository::setAlarms(std::vector<Alarm>&& list) {
+    alarms = std::move(list);
+    assignIds(alarmIds, alarms.size());
+    notify(MODEL_ALARM, MODEL_RELOADED, MODEL_INVALID_ID);
+}
+
+void ModelRepository::setAccounts(std::vector<AlertzyAccount>&& list) {
+    accounts = std::move(list);
+    assignIds(accountIds, accounts.size());
+    notify(MODEL_ACCOUNT, MODEL_RELOADED, MODEL_INVALID_ID);
+}
+
+void ModelRepository::setRoutines(RoutineIndex&& index) {
+    routines = std::move(index);
+    assignIds(routineIds, routines.size());
+    for (auto& c : routineCache) {
+        c.id = MODEL_INVALID_ID;
+        c.body = RoutineStore();
+    }
+    notify(MODEL_ROUTINE, MODEL_RELOADED, MODEL_INVALID_ID);
+}
+
+uint16_t ModelRepository::alarmId(int index) const {
+    if (index < 0 || index >= (int)alarmIds.size()) return MODEL_INVALID_ID;
+    return alarmIds[index];
+}
+
+uint16_t ModelRepository::addAlarm(const Alarm& alarm) {
+    uint16_t id = allocateId();
+    alarms.push_back(alarm);
+    alarmIds.push_back(id);
+    notify(MODEL_ALARM, MODEL_ADDED, id);
+    return id;
+}
+
+bool ModelRepository::removeAlarm(uint16_t id) {
+    int index = alarmIndex(id);
+    if (index < 0) return false;
+    alarms.erase(alarms.begin() + index);
+    alarmIds.erase(alarmIds.begin() + index);
+    notify(MODEL_ALARM, MODEL_REMOVED, id);
+    return true;
+}
+
+uint16_t ModelRepository::accountId(int index) const {
+    if (index < 0 || index >= (int)accountIds.size()) return MODEL_INVALID_ID;
+    return accountIds[index];
+}
+
+uint16_t ModelRepository::addAccount(AlertzyAccount&& account) {
+    uint16_t id = allocateId();
+    accounts.push_back(std::move(account));
+    accountIds.push_back(id);
+    notify(MODEL_ACCOUNT, MODEL_ADDED, id);
+    return id;
+}
+
+bool ModelRepository::removeAccount(uint16_t id) {
+    int index = accountIndex(id);
+    if (index < 0) return false;
+    accounts.erase(accounts.begin() + index);
+    accountIds.erase(accountIds.begin() + index);
+    notify(MODEL_ACCOUNT, MODEL_REMOVED, id);
+    return true;
+}
+
+uint16_t ModelRepository::routineId(int index) const {
+    if (index < 0 || index >= (int)routineIds.size()) return MODEL_INVALID_ID;
+    return routineIds[index];
+}
+
+ModelRepository::CachedRoutine* ModelRepository::findCached(uint16_t id) {
+    if (id == MODEL_INVALID_ID) return nullptr;
+    for (auto& c : routineCache) {
+        if (c.id == id) return &c;
+    }
+    return nullptr;
+}
+
+// A free entry, or the least recently used one
+ModelRepository::CachedRoutine* ModelRepository::evictCached() {
+    CachedRoutine* victim = &routineCache[0];
+    for (auto& c : routineCache) {
+        if (c.id == MODEL_INVALID_ID) return &c;
+        if (c.lastUse < victim->lastUse) victim = &c;
+    }
+    victim->id = MODEL_INVALID_ID;
+    return victim;
+}
+
+const RoutineStore* ModelRepository::routine(uint16_t id) {
+    if (routineIndex(id) < 0) return nullptr;
+    CachedRoutine* entry = findCached(id);
+    if (entry) {
+        cacheStats.hits++;
+    } else {
+        entry = evictCached();
+        if (!routineLoader || !routineLoader(id, entry->body, loaderContext) || entry->body.size() != 1) {
+            cacheStats.failures++;
+            entry->body = RoutineStore();
+            return nullptr;
+        }
+        cacheStats.loads++;
+        entry->id = id;
+    }
+    entry->lastUse = ++cacheClock;
+    return &entry->body;
+}
+
+const RoutineStore* ModelRepository::cachedRoutine(uint16_t id) const {
+    for (const auto& c : routineCache) {
+        if (id != MODEL_INVALID_ID && c.id == id) return &c.body;
+    }
+    return nullptr;
+}
+
+// The edited body goes straight into the cache, where storage encodes it from
+uint16_t ModelRepository::saveRoutine(uint16_t id, const CustomTimer& timer) {
+    int index = routineIndex(id);
+    CachedRoutine* entry = index >= 0 ? findCached(id) : nullptr;
+    if (!entry) entry = evictCached();
+    entry->body.clear();
+    entry->body.add(timer);
+    entry->lastUse = ++cacheClock;
+    if (index >= 0) {
+        routines.set(index, entry->body[0]);
+        entry->id = id;
+        notify(MODEL_ROUTINE, MODEL_UPDATED, id);
+        return id;
+    }
+    routines.add(entry->body[0]);
+    id = allocateId();
+    routineIds.push_back(id);
+    entry->id = id;
+    notify(MODEL_ROUTINE, MODEL_ADDED, id);
+    return id;
+}
+
+bool ModelRepository::removeRoutine(uint16_t id) {
+    int index = routineIndex(id);
+    if (index < 0 || !routines.remove(index)) return false;
+    CachedRoutine* entry = findCached(id);
+    if (entry) {
+        entry->id = MODEL_INVALID_ID;
+        entry->body = RoutineStore();
+    }
+    routineIds.erase(routineIds.begin() + index);
+    notify(MODEL_ROUTINE, MODEL_REMOVED, id);
+    return true;
+}
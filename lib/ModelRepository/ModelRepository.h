@@ -0,0 +1,134 @@
+#ifndef MODELREPOSITORY_H
+#define MODELREPOSITORY_H
+
+#include <Arduino.h>
+#include <vector>
+#include "DataModels.h"
+#include "RoutineStore.h"
+
+// Ids are never reused while the device runs; 0 means "no entity"
+#define MODEL_INVALID_ID 0
+#define MODEL_MAX_LISTENERS 4
+// Routine bodies kept in RAM, least recently used evicted first
+#define MODEL_ROUTINE_CACHE 3
+
+enum ModelKind : uint8_t {
+    MODEL_ALARM,
+    MODEL_ACCOUNT,
+    MODEL_ROUTINE
+};
+
+enum ModelChange : uint8_t {
+    MODEL_ADDED,
+    MODEL_UPDATED,
+    MODEL_REMOVED,
+    MODEL_RELOADED // whole collection replaced (e.g. loaded from storage)
+};
+
+typedef void (*ModelListener)(ModelKind kind, ModelChange change, uint16_t id, void* context);
+// Reads one routine's body from storage into out (cleared first)
+typedef bool (*RoutineLoader)(uint16_t id, RoutineStore& out, void* context);
+
+struct RoutineCacheStats {
+    uint32_t hits;
+    uint32_t loads; // bodies read from storage
+    uint32_t failures;
+};
+
+// Single owner of the alarm, account and routine collections. Modules read
+// them by const reference; edits go through here, in place and by id, and
+// each edit is announced to the registered listeners. Routines are held as an
+// index; a routine's phases are loaded when it is run or edited.
+class ModelRepository {
+private:
+    std::vector<Alarm> alarms;
+    std::vector<uint16_t> alarmIds;
+    std::vector<AlertzyAccount> accounts;
+    std::vector<uint16_t> accountIds;
+    RoutineIndex routines;
+    std::vector<uint16_t> routineIds;
+    uint16_t nextId;
+
+    // Each cached body is a store holding that one routine
+    struct CachedRoutine {
+        uint16_t id; // MODEL_INVALID_ID when free
+        uint32_t lastUse;
+        RoutineStore body;
+    };
+    CachedRoutine routineCache[MODEL_ROUTINE_CACHE];
+    uint32_t cacheClock;
+    RoutineCacheStats cacheStats;
+    RoutineLoader routineLoader;
+    void* loaderContext;
+
+    struct ListenerSlot {
+        ModelListener fn;
+        void* context;
+    };
+    ListenerSlot listeners[MODEL_MAX_LISTENERS];
+    uint8_t listenerCount;
+
+    uint16_t allocateId();
+    void assignIds(std::vector<uint16_t>& ids, size_t count);
+    static int findIndex(const std::vector<uint16_t>& ids, uint16_t id);
+    void notify(ModelKind kind, ModelChange change, uint16_t id);
+    CachedRoutine* findCached(uint16_t id);
+    CachedRoutine* evictCached();
+
+public:
+    ModelRepository();
+
+    bool addListener(ModelListener fn, void* context = nullptr);
+    void setRoutineLoader(RoutineLoader fn, void* context = nullptr);
+
+    // Move-only hand-off from StorageManager; no element is copied
+    void setAlarms(std::vector<Alarm>&& list);
+    void setAccounts(std::vector<AlertzyAccount>&& list);
+    void setRoutines(RoutineIndex&& index);
+
+    // Alarms
+    const std::vector<Alarm>& getAlarms() const { return alarms; }
+    uint16_t alarmId(int index) const;
+    int alarmIndex(uint16_t id) const { return findIndex(alarmIds, id); }
+    uint16_t addAlarm(const Alarm& alarm);
+    bool removeAlarm(uint16_t id);
+    // Edit one alarm in place: edit(Alarm&)
+    template <typename Fn> bool updateAlarm(uint16_t id, Fn edit) {
+        int index = alarmIndex(id);
+        if (index < 0) return false;
+        edit(alarms[index]);
+        notify(MODEL_ALARM, MODEL_UPDATED, id);
+        return true;
+    }
+
+    // Alertzy accounts
+    const std::vector<AlertzyAccount>& getAccounts() const { return accounts; }
+    uint16_t accountId(int index) const;
+    int accountIndex(uint16_t id) const { return findIndex(accountIds, id); }
+    uint16_t addAccount(AlertzyAccount&& account);
+    bool removeAccount(uint16_t id);
+    // Edit one account in place: edit(AlertzyAccount&)
+    template <typename Fn> bool updateAccount(uint16_t id, Fn edit) {
+        int index = accountIndex(id);
+        if (index < 0) return false;
+        edit(accounts[index]);
+        notify(MODEL_ACCOUNT, MODEL_UPDATED, id);
+        return true;
+    }
+
+    // Routines (custom timers): the index, and each body on demand
+    const RoutineIndex& getRoutines() const { return routines; }
+    uint16_t routineId(int index) const;
+    int routineIndex(uint16_t id) const { return findIndex(routineIds, id); }
+    // Body of routine id (the store's only routine), from the cache or the
+    // loader; nullptr if it cannot be read. Valid until the next routine call.
+    const RoutineStore* routine(uint16_t id);
+    // The cached body only, never loads
+    const RoutineStore* cachedRoutine(uint16_t id) const;
+    const RoutineCacheStats& getRoutineCacheStats() const { return cacheStats; }
+    // Replace routine id in place, or append it when id is MODEL_INVALID_ID
+    uint16_t saveRoutine(uint16_t id, const CustomTimer& timer);
+    bool removeRoutine(uint16_t id);
+};
+
+#endif
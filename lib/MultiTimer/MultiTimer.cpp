@@ -2,27 +2,61 @@
 #include "configs.h"
 #include "NotificationManager.h"
 #include "PushNotifier.h"
+#include "TimerCheckpoint.h"
+#include "ExpiryScheduler.h"
 
 extern NotificationManager notificationManager;
 extern PushNotifier pushNotifier;
+extern TimerCheckpoint timerCheckpoint;
+extern ExpiryScheduler expiryScheduler;
 
-MultiTimer::MultiTimer(Adafruit_SSD1306* displayInstance) 
+MultiTimer::MultiTimer(Adafruit_SSD1306* displayInstance, ModelRepository* modelRepository) 
     : display(displayInstance), isRunning(false), isFinished(false), currentPhaseStartTime(0),
-      currentPhaseIndex(0), remainingTime(0), selectedTimerIndex(0), currentTimer(nullptr), lastDisplayUpdate(0) {}
-
-void MultiTimer::setTimers(const std::vector<CustomTimer>& list) {
-    timers = list;
+      currentPhaseIndex(0), nextPhaseIndex(-1), expiryArmed(false), remainingTime(0), models(modelRepository), timers(modelRepository->getRoutines()),
+      selectedTimerIndex(0), currentRoutine(-1), currentRoutineId(MODEL_INVALID_ID), lastDisplayUpdate(0) {
+    memset(&cursor, 0, sizeof(cursor));
+    models->addListener(&MultiTimer::onModelChanged, this);
 }
 
-const std::vector<CustomTimer>& MultiTimer::getTimers() const {
+const RoutineIndex& MultiTimer::getTimers() const {
     return timers;
 }
 
+// A copy of the body, so the repository's cache can evict it mid-run
+bool MultiTimer::loadRunning(int routineIndex) {
+    const RoutineStore* body = models->routine(models->routineId(routineIndex));
+    if (!body) {
+        Serial.printf("MultiTimer: routine %d could not be loaded\n", routineIndex);
+        return false;
+    }
+    running = *body;
+    return true;
+}
+
+// Keep currentRoutine pointing at the running routine while the list is edited
+void MultiTimer::onModelChanged(ModelKind kind, ModelChange change, uint16_t id, void* context) {
+    MultiTimer* self = static_cast<MultiTimer*>(context);
+    if (kind != MODEL_ROUTINE || change == MODEL_ADDED) return;
+    if (self->currentRoutine < 0) {
+        self->selectedTimerIndex = 0;
+        return;
+    }
+    if (change == MODEL_RELOADED || id == self->currentRoutineId) {
+        // The running program changed under us; stop rather than run stale phases
+        self->reset();
+        return;
+    }
+    if (change == MODEL_REMOVED) {
+        self->currentRoutine = self->models->routineIndex(self->currentRoutineId);
+        self->selectedTimerIndex = self->currentRoutine;
+    }
+}
+
 void MultiTimer::startTimerSelection() {
     selectedTimerIndex = 0;
     isRunning = false;
     isFinished = false;
-    currentTimer = nullptr;
+    currentRoutine = -1;
     drawTimerSelectionScreen();
 }
 
@@ -49,37 +83,101 @@ void MultiTimer::setSelectedTimerIndex(int index) { if (index >= 0 && index < (i
 
 void MultiTimer::startTimer() {
     if (isTimerSelected()) {
-        currentTimer = &timers[selectedTimerIndex];
-        if (currentTimer->phases.empty()) return;
-        currentPhaseIndex = 0;
+        if (timers.phaseCount(selectedTimerIndex) == 0 || !loadRunning(selectedTimerIndex)) return;
+        currentRoutine = selectedTimerIndex;
+        currentRoutineId = models->routineId(currentRoutine);
+        memset(&cursor, 0, sizeof(cursor));
+        int first = runProgram();
+        if (first < 0) {
+            currentRoutine = -1;
+            return;
+        }
+        currentPhaseIndex = first;
+        cursor.step = 1;
         currentPhaseStartTime = millis();
         isRunning = true;
         isFinished = false;
-        remainingTime = currentTimer->phases[0].duration_seconds;
+        remainingTime = running[0].phase(currentPhaseIndex).durationSeconds();
         lastDisplayUpdate = millis();
+        timerCheckpoint.saveMulti(currentRoutine, running[0].phaseCount(), cursor, currentPhaseIndex, remainingTime, remainingTime);
+        armPhaseExpiry();
         drawRunningScreen();
     }
 }
 
+bool MultiTimer::restoreRunning(int routineIndex, int routinePhases, const RoutineCursor& at, int phaseIndex, uint32_t remainingSeconds,
+                                uint32_t overshootSeconds) {
+    if (routineIndex < 0 || routineIndex >= (int)timers.size()) return false;
+    // A checkpoint taken before the list changed may point at another routine
+    if (timers.phaseCount(routineIndex) != routinePhases || !loadRunning(routineIndex)) return false;
+    RoutineView timer = running[0];
+    if (phaseIndex < 0 || phaseIndex >= timer.phaseCount()) return false;
+    // The cursor must sit just past the PHASE instruction of the running phase
+    const uint8_t* prog = timer.program();
+    if (at.pc < 2 || at.pc > timer.programLength() || at.depth > ROUTINE_MAX_LOOP_DEPTH) return false;
+    if (prog[at.pc - 2] != OP_PHASE || prog[at.pc - 1] != phaseIndex) return false;
+    uint32_t phaseDuration = timer.phase(phaseIndex).durationSeconds();
+    if (remainingSeconds > phaseDuration) return false;
+
+    selectedTimerIndex = routineIndex;
+    currentRoutine = routineIndex;
+    currentRoutineId = models->routineId(routineIndex);
+    cursor = at;
+    currentPhaseIndex = phaseIndex;
+    inPhaseTransition = false;
+    lastDisplayUpdate = millis();
+
+    // The reset outlasted the phase: walk the program through the phases
+    // that ran out meanwhile, without their alerts, to the one still running
+    if (remainingSeconds == 0 && overshootSeconds > 0) {
+        uint32_t late = overshootSeconds;
+        while (true) {
+            int next = runProgram(false, true);
+            if (next < 0) {
+                isRunning = false;
+                isFinished = true;
+                timerCheckpoint.clear();
+                drawFinishedScreen();
+                return true;
+            }
+            cursor.step++;
+            currentPhaseIndex = next;
+            phaseDuration = timer.phase(next).durationSeconds();
+            if (late < phaseDuration) break;
+            late -= phaseDuration;
+        }
+        remainingSeconds = phaseDuration - late;
+        timerCheckpoint.saveMulti(currentRoutine, timer.phaseCount(), cursor, currentPhaseIndex, phaseDuration, remainingSeconds);
+    }
+
+    remainingTime = remainingSeconds;
+    // Back-date the phase start so updateRemainingTime() continues from the checkpoint
+    currentPhaseStartTime = millis() - ((phaseDuration - remainingSeconds) * 1000);
+    isRunning = true;
+    isFinished = false;
+    armPhaseExpiry();
+    drawRunningScreen();
+    return true;
+}
+
 void MultiTimer::updateRoutine() {
-    if (!isRunning || !currentTimer) return;
+    if (!isRunning || currentRoutine < 0) return;
 
     updateRemainingTime();
 
-    if (remainingTime <= 0) {
-        // End-of-phase alerts
-        const TimerPhase& phase = currentTimer->phases[currentPhaseIndex];
-        if (phase.sound_track > 0) {
-            notificationManager.playAlert(phase.sound_track);
-        }
-        if (!phase.alertzy_key_indices.empty()) {
-            pushNotifier.sendNotification("Chrono-Cubo", String("Phase complete: ") + phase.name, phase.alertzy_key_indices);
-        }
+    // When armed, the phase end is fired by the scheduler, which also started its PLAY alert
+    bool expired = expiryArmed ? expiryScheduler.takeExpired(EXPIRY_MULTI_PHASE) : (remainingTime <= 0);
+    if (expired && !inPhaseTransition) {
+        remainingTime = 0;
+        // Run the finished phase's alert instructions and find the next phase
+        nextPhaseIndex = runProgram(expiryArmed);
+        expiryArmed = false;
 
         // Proceed to next phase or finish (use non-blocking transition)
-        if (currentPhaseIndex >= (int)currentTimer->phases.size() - 1) {
+        if (nextPhaseIndex < 0) {
             isRunning = false;
             isFinished = true;
+            timerCheckpoint.clear();
             drawFinishedScreen();
             return;
         } else {
@@ -146,7 +244,14 @@ void MultiTimer::drawTimerSelectionScreen() {
                 display->setTextColor(SSD1306_WHITE);
             }
             display->setCursor(2, y);
-            display->print(timers[idx].name);
+            display->print(timers.name(idx));
+            // Total length, right-aligned over the end of a long name
+            char total[12];
+            snprintf(total, sizeof(total), "%lum", (unsigned long)(((uint64_t)timers.totalDurationSeconds(idx) + 59) / 60));
+            int x = SCREEN_WIDTH - 6 * (int)strlen(total) - 2;
+            display->fillRect(x - 2, y - 1, SCREEN_WIDTH - x + 2, 10, idx == selectedTimerIndex ? SSD1306_WHITE : SSD1306_BLACK);
+            display->setCursor(x, y);
+            display->print(total);
         }
         display->setTextColor(SSD1306_WHITE);
         display->setCursor(0, 56);
@@ -156,26 +261,28 @@ void MultiTimer::drawTimerSelectionScreen() {
 }
 
 void MultiTimer::drawRunningScreen() {
-    if (!display || !currentTimer) return;
+    if (!display || currentRoutine < 0) return;
+    RoutineView timer = running[0];
     display->clearDisplay();
     display->setTextSize(1);
     display->setTextColor(SSD1306_WHITE);
     display->setCursor(0, 0);
     display->print("Timer: ");
-    display->println(currentTimer->name);
+    display->println(timer.name());
     display->println("=============");
 
-    const TimerPhase& phase = currentTimer->phases[currentPhaseIndex];
+    PhaseView phase = timer.phase(currentPhaseIndex);
     display->setCursor(0, 16);
     display->print("Phase ");
-    display->print(currentPhaseIndex + 1);
+    display->print(cursor.step);
     display->print("/");
-    display->print((int)currentTimer->phases.size());
+    display->print(timer.totalSteps());
     display->print(": ");
-    display->println(phase.name);
+    display->println(phase.name());
 
-    unsigned long phaseElapsed = phase.duration_seconds - remainingTime;
-    int progress = (phase.duration_seconds > 0) ? (phaseElapsed * 100) / phase.duration_seconds : 0;
+    uint32_t phaseDuration = phase.durationSeconds();
+    unsigned long phaseElapsed = phaseDuration - remainingTime;
+    int progress = (phaseDuration > 0) ? (phaseElapsed * 100) / phaseDuration : 0;
     progress = constrain(progress, 0, 100);
     display->setCursor(0, 28);
     display->print("Progress: ");
@@ -197,15 +304,16 @@ void MultiTimer::drawRunningScreen() {
 }
 
 void MultiTimer::drawPhaseTransitionScreen() {
-    if (!display || !currentTimer) return;
+    if (!display || currentRoutine < 0) return;
+    RoutineView timer = running[0];
     display->clearDisplay();
     display->setTextSize(1);
     display->setTextColor(SSD1306_WHITE);
     display->setCursor(0, 20);
     display->println("Phase Complete!");
-    if (currentPhaseIndex < (int)currentTimer->phases.size() - 1) {
+    if (nextPhaseIndex >= 0) {
         display->print("Next: ");
-        display->println(currentTimer->phases[currentPhaseIndex + 1].name);
+        display->println(timer.phase(nextPhaseIndex).name());
     } else {
         display->println("All phases complete!");
     }
@@ -242,42 +350,117 @@ String MultiTimer::formatTime(unsigned long seconds) {
 }
 
 void MultiTimer::updateRemainingTime() {
-    if (!isRunning || !currentTimer) return;
+    if (!isRunning || currentRoutine < 0) return;
     unsigned long currentTime = millis();
     unsigned long phaseElapsed = (currentTime - currentPhaseStartTime) / 1000;
-    const auto& phase = currentTimer->phases[currentPhaseIndex];
-    remainingTime = (phaseElapsed >= phase.duration_seconds) ? 0 : (phase.duration_seconds - phaseElapsed);
+    uint32_t phaseDuration = running[0].phase(currentPhaseIndex).durationSeconds();
+    remainingTime = (phaseElapsed >= phaseDuration) ? 0 : (phaseDuration - phaseElapsed);
 }
 
 void MultiTimer::advanceToNextPhase() {
-    if (!currentTimer || currentPhaseIndex >= (int)currentTimer->phases.size() - 1) return;
-    currentPhaseIndex++;
+    if (currentRoutine < 0 || nextPhaseIndex < 0) return;
+    currentPhaseIndex = nextPhaseIndex;
+    nextPhaseIndex = -1;
+    cursor.step++;
     currentPhaseStartTime = millis();
-    remainingTime = currentTimer->phases[currentPhaseIndex].duration_seconds;
+    remainingTime = running[0].phase(currentPhaseIndex).durationSeconds();
+    timerCheckpoint.saveMulti(currentRoutine, running[0].phaseCount(), cursor, currentPhaseIndex, remainingTime, remainingTime);
+    armPhaseExpiry();
+}
+
+// The phase's end-of-phase PLAY, if any, directly follows its PHASE instruction
+void MultiTimer::armPhaseExpiry() {
+    RoutineView timer = running[0];
+    const uint8_t* prog = timer.program();
+    uint8_t track = 0;
+    if (cursor.pc + 1 < timer.programLength() && prog[cursor.pc] == OP_PLAY) track = prog[cursor.pc + 1];
+    expiryArmed = expiryScheduler.arm(EXPIRY_MULTI_PHASE, (uint64_t)remainingTime * 1000000ULL, track);
+}
+
+// alertStarted: the scheduler already played the PLAY right after the cursor.
+// silent: only move the cursor, for phases that ended while the device was off
+int MultiTimer::runProgram(bool alertStarted, bool silent) {
+    RoutineView timer = running[0];
+    const uint8_t* prog = timer.program();
+    int len = timer.programLength();
+    int skipPlayAt = alertStarted ? cursor.pc : -1;
+
+    while (cursor.pc < len) {
+        uint8_t op = prog[cursor.pc++];
+        switch (op) {
+            case OP_PHASE:
+                return prog[cursor.pc++];
+            case OP_PLAY:
+                if (!silent && cursor.pc - 1 != skipPlayAt) notificationManager.playAlert(prog[cursor.pc]);
+                cursor.pc++;
+                break;
+            case OP_NOTIFY: {
+                PhaseView phase = timer.phase(prog[cursor.pc++]);
+                if (!silent) pushNotifier.sendNotificationMask("Chrono-Cubo", String("Phase complete: ") + phase.name(), phase.notifyMask());
+                break;
+            }
+            case OP_REPEAT: {
+                uint8_t count = prog[cursor.pc++];
+                if (cursor.depth < ROUTINE_MAX_LOOP_DEPTH) {
+                    cursor.loopRemaining[cursor.depth] = count;
+                    cursor.loopStart[cursor.depth] = cursor.pc;
+                    cursor.depth++;
+                }
+                break;
+            }
+            case OP_LOOP:
+                if (cursor.depth > 0) {
+                    uint8_t& remaining = cursor.loopRemaining[cursor.depth - 1];
+                    if (--remaining > 0) cursor.pc = cursor.loopStart[cursor.depth - 1];
+                    else cursor.depth--;
+                }
+                break;
+            default: // OP_END
+                return -1;
+        }
+    }
+    return -1;
 }
 
 void MultiTimer::reset() {
+    if (isRunning) timerCheckpoint.clear();
+    expiryScheduler.cancel(EXPIRY_MULTI_PHASE);
+    expiryArmed = false;
     isRunning = false;
     isFinished = false;
     currentPhaseStartTime = 0;
     currentPhaseIndex = 0;
     remainingTime = 0;
-    currentTimer = nullptr;
+    currentRoutine = -1;
+    currentRoutineId = MODEL_INVALID_ID;
+    running = RoutineStore();
+    nextPhaseIndex = -1;
+    inPhaseTransition = false;
+    memset(&cursor, 0, sizeof(cursor));
     selectedTimerIndex = 0;
 }
 
-void MultiTimer::pause() { if (isRunning) isRunning = false; }
+void MultiTimer::pause() {
+    if (isRunning) {
+        isRunning = false;
+        timerCheckpoint.clear();
+        expiryScheduler.cancel(EXPIRY_MULTI_PHASE);
+        expiryArmed = false;
+    }
+}
 void MultiTimer::resume() {
-    if (!isRunning && !isFinished && currentTimer) {
-        const auto& phase = currentTimer->phases[currentPhaseIndex];
-        currentPhaseStartTime = millis() - ((phase.duration_seconds - remainingTime) * 1000);
+    if (!isRunning && !isFinished && currentRoutine >= 0) {
+        uint32_t phaseDuration = running[0].phase(currentPhaseIndex).durationSeconds();
+        currentPhaseStartTime = millis() - ((phaseDuration - remainingTime) * 1000);
         isRunning = true;
+        timerCheckpoint.saveMulti(currentRoutine, running[0].phaseCount(), cursor, currentPhaseIndex, phaseDuration, remainingTime);
+        armPhaseExpiry();
     }
 }
 
 unsigned long MultiTimer::getRemainingTime() const { return remainingTime; }
 int MultiTimer::getCurrentPhaseIndex() const { return currentPhaseIndex; }
 String MultiTimer::getCurrentPhaseName() const {
-    if (currentTimer && currentPhaseIndex < (int)currentTimer->phases.size()) return currentTimer->phases[currentPhaseIndex].name;
+    if (currentRoutine >= 0 && currentPhaseIndex < running[0].phaseCount()) return running[0].phase(currentPhaseIndex).name();
     return "";
 }
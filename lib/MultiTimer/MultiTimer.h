@@ -6,6 +6,8 @@
 #include <vector>
 #include "KeyInput.h"
 #include "DataModels.h"
+#include "RoutineStore.h"
+#include "ModelRepository.h"
 
 class MultiTimer {
 private:
@@ -15,13 +17,20 @@ private:
     bool isRunning;
     bool isFinished;
     unsigned long currentPhaseStartTime;
-    int currentPhaseIndex;
+    int currentPhaseIndex; // Phase of the routine being counted down
+    int nextPhaseIndex;    // Phase queued behind the transition screen, -1 at the end
+    RoutineCursor cursor;  // Program position of the routine engine
+    bool expiryArmed;      // phase end fired by ExpiryScheduler instead of polling
     unsigned long remainingTime;
     
-    // Routines (custom timers)
-    std::vector<CustomTimer> timers;
+    // Routine index, owned by the model repository; only the running
+    // routine's phases are held, as the one entry of running
+    ModelRepository* models;
+    const RoutineIndex& timers;
+    RoutineStore running;
     int selectedTimerIndex;
-    CustomTimer* currentTimer;
+    int currentRoutine; // index into timers, -1 when idle
+    uint16_t currentRoutineId;
     
     // Display variables
     unsigned long lastDisplayUpdate;
@@ -38,14 +47,17 @@ private:
     String formatTime(unsigned long seconds);
     void updateRemainingTime();
     void advanceToNextPhase();
+    int runProgram(bool alertStarted = false, bool silent = false);
+    void armPhaseExpiry();
+    bool loadRunning(int routineIndex);
+    static void onModelChanged(ModelKind kind, ModelChange change, uint16_t id, void* context);
     
 public:
     // Constructor
-    MultiTimer(Adafruit_SSD1306* displayInstance);
+    MultiTimer(Adafruit_SSD1306* displayInstance, ModelRepository* modelRepository);
     
-    // Load/Set timers
-    void setTimers(const std::vector<CustomTimer>& list);
-    const std::vector<CustomTimer>& getTimers() const;
+    // Routines are edited through the model repository
+    const RoutineIndex& getTimers() const;
     
     // Selection UI
     void startTimerSelection();
@@ -59,6 +71,10 @@ public:
     void updateRoutine();
     bool isRoutineRunning() const;
     bool isRoutineFinished() const;
+    // Resume a routine from a reset checkpoint; overshootSeconds is how long
+    // ago the checkpointed phase ran out, and skips the phases that fit in it
+    bool restoreRunning(int routineIndex, int routinePhases, const RoutineCursor& at, int phaseIndex, uint32_t remainingSeconds,
+                        uint32_t overshootSeconds);
     
     // Display methods
     void drawCurrentScreen();
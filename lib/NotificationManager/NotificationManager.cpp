@@ -7,9 +7,19 @@
 static HardwareSerial DFSerial(1);
 
 NotificationManager::NotificationManager()
-    : isAlertActive(false), lastFlashTime(0), ledState(false), currentVolume(20) {}
+    : isAlertActive(false), lastFlashTime(0), ledState(false), currentVolume(20), playerLock(nullptr) {}
+
+void NotificationManager::lock() {
+    if (playerLock) xSemaphoreTakeRecursive(playerLock, portMAX_DELAY);
+}
+
+void NotificationManager::unlock() {
+    if (playerLock) xSemaphoreGiveRecursive(playerLock);
+}
 
 void NotificationManager::begin() {
+    playerLock = xSemaphoreCreateRecursiveMutex();
+
     // Initialize LED pin
     pinMode(LED_PIN, OUTPUT);
     digitalWrite(LED_PIN, LOW);
@@ -32,7 +42,7 @@ void NotificationManager::begin() {
 }
 
 void NotificationManager::playAlert(int trackNumber) {
-
+    lock();
     if (dfPlayer.available()) {
         // Drain any pending notifications
         while (dfPlayer.available()) { dfPlayer.readType(); }
@@ -47,22 +57,27 @@ void NotificationManager::playAlert(int trackNumber) {
     lastFlashTime = millis();
     ledState = true;
     digitalWrite(LED_PIN, ledState ? HIGH : LOW);
+    unlock();
 }
 
 void NotificationManager::playAlert(int trackNumber, int vol) {
     if (vol < 0) vol = 0; if (vol > 30) vol = 30;
+    lock();
     currentVolume = vol;
     if (dfPlayer.available()) dfPlayer.volume(currentVolume);
     playAlert(trackNumber);
+    unlock();
 }
 
 void NotificationManager::stopAlert() {
+    lock();
     if (isAlertActive) {
         dfPlayer.stop();
     }
     isAlertActive = false;
     ledState = false;
     digitalWrite(LED_PIN, LOW);
+    unlock();
 }
 
 void NotificationManager::update() {
@@ -70,18 +85,24 @@ void NotificationManager::update() {
 
     unsigned long now = millis();
     if (now - lastFlashTime >= 250) {
+        lock();
         lastFlashTime = now;
-        ledState = !ledState;
-        digitalWrite(LED_PIN, ledState ? HIGH : LOW);
+        if (isAlertActive) {
+            ledState = !ledState;
+            digitalWrite(LED_PIN, ledState ? HIGH : LOW);
+        }
+        unlock();
     }
 }
 
 void NotificationManager::setVolume(int vol) {
     if (vol < 0) vol = 0;
     if (vol > 30) vol = 30;
+    lock();
     currentVolume = vol;
     // Apply to DFPlayer if possible
     if (dfPlayer.available()) dfPlayer.volume(currentVolume);
+    unlock();
 }
 
 int NotificationManager::getVolume() const {
@@ -91,6 +112,7 @@ int NotificationManager::getVolume() const {
 void NotificationManager::playAdvert(uint16_t trackNumber) {
     // Use DFPlayer's advertisement/interrupt API which pauses current mp3 and plays advert
     // Note: playAdvertisement is available in DFRobotDFPlayerMini library
+    lock();
     if (dfPlayer.available()) {
         // DFRobotDFPlayerMini provides `advertise()` to play short advert/notification clips
         dfPlayer.advertise((uint8_t)trackNumber);
@@ -98,6 +120,7 @@ void NotificationManager::playAdvert(uint16_t trackNumber) {
         // Fallback: just play from mp3 folder
         dfPlayer.playMp3Folder(trackNumber);
     }
+    unlock();
 }
 
 bool NotificationManager::isAlerting() const {
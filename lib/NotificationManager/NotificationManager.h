@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include "DFRobotDFPlayerMini.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 class NotificationManager {
 private:
@@ -11,6 +13,10 @@ private:
     unsigned long lastFlashTime;
     bool ledState;
     int currentVolume;
+    // DFPlayer/LED access is shared with the expiry alert task
+    SemaphoreHandle_t playerLock;
+    void lock();
+    void unlock();
 
 public:
     NotificationManager();
@@ -0,0 +1,61 @@
+#include "NvsService.h"
+
+NvsService::NvsService() : entryCount(0), lock(nullptr), writeListener(nullptr), listenerContext(nullptr) {
+    memset(&stats, 0, sizeof(stats));
+    for (auto& e : entries) {
+        e.name[0] = '\0';
+        e.open = false;
+    }
+}
+
+void NvsService::begin() {
+    if (!lock) lock = xSemaphoreCreateRecursiveMutex();
+}
+
+Preferences* NvsService::acquire(const char* ns) {
+    if (lock && xSemaphoreTakeRecursive(lock, 0) != pdTRUE) {
+        stats.waits++;
+        xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+    }
+    Entry* entry = nullptr;
+    for (uint8_t i = 0; i < entryCount && !entry; ++i) {
+        if (strcmp(entries[i].name, ns) == 0) entry = &entries[i];
+    }
+    if (!entry && entryCount < NVS_SERVICE_MAX_NAMESPACES) {
+        entry = &entries[entryCount++];
+        strncpy(entry->name, ns, sizeof(entry->name) - 1);
+        entry->name[sizeof(entry->name) - 1] = '\0';
+    }
+    if (entry && !entry->open) {
+        // Read-write, so a fresh device gets the namespace created here
+        entry->open = entry->prefs.begin(entry->name, false, NVS_PARTITION);
+        stats.opens++;
+        if (!entry->open) Serial.printf("NvsService: failed to open namespace %s\n", entry->name);
+    }
+    if (!entry || !entry->open) {
+        if (!entry) Serial.printf("NvsService: no slot for namespace %s\n", ns);
+        release();
+        return nullptr;
+    }
+    stats.acquires++;
+    return &entry->prefs;
+}
+
+void NvsService::release() {
+    if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+void NvsService::noteWrite(const char* ns, const char* key, size_t bytes) {
+    stats.writes++;
+    stats.bytesWritten += bytes;
+    if (writeListener) writeListener(ns, key, bytes, listenerContext);
+}
+
+void NvsService::setWriteListener(NvsWriteListener fn, void* context) {
+    writeListener = fn;
+    listenerContext = context;
+}
+
+const char* NvsService::namespaceName(uint8_t index) const {
+    return index < entryCount ? entries[index].name : "";
+}
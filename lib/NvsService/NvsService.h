@@ -0,0 +1,83 @@
+#ifndef NVSSERVICE_H
+#define NVSSERVICE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#define NVS_SERVICE_MAX_NAMESPACES 4
+#define NVS_NAMESPACE_MAX 16 // NVS names are at most 15 characters
+#define NVS_PARTITION "nvs"
+
+struct NvsServiceStats {
+    uint32_t opens;    // namespace opens (once each, unless one failed)
+    uint32_t acquires; // handles lent out
+    uint32_t waits;    // acquires that had to wait for another task
+    uint32_t writes;   // puts and removes reported through noteWrite
+    uint32_t bytesWritten;
+};
+
+// Told of each reported write; runs under the service lock
+typedef void (*NvsWriteListener)(const char* ns, const char* key, size_t bytes, void* context);
+
+// Opens each NVS namespace once, read-write, and keeps the handle for the
+// life of the program instead of a begin()/end() per access. Modules borrow
+// a handle through NvsHandle; one recursive mutex serializes them across
+// tasks, and a module may nest borrows (a load that migrates and saves).
+class NvsService {
+private:
+    struct Entry {
+        char name[NVS_NAMESPACE_MAX];
+        Preferences prefs;
+        bool open;
+    };
+    Entry entries[NVS_SERVICE_MAX_NAMESPACES];
+    uint8_t entryCount;
+    SemaphoreHandle_t lock;
+    NvsServiceStats stats;
+    NvsWriteListener writeListener;
+    void* listenerContext;
+
+public:
+    NvsService();
+    // Creates the mutex; call before a second task touches NVS
+    void begin();
+
+    // Locks and returns the namespace's handle, opening it on first use.
+    // Every non-null result must be paired with release().
+    Preferences* acquire(const char* ns);
+    void release();
+
+    // Modules report each put (bytes is the value size) and remove (0) right
+    // after the Preferences call, while still holding the handle
+    void noteWrite(const char* ns, const char* key, size_t bytes);
+    void setWriteListener(NvsWriteListener fn, void* context = nullptr);
+
+    // Namespaces opened so far
+    uint8_t namespaceCount() const { return entryCount; }
+    const char* namespaceName(uint8_t index) const;
+
+    const NvsServiceStats& getStats() const { return stats; }
+};
+
+// Borrows one namespace for a scope: if (handle) handle->getBytes(...)
+class NvsHandle {
+private:
+    NvsService* service;
+    Preferences* prefs;
+
+public:
+    NvsHandle(NvsService* nvs, const char* ns) : service(nvs), prefs(nvs ? nvs->acquire(ns) : nullptr) {}
+    ~NvsHandle() {
+        if (prefs) service->release();
+    }
+    NvsHandle(const NvsHandle&) = delete;
+    NvsHandle& operator=(const NvsHandle&) = delete;
+
+    explicit operator bool() const { return prefs != nullptr; }
+    Preferences* operator->() const { return prefs; }
+    Preferences& operator*() const { return *prefs; }
+};
+
+#endif // NVSSERVICE_H
@@ -2,14 +2,10 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 
-PushNotifier::PushNotifier(Preferences* prefs) : preferences(prefs) {}
+PushNotifier::PushNotifier(ModelRepository* models) : accounts(models->getAccounts()) {}
 
 void PushNotifier::begin() {
-    // No-op here; accounts are injected via setAccounts from StorageManager
-}
-
-void PushNotifier::setAccounts(const std::vector<AlertzyAccount>& list) {
-    accounts = list;
+    // No-op here; accounts are loaded into the model repository from StorageManager
 }
 
 const std::vector<AlertzyAccount>& PushNotifier::getAccounts() const {
@@ -39,14 +35,22 @@ String PushNotifier::urlEncode(String str) {
 }
 
 void PushNotifier::sendNotification(String title, String message, const std::vector<uint8_t>& key_indices) {
+    uint32_t mask = 0;
+    for (uint8_t idx : key_indices) {
+        if (idx < 32) mask |= (1UL << idx);
+    }
+    sendNotificationMask(title, message, mask);
+}
+
+void PushNotifier::sendNotificationMask(String title, String message, uint32_t key_mask) {
     if (WiFi.status() != WL_CONNECTED) return;
     if (accounts.empty()) return;
 
     // Build a single underscore-concatenated accountKey string per Alertzy docs
     String combinedKeys = "";
     bool first = true;
-    for (uint8_t idx : key_indices) {
-        if (idx >= accounts.size()) continue;
+    for (size_t idx = 0; idx < accounts.size() && idx < 32; ++idx) {
+        if (!(key_mask & (1UL << idx))) continue;
         const String& key = accounts[idx].key;
         if (key.length() == 0) continue;
         if (!first) combinedKeys += "_";
@@ -75,8 +79,5 @@ void PushNotifier::sendNotification(String title, String message, const std::vec
 }
 
 void PushNotifier::sendAll(String title, String message) {
-    std::vector<uint8_t> indices;
-    indices.reserve(accounts.size());
-    for (uint8_t i = 0; i < accounts.size(); ++i) indices.push_back(i);
-    sendNotification(title, message, indices);
+    sendNotificationMask(title, message, 0xFFFFFFFF);
 }
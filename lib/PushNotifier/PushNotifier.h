@@ -2,26 +2,27 @@
 #define PUSHNOTIFIER_H
 
 #include <Arduino.h>
-#include <Preferences.h>
 #include <vector>
 #include "DataModels.h"
+#include "ModelRepository.h"
 
 class PushNotifier {
 private:
-    Preferences* preferences;
-    std::vector<AlertzyAccount> accounts;
+    // Owned by the model repository
+    const std::vector<AlertzyAccount>& accounts;
     String urlEncode(String str);
 
 public:
-    PushNotifier(Preferences* prefs);
+    PushNotifier(ModelRepository* models);
     void begin();
 
-    // Accounts management (data provided by StorageManager)
-    void setAccounts(const std::vector<AlertzyAccount>& list);
+    // Accounts are edited through the model repository
     const std::vector<AlertzyAccount>& getAccounts() const;
 
     // Send notifications to selected accounts by indices
     void sendNotification(String title, String message, const std::vector<uint8_t>& key_indices);
+    // Same, with accounts selected by bit index (bit i = account i)
+    void sendNotificationMask(String title, String message, uint32_t key_mask);
     // Convenience: send to all accounts
     void sendAll(String title, String message);
 };
@@ -0,0 +1,171 @@
+#include "RecordCodec.h"
+
+// Half-byte table: 64 bytes of flash instead of 1 KB, two lookups a byte
+static const uint32_t CRC32_NIBBLES[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t recordCrc32(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc = (crc >> 4) ^ CRC32_NIBBLES[(crc ^ data[i]) & 0x0F];
+        crc = (crc >> 4) ^ CRC32_NIBBLES[(crc ^ (data[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+static void putUint32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint32_t getUint32(const uint8_t* in) {
+    return (uint32_t)in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+void frameRecord(std::vector<uint8_t>& blob, uint32_t seq) {
+    uint8_t frame[RECORD_FRAME_SIZE];
+    putUint32(frame, seq);
+    putUint32(frame + 4, blob.size());
+    putUint32(frame + 8, recordCrc32(recordCrc32(0, frame, 8), blob.data(), blob.size()));
+    blob.insert(blob.begin(), frame, frame + RECORD_FRAME_SIZE);
+}
+
+bool readFrame(const uint8_t* data, size_t len, RecordFrame& frame) {
+    if (len < RECORD_FRAME_SIZE) return false;
+    frame.seq = getUint32(data);
+    frame.length = getUint32(data + 4);
+    frame.crc = getUint32(data + 8);
+    return true;
+}
+
+RecordWriter::RecordWriter(std::vector<uint8_t>& buffer) : out(buffer), recordStart(0), cutCount(0) {}
+
+void RecordWriter::writeHeader(RecordKind kind, uint8_t version) {
+    out.push_back(RECORD_MAGIC);
+    out.push_back(kind);
+    out.push_back(version);
+}
+
+void RecordWriter::writeByte(uint8_t value) {
+    out.push_back(value);
+}
+
+void RecordWriter::writeVarint(uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+// Cut to what a reader keeps, at a UTF-8 character boundary, so what is
+// stored is what loads back
+void RecordWriter::writeString(const char* value) {
+    size_t len = value ? strlen(value) : 0;
+    if (len > RECORD_MAX_STRING - 1) {
+        len = RECORD_MAX_STRING - 1;
+        while (len > 0 && ((uint8_t)value[len] & 0xC0) == 0x80) len--;
+        cutCount++;
+    }
+    writeVarint(len);
+    out.insert(out.end(), value, value + len);
+}
+
+void RecordWriter::beginRecord() {
+    recordStart = out.size();
+    out.push_back(0);
+    out.push_back(0);
+}
+
+void RecordWriter::endRecord() {
+    size_t bodyLength = out.size() - recordStart - 2;
+    out[recordStart] = bodyLength & 0xFF;
+    out[recordStart + 1] = (bodyLength >> 8) & 0xFF;
+}
+
+uint16_t RecordWriter::stringsCut() const {
+    return cutCount;
+}
+
+MemoryRecordSource::MemoryRecordSource(const uint8_t* buffer, size_t size) : data(buffer), length(size), pos(0) {}
+
+size_t MemoryRecordSource::read(uint8_t* buffer, size_t size) {
+    size_t n = length - pos < size ? length - pos : size;
+    memcpy(buffer, data + pos, n);
+    pos += n;
+    return n;
+}
+
+size_t MemoryRecordSource::totalSize() const {
+    return length;
+}
+
+RecordReader::RecordReader(RecordSource& recordSource)
+    : source(recordSource), chunkLength(0), chunkPos(0), consumed(0), recordEnd(SIZE_MAX), failed(false) {}
+
+bool RecordReader::fill() {
+    chunkLength = source.read(chunk, sizeof(chunk));
+    chunkPos = 0;
+    return chunkLength > 0;
+}
+
+bool RecordReader::readHeader(RecordKind kind, uint8_t* version) {
+    if (readByte() != RECORD_MAGIC || readByte() != kind) failed = true;
+    *version = readByte();
+    return !failed;
+}
+
+uint8_t RecordReader::readByte() {
+    if (failed || consumed >= recordEnd || (chunkPos >= chunkLength && !fill())) {
+        failed = true;
+        return 0;
+    }
+    consumed++;
+    return chunk[chunkPos++];
+}
+
+uint32_t RecordReader::readVarint() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t b = readByte();
+        // The fifth byte holds the top 4 bits; anything above would be dropped
+        if (shift == 28 && b > 0x0F) break;
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return value;
+    }
+    failed = true;
+    return 0;
+}
+
+void RecordReader::readString(char* out, size_t size) {
+    uint32_t len = readVarint();
+    if (len > source.totalSize()) failed = true;
+    size_t kept = 0;
+    for (uint32_t i = 0; i < len && !failed; ++i) {
+        char c = (char)readByte();
+        if (kept < size - 1) out[kept++] = c;
+    }
+    out[failed ? 0 : kept] = '\0';
+}
+
+bool RecordReader::beginRecord() {
+    uint32_t bodyLength = readByte();
+    bodyLength |= (uint32_t)readByte() << 8;
+    if (failed) return false;
+    recordEnd = consumed + bodyLength;
+    return true;
+}
+
+void RecordReader::endRecord() {
+    while (!failed && consumed < recordEnd) readByte();
+    recordEnd = SIZE_MAX;
+}
+
+bool RecordReader::ok() const {
+    return !failed;
+}
+
+size_t RecordReader::totalSize() const {
+    return source.totalSize();
+}
@@ -0,0 +1,124 @@
+#ifndef RECORDCODEC_H
+#define RECORDCODEC_H
+
+#include <Arduino.h>
+#include <vector>
+
+// Binary layout of what StorageManager keeps in NVS:
+//   header   magic, kind, schema version
+//   count    varint number of records (plus kind-specific size hints)
+//   records  uint16 little-endian body length, then the body
+// A single stored entity is the header and one record, no count; a manifest
+// is the header, the entity kind byte, a count and one varint slot each. A
+// routine manifest then has one record per routine: name, phase count,
+// total seconds and (schema 3) the seq of the routine's stored copy.
+// Integers are LEB128 varints and strings are a varint length plus the bytes.
+// Fields are only ever appended to a record body, so a reader skips whatever
+// a newer writer added after the fields it knows.
+//
+// Each stored entity and manifest is kept as two copies, A and B, and every
+// copy starts with a frame: uint32 seq, uint32 payload length and a CRC32
+// of both and the payload, little-endian. A write goes to the copy not
+// holding the newest seq; a load takes the highest seq whose CRC checks out.
+#define RECORD_MAGIC 0xC5
+#define RECORD_MAX_STRING 64 // longest string kept, with its NUL; writers cut longer ones (keyboard input is shorter)
+#define RECORD_CHUNK_SIZE 256 // reader buffer, and the size of each stored chunk
+#define RECORD_FRAME_SIZE 12
+
+enum RecordKind : uint8_t {
+    RECORD_ROUTINES = 1,
+    RECORD_ALARMS = 2,
+    RECORD_ACCOUNTS = 3,
+    RECORD_MANIFEST = 4,
+    RECORD_TELEMETRY = 5 // NVS write counters (StorageTelemetry)
+};
+
+struct RecordFrame {
+    uint32_t seq;
+    uint32_t length;
+    uint32_t crc;
+};
+
+// CRC32 as zlib computes it; start from 0 and feed the data in pieces
+uint32_t recordCrc32(uint32_t crc, const uint8_t* data, size_t len);
+// Puts the frame for seq in front of the payload already in blob
+void frameRecord(std::vector<uint8_t>& blob, uint32_t seq);
+// False if data is too short to start with a frame
+bool readFrame(const uint8_t* data, size_t len, RecordFrame& frame);
+
+class RecordWriter {
+private:
+    std::vector<uint8_t>& out;
+    size_t recordStart; // offset of the open record's length field
+    uint16_t cutCount;
+
+public:
+    explicit RecordWriter(std::vector<uint8_t>& buffer);
+
+    void writeHeader(RecordKind kind, uint8_t version);
+    void writeByte(uint8_t value);
+    void writeVarint(uint32_t value);
+    void writeString(const char* value);
+    void beginRecord();
+    void endRecord();
+
+    // Strings writeString had to cut to RECORD_MAX_STRING - 1 bytes; the
+    // caller knows what they were and reports it
+    uint16_t stringsCut() const;
+};
+
+// Where a RecordReader pulls encoded bytes from, a chunk at a time
+class RecordSource {
+public:
+    virtual ~RecordSource() {}
+    // Fills buffer with the next chunk (at most size bytes); 0 at the end
+    virtual size_t read(uint8_t* buffer, size_t size) = 0;
+    // Encoded length in bytes, used to sanity-check counts before allocating
+    virtual size_t totalSize() const = 0;
+};
+
+class MemoryRecordSource : public RecordSource {
+private:
+    const uint8_t* data;
+    size_t length;
+    size_t pos;
+
+public:
+    MemoryRecordSource(const uint8_t* buffer, size_t size);
+    size_t read(uint8_t* buffer, size_t size) override;
+    size_t totalSize() const override;
+};
+
+// Pulls fields out of an encoded stream through one fixed chunk buffer, so
+// decoding needs no heap of its own. Any malformed or truncated input sets a
+// sticky failure flag; later reads return zero/empty.
+class RecordReader {
+private:
+    RecordSource& source;
+    uint8_t chunk[RECORD_CHUNK_SIZE];
+    size_t chunkLength;
+    size_t chunkPos;
+    size_t consumed;  // stream offset of chunk[chunkPos]
+    size_t recordEnd; // stream offset where the open record ends
+    bool failed;
+
+    bool fill();
+
+public:
+    explicit RecordReader(RecordSource& recordSource);
+
+    // False unless magic and kind match; version is the writer's schema version
+    bool readHeader(RecordKind kind, uint8_t* version);
+    uint8_t readByte();
+    uint32_t readVarint();
+    // Copies the string into out (NUL-terminated, cut to size - 1 bytes)
+    void readString(char* out, size_t size);
+    bool beginRecord();
+    // Skips fields this reader does not know
+    void endRecord();
+
+    bool ok() const;
+    size_t totalSize() const;
+};
+
+#endif // RECORDCODEC_H
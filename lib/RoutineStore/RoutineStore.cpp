@@ -0,0 +1,448 @@
+#include "RoutineStore.h"
+#include <algorithm>
+
+// ---- Views ----
+
+const char* PhaseView::name() const { return &store->namePool[store->phaseNames[index]]; }
+uint32_t PhaseView::durationSeconds() const { return store->durations[index]; }
+uint8_t PhaseView::soundTrack() const { return store->soundTracks[index]; }
+uint32_t PhaseView::notifyMask() const { return store->notifyMasks[index]; }
+
+const char* RoutineView::name() const { return &store->namePool[store->routines[index].nameOffset]; }
+int RoutineView::phaseCount() const { return store->routines[index].phaseCount; }
+
+PhaseView RoutineView::phase(int i) const {
+    return PhaseView(store, (uint16_t)(store->routines[index].firstPhase + i));
+}
+
+uint32_t RoutineView::totalDurationSeconds() const {
+    // Walk the program so repeated phases are counted every time they run
+    const uint8_t* prog = program();
+    int len = programLength();
+    // Up to 255^4 runs of a phase: sum in 64 bits and saturate
+    uint64_t total = 0;
+    uint64_t multiplier = 1;
+    uint8_t counts[ROUTINE_MAX_LOOP_DEPTH];
+    int depth = 0;
+    for (int pc = 0; pc < len;) {
+        uint8_t op = prog[pc++];
+        if (op == OP_REPEAT) {
+            uint8_t n = prog[pc++];
+            if (depth < ROUTINE_MAX_LOOP_DEPTH) {
+                counts[depth++] = n;
+                multiplier *= n;
+            }
+        } else if (op == OP_LOOP) {
+            if (depth > 0) multiplier /= counts[--depth];
+        } else if (op == OP_PHASE) {
+            total += multiplier * phase(prog[pc++]).durationSeconds();
+            if (total >= UINT32_MAX) return UINT32_MAX;
+        } else if (op == OP_PLAY || op == OP_NOTIFY) {
+            pc++;
+        } else {
+            break;
+        }
+    }
+    return (uint32_t)total;
+}
+
+const uint8_t* RoutineView::program() const {
+    return &store->code[store->routines[index].codeOffset];
+}
+
+int RoutineView::programLength() const { return store->routines[index].codeLength; }
+int RoutineView::totalSteps() const { return store->routines[index].totalSteps; }
+
+std::vector<RepeatBlock> RoutineView::repeats() const {
+    // Recover the repeat blocks from REPEAT/LOOP pairs in the program
+    std::vector<RepeatBlock> blocks;
+    RepeatBlock stack[ROUTINE_MAX_LOOP_DEPTH];
+    bool pendingFirst[ROUTINE_MAX_LOOP_DEPTH];
+    int depth = 0;
+    uint8_t lastPhase = 0;
+    const uint8_t* prog = program();
+    int len = programLength();
+    for (int pc = 0; pc < len;) {
+        uint8_t op = prog[pc++];
+        if (op == OP_REPEAT) {
+            uint8_t n = prog[pc++];
+            if (depth < ROUTINE_MAX_LOOP_DEPTH) {
+                stack[depth] = RepeatBlock{0, 0, n};
+                pendingFirst[depth] = true;
+                depth++;
+            }
+        } else if (op == OP_PHASE) {
+            lastPhase = prog[pc++];
+            for (int d = 0; d < depth; ++d) {
+                if (pendingFirst[d]) { stack[d].first_phase = lastPhase; pendingFirst[d] = false; }
+            }
+        } else if (op == OP_LOOP) {
+            if (depth > 0) {
+                RepeatBlock b = stack[--depth];
+                b.last_phase = lastPhase;
+                blocks.push_back(b);
+            }
+        } else if (op == OP_PLAY || op == OP_NOTIFY) {
+            pc++;
+        } else {
+            break;
+        }
+    }
+    std::sort(blocks.begin(), blocks.end(), [](const RepeatBlock& a, const RepeatBlock& b) {
+        return a.first_phase != b.first_phase ? a.first_phase < b.first_phase : a.last_phase > b.last_phase;
+    });
+    return blocks;
+}
+
+// ---- Store ----
+
+RoutineStore::RoutineStore() {
+    clear();
+}
+
+void RoutineStore::clear() {
+    routines.clear();
+    durations.clear();
+    soundTracks.clear();
+    notifyMasks.clear();
+    phaseNames.clear();
+    namePool.clear();
+    code.clear();
+    pendingRepeats.clear();
+    namePool.push_back('\0'); // offset 0 is the empty string
+}
+
+void RoutineStore::reserve(size_t routineCount, size_t phaseCount, size_t nameBytes) {
+    routines.reserve(routineCount);
+    durations.reserve(phaseCount);
+    soundTracks.reserve(phaseCount);
+    notifyMasks.reserve(phaseCount);
+    phaseNames.reserve(phaseCount);
+    namePool.reserve(nameBytes + 1);
+    code.reserve(phaseCount * 6 + routineCount);
+}
+
+uint16_t RoutineStore::intern(const char* name) {
+    if (!name || !name[0]) return 0;
+    // Linear scan of the pool; names repeat a lot ("Work", "Break") and the pool is small
+    size_t len = strlen(name);
+    size_t offset = 0;
+    while (offset < namePool.size()) {
+        size_t entryLen = strlen(&namePool[offset]);
+        if (entryLen == len && memcmp(&namePool[offset], name, len) == 0) return (uint16_t)offset;
+        offset += entryLen + 1;
+    }
+    offset = namePool.size();
+    namePool.insert(namePool.end(), name, name + len + 1);
+    return (uint16_t)offset;
+}
+
+void RoutineStore::compactNames() {
+    // Rebuild the pool with only the names still referenced
+    std::vector<char> oldPool;
+    oldPool.swap(namePool);
+    namePool.reserve(oldPool.size());
+    namePool.push_back('\0');
+    for (auto& r : routines) r.nameOffset = intern(&oldPool[r.nameOffset]);
+    for (auto& off : phaseNames) off = intern(&oldPool[off]);
+}
+
+void RoutineStore::compile(RoutineEntry& entry, const std::vector<RepeatBlock>& repeats, std::vector<uint8_t>& out) const {
+    // Blocks come back sorted outer-first and properly nested
+    std::vector<RepeatBlock> blocks = sanitizeRepeats(repeats, entry.phaseCount);
+    const RepeatBlock* open[ROUTINE_MAX_LOOP_DEPTH];
+    int depth = 0;
+    size_t next = 0;
+    uint32_t multiplier = 1;
+    uint32_t steps = 0;
+    size_t start = out.size();
+
+    for (int i = 0; i < entry.phaseCount; ++i) {
+        while (next < blocks.size() && blocks[next].first_phase == i) {
+            out.push_back(OP_REPEAT);
+            out.push_back(blocks[next].count);
+            multiplier *= blocks[next].count;
+            open[depth++] = &blocks[next++];
+        }
+        uint16_t g = entry.firstPhase + i;
+        out.push_back(OP_PHASE);
+        out.push_back((uint8_t)i);
+        if (soundTracks[g] > 0) { out.push_back(OP_PLAY); out.push_back(soundTracks[g]); }
+        if (notifyMasks[g] != 0) { out.push_back(OP_NOTIFY); out.push_back((uint8_t)i); }
+        steps += multiplier;
+        while (depth > 0 && open[depth - 1]->last_phase == i) {
+            out.push_back(OP_LOOP);
+            multiplier /= open[--depth]->count;
+        }
+    }
+    out.push_back(OP_END);
+    entry.codeLength = (uint16_t)(out.size() - start);
+    entry.totalSteps = (uint16_t)min<uint32_t>(steps, 0xFFFF);
+}
+
+std::vector<RepeatBlock> RoutineStore::sanitizeRepeats(const std::vector<RepeatBlock>& repeats, int phaseCount) {
+    std::vector<RepeatBlock> sorted;
+    for (const auto& b : repeats) {
+        if (b.count >= 2 && b.first_phase <= b.last_phase && b.last_phase < phaseCount) sorted.push_back(b);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const RepeatBlock& a, const RepeatBlock& b) {
+        return a.first_phase != b.first_phase ? a.first_phase < b.first_phase : a.last_phase > b.last_phase;
+    });
+
+    std::vector<RepeatBlock> result;
+    RepeatBlock stack[ROUTINE_MAX_LOOP_DEPTH];
+    int depth = 0;
+    for (const auto& b : sorted) {
+        while (depth > 0 && stack[depth - 1].last_phase < b.first_phase) depth--;
+        if (depth > 0) {
+            const RepeatBlock& outer = stack[depth - 1];
+            if (b.last_phase > outer.last_phase) continue; // partial overlap
+            if (b.first_phase == outer.first_phase && b.last_phase == outer.last_phase) continue; // duplicate
+        }
+        if (depth == ROUTINE_MAX_LOOP_DEPTH) continue;
+        stack[depth++] = b;
+        result.push_back(b);
+    }
+    return result;
+}
+
+int RoutineStore::beginRoutine(const char* name) {
+    RoutineEntry entry;
+    entry.nameOffset = intern(name);
+    entry.firstPhase = (uint16_t)durations.size();
+    entry.phaseCount = 0;
+    entry.codeOffset = (uint16_t)code.size();
+    entry.codeLength = 0;
+    entry.totalSteps = 0;
+    routines.push_back(entry);
+    pendingRepeats.clear();
+    return (int)routines.size() - 1;
+}
+
+void RoutineStore::addRepeat(uint8_t firstPhase, uint8_t lastPhase, uint8_t count) {
+    pendingRepeats.push_back(RepeatBlock{firstPhase, lastPhase, count});
+}
+
+void RoutineStore::endRoutine() {
+    if (routines.empty()) return;
+    RoutineEntry& entry = routines.back();
+    entry.codeOffset = (uint16_t)code.size();
+    compile(entry, pendingRepeats, code);
+    pendingRepeats.clear();
+}
+
+void RoutineStore::addPhase(const char* name, uint32_t durationSeconds, uint8_t soundTrack, uint32_t notifyMask) {
+    if (routines.empty() || routines.back().phaseCount >= ROUTINE_MAX_PHASES) return;
+    durations.push_back(durationSeconds);
+    soundTracks.push_back(soundTrack);
+    notifyMasks.push_back(notifyMask);
+    phaseNames.push_back(intern(name));
+    routines.back().phaseCount++;
+}
+
+int RoutineStore::add(const CustomTimer& timer) {
+    int index = beginRoutine(timer.name.c_str());
+    for (const auto& p : timer.phases) {
+        addPhase(p.name.c_str(), p.duration_seconds, p.sound_track, indicesToMask(p.alertzy_key_indices));
+    }
+    pendingRepeats = timer.repeats;
+    endRoutine();
+    return index;
+}
+
+bool RoutineStore::replace(int index, const CustomTimer& timer) {
+    if (index < 0 || index >= (int)routines.size()) return false;
+    RoutineEntry& entry = routines[index];
+    uint16_t first = entry.firstPhase;
+    int oldCount = entry.phaseCount;
+    int newCount = min((int)timer.phases.size(), ROUTINE_MAX_PHASES);
+
+    // Resize the routine's slice of each column in place, then overwrite it
+    if (newCount != oldCount) {
+        int delta = newCount - oldCount;
+        if (delta > 0) {
+            size_t at = first + oldCount;
+            durations.insert(durations.begin() + at, delta, 0);
+            soundTracks.insert(soundTracks.begin() + at, delta, 0);
+            notifyMasks.insert(notifyMasks.begin() + at, delta, 0);
+            phaseNames.insert(phaseNames.begin() + at, delta, 0);
+        } else {
+            size_t from = first + newCount;
+            size_t to = first + oldCount;
+            durations.erase(durations.begin() + from, durations.begin() + to);
+            soundTracks.erase(soundTracks.begin() + from, soundTracks.begin() + to);
+            notifyMasks.erase(notifyMasks.begin() + from, notifyMasks.begin() + to);
+            phaseNames.erase(phaseNames.begin() + from, phaseNames.begin() + to);
+        }
+        for (size_t r = index + 1; r < routines.size(); ++r) routines[r].firstPhase += delta;
+        entry.phaseCount = (uint16_t)newCount;
+    }
+
+    entry.nameOffset = intern(timer.name.c_str());
+    for (int i = 0; i < newCount; ++i) {
+        const TimerPhase& p = timer.phases[i];
+        durations[first + i] = p.duration_seconds;
+        soundTracks[first + i] = p.sound_track;
+        notifyMasks[first + i] = indicesToMask(p.alertzy_key_indices);
+        phaseNames[first + i] = intern(p.name.c_str());
+    }
+
+    // Recompile and splice the program over the old one
+    std::vector<uint8_t> program;
+    uint16_t oldLength = entry.codeLength;
+    compile(entry, timer.repeats, program);
+    code.erase(code.begin() + entry.codeOffset, code.begin() + entry.codeOffset + oldLength);
+    code.insert(code.begin() + entry.codeOffset, program.begin(), program.end());
+    int codeDelta = (int)entry.codeLength - (int)oldLength;
+    for (size_t r = index + 1; r < routines.size(); ++r) routines[r].codeOffset += codeDelta;
+
+    compactNames();
+    return true;
+}
+
+bool RoutineStore::remove(int index) {
+    if (index < 0 || index >= (int)routines.size()) return false;
+    uint16_t first = routines[index].firstPhase;
+    uint16_t count = routines[index].phaseCount;
+    uint16_t codeOffset = routines[index].codeOffset;
+    uint16_t codeLength = routines[index].codeLength;
+    code.erase(code.begin() + codeOffset, code.begin() + codeOffset + codeLength);
+    durations.erase(durations.begin() + first, durations.begin() + first + count);
+    soundTracks.erase(soundTracks.begin() + first, soundTracks.begin() + first + count);
+    notifyMasks.erase(notifyMasks.begin() + first, notifyMasks.begin() + first + count);
+    phaseNames.erase(phaseNames.begin() + first, phaseNames.begin() + first + count);
+    routines.erase(routines.begin() + index);
+    for (size_t r = index; r < routines.size(); ++r) {
+        routines[r].firstPhase -= count;
+        routines[r].codeOffset -= codeLength;
+    }
+    compactNames();
+    return true;
+}
+
+CustomTimer RoutineStore::unpack(int index) const {
+    CustomTimer timer;
+    if (index < 0 || index >= (int)routines.size()) return timer;
+    RoutineView view = (*this)[index];
+    timer.name = view.name();
+    timer.phases.reserve(view.phaseCount());
+    for (int i = 0; i < view.phaseCount(); ++i) {
+        PhaseView pv = view.phase(i);
+        TimerPhase p;
+        p.name = pv.name();
+        p.duration_seconds = pv.durationSeconds();
+        p.sound_track = pv.soundTrack();
+        p.alertzy_key_indices = maskToIndices(pv.notifyMask());
+        timer.phases.push_back(p);
+    }
+    timer.repeats = view.repeats();
+    return timer;
+}
+
+size_t RoutineStore::size() const { return routines.size(); }
+bool RoutineStore::empty() const { return routines.empty(); }
+
+RoutineView RoutineStore::operator[](int index) const {
+    return RoutineView(this, (uint16_t)index);
+}
+
+size_t RoutineStore::heapBytes() const {
+    return routines.capacity() * sizeof(RoutineEntry) +
+           durations.capacity() * sizeof(uint32_t) +
+           soundTracks.capacity() * sizeof(uint8_t) +
+           notifyMasks.capacity() * sizeof(uint32_t) +
+           phaseNames.capacity() * sizeof(uint16_t) +
+           namePool.capacity() +
+           code.capacity();
+}
+
+uint32_t RoutineStore::indicesToMask(const std::vector<uint8_t>& indices) {
+    uint32_t mask = 0;
+    for (uint8_t idx : indices) {
+        if (idx < ROUTINE_MAX_NOTIFY_ACCOUNTS) mask |= (1UL << idx);
+    }
+    return mask;
+}
+
+std::vector<uint8_t> RoutineStore::maskToIndices(uint32_t mask) {
+    std::vector<uint8_t> indices;
+    for (uint8_t i = 0; i < ROUTINE_MAX_NOTIFY_ACCOUNTS && mask; ++i) {
+        if (mask & (1UL << i)) {
+            indices.push_back(i);
+            mask &= ~(1UL << i);
+        }
+    }
+    return indices;
+}
+
+// ---- Index ----
+
+RoutineIndex::RoutineIndex() {
+    clear();
+}
+
+void RoutineIndex::clear() {
+    entries.clear();
+    namePool.clear();
+    namePool.push_back('\0'); // offset 0 is the empty string
+}
+
+void RoutineIndex::reserve(size_t count, size_t nameBytes) {
+    entries.reserve(count);
+    namePool.reserve(nameBytes + 1);
+}
+
+uint16_t RoutineIndex::appendName(const char* name) {
+    if (!name || !name[0]) return 0;
+    uint16_t offset = (uint16_t)namePool.size();
+    namePool.insert(namePool.end(), name, name + strlen(name) + 1);
+    return offset;
+}
+
+void RoutineIndex::compactNames() {
+    // Rebuild the pool with only the names still referenced
+    std::vector<char> oldPool;
+    oldPool.swap(namePool);
+    namePool.reserve(oldPool.size());
+    namePool.push_back('\0');
+    for (auto& e : entries) e.nameOffset = appendName(&oldPool[e.nameOffset]);
+}
+
+void RoutineIndex::add(const char* name, uint16_t phaseCount, uint32_t totalSeconds) {
+    Entry entry;
+    entry.nameOffset = appendName(name);
+    entry.phaseCount = phaseCount;
+    entry.totalSeconds = totalSeconds;
+    entries.push_back(entry);
+}
+
+void RoutineIndex::add(RoutineView routine) {
+    add(routine.name(), (uint16_t)routine.phaseCount(), routine.totalDurationSeconds());
+}
+
+bool RoutineIndex::set(int index, RoutineView routine) {
+    if (index < 0 || index >= (int)entries.size()) return false;
+    Entry& entry = entries[index];
+    entry.nameOffset = appendName(routine.name());
+    entry.phaseCount = (uint16_t)routine.phaseCount();
+    entry.totalSeconds = routine.totalDurationSeconds();
+    compactNames();
+    return true;
+}
+
+bool RoutineIndex::remove(int index) {
+    if (index < 0 || index >= (int)entries.size()) return false;
+    entries.erase(entries.begin() + index);
+    compactNames();
+    return true;
+}
+
+size_t RoutineIndex::size() const { return entries.size(); }
+bool RoutineIndex::empty() const { return entries.empty(); }
+const char* RoutineIndex::name(int index) const { return &namePool[entries[index].nameOffset]; }
+int RoutineIndex::phaseCount(int index) const { return entries[index].phaseCount; }
+uint32_t RoutineIndex::totalDurationSeconds(int index) const { return entries[index].totalSeconds; }
+
+size_t RoutineIndex::heapBytes() const {
+    return entries.capacity() * sizeof(Entry) + namePool.capacity();
+}
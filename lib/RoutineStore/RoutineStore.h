@@ -0,0 +1,179 @@
+#ifndef ROUTINESTORE_H
+#define ROUTINESTORE_H
+
+#include <Arduino.h>
+#include <vector>
+#include "DataModels.h"
+
+// Notify masks hold one bit per Alertzy account index
+#define ROUTINE_MAX_NOTIFY_ACCOUNTS 32
+// Phases are addressed by a one-byte operand in routine programs
+#define ROUTINE_MAX_PHASES 255
+// Maximum nesting of repeat blocks the engine will run
+#define ROUTINE_MAX_LOOP_DEPTH 4
+
+// Routine program opcodes. Each routine is compiled into a byte stream:
+//   REPEAT n ... LOOP   run the enclosed instructions n times
+//   PHASE i             count down phase i of the routine
+//   PLAY t              end-of-phase alert with MP3 track t
+//   NOTIFY i            end-of-phase push to the accounts in phase i's mask
+//   END                 routine complete
+enum RoutineOp : uint8_t {
+    OP_END = 0x00,
+    OP_PHASE = 0x01,
+    OP_PLAY = 0x02,
+    OP_NOTIFY = 0x03,
+    OP_REPEAT = 0x04,
+    OP_LOOP = 0x05
+};
+
+// Interpreter position inside a routine program. Fixed size, so a routine
+// costs the same RAM however many times its blocks repeat.
+struct RoutineCursor {
+    uint16_t pc;    // Offset into the routine's program
+    uint16_t step;  // Phases started so far (1-based once running)
+    uint8_t depth;  // Active repeat blocks
+    uint8_t loopRemaining[ROUTINE_MAX_LOOP_DEPTH];
+    uint16_t loopStart[ROUTINE_MAX_LOOP_DEPTH];
+};
+
+class RoutineStore;
+
+// Read-only view of one phase inside a RoutineStore
+class PhaseView {
+private:
+    const RoutineStore* store;
+    uint16_t index; // global phase index
+
+public:
+    PhaseView(const RoutineStore* s, uint16_t i) : store(s), index(i) {}
+    const char* name() const;
+    uint32_t durationSeconds() const;
+    uint8_t soundTrack() const;
+    uint32_t notifyMask() const;
+};
+
+// Read-only view of one routine inside a RoutineStore
+class RoutineView {
+private:
+    const RoutineStore* store;
+    uint16_t index; // routine index
+
+public:
+    RoutineView(const RoutineStore* s, uint16_t i) : store(s), index(i) {}
+    const char* name() const;
+    int phaseCount() const;
+    PhaseView phase(int i) const;
+    uint32_t totalDurationSeconds() const;
+    // Compiled program and the number of phases it runs once expanded
+    const uint8_t* program() const;
+    int programLength() const;
+    int totalSteps() const;
+    std::vector<RepeatBlock> repeats() const;
+};
+
+// Packed structure-of-arrays storage for custom timer routines. Phase fields live in
+// contiguous per-field arrays and all names share one interned string pool, so the
+// whole collection costs a handful of allocations regardless of routine count.
+class RoutineStore {
+private:
+    struct RoutineEntry {
+        uint16_t nameOffset;
+        uint16_t firstPhase;
+        uint16_t phaseCount;
+        uint16_t codeOffset;
+        uint16_t codeLength;
+        uint16_t totalSteps;
+    };
+
+    std::vector<RoutineEntry> routines;
+    // Per-phase columns, indexed by global phase index
+    std::vector<uint32_t> durations;
+    std::vector<uint8_t> soundTracks;
+    std::vector<uint32_t> notifyMasks;
+    std::vector<uint16_t> phaseNames; // offsets into namePool
+    // NUL-terminated names, each distinct string stored once
+    std::vector<char> namePool;
+    // Compiled routine programs, back to back
+    std::vector<uint8_t> code;
+    // Repeat blocks of the routine being built, consumed by endRoutine()
+    std::vector<RepeatBlock> pendingRepeats;
+
+    uint16_t intern(const char* name);
+    void compactNames();
+    void compile(RoutineEntry& entry, const std::vector<RepeatBlock>& repeats, std::vector<uint8_t>& out) const;
+
+    friend class PhaseView;
+    friend class RoutineView;
+
+public:
+    RoutineStore();
+
+    // Builder API (used by loaders to decode straight into the store)
+    void clear();
+    void reserve(size_t routineCount, size_t phaseCount, size_t nameBytes);
+    int beginRoutine(const char* name);
+    void addPhase(const char* name, uint32_t durationSeconds, uint8_t soundTrack, uint32_t notifyMask);
+    void addRepeat(uint8_t firstPhase, uint8_t lastPhase, uint8_t count);
+    void endRoutine();
+
+    // Whole-routine editing
+    int add(const CustomTimer& timer);
+    bool replace(int index, const CustomTimer& timer);
+    bool remove(int index);
+    CustomTimer unpack(int index) const;
+
+    // Access
+    size_t size() const;
+    bool empty() const;
+    RoutineView operator[](int index) const;
+
+    // Bytes of heap owned by the store (capacity, not size)
+    size_t heapBytes() const;
+
+    // Conversion helpers between notify index lists and masks
+    static uint32_t indicesToMask(const std::vector<uint8_t>& indices);
+    static std::vector<uint8_t> maskToIndices(uint32_t mask);
+    // Drop blocks that are out of range, partially overlap or nest too deep
+    static std::vector<RepeatBlock> sanitizeRepeats(const std::vector<RepeatBlock>& repeats, int phaseCount);
+};
+
+// What lists show of each routine (name, phase count, total duration) without
+// its phases, which stay in storage until the routine is run or edited. Names
+// share one pool, so the index costs two allocations whatever its size.
+class RoutineIndex {
+private:
+    struct Entry {
+        uint16_t nameOffset;
+        uint16_t phaseCount;
+        uint32_t totalSeconds;
+    };
+
+    std::vector<Entry> entries;
+    // NUL-terminated names, back to back
+    std::vector<char> namePool;
+
+    uint16_t appendName(const char* name);
+    void compactNames();
+
+public:
+    RoutineIndex();
+
+    void clear();
+    void reserve(size_t count, size_t nameBytes);
+    void add(const char* name, uint16_t phaseCount, uint32_t totalSeconds);
+    void add(RoutineView routine);
+    bool set(int index, RoutineView routine);
+    bool remove(int index);
+
+    size_t size() const;
+    bool empty() const;
+    const char* name(int index) const;
+    int phaseCount(int index) const;
+    uint32_t totalDurationSeconds(int index) const;
+
+    // Bytes of heap owned by the index (capacity, not size)
+    size_t heapBytes() const;
+};
+
+#endif // ROUTINESTORE_H
@@ -1,13 +1,22 @@
 #include "SingleTimer.h"
 #include "configs.h"
 #include "NotificationManager.h"
+#include "TimerCheckpoint.h"
+#include "ExpiryScheduler.h"
 
-// Use the global notification manager defined in main.cpp
+// Use the global notification manager, checkpoint store and expiry scheduler defined in main.cpp
 extern NotificationManager notificationManager;
+extern TimerCheckpoint timerCheckpoint;
+extern ExpiryScheduler expiryScheduler;
 
 SingleTimer::SingleTimer(Adafruit_SSD1306* displayInstance) 
     : display(displayInstance), isRunning(false), isFinished(false), startTime(0), duration(0), remainingTime(0),
-      setupMinutes(0), setupSeconds(0), setupSoundTrack(1), setupState(0), lastDisplayUpdate(0) {
+      setupMinutes(0), setupSeconds(0), setupSoundTrack(1), setupState(0), expiryArmed(false), lastDisplayUpdate(0) {
+}
+
+// Have the deadline fire the alert; polling remains the fallback
+void SingleTimer::armExpiry() {
+    expiryArmed = expiryScheduler.arm(EXPIRY_SINGLE_TIMER, (uint64_t)remainingTime * 1000000ULL, (uint8_t)setupSoundTrack);
 }
 
 void SingleTimer::startSetup() {
@@ -71,22 +80,44 @@ void SingleTimer::startTimer() {
         isRunning = true;
         isFinished = false;
         lastDisplayUpdate = millis();
+        timerCheckpoint.saveSingle(duration, remainingTime, (uint8_t)setupSoundTrack);
+        armExpiry();
         drawRunningScreen();
     }
 }
 
+bool SingleTimer::restoreRunning(uint32_t durationSeconds, uint32_t remainingSeconds, uint8_t soundTrack) {
+    if (durationSeconds == 0 || remainingSeconds > durationSeconds) return false;
+    setupMinutes = durationSeconds / 60;
+    setupSeconds = durationSeconds % 60;
+    setupSoundTrack = soundTrack;
+    duration = durationSeconds;
+    remainingTime = remainingSeconds;
+    // Back-date the start so updateRemainingTime() continues from the checkpoint
+    startTime = millis() - ((duration - remainingTime) * 1000);
+    isRunning = true;
+    isFinished = false;
+    lastDisplayUpdate = millis();
+    armExpiry();
+    drawRunningScreen();
+    return true;
+}
+
 void SingleTimer::updateTimer() {
     if (!isRunning) return;
     
     updateRemainingTime();
     
-    // Check if timer finished
-    if (remainingTime <= 0) {
+    // Check if timer finished; when armed the alert task has already started the alert
+    bool expired = expiryArmed ? expiryScheduler.takeExpired(EXPIRY_SINGLE_TIMER) : (remainingTime <= 0);
+    if (expired) {
         isRunning = false;
         isFinished = true;
         remainingTime = 0;
+        timerCheckpoint.clear();
         // Trigger audio/LED alert
-        notificationManager.playAlert(setupSoundTrack);
+        if (!expiryArmed) notificationManager.playAlert(setupSoundTrack);
+        expiryArmed = false;
         drawFinishedScreen();
         return;
     }
@@ -261,6 +292,9 @@ void SingleTimer::updateRemainingTime() {
 }
 
 void SingleTimer::reset() {
+    if (isRunning) timerCheckpoint.clear();
+    expiryScheduler.cancel(EXPIRY_SINGLE_TIMER);
+    expiryArmed = false;
     isRunning = false;
     isFinished = false;
     startTime = 0;
@@ -275,7 +309,10 @@ void SingleTimer::reset() {
 void SingleTimer::pause() {
     if (isRunning) {
         isRunning = false;
-        // Store remaining time for resume
+        // Store remaining time for resume; a paused timer has no deadline
+        timerCheckpoint.clear();
+        expiryScheduler.cancel(EXPIRY_SINGLE_TIMER);
+        expiryArmed = false;
     }
 }
 
@@ -283,6 +320,8 @@ void SingleTimer::resume() {
     if (!isRunning && !isFinished && remainingTime > 0) {
         isRunning = true;
         startTime = millis() - ((duration - remainingTime) * 1000);
+        timerCheckpoint.saveSingle(duration, remainingTime, (uint8_t)setupSoundTrack);
+        armExpiry();
     }
 }
 
@@ -21,6 +21,7 @@ private:
     int setupSeconds;
     int setupSoundTrack;
     int setupState; // 0 for minutes, 1 for seconds, 2 for sound
+    bool expiryArmed; // end fired by ExpiryScheduler instead of polling
     
     // Display variables
     unsigned long lastDisplayUpdate;
@@ -32,6 +33,7 @@ private:
     void drawFinishedScreen();
     String formatTime(unsigned long seconds);
     void updateRemainingTime();
+    void armExpiry();
     
 public:
     // Constructor
@@ -47,6 +49,8 @@ public:
     void updateTimer();
     bool isTimerRunning() const;
     bool isTimerFinished() const;
+    // Resume a timer from a reset checkpoint
+    bool restoreRunning(uint32_t durationSeconds, uint32_t remainingSeconds, uint8_t soundTrack);
     
     // Display methods
     void drawCurrentScreen();
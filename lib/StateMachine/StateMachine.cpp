@@ -4,6 +4,7 @@
 #include "MultiTimer.h"
 #include "AlarmClock.h"
 #include "TimeManager.h"
+#include "TimeZone.h"
 
 StateMachine::StateMachine(Adafruit_SSD1306* displayInstance) 
     : display(displayInstance), currentState(STATE_MAIN_MENU), previousState(STATE_MAIN_MENU),
@@ -24,6 +25,8 @@ void StateMachine::initialize() {
 void StateMachine::update() {
     unsigned long currentTime = millis();
     lastUpdateTime = currentTime;
+    stateEntered = entryPending;
+    entryPending = false;
     
     // Handle state-specific logic
     switch (currentState) {
@@ -223,49 +226,72 @@ void StateMachine::handleSettings() {
 
 void StateMachine::handleTimeDisplay() {
     if (!timeManagerModule || !display) return;
+    if (isStateEntry()) timeManagerModule->invalidateClockFace(); // another screen was drawn
     timeManagerModule->displayCurrentTime();
 }
 
 void StateMachine::handleSettingsTimeZone() {
     if (!timeManagerModule || !display) return;
-    static bool drawn = false;
-    static int tz = 0;
-    if (previousState != STATE_SETTINGS_TIMEZONE) { drawn = false; }
+    // Presets, then a last entry for typing a POSIX TZ string
+    static int selected = 0;
+    const int entries = TIME_ZONE_PRESET_COUNT + 1;
 
     auto draw = [&]() {
+        const char* posix = (selected < TIME_ZONE_PRESET_COUNT) ? TIME_ZONE_PRESETS[selected].posix
+                                                                : timeManagerModule->getTimezone();
+        TimeZone preview;
+        preview.set(posix);
+        uint32_t utc = timeManagerModule->getUnixTimestamp();
+
         display->clearDisplay();
         display->setTextSize(1);
         display->setTextColor(SSD1306_WHITE);
         display->setCursor(0, 0);
         display->println("Set Timezone");
         display->println("============");
-        display->setCursor(0, 24);
-        display->printf("GMT%+d\n", tz);
+        display->setCursor(0, 20);
+        display->print("< ");
+        display->print(selected < TIME_ZONE_PRESET_COUNT ? TIME_ZONE_PRESETS[selected].name : "Custom...");
+        display->print(" >");
+        display->setCursor(0, 32);
+        display->print(TimeZone::formatOffset(preview.offsetAt(utc)));
+        display->print(" ");
+        display->print(preview.abbreviationAt(utc));
+        display->setCursor(0, 44);
+        display->print(posix);
         display->setCursor(0, 56);
-        display->print("X:Adj Btn:Save");
+        display->print("X:Zone Btn:Save");
         display->display();
     };
 
-    if (!drawn) { drawn = true; /* read current from timeManager if available (not exposed) */ }
+    if (isStateEntry()) {
+        selected = TIME_ZONE_PRESET_COUNT;
+        for (int i = 0; i < TIME_ZONE_PRESET_COUNT; ++i) {
+            if (strcmp(TIME_ZONE_PRESETS[i].posix, timeManagerModule->getTimezone()) == 0) selected = i;
+        }
+        draw();
+    }
 
     if (can_move()) {
         int x = get_x_movement();
         if (x != 0) {
-            tz += (x == 1) ? 1 : -1;
-            if (tz < -12) tz = -12;
-            if (tz > 14) tz = 14;
-            timeManagerModule->setTimezone(tz);
+            selected = (selected + (x == 1 ? 1 : entries - 1)) % entries;
             draw();
         }
     }
 
     if (select_button_pressed()) {
-        // Save to preferences
-        Preferences p;
-        if (p.begin("storage", false, "nvs")) {
-            p.putInt("gmt_offset", tz);
-            p.end();
+        bool saved;
+        if (selected < TIME_ZONE_PRESET_COUNT) {
+            saved = timeManagerModule->setTimezone(TIME_ZONE_PRESETS[selected].posix);
+        } else {
+            // e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+            const char* posix = prompt_keyboard();
+            saved = posix && strlen(posix) > 0 && timeManagerModule->setTimezone(posix);
+            if (!saved) Serial.println("Invalid POSIX timezone, keeping the current one");
         }
+        // Alarm times are wall-clock; their UTC fire times moved
+        if (saved && alarmClockModule) alarmClockModule->rescheduleAlarms();
         transitionTo(STATE_SETTINGS_MENU);
     }
 }
@@ -278,6 +304,7 @@ void StateMachine::transitionTo(AppState newState) {
     previousState = currentState;
     currentState = newState;
     stateEnterTime = millis();
+    entryPending = true;
     
     Serial.print("State transition: ");
     Serial.print(previousState);
@@ -293,6 +320,10 @@ AppState StateMachine::getPreviousState() const {
     return previousState;
 }
 
+bool StateMachine::isStateEntry() const {
+    return stateEntered;
+}
+
 void StateMachine::setMenuItems(MenuItem* items, int count) {
     menuItems = items;
     menuItemCount = count;
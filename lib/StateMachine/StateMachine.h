@@ -20,6 +20,7 @@ enum AppState {
     STATE_MULTI_TIMER_SELECT,
     STATE_MULTI_TIMER_RUNNING,
     STATE_MULTI_TIMER_FINISHED,
+    STATE_STOPWATCH,
     STATE_ALARM_SETUP,
     STATE_ALARM_LIST_MENU,
     STATE_ALARM_REMOVE_MENU,
@@ -36,10 +37,13 @@ enum AppState {
     STATE_TIMER_CREATE_EDIT,
     STATE_PHASE_LIST_EDIT,
     STATE_PHASE_EDIT,
+    STATE_REPEAT_EDIT,
     STATE_ALERTZY_KEY_LIST,
     STATE_ALERTZY_KEY_CREATE,
     STATE_CUSTOM_TIMER_START,
-    STATE_WIFI_SETUP
+    STATE_WIFI_SETUP,
+    STATE_SETTINGS_TRANSFER,
+    STATE_SETTINGS_DIAGNOSTICS
 };
 
 // Menu item structure
@@ -69,6 +73,8 @@ private:
     // State transition tracking
     unsigned long stateEnterTime;
     unsigned long lastUpdateTime;
+    bool entryPending = false;
+    bool stateEntered = false;
     
     // Internal methods
     void handleMainMenu();
@@ -101,6 +107,8 @@ public:
     void setState(AppState newState);
     AppState getCurrentState() const;
     AppState getPreviousState() const;
+    // True during the first update() after a state change
+    bool isStateEntry() const;
     
     // Menu management
     void setMenuItems(MenuItem* items, int count);
@@ -0,0 +1,149 @@
+#include "Stopwatch.h"
+#include "configs.h"
+#include <esp_timer.h>
+
+// A press older than this was not the one that got us here
+static const int64_t PRESS_MAX_AGE_US = 250000;
+
+Stopwatch::Stopwatch(Adafruit_SSD1306* displayInstance)
+    : display(displayInstance), running(false), startUs(0), accumulatedUs(0),
+      lapHead(0), lapCount(0), lapNumber(0), lapScroll(0), nextFrameUs(0) {
+    memset(lapSplitUs, 0, sizeof(lapSplitUs));
+}
+
+// Use the ISR timestamp of the press so loop latency does not skew the time
+int64_t Stopwatch::pressTime(int64_t nowUs) {
+    int64_t pressUs;
+    if (take_select_press_time(&pressUs) && pressUs <= nowUs && nowUs - pressUs < PRESS_MAX_AGE_US) return pressUs;
+    return nowUs;
+}
+
+int64_t Stopwatch::elapsedAt(int64_t nowUs) const {
+    if (!running) return accumulatedUs;
+    return accumulatedUs + (nowUs - startUs);
+}
+
+// Split of the lap captured `age` laps ago (0 = newest)
+int64_t Stopwatch::lapSplit(int age) const {
+    int slot = (lapHead - 1 - age + STOPWATCH_MAX_LAPS) % STOPWATCH_MAX_LAPS;
+    return lapSplitUs[slot];
+}
+
+void Stopwatch::handleButton() {
+    int64_t now = esp_timer_get_time();
+    int64_t at = pressTime(now);
+    if (running) {
+        lapSplitUs[lapHead] = elapsedAt(at);
+        lapHead = (lapHead + 1) % STOPWATCH_MAX_LAPS;
+        if (lapCount < STOPWATCH_MAX_LAPS) lapCount++;
+        lapNumber++;
+        lapScroll = 0;
+    } else if (accumulatedUs > 0) {
+        reset();
+    } else {
+        startUs = at;
+        running = true;
+    }
+    updateDisplay(true);
+}
+
+void Stopwatch::toggleRunning() {
+    int64_t now = esp_timer_get_time();
+    if (running) {
+        accumulatedUs = elapsedAt(now);
+        running = false;
+    } else if (accumulatedUs > 0) {
+        startUs = now;
+        running = true;
+    }
+    updateDisplay(true);
+}
+
+void Stopwatch::scrollLaps(int direction) {
+    // Two laps fit on screen below the main time
+    int maxScroll = (lapCount > 2) ? lapCount - 2 : 0;
+    int s = (int)lapScroll + direction;
+    if (s < 0) s = 0;
+    if (s > maxScroll) s = maxScroll;
+    lapScroll = (uint8_t)s;
+    updateDisplay(true);
+}
+
+void Stopwatch::updateDisplay(bool forceRedraw) {
+    int64_t now = esp_timer_get_time();
+    if (!forceRedraw && now < nextFrameUs) return;
+    // Advance on a fixed grid; resync if we fell more than a frame behind
+    nextFrameUs += STOPWATCH_FRAME_US;
+    if (nextFrameUs <= now) nextFrameUs = now + STOPWATCH_FRAME_US;
+    drawScreen(now);
+}
+
+void Stopwatch::formatTime(char* out, size_t len, int64_t us) {
+    uint32_t hundredths = (uint32_t)((us / 10000) % 100);
+    uint32_t totalSeconds = (uint32_t)(us / 1000000);
+    uint32_t hours = totalSeconds / 3600;
+    uint32_t minutes = (totalSeconds / 60) % 60;
+    uint32_t seconds = totalSeconds % 60;
+    if (hours > 0) snprintf(out, len, "%lu:%02lu:%02lu.%02lu", (unsigned long)hours, (unsigned long)minutes, (unsigned long)seconds, (unsigned long)hundredths);
+    else snprintf(out, len, "%02lu:%02lu.%02lu", (unsigned long)minutes, (unsigned long)seconds, (unsigned long)hundredths);
+}
+
+void Stopwatch::drawScreen(int64_t nowUs) {
+    if (!display) return;
+    char buf[16];
+
+    display->clearDisplay();
+    display->setTextColor(SSD1306_WHITE);
+    display->setTextSize(1);
+    display->setCursor(0, 0);
+    display->print("Stopwatch");
+    if (!running && accumulatedUs > 0) display->print("  STOPPED");
+
+    int64_t elapsed = elapsedAt(nowUs);
+    formatTime(buf, sizeof(buf), elapsed);
+    display->setTextSize(elapsed >= 36000000000LL ? 1 : 2); // 10h+ no longer fits at size 2
+    display->setCursor(4, 14);
+    display->print(buf);
+
+    // Newest laps: number, lap time, split
+    display->setTextSize(1);
+    for (int row = 0; row < 2 && lapScroll + row < lapCount; ++row) {
+        int age = lapScroll + row;
+        int64_t split = lapSplit(age);
+        int64_t prev = (age + 1 < lapCount) ? lapSplit(age + 1) : 0;
+        // The lap before the oldest kept one was overwritten; only its split survives
+        bool lapKnown = (age + 1 < lapCount) || lapNumber <= STOPWATCH_MAX_LAPS;
+        display->setCursor(0, 34 + row * 10);
+        display->print("L"); display->print(lapNumber - age);
+        display->setCursor(24, 34 + row * 10);
+        if (lapKnown) { formatTime(buf, sizeof(buf), split - prev); display->print(buf); }
+        else display->print("--");
+        display->setCursor(78, 34 + row * 10);
+        formatTime(buf, sizeof(buf), split);
+        display->print(buf);
+    }
+
+    display->setCursor(0, 56);
+    if (running) display->print("Btn:Lap >Stop <Back");
+    else if (accumulatedUs > 0) display->print("Btn:Clear >Go <Back");
+    else display->print("Btn:Start <Back");
+    display->display();
+}
+
+void Stopwatch::reset() {
+    running = false;
+    startUs = 0;
+    accumulatedUs = 0;
+    lapHead = 0;
+    lapCount = 0;
+    lapNumber = 0;
+    lapScroll = 0;
+}
+
+bool Stopwatch::isRunning() const { return running; }
+
+int64_t Stopwatch::getElapsedUs() const {
+    return elapsedAt(esp_timer_get_time());
+}
+
+int Stopwatch::getLapCount() const { return lapNumber; }
@@ -0,0 +1,57 @@
+#ifndef STOPWATCH_H
+#define STOPWATCH_H
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include "KeyInput.h"
+
+// Laps kept for display; older laps are overwritten (the lap number keeps counting)
+#define STOPWATCH_MAX_LAPS 16
+// Frame period while the stopwatch screen is visible (~30 fps)
+#define STOPWATCH_FRAME_US 33333
+
+// Count-up stopwatch on the esp_timer microsecond clock. Elapsed time is
+// derived from timestamps, never accumulated per frame, so it stays exact
+// whether or not the screen is being drawn.
+class Stopwatch {
+private:
+    Adafruit_SSD1306* display;
+
+    bool running;
+    int64_t startUs;       // esp_timer time of the last start/resume
+    int64_t accumulatedUs; // elapsed time banked by earlier stops
+
+    // Lap ring buffer: split (elapsed at capture) for each lap
+    int64_t lapSplitUs[STOPWATCH_MAX_LAPS];
+    uint8_t lapHead;    // slot the next lap is written to
+    uint8_t lapCount;   // valid laps in the buffer
+    uint16_t lapNumber; // laps captured since reset
+    uint8_t lapScroll;  // laps scrolled back from the newest
+
+    int64_t nextFrameUs;
+
+    int64_t pressTime(int64_t nowUs);
+    int64_t elapsedAt(int64_t nowUs) const;
+    int64_t lapSplit(int age) const;
+    static void formatTime(char* out, size_t len, int64_t us);
+    void drawScreen(int64_t nowUs);
+
+public:
+    Stopwatch(Adafruit_SSD1306* displayInstance);
+
+    // Select button: start when cleared, lap while running, clear when stopped
+    void handleButton();
+    // X right: stop / resume
+    void toggleRunning();
+    // Y: scroll the lap list
+    void scrollLaps(int direction);
+    // Draw at a steady frame rate; call every loop while the screen is shown
+    void updateDisplay(bool forceRedraw = false);
+
+    void reset();
+    bool isRunning() const;
+    int64_t getElapsedUs() const;
+    int getLapCount() const;
+};
+
+#endif // STOPWATCH_H
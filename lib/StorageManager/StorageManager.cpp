@@ -1,177 +1,1604 @@
 #include "StorageManager.h"
 #include <ArduinoJson.h>
+#include <esp_system.h>
 
-StorageManager::StorageManager(Preferences* prefs) : preferences(prefs) {
-	if (!preferences) return;
-	if (!preferences->begin("storage", false, "nvs")) {  // true = read-only
-		Serial.println("Failed to open storage");
+// Each entity lives under its own keys and the collection order is a manifest
+// of slots, so an edit rewrites one entity, and an add or remove also the
+// short manifest. Every entity and manifest is kept as an A and a B copy,
+// "<prefix>.<slot>a.0", ... and "<prefix>.idxa.0", ...; the copy a seq
+// picks alternates with its parity, so a write never touches the newest copy.
+struct CollectionKeys {
+	const char* name;
+	const char* prefix;
+	RecordKind record;
+	// Older whole-collection layouts, only read to migrate them: chunk keys
+	// "<chunked>.0", ..., then one blob, then JSON
+	const char* chunked;
+	const char* blob;
+	const char* legacy;
+};
+
+static const CollectionKeys COLLECTION_KEYS[] = {
+	{"alarms", "al", RECORD_ALARMS, "alm", "alarms_bin", "alarms"},               // MODEL_ALARM
+	{"accounts", "ac", RECORD_ACCOUNTS, "acc", "accounts_bin", "alertzy_accounts"}, // MODEL_ACCOUNT
+	{"routines", "rt", RECORD_ROUTINES, "tmr", "timers_bin", "custom_timers"},      // MODEL_ROUTINE
+};
+
+#define ROUTINES_SCHEMA 1
+#define ALARMS_SCHEMA 1
+#define ACCOUNTS_SCHEMA 1
+#define MANIFEST_SCHEMA 3 // 2: routine manifests carry the routine index; 3: and each body's seq
+static const uint8_t ENTITY_SCHEMAS[] = {ALARMS_SCHEMA, ACCOUNTS_SCHEMA, ROUTINES_SCHEMA}; // by ModelKind
+
+// Key names are built into STORAGE_KEY_MAX bytes; false if one would not
+// fit, and a key cut short is never read or written
+static bool chunkKey(char* out, const char* prefix, uint16_t index) {
+	int len = snprintf(out, STORAGE_KEY_MAX, "%s.%u", prefix, (unsigned)index);
+	return len > 0 && len < STORAGE_KEY_MAX;
+}
+
+static bool entityPrefix(char* out, ModelKind kind, uint16_t slot) {
+	return chunkKey(out, COLLECTION_KEYS[kind].prefix, slot);
+}
+
+static void manifestPrefix(char* out, ModelKind kind) {
+	snprintf(out, STORAGE_KEY_MAX, "%s.idx", COLLECTION_KEYS[kind].prefix);
+}
+
+// Key prefix of the copy of record base that holds seq: odd seqs in B
+static bool copyKey(char* out, const char* base, uint32_t seq) {
+	size_t len = strlen(base);
+	if (len + 1 >= STORAGE_KEY_MAX) return false;
+	memcpy(out, base, len);
+	out[len] = (seq & 1) ? 'b' : 'a';
+	out[len + 1] = '\0';
+	return true;
+}
+
+// Feeds a RecordReader one chunk key at a time, straight into its buffer;
+// reads the layouts stored without copies.
+// The namespace must stay open while the reader runs.
+class NvsChunkSource : public RecordSource {
+private:
+	Preferences* preferences;
+	const char* prefix;
+	uint16_t next;
+	size_t total;
+
+public:
+	NvsChunkSource(Preferences* prefs, const char* keyPrefix) : preferences(prefs), prefix(keyPrefix), next(0), total(0) {
+		char key[STORAGE_KEY_MAX];
+		for (uint16_t i = 0;; ++i) {
+			if (!chunkKey(key, prefix, i)) break;
+			size_t len = preferences->isKey(key) ? preferences->getBytesLength(key) : 0;
+			if (len == 0) break;
+			total += len;
+		}
+	}
+
+	size_t read(uint8_t* buffer, size_t size) override {
+		char key[STORAGE_KEY_MAX];
+		if (!chunkKey(key, prefix, next) || !preferences->isKey(key)) return 0;
+		size_t len = preferences->getBytesLength(key);
+		if (len == 0 || len > size) return 0;
+		if (preferences->getBytes(key, buffer, len) != len) return 0;
+		next++;
+		return len;
+	}
+
+	size_t totalSize() const override {
+		return total;
+	}
+};
+
+// One stored copy of an A/B record. Chunk 0 is read up front for its frame;
+// the payload then streams to a RecordReader with the CRC taken on the way,
+// so the copy is checked and decoded in one pass.
+class NvsCopySource : public RecordSource {
+private:
+	Preferences* preferences;
+	char key[STORAGE_KEY_MAX];
+	uint8_t first[RECORD_CHUNK_SIZE];
+	size_t firstLength;
+	RecordFrame frame;
+	bool framed;
+	uint16_t next;
+	size_t delivered;
+	uint32_t crc;
+
+public:
+	NvsCopySource(Preferences* prefs, const char* base, uint32_t seq)
+		: preferences(prefs), firstLength(0), framed(false), next(0), delivered(0), crc(0) {
+		char chunk[STORAGE_KEY_MAX];
+		bool named = copyKey(key, base, seq) && chunkKey(chunk, key, 0);
+		size_t len = named && preferences->isKey(chunk) ? preferences->getBytesLength(chunk) : 0;
+		if (len > 0 && len <= sizeof(first) && preferences->getBytes(chunk, first, len) == len) firstLength = len;
+		framed = readFrame(first, firstLength, frame);
+		if (framed) crc = recordCrc32(0, first, 8);
+	}
+
+	bool exists() const {
+		return framed;
+	}
+
+	uint32_t seq() const {
+		return frame.seq;
+	}
+
+	const char* name() const {
+		return key;
+	}
+
+	size_t read(uint8_t* buffer, size_t size) override {
+		if (!framed || delivered >= frame.length) return 0;
+		size_t len;
+		if (next == 0) {
+			len = firstLength - RECORD_FRAME_SIZE;
+			if (len > size) len = size;
+			memmove(buffer, first + RECORD_FRAME_SIZE, len);
+		} else {
+			char chunk[STORAGE_KEY_MAX];
+			len = chunkKey(chunk, key, next) && preferences->isKey(chunk) ? preferences->getBytesLength(chunk) : 0;
+			if (len == 0 || len > size || preferences->getBytes(chunk, buffer, len) != len) return 0;
+		}
+		next++;
+		if (len > frame.length - delivered) len = frame.length - delivered;
+		crc = recordCrc32(crc, buffer, len);
+		delivered += len;
+		return len;
+	}
+
+	size_t totalSize() const override {
+		return framed ? frame.length : 0;
+	}
+
+	// Streams whatever the decoder left unread, then checks length and CRC
+	bool intact() {
+		while (read(first, sizeof(first)) > 0) {
+		}
+		return framed && delivered == frame.length && crc == frame.crc;
+	}
+};
+
+// True if key is one of the two copies of record base
+static bool isCopyOf(const char* key, const char* base) {
+	size_t len = strlen(base);
+	return strncmp(key, base, len) == 0 && (key[len] == 'a' || key[len] == 'b') && key[len + 1] == '\0';
+}
+
+// Only migrated legacy data has strings longer than a reader keeps; say so
+// once per record instead of letting the next load shorten them silently
+static void logCutStrings(const RecordWriter& out, const char* what) {
+	if (out.stringsCut() == 0) return;
+	Serial.printf("StorageManager: %u %s string(s) cut to %u bytes\n", (unsigned)out.stringsCut(), what,
+		(unsigned)(RECORD_MAX_STRING - 1));
+}
+
+// One key written (bytes) or removed (0), for the write stats and telemetry
+void StorageManager::countKey(const char* key, size_t bytes) {
+	nvs->noteWrite(STORAGE_NAMESPACE, key, bytes);
+	stats.lastBytes += bytes;
+	stats.lastKeys++;
+	stats.totalBytes += bytes;
+	stats.totalKeys++;
+}
+
+static uint16_t modelId(const ModelRepository& models, ModelKind kind, int index) {
+	switch (kind) {
+		case MODEL_ALARM: return models.alarmId(index);
+		case MODEL_ACCOUNT: return models.accountId(index);
+		default: return models.routineId(index);
+	}
+}
+
+static int modelIndex(const ModelRepository& models, ModelKind kind, uint16_t id) {
+	switch (kind) {
+		case MODEL_ALARM: return models.alarmIndex(id);
+		case MODEL_ACCOUNT: return models.accountIndex(id);
+		default: return models.routineIndex(id);
+	}
+}
+
+static size_t modelCount(const ModelRepository& models, ModelKind kind) {
+	switch (kind) {
+		case MODEL_ALARM: return models.getAlarms().size();
+		case MODEL_ACCOUNT: return models.getAccounts().size();
+		default: return models.getRoutines().size();
+	}
+}
+
+// Level with the Arduino loop task, which never blocks, so the flush gets time
+// slices; below the expiry alert task
+#define STORAGE_FLUSH_TASK_PRIORITY 1
+#define STORAGE_FLUSH_TASK_STACK 4096
+
+// Holds the recursive state lock for a scope; a no-op before begin()
+class ScopedLock {
+private:
+	SemaphoreHandle_t lock;
+
+public:
+	explicit ScopedLock(SemaphoreHandle_t handle) : lock(handle) {
+		if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+	}
+	~ScopedLock() {
+		if (lock) xSemaphoreGiveRecursive(lock);
+	}
+};
+
+// Flushed from the shutdown hook, which takes no argument
+static StorageManager* shutdownOwner = nullptr;
+
+static void flushOnShutdown() {
+	if (shutdownOwner) shutdownOwner->flush();
+}
+
+StorageManager::StorageManager(NvsService* nvsService)
+	: nvs(nvsService), preferences(nullptr), flushRequested(false), firstChangeMs(0), lastChangeMs(0),
+	  batching(false), openFailed(false), openFailedMs(0), stateLock(nullptr), flushTask(nullptr) {
+	memset(&stats, 0, sizeof(stats));
+	memset(&flushStats, 0, sizeof(flushStats));
+	for (auto& m : manifests) {
+		m.seq = 0;
+		m.awaitingIds = false;
+	}
+	for (bool& dirty : manifestDirty) dirty = false;
+}
+
+bool StorageManager::begin() {
+	if (flushTask) return true;
+	stateLock = xSemaphoreCreateRecursiveMutex();
+	if (!stateLock) return false;
+	if (xTaskCreate(&StorageManager::flushTaskMain, "storage_flush", STORAGE_FLUSH_TASK_STACK, this,
+					STORAGE_FLUSH_TASK_PRIORITY, &flushTask) != pdPASS) {
+		Serial.println("StorageManager: flush task start failed; writing through");
+		flushTask = nullptr;
+		return false;
+	}
+	// esp_restart() and friends run this; a brownout gives no warning, so
+	// STORAGE_FLUSH_MAX_DELAY_MS bounds what it can lose
+	shutdownOwner = this;
+	esp_register_shutdown_handler(&flushOnShutdown);
+	return true;
+}
+
+// While batching, only what a flush may write now counts
+bool StorageManager::isDirty() const {
+	if (batching) {
+		for (const auto& w : pending) {
+			if (w.type != PENDING_ERASE) return true;
+		}
+		return false;
+	}
+	return !pending.empty() || manifestDirty[MODEL_ALARM] || manifestDirty[MODEL_ACCOUNT] ||
+		manifestDirty[MODEL_ROUTINE];
+}
+
+// Caller holds stateLock
+void StorageManager::queue(const char* key, PendingType type, std::vector<uint8_t>&& data) {
+	uint32_t now = millis();
+	if (!isDirty()) firstChangeMs = now;
+	lastChangeMs = now;
+	flushStats.queued++;
+	for (auto& w : pending) {
+		if (strcmp(w.key, key) != 0) continue;
+		w.type = type;
+		w.data = std::move(data);
+		flushStats.writesAvoided++;
+		return;
+	}
+	PendingWrite w;
+	strncpy(w.key, key, sizeof(w.key) - 1);
+	w.key[sizeof(w.key) - 1] = '\0';
+	w.type = type;
+	w.data = std::move(data);
+	pending.push_back(std::move(w));
+}
+
+// Encoded now, while the routine index it summarizes is at hand. A manifest
+// still waiting keeps its seq; otherwise the next one goes to the other copy.
+void StorageManager::queueManifest(ModelKind kind, const RoutineIndex* routines) {
+	uint32_t now = millis();
+	if (!isDirty()) firstChangeMs = now;
+	lastChangeMs = now;
+	flushStats.queued++;
+	if (manifestDirty[kind]) flushStats.writesAvoided++;
+	else manifests[kind].seq++;
+	manifestDirty[kind] = true;
+	manifestData[kind].clear();
+	encodeManifest(manifestData[kind], kind, routines);
+	frameRecord(manifestData[kind], manifests[kind].seq);
+}
+
+// Queues a copy of the entity in slot, whose newest copy has seq current (0
+// for none), and returns the copy's seq. A copy still waiting is replaced in
+// place; otherwise it goes to the other key, so the newest copy on flash
+// stays as the fallback until the new one is whole.
+uint32_t StorageManager::queueCopy(ModelKind kind, uint16_t slot, uint32_t current, std::vector<uint8_t>&& blob) {
+	char base[STORAGE_KEY_MAX];
+	char key[STORAGE_KEY_MAX];
+	if (!entityPrefix(base, kind, slot) || !copyKey(key, base, current)) {
+		Serial.printf("StorageManager: no key for slot %u; not saved\n", (unsigned)slot);
+		return current;
+	}
+	bool waiting = false;
+	for (const auto& w : pending) {
+		if (w.type == PENDING_CHUNKS && strcmp(w.key, key) == 0) waiting = true;
+	}
+	uint32_t seq = waiting && current > 0 ? current : current + 1;
+	unqueue(base, PENDING_ERASE);
+	frameRecord(blob, seq);
+	copyKey(key, base, seq);
+	queue(key, PENDING_CHUNKS, std::move(blob));
+	return seq;
+}
+
+void StorageManager::queueErase(const char* base) {
+	unqueue(base, PENDING_CHUNKS);
+	queue(base, PENDING_ERASE, std::vector<uint8_t>());
+}
+
+// Drops what is queued for record base: its erase, or a copy of it
+void StorageManager::unqueue(const char* base, PendingType type) {
+	for (size_t i = 0; i < pending.size(); ++i) {
+		const PendingWrite& w = pending[i];
+		if (w.type != type) continue;
+		if (type == PENDING_ERASE ? strcmp(w.key, base) != 0 : !isCopyOf(w.key, base)) continue;
+		pending.erase(pending.begin() + i);
+		flushStats.writesAvoided++;
+		return;
+	}
+}
+
+bool StorageManager::erasePending(ModelKind kind, uint16_t slot) const {
+	char prefix[STORAGE_KEY_MAX];
+	entityPrefix(prefix, kind, slot);
+	for (const auto& w : pending) {
+		if (w.type == PENDING_ERASE && strcmp(w.key, prefix) == 0) return true;
+	}
+	return false;
+}
+
+// A whole-collection save into slots 0..count-1 supersedes what was queued
+// for that collection; queued erases of slots it did not reuse are done here,
+// and seqs step back over copies that will now never be written. Caller
+// holds both locks with the namespace open.
+void StorageManager::dropPending(ModelKind kind, size_t count) {
+	Manifest& m = manifests[kind];
+	const char* prefix = COLLECTION_KEYS[kind].prefix;
+	size_t len = strlen(prefix);
+	size_t kept = 0;
+	for (size_t i = 0; i < pending.size(); ++i) {
+		PendingWrite& w = pending[i];
+		bool ours = strncmp(w.key, prefix, len) == 0 && w.key[len] == '.' && isdigit(w.key[len + 1]);
+		if (!ours) {
+			pending[kept++] = std::move(w);
+		} else if (w.type == PENDING_ERASE) {
+			if ((size_t)atoi(w.key + len + 1) >= count) removeCopies(w.key);
+		} else if (w.type == PENDING_CHUNKS) {
+			uint16_t slot = atoi(w.key + len + 1);
+			for (size_t p = 0; p < m.slots.size(); ++p) {
+				if (m.slots[p] == slot && m.seqs[p] > 0) m.seqs[p]--;
+			}
+		}
+	}
+	pending.resize(kept);
+	if (manifestDirty[kind] && m.seq > 0) m.seq--;
+	manifestDirty[kind] = false;
+	manifestData[kind].clear();
+}
+
+// 0 when a flush is due, UINT32_MAX when there is nothing to write
+uint32_t StorageManager::msUntilFlush() {
+	ScopedLock state(stateLock);
+	uint32_t wait = UINT32_MAX;
+	if (isDirty()) {
+		uint32_t now = millis();
+		uint32_t quiet = now - lastChangeMs;
+		uint32_t age = now - firstChangeMs;
+		uint32_t quietLeft = quiet >= STORAGE_FLUSH_QUIET_MS ? 0 : STORAGE_FLUSH_QUIET_MS - quiet;
+		uint32_t ageLeft = age >= STORAGE_FLUSH_MAX_DELAY_MS ? 0 : STORAGE_FLUSH_MAX_DELAY_MS - age;
+		wait = flushRequested ? 0 : (quietLeft < ageLeft ? quietLeft : ageLeft);
+		// A namespace that would not open is not retried in a tight loop
+		uint32_t sinceFailure = now - openFailedMs;
+		if (openFailed && sinceFailure < STORAGE_FLUSH_QUIET_MS && wait < STORAGE_FLUSH_QUIET_MS - sinceFailure) {
+			wait = STORAGE_FLUSH_QUIET_MS - sinceFailure;
+		}
+	}
+	return wait;
+}
+
+// Without the flush task every change is written at once, as before
+void StorageManager::wake() {
+	if (flushTask) xTaskNotifyGive(flushTask);
+	else flush();
+}
+
+void StorageManager::flushTaskMain(void* arg) {
+	StorageManager* self = static_cast<StorageManager*>(arg);
+	for (;;) {
+		uint32_t wait = self->msUntilFlush();
+		if (wait == 0) {
+			self->flush();
+			continue;
+		}
+		// Any new change wakes us to recompute the deadline
+		ulTaskNotifyTake(pdTRUE, wait == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(wait));
+	}
+}
+
+void StorageManager::requestFlush() {
+	bool due;
+	{
+		ScopedLock state(stateLock);
+		flushRequested = due = isDirty();
+	}
+	if (due) wake();
+}
+
+// The namespace is held from the snapshot to the last write, so flushes and
+// whole-collection saves reach flash in the order they were taken
+void StorageManager::flush() {
+	if (!open("flush")) {
+		// The queue stays for the next attempt, STORAGE_FLUSH_QUIET_MS from now
+		ScopedLock state(stateLock);
+		openFailed = true;
+		openFailedMs = millis();
+		flushRequested = false;
+		return;
+	}
+	std::vector<PendingWrite> batch;
+	PendingWrite manifestWrites[3];
+	bool manifestQueued[3];
+	bool any;
+	uint32_t firstMs;
+	{
+		ScopedLock state(stateLock);
+		any = isDirty();
+		if (batching) {
+			std::vector<PendingWrite> erases;
+			for (auto& w : pending) {
+				if (w.type == PENDING_ERASE) erases.push_back(std::move(w));
+				else batch.push_back(std::move(w));
+			}
+			pending.swap(erases);
+		} else {
+			batch.swap(pending);
+		}
+		for (int k = 0; k < 3; ++k) {
+			manifestQueued[k] = manifestDirty[k] && !batching;
+			if (!manifestQueued[k]) continue;
+			char base[STORAGE_KEY_MAX];
+			manifestPrefix(base, (ModelKind)k);
+			manifestQueued[k] = copyKey(manifestWrites[k].key, base, manifests[k].seq);
+			manifestWrites[k].data.swap(manifestData[k]);
+			manifestDirty[k] = false;
+		}
+		firstMs = firstChangeMs;
+		flushRequested = false;
+		openFailed = false;
+	}
+	if (!any) {
+		close();
+		return;
+	}
+
+	uint32_t startUs = micros();
+	beginWrite("flush");
+	// Entities before the manifests that list them, erases after the
+	// manifests that stopped listing them
+	for (const auto& w : batch) {
+		if (w.type == PENDING_CHUNKS) {
+			putCopy(w.key, w.data);
+		} else if (w.type == PENDING_STRING) {
+			if (preferences->putString(w.key, (const char*)w.data.data())) countKey(w.key, w.data.size());
+		}
+	}
+	for (int k = 0; k < 3; ++k) {
+		if (manifestQueued[k]) putCopy(manifestWrites[k].key, manifestWrites[k].data);
+	}
+	for (const auto& w : batch) {
+		if (w.type == PENDING_ERASE) removeCopies(w.key);
+	}
+	endWrite("flush");
+
+	uint32_t elapsedUs = micros() - startUs;
+	flushStats.flushes++;
+	flushStats.lastFlushUs = elapsedUs;
+	if (elapsedUs > flushStats.maxFlushUs) flushStats.maxFlushUs = elapsedUs;
+	flushStats.lastDelayMs = millis() - firstMs;
+	close();
+	Serial.printf("StorageManager: flushed %lu ms after the first change, in %lu us; %lu of %lu queued writes avoided\n",
+		(unsigned long)flushStats.lastDelayMs, (unsigned long)elapsedUs, (unsigned long)flushStats.writesAvoided,
+		(unsigned long)flushStats.queued);
+}
+
+void StorageManager::beginBatch() {
+	ScopedLock state(stateLock);
+	batching = true;
+}
+
+void StorageManager::commitBatch() {
+	{
+		ScopedLock state(stateLock);
+		batching = false;
+	}
+	flush();
+}
+
+// Borrows the shared "storage" handle; nests, and pairs with close()
+bool StorageManager::open(const char* what) {
+	preferences = nvs ? nvs->acquire(STORAGE_NAMESPACE) : nullptr;
+	if (!preferences) Serial.printf("StorageManager: failed to open preferences (%s)\n", what);
+	return preferences != nullptr;
+}
+
+void StorageManager::close() {
+	nvs->release();
+}
+
+bool StorageManager::beginWrite(const char* what) {
+	stats.lastBytes = 0;
+	stats.lastKeys = 0;
+	if (!open(what)) return false;
+	stats.operations++;
+	return true;
+}
+
+void StorageManager::endWrite(const char* what) {
+	close();
+	Serial.printf("StorageManager: %s wrote %u bytes in %u keys\n", what, (unsigned)stats.lastBytes,
+		(unsigned)stats.lastKeys);
+}
+
+bool StorageManager::putChunk(const char* prefix, uint16_t index, const std::vector<uint8_t>& blob) {
+	char key[STORAGE_KEY_MAX];
+	if (!chunkKey(key, prefix, index)) {
+		Serial.printf("StorageManager: key too long (%s.%u); not written\n", prefix, (unsigned)index);
+		return false;
+	}
+	size_t offset = (size_t)index * RECORD_CHUNK_SIZE;
+	size_t len = blob.size() - offset < RECORD_CHUNK_SIZE ? blob.size() - offset : RECORD_CHUNK_SIZE;
+	if (preferences->putBytes(key, blob.data() + offset, len) != len) {
+		Serial.printf("StorageManager: write failed (%s)\n", key);
+		return false;
+	}
+	countKey(key, len);
+	return true;
+}
+
+// Stores a framed blob as chunk keys: the chunks after the first, then drops
+// chunks left over from a longer save, then chunk 0. Until chunk 0 lands the
+// old frame stays, and its CRC no longer matches what follows it.
+bool StorageManager::putChunks(const char* prefix, const std::vector<uint8_t>& blob) {
+	uint16_t count = (blob.size() + RECORD_CHUNK_SIZE - 1) / RECORD_CHUNK_SIZE;
+	for (uint16_t index = 1; index < count; ++index) {
+		if (!putChunk(prefix, index, blob)) return false;
+	}
+	removeChunks(prefix, count);
+	return putChunk(prefix, 0, blob);
+}
+
+void StorageManager::removeChunks(const char* prefix, uint16_t first) {
+	char key[STORAGE_KEY_MAX];
+	for (uint16_t index = first;; ++index) {
+		if (!chunkKey(key, prefix, index) || !preferences->isKey(key)) break;
+		preferences->remove(key);
+		countKey(key, 0);
+	}
+}
+
+// Writes one copy of an A/B record. Seq 1 starts the record afresh, so the
+// other copy is removed first: an entity that used the slot before may have
+// left one there with a higher seq.
+bool StorageManager::putCopy(const char* key, const std::vector<uint8_t>& blob) {
+	RecordFrame frame;
+	if (!readFrame(blob.data(), blob.size(), frame)) return false;
+	if (frame.seq == 1) {
+		char other[STORAGE_KEY_MAX];
+		strcpy(other, key);
+		other[strlen(other) - 1] = 'a';
+		removeChunks(other, 0);
+	}
+	return putChunks(key, blob);
+}
+
+// Both copies; each loses its chunk 0 first, and a copy without one is gone
+void StorageManager::removeCopies(const char* base) {
+	char key[STORAGE_KEY_MAX];
+	for (uint32_t seq = 0; seq < 2; ++seq) {
+		if (copyKey(key, base, seq)) removeChunks(key, 0);
+	}
+}
+
+// Seq of the newest copy in slot per the manifest; 0 for a slot not in use
+uint32_t StorageManager::storedSeq(ModelKind kind, uint16_t slot) const {
+	const Manifest& m = manifests[kind];
+	for (size_t i = 0; i < m.slots.size(); ++i) {
+		if (m.slots[i] == slot) return m.seqs[i];
+	}
+	return 0;
+}
+
+// Frames blob as the next copy of slot, for a whole-collection save
+bool StorageManager::putEntity(ModelKind kind, uint16_t slot, std::vector<uint8_t>& blob) {
+	char base[STORAGE_KEY_MAX];
+	char key[STORAGE_KEY_MAX];
+	uint32_t seq = storedSeq(kind, slot) + 1;
+	frameRecord(blob, seq);
+	if (!entityPrefix(base, kind, slot) || !copyKey(key, base, seq)) return false;
+	return putCopy(key, blob);
+}
+
+// A routine manifest follows the slots with one summary record per routine,
+// from routines (in manifest order), so boot needs no routine body
+void StorageManager::encodeManifest(std::vector<uint8_t>& blob, ModelKind kind, const RoutineIndex* routines) const {
+	const Manifest& m = manifests[kind];
+	bool summaries = kind == MODEL_ROUTINE && routines && routines->size() == m.slots.size();
+	blob.reserve(8 + m.slots.size() * (summaries ? 16 : 2));
+	RecordWriter out(blob);
+	out.writeHeader(RECORD_MANIFEST, MANIFEST_SCHEMA);
+	out.writeByte(COLLECTION_KEYS[kind].record);
+	out.writeVarint(m.slots.size());
+	for (uint16_t slot : m.slots) out.writeVarint(slot);
+	if (!summaries) return;
+	for (size_t i = 0; i < m.slots.size(); ++i) {
+		out.beginRecord();
+		out.writeString(routines->name(i));
+		out.writeVarint(routines->phaseCount(i));
+		out.writeVarint(routines->totalDurationSeconds(i));
+		out.writeVarint(m.seqs[i]);
+		out.endRecord();
+	}
+	logCutStrings(out, "routine index");
+}
+
+bool StorageManager::putManifest(ModelKind kind, const RoutineIndex* routines) {
+	Manifest& m = manifests[kind];
+	std::vector<uint8_t> blob;
+	encodeManifest(blob, kind, routines);
+	frameRecord(blob, m.seq + 1);
+	char base[STORAGE_KEY_MAX];
+	char key[STORAGE_KEY_MAX];
+	manifestPrefix(base, kind);
+	if (!copyKey(key, base, m.seq + 1) || !putCopy(key, blob)) return false;
+	m.seq++;
+	return true;
+}
+
+// Decodes the current copy of the A/B record base into out: the copy with
+// the higher seq, or the other one if that fails its CRC (a write cut short),
+// so normally only one copy is decoded. seq gets the copy's seq; if neither
+// is intact it gets the newest seq, and 0 if there is no copy at all.
+bool StorageManager::readCopy(const char* base, CopyDecoder decode, void* out, uint32_t* seq) {
+	NvsCopySource a(preferences, base, 0);
+	NvsCopySource b(preferences, base, 1);
+	NvsCopySource* order[2] = {&a, &b};
+	if (!a.exists() || (b.exists() && b.seq() > a.seq())) {
+		order[0] = &b;
+		order[1] = &a;
+	}
+	*seq = order[0]->exists() ? order[0]->seq() : 0;
+	for (NvsCopySource* copy : order) {
+		if (!copy->exists()) continue;
+		bool decoded = decode(*copy, out);
+		if (copy->intact() && decoded) {
+			*seq = copy->seq();
+			return true;
+		}
+		Serial.printf("StorageManager: damaged copy (%s)\n", copy->name());
+	}
+	return false;
+}
+
+// What decodeManifest fills; summaries only for a routine manifest
+struct ManifestContents {
+	RecordKind record;
+	std::vector<uint16_t> slots;
+	std::vector<uint32_t> seqs;
+	RoutineIndex* summaries;
+};
+
+bool StorageManager::decodeManifest(RecordSource& source, void* out) {
+	ManifestContents& contents = *static_cast<ManifestContents*>(out);
+	contents.slots.clear();
+	contents.seqs.clear();
+	if (contents.summaries) contents.summaries->clear();
+	RecordReader in(source);
+	uint8_t version;
+	if (!in.readHeader(RECORD_MANIFEST, &version) || in.readByte() != contents.record) return false;
+	uint32_t count = in.readVarint();
+	if (!in.ok() || count > in.totalSize()) return false;
+	contents.slots.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t slot = in.readVarint();
+		if (!in.ok() || slot > 0xFFFF) return false;
+		contents.slots.push_back(slot);
+	}
+	if (!contents.summaries || version < 3 || count == 0) return true;
+	RoutineIndex& summaries = *contents.summaries;
+	char name[RECORD_MAX_STRING];
+	summaries.reserve(count, count * 12);
+	contents.seqs.reserve(count);
+	for (uint32_t i = 0; i < count && in.beginRecord(); ++i) {
+		in.readString(name, sizeof(name));
+		uint32_t phases = in.readVarint();
+		uint32_t seconds = in.readVarint();
+		uint32_t seq = in.readVarint();
+		in.endRecord();
+		if (!in.ok()) break;
+		summaries.add(name, (uint16_t)phases, seconds);
+		contents.seqs.push_back(seq);
+	}
+	// The slots stand on their own; bad summaries only cost a pass over the bodies
+	if (!in.ok() || summaries.size() != count) {
+		summaries.clear();
+		contents.seqs.clear();
+	}
+	return true;
+}
+
+// Slots in the stored manifest, in collection order; false if there is none
+// (nothing saved in this layout yet). A routine manifest also fills
+// summaries and each body's seq, both left empty if unreadable. Sets the
+// manifest's own seq. The namespace must be open.
+bool StorageManager::readManifest(ModelKind kind, std::vector<uint16_t>& slots, std::vector<uint32_t>& seqs,
+	RoutineIndex* summaries) {
+	char base[STORAGE_KEY_MAX];
+	manifestPrefix(base, kind);
+	ManifestContents contents;
+	contents.record = COLLECTION_KEYS[kind].record;
+	contents.summaries = summaries;
+	Manifest& m = manifests[kind];
+	if (!readCopy(base, &decodeManifest, &contents, &m.seq)) {
+		if (m.seq == 0) return false;
+		Serial.printf("StorageManager: corrupt manifest (%s)\n", base);
+		if (summaries) summaries->clear();
+		return true;
+	}
+	slots.swap(contents.slots);
+	seqs.swap(contents.seqs);
+	return true;
+}
+
+// Slots listed by a manifest stored without copies, "<prefix>.idx.0", ...
+// The namespace must be open.
+bool StorageManager::readUnframedSlots(ModelKind kind, std::vector<uint16_t>& slots) {
+	char base[STORAGE_KEY_MAX];
+	manifestPrefix(base, kind);
+	NvsChunkSource chunks(preferences, base);
+	if (chunks.totalSize() == 0) return false;
+	ManifestContents contents;
+	contents.record = COLLECTION_KEYS[kind].record;
+	contents.summaries = nullptr;
+	if (decodeManifest(chunks, &contents)) slots.swap(contents.slots);
+	return true;
+}
+
+void StorageManager::removeUnframed(ModelKind kind) {
+	std::vector<uint16_t> slots;
+	if (!readUnframedSlots(kind, slots)) return;
+	char base[STORAGE_KEY_MAX];
+	for (uint16_t slot : slots) {
+		entityPrefix(base, kind, slot);
+		removeChunks(base, 0);
+	}
+	manifestPrefix(base, kind);
+	removeChunks(base, 0);
+}
+
+// Lowest slot the collection neither uses nor is still waiting to erase
+uint16_t StorageManager::freeSlot(ModelKind kind) const {
+	const Manifest& m = manifests[kind];
+	// Slots need not be compact: a batch adds past the ones it still erases
+	size_t size = m.slots.size() + 1;
+	for (uint16_t slot : m.slots) {
+		if (slot >= size) size = slot + 1;
+	}
+	std::vector<bool> used(size, false);
+	for (uint16_t slot : m.slots) used[slot] = true;
+	uint16_t slot = 0;
+	while ((slot < used.size() && used[slot]) || erasePending(kind, slot)) slot++;
+	return slot;
+}
+
+// After a whole-collection save into slots 0..count-1 (each written with
+// putEntity, after dropPending): store the manifest, then erase the entities
+// of slots no longer used and drop the older layouts
+void StorageManager::finishRewrite(ModelKind kind, size_t count, const RoutineIndex* routines) {
+	Manifest& m = manifests[kind];
+	std::vector<uint32_t> seqs;
+	for (size_t i = 0; i < count; ++i) seqs.push_back(storedSeq(kind, i) + 1);
+	std::vector<uint16_t> unused;
+	for (uint16_t slot : m.slots) {
+		if (slot >= count) unused.push_back(slot);
+	}
+	m.slots.clear();
+	for (size_t i = 0; i < count; ++i) m.slots.push_back(i);
+	m.seqs.swap(seqs);
+	m.ids.assign(count, MODEL_INVALID_ID);
+	m.awaitingIds = true;
+	if (!putManifest(kind, routines)) return;
+	char base[STORAGE_KEY_MAX];
+	for (uint16_t slot : unused) {
+		entityPrefix(base, kind, slot);
+		removeCopies(base);
+	}
+	removeUnframed(kind);
+
+	const CollectionKeys& keys = COLLECTION_KEYS[kind];
+	removeChunks(keys.chunked, 0);
+	if (preferences->isKey(keys.blob)) {
+		preferences->remove(keys.blob);
+		countKey(keys.blob, 0);
+	}
+	if (preferences->isKey(keys.legacy)) {
+		preferences->remove(keys.legacy);
+		countKey(keys.legacy, 0);
+	}
+}
+
+// Queues the whole collection into slots 0..n-1. Routines can only be
+// rewritten while every body is cached; otherwise storage is left as it is.
+void StorageManager::queueRewrite(const ModelRepository& models, ModelKind kind) {
+	Manifest& m = manifests[kind];
+	size_t count = modelCount(models, kind);
+	for (size_t i = 0; kind == MODEL_ROUTINE && i < count; ++i) {
+		if (!models.cachedRoutine(models.routineId(i))) {
+			Serial.println("StorageManager: routines out of step with storage; not rewritten");
+			return;
+		}
+	}
+	std::vector<uint32_t> seqs(count);
+	for (size_t i = 0; i < count; ++i) {
+		std::vector<uint8_t> blob;
+		encodeEntity(blob, models, kind, i);
+		seqs[i] = queueCopy(kind, i, storedSeq(kind, i), std::move(blob));
+	}
+	char base[STORAGE_KEY_MAX];
+	for (uint16_t slot : m.slots) {
+		if (slot < count) continue;
+		entityPrefix(base, kind, slot);
+		queueErase(base);
+	}
+	m.slots.clear();
+	for (size_t i = 0; i < count; ++i) m.slots.push_back(i);
+	m.seqs.swap(seqs);
+	m.ids.assign(count, MODEL_INVALID_ID);
+	queueManifest(kind, &models.getRoutines());
+	bindIds(models, kind);
+}
+
+// Manifest entries and repository entries line up by position right after a load
+void StorageManager::bindIds(const ModelRepository& models, ModelKind kind) {
+	Manifest& m = manifests[kind];
+	if (m.slots.size() != modelCount(models, kind)) return; // stays unbound; the next change rewrites
+	m.awaitingIds = false;
+	for (size_t i = 0; i < m.ids.size(); ++i) m.ids[i] = modelId(models, kind, i);
+}
+
+// A routine is encoded from its cached body; every edit leaves it cached
+bool StorageManager::encodeEntity(std::vector<uint8_t>& blob, const ModelRepository& models, ModelKind kind,
+	int index) {
+	switch (kind) {
+		case MODEL_ALARM: encodeAlarm(blob, models.getAlarms()[index]); break;
+		case MODEL_ACCOUNT: encodeAccount(blob, models.getAccounts()[index]); break;
+		case MODEL_ROUTINE: {
+			const RoutineStore* body = models.cachedRoutine(models.routineId(index));
+			if (!body) return false;
+			encodeRoutine(blob, (*body)[0]);
+			break;
+		}
+	}
+	return true;
+}
+
+// Only encodes and queues; the flush task writes entities first, then
+// manifests, then erases, so a reset mid-flush never leaves a manifest
+// pointing at a missing entity
+void StorageManager::applyChange(const ModelRepository& models, ModelKind kind, ModelChange change, uint16_t id) {
+	{
+		ScopedLock state(stateLock);
+		queueChange(models, kind, change, id);
+	}
+	wake();
+}
+
+void StorageManager::queueChange(const ModelRepository& models, ModelKind kind, ModelChange change, uint16_t id) {
+	Manifest& m = manifests[kind];
+	if (change == MODEL_RELOADED) {
+		if (m.awaitingIds && m.slots.size() == modelCount(models, kind)) bindIds(models, kind);
+		else queueRewrite(models, kind);
 		return;
-  	}
-	preferences->end();
+	}
+
+	int index = modelIndex(models, kind, id);
+	int pos = -1;
+	for (size_t i = 0; i < m.ids.size(); ++i) {
+		if (m.ids[i] == id) {
+			pos = i;
+			break;
+		}
+	}
+	// A change storage cannot place (ids not bound, say) rewrites the collection
+	bool placeable;
+	switch (change) {
+		case MODEL_ADDED: placeable = pos < 0 && index >= 0 && index <= (int)m.slots.size(); break;
+		case MODEL_UPDATED: placeable = pos >= 0 && index >= 0; break;
+		default: placeable = pos >= 0; break;
+	}
+	if (!placeable) {
+		queueRewrite(models, kind);
+	} else if (change == MODEL_REMOVED) {
+		char base[STORAGE_KEY_MAX];
+		entityPrefix(base, kind, m.slots[pos]);
+		m.slots.erase(m.slots.begin() + pos);
+		m.seqs.erase(m.seqs.begin() + pos);
+		m.ids.erase(m.ids.begin() + pos);
+		queueManifest(kind, &models.getRoutines());
+		queueErase(base);
+	} else {
+		std::vector<uint8_t> blob;
+		if (!encodeEntity(blob, models, kind, index)) {
+			Serial.printf("StorageManager: no body for routine %u; not saved\n", (unsigned)id);
+			return;
+		}
+		if (change == MODEL_ADDED) {
+			uint16_t slot = freeSlot(kind);
+			m.slots.insert(m.slots.begin() + index, slot);
+			m.seqs.insert(m.seqs.begin() + index, 0);
+			m.ids.insert(m.ids.begin() + index, id);
+			pos = index;
+		}
+		m.seqs[pos] = queueCopy(kind, m.slots[pos], m.seqs[pos], std::move(blob));
+		// An add changes the slots; a routine edit may change its name or duration
+		if (change == MODEL_ADDED || kind == MODEL_ROUTINE) queueManifest(kind, &models.getRoutines());
+	}
+}
+
+void StorageManager::queueString(const char* key, const char* value) {
+	size_t len = strlen(value) + 1;
+	{
+		ScopedLock state(stateLock);
+		queue(key, PENDING_STRING, std::vector<uint8_t>(value, value + len));
+	}
+	wake();
+}
+
+// Legacy JSON text, only present on devices not yet migrated
+// ArduinoJson 7 sizes the document to the input (the fixed capacities of
+// older versions are gone), so what is left to fail is heap or a malformed
+// string. Either is reported; the JSON stays in NVS for the next boot.
+static bool parseLegacyJson(JsonDocument& doc, const String& json, const char* what) {
+	DeserializationError err = deserializeJson(doc, json);
+	if (!err && doc.is<JsonArray>()) return true;
+	Serial.printf("StorageManager: %s JSON (%u bytes) not migrated: %s\n", what, (unsigned)json.length(),
+		err ? err.c_str() : "not an array");
+	return false;
+}
+
+String StorageManager::readLegacyJson(const char* key) {
+	String json;
+	if (!open(key)) return json;
+	if (preferences->isKey(key)) json = preferences->getString(key, "");
+	close();
+	return json;
+}
+
+// Whole blob stored under key; false if it is missing or unreadable
+bool StorageManager::readBlob(const char* key, std::vector<uint8_t>& blob) {
+	if (!open(key)) return false;
+	bool found = false;
+	if (preferences->isKey(key)) {
+		blob.resize(preferences->getBytesLength(key));
+		found = !blob.empty() && preferences->getBytes(key, blob.data(), blob.size()) == blob.size();
+	}
+	close();
+	return found;
 }
 
 std::vector<AlertzyAccount> StorageManager::loadAlertzyAccounts() {
 	std::vector<AlertzyAccount> accounts;
-	if (!preferences) return accounts;
-	if (!preferences->begin("storage", true, "nvs")) {
-		Serial.println("StorageManager: failed to open preferences for read (alertzy_accounts)");
-		return accounts;
+	if (!open("accounts")) return accounts;
+	ScopedLock state(stateLock);
+	Manifest& m = manifests[MODEL_ACCOUNT];
+	std::vector<uint16_t> slots;
+	std::vector<uint32_t> seqs;
+	bool stored = readManifest(MODEL_ACCOUNT, slots, seqs);
+	m.slots.clear();
+	m.seqs.clear();
+	accounts.reserve(slots.size());
+	char base[STORAGE_KEY_MAX];
+	for (uint16_t slot : slots) {
+		entityPrefix(base, MODEL_ACCOUNT, slot);
+		AlertzyAccount account;
+		uint32_t seq;
+		if (!readCopy(base, &decodeAccountCopy, &account, &seq)) {
+			Serial.printf("StorageManager: corrupt account (%s)\n", base);
+			continue;
+		}
+		accounts.push_back(std::move(account));
+		m.slots.push_back(slot);
+		m.seqs.push_back(seq);
 	}
-	// If the key does not exist, return empty list (fresh device)
-	if (!preferences->isKey("alertzy_accounts")) {
-		preferences->end();
+	m.ids.assign(m.slots.size(), MODEL_INVALID_ID);
+	m.awaitingIds = true;
+	if (!stored) {
+		accounts = loadLegacyAccounts();
+		if (!accounts.empty()) saveAlertzyAccounts(accounts);
+	}
+	close();
+	return accounts;
+}
+
+// Body of one account record; account is set only if it decoded cleanly
+bool StorageManager::readAccount(RecordReader& in, AlertzyAccount& account) {
+	char name[RECORD_MAX_STRING];
+	char key[RECORD_MAX_STRING];
+	in.readString(name, sizeof(name));
+	in.readString(key, sizeof(key));
+	in.endRecord();
+	if (in.ok()) account = AlertzyAccount{String(name), String(key)};
+	return in.ok();
+}
+
+bool StorageManager::decodeAccountCopy(RecordSource& source, void* out) {
+	RecordReader in(source);
+	uint8_t version;
+	return in.readHeader(RECORD_ACCOUNTS, &version) && readRecord(in, *static_cast<AlertzyAccount*>(out));
+}
+
+bool StorageManager::decodeAccounts(RecordSource& source, std::vector<AlertzyAccount>& accounts) {
+	RecordReader in(source);
+	uint8_t version;
+	if (!in.readHeader(RECORD_ACCOUNTS, &version)) return false;
+	uint32_t count = in.readVarint();
+	if (count > in.totalSize()) return false; // corrupt count
+	accounts.reserve(count);
+	AlertzyAccount account;
+	for (uint32_t i = 0; i < count && readRecord(in, account); ++i) accounts.push_back(account);
+	if (!in.ok()) {
+		Serial.println("StorageManager: corrupt accounts record");
+		accounts.clear();
+	}
+	return in.ok();
+}
+
+std::vector<AlertzyAccount> StorageManager::loadLegacyAccounts() {
+	std::vector<AlertzyAccount> accounts;
+	const CollectionKeys& keys = COLLECTION_KEYS[MODEL_ACCOUNT];
+	if (open(keys.name)) {
+		std::vector<uint16_t> slots;
+		bool stored = readUnframedSlots(MODEL_ACCOUNT, slots);
+		char base[STORAGE_KEY_MAX];
+		AlertzyAccount account;
+		for (uint16_t slot : slots) {
+			entityPrefix(base, MODEL_ACCOUNT, slot);
+			NvsChunkSource chunks(preferences, base);
+			if (decodeAccountCopy(chunks, &account)) accounts.push_back(account);
+		}
+		close();
+		if (stored) {
+			Serial.printf("StorageManager: migrating %u accounts to A/B copies\n", (unsigned)accounts.size());
+			return accounts;
+		}
+	}
+	if (open(keys.chunked)) {
+		NvsChunkSource chunks(preferences, keys.chunked);
+		bool stored = chunks.totalSize() > 0;
+		if (stored) decodeAccounts(chunks, accounts);
+		close();
+		if (stored) return accounts;
+	}
+	std::vector<uint8_t> blob;
+	if (readBlob(keys.blob, blob)) {
+		MemoryRecordSource source(blob.data(), blob.size());
+		decodeAccounts(source, accounts);
 		return accounts;
 	}
-	String json = preferences->getString("alertzy_accounts", "");
-	preferences->end();
+	String json = readLegacyJson(keys.legacy);
 	if (json.length() == 0) return accounts; // no data yet
 
-	DynamicJsonDocument doc(4096);
-	auto err = deserializeJson(doc, json);
-	if (err) return accounts;
-	if (!doc.is<JsonArray>()) return accounts;
+	JsonDocument doc;
+	if (!parseLegacyJson(doc, json, "accounts")) return accounts;
 
-	for (JsonVariant v : doc.as<JsonArray>()) {
+	JsonArray arr = doc.as<JsonArray>();
+	accounts.reserve(arr.size());
+	for (JsonVariant v : arr) {
 		AlertzyAccount acc;
 		acc.name = v["name"].as<String>();
 		acc.key = v["key"].as<String>();
-		accounts.push_back(acc);
+		accounts.push_back(std::move(acc));
 	}
+	Serial.printf("StorageManager: migrating %u accounts from JSON\n", (unsigned)accounts.size());
 	return accounts;
 }
 
+void StorageManager::encodeAccount(std::vector<uint8_t>& blob, const AlertzyAccount& account) {
+	RecordWriter out(blob);
+	out.writeHeader(RECORD_ACCOUNTS, ACCOUNTS_SCHEMA);
+	encodeRecord(blob, account);
+}
+
+void StorageManager::encodeRecord(std::vector<uint8_t>& blob, const AlertzyAccount& account) {
+	RecordWriter out(blob);
+	out.beginRecord();
+	out.writeString(account.name.c_str());
+	out.writeString(account.key.c_str());
+	out.endRecord();
+	logCutStrings(out, "account");
+}
+
+bool StorageManager::readRecord(RecordReader& in, AlertzyAccount& account) {
+	return in.beginRecord() && readAccount(in, account);
+}
+
+// Whole collection into slots 0..n-1 (migration, or a reload storage did not
+// produce); single edits go through applyChange
 void StorageManager::saveAlertzyAccounts(const std::vector<AlertzyAccount>& accounts) {
-	DynamicJsonDocument doc(4096);
-	JsonArray arr = doc.to<JsonArray>();
-	for (const auto& acc : accounts) {
-		JsonObject o = arr.add<JsonObject>();
-		o["name"] = acc.name;
-		o["key"] = acc.key;
+	if (!beginWrite("accounts")) return;
+	ScopedLock state(stateLock);
+	dropPending(MODEL_ACCOUNT, accounts.size());
+	std::vector<uint8_t> blob;
+	bool written = true;
+	for (size_t i = 0; i < accounts.size() && written; ++i) {
+		blob.clear();
+		encodeAccount(blob, accounts[i]);
+		written = putEntity(MODEL_ACCOUNT, i, blob);
 	}
-	String json;
-	serializeJson(doc, json);
-	if (!preferences) return;
-	if (!preferences->begin("storage", false, "nvs")) {
-		Serial.println("StorageManager: failed to open preferences for write (alertzy_accounts)");
-		return;
+	if (written) finishRewrite(MODEL_ACCOUNT, accounts.size(), nullptr);
+	endWrite("accounts");
+}
+
+// One routine body into out (cleared first), and the seq of its copy: a
+// queued copy of the slot wins over what flash still holds. Caller has the
+// namespace open and holds stateLock.
+bool StorageManager::readRoutineSlot(uint16_t slot, RoutineStore& out, uint32_t* seq) {
+	char base[STORAGE_KEY_MAX];
+	entityPrefix(base, MODEL_ROUTINE, slot);
+	const PendingWrite* queued = nullptr;
+	for (const auto& w : pending) {
+		if (w.type == PENDING_CHUNKS && isCopyOf(w.key, base)) queued = &w;
 	}
-	preferences->putString("alertzy_accounts", json);
-	preferences->end();
+	bool ok;
+	if (queued) {
+		RecordFrame frame;
+		readFrame(queued->data.data(), queued->data.size(), frame);
+		MemoryRecordSource memory(queued->data.data() + RECORD_FRAME_SIZE, queued->data.size() - RECORD_FRAME_SIZE);
+		ok = decodeRoutine(memory, out);
+		*seq = frame.seq;
+	} else {
+		ok = readCopy(base, &decodeRoutineCopy, &out, seq);
+	}
+	if (!ok) Serial.printf("StorageManager: corrupt routine (%s)\n", base);
+	return ok;
 }
 
-std::vector<CustomTimer> StorageManager::loadCustomTimers() {
-	std::vector<CustomTimer> timers;
-	if (!preferences) return timers;
-	if (!preferences->begin("storage", true, "nvs")) {
-		Serial.println("StorageManager: failed to open preferences for read (custom_timers)");
-		return timers;
+bool StorageManager::decodeRoutineCopy(RecordSource& source, void* out) {
+	return decodeRoutine(source, *static_cast<RoutineStore*>(out));
+}
+
+bool StorageManager::decodeRoutine(RecordSource& source, RoutineStore& out) {
+	RecordReader in(source);
+	out.clear();
+	uint8_t version;
+	if (in.readHeader(RECORD_ROUTINES, &version) && in.beginRecord()) readRoutine(in, out);
+	if (in.ok() && out.size() == 1) return true;
+	out.clear();
+	return false;
+}
+
+// The routine index comes from the manifest alone. A manifest written before
+// it carried the index costs one pass over the bodies, then is rewritten.
+RoutineIndex StorageManager::loadRoutineIndex() {
+	RoutineIndex index;
+	if (!open("routines")) return index;
+	ScopedLock state(stateLock);
+	Manifest& m = manifests[MODEL_ROUTINE];
+	std::vector<uint16_t> slots;
+	std::vector<uint32_t> seqs;
+	bool stored = readManifest(MODEL_ROUTINE, slots, seqs, &index);
+	if (index.size() == slots.size() && seqs.size() == slots.size()) {
+		m.slots = slots;
+		m.seqs = seqs;
+	} else {
+		index.clear();
+		m.slots.clear();
+		m.seqs.clear();
+		RoutineStore body;
+		uint32_t seq;
+		for (uint16_t slot : slots) {
+			if (!readRoutineSlot(slot, body, &seq)) continue;
+			index.add(body[0]);
+			m.slots.push_back(slot);
+			m.seqs.push_back(seq);
+		}
+		queueManifest(MODEL_ROUTINE, &index);
+	}
+	m.ids.assign(m.slots.size(), MODEL_INVALID_ID);
+	m.awaitingIds = true;
+	if (!stored) {
+		RoutineStore timers = loadLegacyTimers();
+		if (!timers.empty()) saveCustomTimers(timers);
+		index.clear();
+		for (size_t t = 0; t < timers.size(); ++t) index.add(timers[t]);
+	}
+	close();
+	return index;
+}
+
+bool StorageManager::loadRoutine(uint16_t id, RoutineStore& out) {
+	out.clear();
+	if (!open("routine")) return false;
+	bool found = false;
+	{
+		ScopedLock state(stateLock);
+		Manifest& m = manifests[MODEL_ROUTINE];
+		uint32_t seq;
+		for (size_t i = 0; i < m.ids.size() && !found; ++i) {
+			if (m.ids[i] != id) continue;
+			found = readRoutineSlot(m.slots[i], out, &seq);
+			if (found) m.seqs[i] = seq; // the copy actually read, should the newest be damaged
+		}
+	}
+	close();
+	return found;
+}
+
+// Body of one routine record, decoded field by field straight into the packed
+// store as the chunks stream in
+void StorageManager::readRoutine(RecordReader& in, RoutineStore& timers) {
+	char name[RECORD_MAX_STRING];
+	in.readString(name, sizeof(name));
+	timers.beginRoutine(name);
+	uint32_t phases = in.readVarint();
+	for (uint32_t i = 0; i < phases && in.ok(); ++i) {
+		in.readString(name, sizeof(name));
+		uint32_t duration = in.readVarint();
+		uint8_t track = in.readByte();
+		uint32_t mask = in.readVarint();
+		timers.addPhase(name, duration, track, mask);
 	}
-	// If the key does not exist, return empty list (fresh device)
-	if (!preferences->isKey("custom_timers")) {
-		preferences->end();
+	uint32_t repeats = in.readVarint();
+	for (uint32_t i = 0; i < repeats && in.ok(); ++i) {
+		uint8_t first = in.readByte();
+		uint8_t last = in.readByte();
+		timers.addRepeat(first, last, in.readByte());
+	}
+	timers.endRoutine();
+	in.endRecord();
+}
+
+bool StorageManager::readRecord(RecordReader& in, RoutineStore& routines) {
+	size_t before = routines.size();
+	if (in.beginRecord()) readRoutine(in, routines);
+	if (!in.ok() && routines.size() > before) routines.remove(before);
+	return in.ok();
+}
+
+bool StorageManager::decodeTimers(RecordSource& source, RoutineStore& timers) {
+	RecordReader in(source);
+	uint8_t version;
+	if (!in.readHeader(RECORD_ROUTINES, &version)) return false;
+	uint32_t count = in.readVarint();
+	uint32_t phaseCount = in.readVarint();
+	uint32_t nameBytes = in.readVarint();
+	size_t total = in.totalSize();
+	if (!in.ok() || count > total || phaseCount > total || nameBytes > total) return false;
+	timers.reserve(count, phaseCount, nameBytes);
+
+	for (uint32_t t = 0; t < count && readRecord(in, timers); ++t) {}
+	if (!in.ok()) {
+		Serial.println("StorageManager: corrupt routines record");
+		timers.clear();
+	}
+	return in.ok();
+}
+
+RoutineStore StorageManager::loadLegacyTimers() {
+	RoutineStore timers;
+	const CollectionKeys& keys = COLLECTION_KEYS[MODEL_ROUTINE];
+	if (open(keys.name)) {
+		std::vector<uint16_t> slots;
+		bool stored = readUnframedSlots(MODEL_ROUTINE, slots);
+		char base[STORAGE_KEY_MAX];
+		for (uint16_t slot : slots) {
+			entityPrefix(base, MODEL_ROUTINE, slot);
+			NvsChunkSource chunks(preferences, base);
+			RecordReader in(chunks);
+			uint8_t version;
+			if (in.readHeader(RECORD_ROUTINES, &version)) readRecord(in, timers);
+		}
+		close();
+		if (stored) {
+			Serial.printf("StorageManager: migrating %u routines to A/B copies\n", (unsigned)timers.size());
+			return timers;
+		}
+	}
+	if (open(keys.chunked)) {
+		NvsChunkSource chunks(preferences, keys.chunked);
+		bool stored = chunks.totalSize() > 0;
+		if (stored) decodeTimers(chunks, timers);
+		close();
+		if (stored) return timers;
+	}
+	std::vector<uint8_t> blob;
+	if (readBlob(keys.blob, blob)) {
+		MemoryRecordSource source(blob.data(), blob.size());
+		decodeTimers(source, timers);
 		return timers;
 	}
-	String json = preferences->getString("custom_timers", "");
-	preferences->end();
+	String json = readLegacyJson(keys.legacy);
 	if (json.length() == 0) return timers;
 
-	DynamicJsonDocument doc(16384);
-	auto err = deserializeJson(doc, json);
-	if (err) return timers;
-	if (!doc.is<JsonArray>()) return timers;
+	JsonDocument doc;
+	if (!parseLegacyJson(doc, json, "routines")) return timers;
 
-	for (JsonVariant t : doc.as<JsonArray>()) {
-		CustomTimer timer;
-		timer.name = t["name"].as<String>();
+	// Decode straight into the packed store; no intermediate CustomTimer objects
+	JsonArray arr = doc.as<JsonArray>();
+	size_t phaseCount = 0;
+	for (JsonVariant t : arr) phaseCount += t["phases"].as<JsonArray>().size();
+	timers.reserve(arr.size(), phaseCount, json.length() / 4);
+
+	for (JsonVariant t : arr) {
+		timers.beginRoutine(t["name"].as<const char*>());
 		JsonArray phases = t["phases"].as<JsonArray>();
 		for (JsonVariant p : phases) {
-			TimerPhase phase;
-			phase.name = p["name"].as<String>();
-			phase.duration_seconds = p["duration_seconds"].as<uint32_t>();
-			phase.sound_track = p["sound_track"].as<uint8_t>();
+			uint32_t mask = 0;
 			for (JsonVariant idx : p["alertzy_key_indices"].as<JsonArray>()) {
-				phase.alertzy_key_indices.push_back(idx.as<uint8_t>());
+				uint8_t i = idx.as<uint8_t>();
+				if (i < ROUTINE_MAX_NOTIFY_ACCOUNTS) mask |= (1UL << i);
 			}
-			timer.phases.push_back(phase);
+			timers.addPhase(p["name"].as<const char*>(), p["duration_seconds"].as<uint32_t>(),
+				p["sound_track"].as<uint8_t>(), mask);
+		}
+		// Optional repeat blocks (absent in older saves)
+		for (JsonVariant r : t["repeats"].as<JsonArray>()) {
+			timers.addRepeat(r["first"].as<uint8_t>(), r["last"].as<uint8_t>(), r["count"].as<uint8_t>());
 		}
-		timers.push_back(timer);
+		timers.endRoutine();
 	}
+	Serial.printf("StorageManager: migrating %u routines from JSON\n", (unsigned)timers.size());
 	return timers;
 }
 
-void StorageManager::saveCustomTimers(const std::vector<CustomTimer>& timers) {
-	DynamicJsonDocument doc(16384);
-	JsonArray arr = doc.to<JsonArray>();
-	for (const auto& timer : timers) {
-		JsonObject to = arr.add<JsonObject>();
-		to["name"] = timer.name;
-		JsonArray phases = to.createNestedArray("phases");
-		for (const auto& phase : timer.phases) {
-			JsonObject po = phases.add<JsonObject>();
-			po["name"] = phase.name;
-			po["duration_seconds"] = phase.duration_seconds;
-			po["sound_track"] = phase.sound_track;
-			JsonArray keys = po.createNestedArray("alertzy_key_indices");
-			for (auto idx : phase.alertzy_key_indices) keys.add(idx);
-		}
+void StorageManager::encodeRoutine(std::vector<uint8_t>& blob, RoutineView timer) {
+	RecordWriter out(blob);
+	out.writeHeader(RECORD_ROUTINES, ROUTINES_SCHEMA);
+	encodeRecord(blob, timer);
+}
+
+void StorageManager::encodeRecord(std::vector<uint8_t>& blob, RoutineView timer) {
+	RecordWriter out(blob);
+	out.beginRecord();
+	out.writeString(timer.name());
+	out.writeVarint(timer.phaseCount());
+	for (int i = 0; i < timer.phaseCount(); ++i) {
+		PhaseView phase = timer.phase(i);
+		out.writeString(phase.name());
+		out.writeVarint(phase.durationSeconds());
+		out.writeByte(phase.soundTrack());
+		out.writeVarint(phase.notifyMask());
 	}
-	String json;
-	serializeJson(doc, json);
-	if (!preferences) return;
-	preferences->begin("storage", false, "nvs");
-	preferences->putString("custom_timers", json);
-	preferences->end();
+	std::vector<RepeatBlock> repeats = timer.repeats();
+	out.writeVarint(repeats.size());
+	for (const auto& r : repeats) {
+		out.writeByte(r.first_phase);
+		out.writeByte(r.last_phase);
+		out.writeByte(r.count);
+	}
+	out.endRecord();
+	logCutStrings(out, "routine");
+}
+
+void StorageManager::saveCustomTimers(const RoutineStore& timers) {
+	if (!beginWrite("routines")) return;
+	ScopedLock state(stateLock);
+	dropPending(MODEL_ROUTINE, timers.size());
+	std::vector<uint8_t> blob;
+	bool written = true;
+	for (size_t t = 0; t < timers.size() && written; ++t) {
+		blob.clear();
+		encodeRoutine(blob, timers[t]);
+		written = putEntity(MODEL_ROUTINE, t, blob);
+	}
+	if (written) {
+		RoutineIndex index;
+		for (size_t t = 0; t < timers.size(); ++t) index.add(timers[t]);
+		finishRewrite(MODEL_ROUTINE, timers.size(), &index);
+	}
+	endWrite("routines");
 }
 
 std::vector<Alarm> StorageManager::loadAlarms() {
 	std::vector<Alarm> alarms;
-	if (!preferences) return alarms;
-	if (!preferences->begin("storage", true, "nvs")) {
-		Serial.println("StorageManager: failed to open preferences for read (alarms)");
-		return alarms;
+	if (!open("alarms")) return alarms;
+	ScopedLock state(stateLock);
+	Manifest& m = manifests[MODEL_ALARM];
+	std::vector<uint16_t> slots;
+	std::vector<uint32_t> seqs;
+	bool stored = readManifest(MODEL_ALARM, slots, seqs);
+	m.slots.clear();
+	m.seqs.clear();
+	alarms.reserve(slots.size());
+	char base[STORAGE_KEY_MAX];
+	for (uint16_t slot : slots) {
+		entityPrefix(base, MODEL_ALARM, slot);
+		Alarm alarm;
+		uint32_t seq;
+		if (!readCopy(base, &decodeAlarmCopy, &alarm, &seq)) {
+			Serial.printf("StorageManager: corrupt alarm (%s)\n", base);
+			continue;
+		}
+		alarms.push_back(alarm);
+		m.slots.push_back(slot);
+		m.seqs.push_back(seq);
 	}
-	// If the key does not exist, return empty list (fresh device)
-	if (!preferences->isKey("alarms")) {
-		preferences->end();
+	m.ids.assign(m.slots.size(), MODEL_INVALID_ID);
+	m.awaitingIds = true;
+	if (!stored) {
+		alarms = loadLegacyAlarms();
+		if (!alarms.empty()) saveAlarms(alarms);
+	}
+	close();
+	return alarms;
+}
+
+bool StorageManager::decodeAlarmCopy(RecordSource& source, void* out) {
+	RecordReader in(source);
+	uint8_t version;
+	return in.readHeader(RECORD_ALARMS, &version) && readRecord(in, *static_cast<Alarm*>(out));
+}
+
+bool StorageManager::decodeAlarms(RecordSource& source, std::vector<Alarm>& alarms) {
+	RecordReader in(source);
+	uint8_t version;
+	if (!in.readHeader(RECORD_ALARMS, &version)) return false;
+	uint32_t count = in.readVarint();
+	if (count > in.totalSize()) return false;
+	alarms.reserve(count);
+	Alarm alarm;
+	for (uint32_t i = 0; i < count && readRecord(in, alarm); ++i) alarms.push_back(alarm);
+	if (!in.ok()) {
+		Serial.println("StorageManager: corrupt alarms record");
+		alarms.clear();
+	}
+	return in.ok();
+}
+
+std::vector<Alarm> StorageManager::loadLegacyAlarms() {
+	std::vector<Alarm> alarms;
+	const CollectionKeys& keys = COLLECTION_KEYS[MODEL_ALARM];
+	if (open(keys.name)) {
+		std::vector<uint16_t> slots;
+		bool stored = readUnframedSlots(MODEL_ALARM, slots);
+		char base[STORAGE_KEY_MAX];
+		Alarm alarm;
+		for (uint16_t slot : slots) {
+			entityPrefix(base, MODEL_ALARM, slot);
+			NvsChunkSource chunks(preferences, base);
+			if (decodeAlarmCopy(chunks, &alarm)) alarms.push_back(alarm);
+		}
+		close();
+		if (stored) {
+			Serial.printf("StorageManager: migrating %u alarms to A/B copies\n", (unsigned)alarms.size());
+			return alarms;
+		}
+	}
+	if (open(keys.chunked)) {
+		NvsChunkSource chunks(preferences, keys.chunked);
+		bool stored = chunks.totalSize() > 0;
+		if (stored) decodeAlarms(chunks, alarms);
+		close();
+		if (stored) return alarms;
+	}
+	std::vector<uint8_t> blob;
+	if (readBlob(keys.blob, blob)) {
+		MemoryRecordSource source(blob.data(), blob.size());
+		decodeAlarms(source, alarms);
 		return alarms;
 	}
-	String json = preferences->getString("alarms", "");
-	preferences->end();
+	String json = readLegacyJson(keys.legacy);
 	if (json.length() == 0) return alarms;
 
-	DynamicJsonDocument doc(1024);
-	auto err = deserializeJson(doc, json);
-	if (err) return alarms;
-	if (!doc.is<JsonArray>()) return alarms;
+	JsonDocument doc;
+	if (!parseLegacyJson(doc, json, "alarms")) return alarms;
 
-	for (JsonVariant v : doc.as<JsonArray>()) {
+	JsonArray arr = doc.as<JsonArray>();
+	alarms.reserve(arr.size());
+	for (JsonVariant v : arr) {
 		Alarm a;
-		a.hour = v["hour"].as<uint8_t>();
-		a.minute = v["minute"].as<uint8_t>();
-		a.enabled = v["enabled"].as<bool>();
-		a.sound_track = v["sound_track"].as<uint8_t>();
+		if (v.is<uint32_t>()) {
+			a = unpackAlarm(v.as<uint32_t>());
+		} else {
+			// Legacy object format: rings every day, no snooze
+			a.hour = v["hour"].as<uint8_t>();
+			a.minute = v["minute"].as<uint8_t>();
+			a.enabled = v["enabled"].as<bool>();
+			a.sound_track = v["sound_track"].as<uint8_t>();
+		}
 		alarms.push_back(a);
 	}
+	Serial.printf("StorageManager: migrating %u alarms from JSON\n", (unsigned)alarms.size());
 	return alarms;
 }
 
-void StorageManager::saveAlarms(const std::vector<Alarm>& alarms) {
-	if (!preferences) return;
-	DynamicJsonDocument doc(1024);
-	JsonArray arr = doc.to<JsonArray>();
-	for (const auto& a : alarms) {
-		JsonObject o = arr.add<JsonObject>();
-		o["hour"] = a.hour;
-		o["minute"] = a.minute;
-		o["enabled"] = a.enabled;
-		o["sound_track"] = a.sound_track;
+// One alarm in one number:
+// bits 0-4 hour, 5-10 minute, 11 enabled, 12 one-shot, 13-19 days, 20-25 track, 26-31 snooze
+uint32_t StorageManager::packAlarm(const Alarm& a) {
+	return (uint32_t)(a.hour & 0x1F) | (uint32_t)(a.minute & 0x3F) << 5 | (uint32_t)a.enabled << 11 |
+		(uint32_t)a.one_shot << 12 | (uint32_t)(a.days & 0x7F) << 13 | (uint32_t)(a.sound_track & 0x3F) << 20 |
+		(uint32_t)(a.snooze_minutes & 0x3F) << 26;
+}
+
+Alarm StorageManager::unpackAlarm(uint32_t packed) {
+	Alarm a;
+	a.hour = packed & 0x1F;
+	a.minute = (packed >> 5) & 0x3F;
+	a.enabled = (packed >> 11) & 1;
+	a.one_shot = (packed >> 12) & 1;
+	a.days = (packed >> 13) & 0x7F;
+	a.sound_track = (packed >> 20) & 0x3F;
+	a.snooze_minutes = (packed >> 26) & 0x3F;
+	if (a.days == 0) a.days = ALARM_EVERY_DAY;
+	return a;
+}
+
+void StorageManager::encodeAlarm(std::vector<uint8_t>& blob, const Alarm& alarm) {
+	RecordWriter out(blob);
+	out.writeHeader(RECORD_ALARMS, ALARMS_SCHEMA);
+	encodeRecord(blob, alarm);
+}
+
+void StorageManager::encodeRecord(std::vector<uint8_t>& blob, const Alarm& alarm) {
+	RecordWriter out(blob);
+	out.beginRecord();
+	out.writeVarint(packAlarm(alarm));
+	out.endRecord();
+}
+
+bool StorageManager::readRecord(RecordReader& in, Alarm& alarm) {
+	if (!in.beginRecord()) return false;
+	uint32_t packed = in.readVarint();
+	in.endRecord();
+	if (in.ok()) alarm = unpackAlarm(packed);
+	return in.ok();
+}
+
+void StorageManager::encodeCollectionHeader(std::vector<uint8_t>& blob, ModelKind kind, uint32_t count,
+	uint32_t phaseCount, uint32_t nameBytes) {
+	RecordWriter out(blob);
+	out.writeHeader(COLLECTION_KEYS[kind].record, ENTITY_SCHEMAS[kind]);
+	out.writeVarint(count);
+	if (kind == MODEL_ROUTINE) {
+		out.writeVarint(phaseCount);
+		out.writeVarint(nameBytes);
 	}
-	String json;
-	serializeJson(doc, json);
-	if (!preferences->begin("storage", false, "nvs")) {
-		Serial.println("StorageManager: failed to open preferences for write (alarms)");
-		return;
+}
+
+// Reads the header and count; a count the stream is too short for is corrupt
+bool StorageManager::readCollectionHeader(RecordReader& in, ModelKind kind, uint32_t* count) {
+	uint8_t version;
+	if (!in.readHeader(COLLECTION_KEYS[kind].record, &version)) return false;
+	*count = in.readVarint();
+	if (kind == MODEL_ROUTINE) {
+		in.readVarint(); // phase count hint
+		in.readVarint(); // name bytes hint
 	}
-	preferences->putString("alarms", json);
-	preferences->end();
-}
\ No newline at end of file
+	return in.ok() && *count <= in.totalSize();
+}
+
+void StorageManager::saveAlarms(const std::vector<Alarm>& alarms) {
+	if (!beginWrite("alarms")) return;
+	ScopedLock state(stateLock);
+	dropPending(MODEL_ALARM, alarms.size());
+	std::vector<uint8_t> blob;
+	bool written = true;
+	for (size_t i = 0; i < alarms.size() && written; ++i) {
+		blob.clear();
+		encodeAlarm(blob, alarms[i]);
+		written = putEntity(MODEL_ALARM, i, blob);
+	}
+	if (written) finishRewrite(MODEL_ALARM, alarms.size(), nullptr);
+	endWrite("alarms");
+}
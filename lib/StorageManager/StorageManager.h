@@ -2,27 +2,215 @@
 #define STORAGEMANAGER_H
 
 #include "DataModels.h"
-#include <Preferences.h>
+#include "RoutineStore.h"
+#include "RecordCodec.h"
+#include "ModelRepository.h"
+#include "NvsService.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include <vector>
 
+#define STORAGE_NAMESPACE "storage"
+#define STORAGE_KEY_MAX 16 // NVS keys are at most 15 characters
+// Write-behind: a burst of edits is flushed once it has been quiet this long,
+// and never later than the cap after its first edit
+#define STORAGE_FLUSH_QUIET_MS 1500UL
+#define STORAGE_FLUSH_MAX_DELAY_MS 10000UL
+
+// What NVS writes have cost; "last" covers the most recent save or edit.
+// Keys counts keys written plus keys erased.
+struct StorageWriteStats {
+	uint32_t lastBytes;
+	uint16_t lastKeys;
+	uint32_t totalBytes;
+	uint32_t totalKeys;
+	uint32_t operations;
+};
+
+// Write-behind counters; a write avoided is a queued write a later change
+// replaced before it reached flash
+struct StorageFlushStats {
+	uint32_t queued;
+	uint32_t writesAvoided;
+	uint32_t flushes;
+	uint32_t lastFlushUs;  // NVS time of the last flush
+	uint32_t maxFlushUs;
+	uint32_t lastDelayMs;  // first queued change -> flushed
+};
+
 class StorageManager {
 private:
-	Preferences* preferences;
+	NvsService* nvs;
+	Preferences* preferences; // the shared handle, valid between open() and close()
+
+	// Storage slot of each stored entity in collection order, the seq of its
+	// newest copy (written or queued), and the model id it belongs to once the
+	// loaded collection has reached the repository. seq is the manifest's own.
+	struct Manifest {
+		std::vector<uint16_t> slots;
+		std::vector<uint32_t> seqs;
+		std::vector<uint16_t> ids;
+		uint32_t seq;
+		bool awaitingIds;
+	};
+	Manifest manifests[3]; // by ModelKind
+	StorageWriteStats stats;
+
+	// A write waiting for the flush task; one per key, later changes replace it
+	enum PendingType : uint8_t {
+		PENDING_CHUNKS, // a framed copy under chunk keys "<key>.0", ...
+		PENDING_STRING, // data is a NUL-terminated string
+		PENDING_ERASE   // remove both copies of the record <key>
+	};
+	struct PendingWrite {
+		char key[STORAGE_KEY_MAX];
+		PendingType type;
+		std::vector<uint8_t> data;
+	};
+	std::vector<PendingWrite> pending;
+	bool manifestDirty[3];
+	std::vector<uint8_t> manifestData[3]; // encoded when queued
+	bool flushRequested;
+	uint32_t firstChangeMs; // of the oldest unflushed change
+	uint32_t lastChangeMs;
+	bool batching; // manifests and erases held for commitBatch()
+	bool openFailed; // the last flush could not open the namespace
+	uint32_t openFailedMs;
+	StorageFlushStats flushStats;
+	// Manifests and pending writes. Recursive: a load that migrates saves
+	// while holding it. Taken after the NVS service lock, never before.
+	SemaphoreHandle_t stateLock;
+	TaskHandle_t flushTask;
+
+	bool isDirty() const;
+	void queue(const char* key, PendingType type, std::vector<uint8_t>&& data);
+	void queueManifest(ModelKind kind, const RoutineIndex* routines);
+	uint32_t queueCopy(ModelKind kind, uint16_t slot, uint32_t current, std::vector<uint8_t>&& blob);
+	void queueErase(const char* base);
+	void unqueue(const char* base, PendingType type);
+	void queueChange(const ModelRepository& models, ModelKind kind, ModelChange change, uint16_t id);
+	bool erasePending(ModelKind kind, uint16_t slot) const;
+	void dropPending(ModelKind kind, size_t count);
+	uint32_t msUntilFlush();
+	void wake();
+	static void flushTaskMain(void* arg);
+
+	static uint32_t packAlarm(const Alarm& a);
+	static Alarm unpackAlarm(uint32_t packed);
+
+	// One entity as a header plus one record
+	static void encodeAlarm(std::vector<uint8_t>& blob, const Alarm& alarm);
+	static void encodeAccount(std::vector<uint8_t>& blob, const AlertzyAccount& account);
+	static void encodeRoutine(std::vector<uint8_t>& blob, RoutineView timer);
+	static bool encodeEntity(std::vector<uint8_t>& blob, const ModelRepository& models, ModelKind kind, int index);
+	void encodeManifest(std::vector<uint8_t>& blob, ModelKind kind, const RoutineIndex* routines) const;
+	static bool readAccount(RecordReader& in, AlertzyAccount& account);
+	static void readRoutine(RecordReader& in, RoutineStore& timers);
+
+	// Borrow the shared namespace handle; calls nest
+	bool open(const char* what);
+	void close();
+	// Write helpers; the namespace is open between beginWrite and endWrite
+	bool beginWrite(const char* what);
+	void endWrite(const char* what);
+	void countKey(const char* key, size_t bytes);
+	bool putChunk(const char* prefix, uint16_t index, const std::vector<uint8_t>& blob);
+	bool putChunks(const char* prefix, const std::vector<uint8_t>& blob);
+	void removeChunks(const char* prefix, uint16_t first);
+	bool putCopy(const char* key, const std::vector<uint8_t>& blob);
+	void removeCopies(const char* base);
+	bool putEntity(ModelKind kind, uint16_t slot, std::vector<uint8_t>& blob);
+	bool putManifest(ModelKind kind, const RoutineIndex* routines);
+	void finishRewrite(ModelKind kind, size_t count, const RoutineIndex* routines);
+	uint32_t storedSeq(ModelKind kind, uint16_t slot) const;
+
+	// Decodes one record from source into out; used for either copy, so it
+	// must leave out whole even if called again after a failure
+	typedef bool (*CopyDecoder)(RecordSource& source, void* out);
+	bool readCopy(const char* base, CopyDecoder decode, void* out, uint32_t* seq);
+	bool readManifest(ModelKind kind, std::vector<uint16_t>& slots, std::vector<uint32_t>& seqs,
+		RoutineIndex* summaries = nullptr);
+	bool readRoutineSlot(uint16_t slot, RoutineStore& out, uint32_t* seq);
+	uint16_t freeSlot(ModelKind kind) const;
+	void queueRewrite(const ModelRepository& models, ModelKind kind);
+	void bindIds(const ModelRepository& models, ModelKind kind);
+
+	static bool decodeAccounts(RecordSource& source, std::vector<AlertzyAccount>& accounts);
+	static bool decodeTimers(RecordSource& source, RoutineStore& timers);
+	static bool decodeRoutine(RecordSource& source, RoutineStore& out);
+	static bool decodeAlarms(RecordSource& source, std::vector<Alarm>& alarms);
+	static bool decodeManifest(RecordSource& source, void* out);
+	static bool decodeAlarmCopy(RecordSource& source, void* out);
+	static bool decodeAccountCopy(RecordSource& source, void* out);
+	static bool decodeRoutineCopy(RecordSource& source, void* out);
+
+	// One-time migration from the layouts older firmware stored: per-entity
+	// keys without copies, then the whole-collection layouts
+	bool readUnframedSlots(ModelKind kind, std::vector<uint16_t>& slots);
+	void removeUnframed(ModelKind kind);
+	bool readBlob(const char* key, std::vector<uint8_t>& blob);
+	String readLegacyJson(const char* key);
+	std::vector<AlertzyAccount> loadLegacyAccounts();
+	RoutineStore loadLegacyTimers();
+	std::vector<Alarm> loadLegacyAlarms();
 
 public:
-	StorageManager(Preferences* prefs);
-	
+	StorageManager(NvsService* nvsService);
+	// Starts the background flush task and the shutdown hook; until then
+	// (or if it fails) every change is written at once
+	bool begin();
+
 	// Alertzy Key Management
 	std::vector<AlertzyAccount> loadAlertzyAccounts();
 	void saveAlertzyAccounts(const std::vector<AlertzyAccount>& accounts);
 
-	// Custom Timer Management
-	std::vector<CustomTimer> loadCustomTimers();
-	void saveCustomTimers(const std::vector<CustomTimer>& timers);
+	// Custom Timer Management: the index at boot, each body when it is needed
+	RoutineIndex loadRoutineIndex();
+	bool loadRoutine(uint16_t id, RoutineStore& out);
+	void saveCustomTimers(const RoutineStore& timers);
 
 	// Alarm Management
 	std::vector<Alarm> loadAlarms();
 	void saveAlarms(const std::vector<Alarm>& alarms);
+
+	// Queues one repository change (register it as a ModelRepository
+	// listener): an edit rewrites only that entity's keys, an add or remove
+	// also the collection's manifest. A reload of what was just loaded only
+	// maps model ids to storage slots; any other reload rewrites everything.
+	void applyChange(const ModelRepository& models, ModelKind kind, ModelChange change, uint16_t id);
+	// Queues a plain setting string under key
+	void queueString(const char* key, const char* value);
+
+	// Ask the flush task to write now (e.g. on leaving a screen); no wait
+	void requestFlush();
+	// Write everything queued before returning (before sleep or reset)
+	void flush();
+	// Between these, flushes write entity copies only: the manifests and
+	// erases wait for commitBatch(), which writes them in one flush. Entities
+	// added in the batch go to fresh slots, so until then a reset loads each
+	// collection as it was before beginBatch().
+	void beginBatch();
+	void commitBatch();
+
+	// Collection files for bulk import/export, in the whole-collection layout
+	// (header, count, one record per entry) the legacy loaders also read.
+	// Written and read an entry at a time, so a file never has to fit in RAM.
+	// A routine header also carries phase and name-byte hints; 0 is no hint.
+	static void encodeCollectionHeader(std::vector<uint8_t>& blob, ModelKind kind, uint32_t count,
+		uint32_t phaseCount = 0, uint32_t nameBytes = 0);
+	static void encodeRecord(std::vector<uint8_t>& blob, const Alarm& alarm);
+	static void encodeRecord(std::vector<uint8_t>& blob, const AlertzyAccount& account);
+	static void encodeRecord(std::vector<uint8_t>& blob, RoutineView routine);
+	static bool readCollectionHeader(RecordReader& in, ModelKind kind, uint32_t* count);
+	// Next record into out; a routine is appended to the store, and nothing
+	// is kept of a record that fails to decode
+	static bool readRecord(RecordReader& in, Alarm& alarm);
+	static bool readRecord(RecordReader& in, AlertzyAccount& account);
+	static bool readRecord(RecordReader& in, RoutineStore& routines);
+
+	const StorageWriteStats& getWriteStats() const { return stats; }
+	const StorageFlushStats& getFlushStats() const { return flushStats; }
 };
 
 #endif
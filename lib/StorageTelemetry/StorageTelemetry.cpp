@@ -0,0 +1,318 @@
+#include "StorageTelemetry.h"
+#include "RecordCodec.h"
+#include <nvs.h>
+#include <esp_system.h>
+#include <algorithm>
+
+#define TELEMETRY_SCHEMA 1
+#define NVS_PAGE_ENTRIES 126 // entries in one 4 KB page; NVS keeps one page free
+
+// Saved from the shutdown hook, which takes no argument
+static StorageTelemetry* shutdownOwner = nullptr;
+
+static void saveOnShutdown() {
+    if (shutdownOwner) shutdownOwner->save();
+}
+
+// Copies key with every run of digits folded to one '#'
+static void keyPattern(char* out, const char* key) {
+    size_t n = 0;
+    for (const char* c = key; *c && n < TELEMETRY_KEY_MAX - 1; ++c) {
+        bool digit = *c >= '0' && *c <= '9';
+        if (!digit) out[n++] = *c;
+        else if (n == 0 || out[n - 1] != '#') out[n++] = '#';
+    }
+    out[n] = '\0';
+}
+
+// A primitive fits in one entry; a string or blob takes a header entry,
+// its data, and for a blob an index entry. A remove only marks entries.
+static uint32_t entriesFor(size_t bytes) {
+    if (bytes == 0) return 0;
+    if (bytes <= 8) return 1;
+    return 2 + (bytes + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE;
+}
+
+StorageTelemetry::StorageTelemetry(NvsService* nvsService, TimeService* timeService)
+    : nvs(nvsService), clock(timeService), lock(nullptr), keyCount(0), today(0), firstDay(0),
+      totalWrites(0), totalBytes(0), totalEntries(0), dirty(false), lastSaveMs(0), lastDayCheckMs(0) {
+    memset(keys, 0, sizeof(keys));
+    memset(days, 0, sizeof(days));
+}
+
+void StorageTelemetry::begin() {
+    if (!lock) lock = xSemaphoreCreateMutex();
+    today = clock->nowUnix() / 86400;
+    lastDayCheckMs = millis();
+    lastSaveMs = millis();
+    {
+        NvsHandle prefs(nvs, TELEMETRY_NAMESPACE);
+        size_t length = prefs ? prefs->getBytesLength(TELEMETRY_KEY) : 0;
+        std::vector<uint8_t> blob(length);
+        if (length > 0 && prefs->getBytes(TELEMETRY_KEY, blob.data(), length) == length && !decode(blob)) {
+            Serial.println("StorageTelemetry: saved counters unreadable, starting over");
+        }
+    }
+    if (firstDay == 0 || firstDay > today) firstDay = today;
+    nvs->setWriteListener(&StorageTelemetry::onWrite, this);
+    shutdownOwner = this;
+    esp_register_shutdown_handler(&saveOnShutdown);
+}
+
+void StorageTelemetry::onWrite(const char* ns, const char* key, size_t bytes, void* context) {
+    static_cast<StorageTelemetry*>(context)->count(key, bytes);
+}
+
+void StorageTelemetry::count(const char* key, size_t bytes) {
+    char pattern[TELEMETRY_KEY_MAX];
+    keyPattern(pattern, key);
+    uint32_t entries = entriesFor(bytes);
+    if (lock) xSemaphoreTake(lock, portMAX_DELAY);
+    NvsKeyWrites* slot = nullptr;
+    for (uint8_t i = 0; i < keyCount && !slot; ++i) {
+        if (strcmp(keys[i].key, pattern) == 0) slot = &keys[i];
+    }
+    if (!slot) {
+        // The last slot is kept for "other" once the table is full
+        slot = &keys[keyCount < TELEMETRY_MAX_KEYS ? keyCount : TELEMETRY_MAX_KEYS - 1];
+        if (keyCount < TELEMETRY_MAX_KEYS - 1) {
+            strcpy(slot->key, pattern);
+            keyCount++;
+        } else if (keyCount == TELEMETRY_MAX_KEYS - 1) {
+            strcpy(slot->key, "other");
+            keyCount++;
+        }
+    }
+    slot->writes++;
+    slot->bytes += bytes;
+    NvsDayWrites& day = dayRecord(today);
+    day.writes++;
+    day.bytes += bytes;
+    day.entries += entries;
+    totalWrites++;
+    totalBytes += bytes;
+    totalEntries += entries;
+    // Saving the counters is counted too, but does not call for another save
+    if (strcmp(key, TELEMETRY_KEY) != 0) dirty = true;
+    if (lock) xSemaphoreGive(lock);
+}
+
+// Caller holds lock; a slot still holding an older day is reset
+NvsDayWrites& StorageTelemetry::dayRecord(uint32_t day) {
+    NvsDayWrites& record = days[day % TELEMETRY_DAYS];
+    if (record.day != day) {
+        memset(&record, 0, sizeof(record));
+        record.day = day;
+    }
+    return record;
+}
+
+void StorageTelemetry::update() {
+    uint32_t now = millis();
+    if (now - lastDayCheckMs >= TELEMETRY_DAY_CHECK_MS) {
+        lastDayCheckMs = now;
+        uint32_t day = clock->nowUnix() / 86400;
+        if (day != today) {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            today = day;
+            if (firstDay > today) firstDay = today; // the RTC was set back
+            xSemaphoreGive(lock);
+        }
+    }
+    if (dirty && now - lastSaveMs >= TELEMETRY_SAVE_INTERVAL_MS) save();
+}
+
+void StorageTelemetry::save() {
+    if (!lock) return;
+    NvsHandle prefs(nvs, TELEMETRY_NAMESPACE);
+    if (!prefs) return;
+    std::vector<uint8_t> blob;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    encode(blob);
+    dirty = false;
+    xSemaphoreGive(lock);
+    lastSaveMs = millis();
+    size_t written = prefs->putBytes(TELEMETRY_KEY, blob.data(), blob.size());
+    if (written != blob.size()) Serial.println("StorageTelemetry: save failed");
+    nvs->noteWrite(TELEMETRY_NAMESPACE, TELEMETRY_KEY, written);
+}
+
+// Header; first day and totals; one record per key pattern; one per day
+void StorageTelemetry::encode(std::vector<uint8_t>& blob) {
+    RecordWriter out(blob);
+    out.writeHeader(RECORD_TELEMETRY, TELEMETRY_SCHEMA);
+    out.beginRecord();
+    out.writeVarint(firstDay);
+    out.writeVarint(totalWrites);
+    out.writeVarint(totalBytes);
+    out.writeVarint(totalEntries);
+    out.endRecord();
+    out.writeVarint(keyCount);
+    for (uint8_t i = 0; i < keyCount; ++i) {
+        out.beginRecord();
+        out.writeString(keys[i].key);
+        out.writeVarint(keys[i].writes);
+        out.writeVarint(keys[i].bytes);
+        out.endRecord();
+    }
+    out.writeVarint(TELEMETRY_DAYS);
+    for (const NvsDayWrites& day : days) {
+        out.beginRecord();
+        out.writeVarint(day.day);
+        out.writeVarint(day.writes);
+        out.writeVarint(day.bytes);
+        out.writeVarint(day.entries);
+        out.endRecord();
+    }
+}
+
+bool StorageTelemetry::decode(const std::vector<uint8_t>& blob) {
+    MemoryRecordSource source(blob.data(), blob.size());
+    RecordReader in(source);
+    uint8_t version;
+    if (!in.readHeader(RECORD_TELEMETRY, &version) || !in.beginRecord()) return false;
+    uint32_t first = in.readVarint();
+    uint32_t writes = in.readVarint();
+    uint32_t bytes = in.readVarint();
+    uint32_t entries = in.readVarint();
+    in.endRecord();
+    uint32_t count = in.readVarint();
+    if (!in.ok() || count > TELEMETRY_MAX_KEYS) return false;
+    NvsKeyWrites loadedKeys[TELEMETRY_MAX_KEYS];
+    for (uint32_t i = 0; i < count && in.beginRecord(); ++i) {
+        in.readString(loadedKeys[i].key, sizeof(loadedKeys[i].key));
+        loadedKeys[i].writes = in.readVarint();
+        loadedKeys[i].bytes = in.readVarint();
+        in.endRecord();
+    }
+    uint32_t dayCount = in.readVarint();
+    NvsDayWrites loadedDays[TELEMETRY_DAYS];
+    memset(loadedDays, 0, sizeof(loadedDays));
+    for (uint32_t i = 0; i < dayCount && in.beginRecord(); ++i) {
+        NvsDayWrites day;
+        day.day = in.readVarint();
+        day.writes = in.readVarint();
+        day.bytes = in.readVarint();
+        day.entries = in.readVarint();
+        in.endRecord();
+        loadedDays[day.day % TELEMETRY_DAYS] = day;
+    }
+    if (!in.ok()) return false;
+    firstDay = first;
+    totalWrites = writes;
+    totalBytes = bytes;
+    totalEntries = entries;
+    keyCount = count;
+    memcpy(keys, loadedKeys, count * sizeof(NvsKeyWrites));
+    memcpy(days, loadedDays, sizeof(days));
+    return true;
+}
+
+bool StorageTelemetry::readUsage(NvsUsage& out) const {
+    nvs_stats_t stats;
+    if (nvs_get_stats(NVS_PARTITION, &stats) != ESP_OK) return false;
+    out.usedEntries = stats.used_entries;
+    out.freeEntries = stats.free_entries;
+    out.totalEntries = stats.total_entries;
+    out.namespaceCount = stats.namespace_count;
+    return true;
+}
+
+bool StorageTelemetry::namespaceEntries(const char* ns, uint32_t* used) const {
+    nvs_handle_t handle;
+    if (nvs_open_from_partition(NVS_PARTITION, ns, NVS_READONLY, &handle) != ESP_OK) return false;
+    size_t count = 0;
+    bool ok = nvs_get_used_entry_count(handle, &count) == ESP_OK;
+    nvs_close(handle);
+    *used = count;
+    return ok;
+}
+
+// Caller holds lock
+uint32_t StorageTelemetry::daysCounted() const {
+    uint32_t counted = today - firstDay + 1;
+    return counted < TELEMETRY_DAYS ? counted : TELEMETRY_DAYS;
+}
+
+uint32_t StorageTelemetry::bytesToday() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t bytes = dayRecord(today).bytes;
+    xSemaphoreGive(lock);
+    return bytes;
+}
+
+float StorageTelemetry::averageBytesPerDay() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t sum = 0;
+    for (const NvsDayWrites& day : days) {
+        if (day.day + TELEMETRY_DAYS > today && day.day <= today) sum += day.bytes;
+    }
+    float average = (float)sum / daysCounted();
+    xSemaphoreGive(lock);
+    return average;
+}
+
+float StorageTelemetry::averageEntriesPerDay() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t sum = 0;
+    for (const NvsDayWrites& day : days) {
+        if (day.day + TELEMETRY_DAYS > today && day.day <= today) sum += day.entries;
+    }
+    float average = (float)sum / daysCounted();
+    xSemaphoreGive(lock);
+    return average;
+}
+
+// NVS fills its pages in turn and erases the oldest to reclaim it, moving
+// live entries along; so every page is erased about once per free entry
+// written, and wears out after endurance * free entries.
+float StorageTelemetry::estimatedLifetimeYears(const NvsUsage& usage) {
+    float perDay = averageEntriesPerDay();
+    if (perDay <= 0) return 0;
+    uint32_t free = usage.freeEntries > NVS_PAGE_ENTRIES ? usage.freeEntries - NVS_PAGE_ENTRIES : 1;
+    return (float)TELEMETRY_FLASH_ENDURANCE * free / perDay / 365.0f;
+}
+
+void StorageTelemetry::dump(Print& out) {
+    NvsUsage usage;
+    if (readUsage(usage)) {
+        out.printf("[NVS] partition: %lu of %lu entries used (%lu%%), %lu free, %lu namespaces\n",
+                   (unsigned long)usage.usedEntries, (unsigned long)usage.totalEntries,
+                   (unsigned long)(usage.totalEntries ? usage.usedEntries * 100 / usage.totalEntries : 0),
+                   (unsigned long)usage.freeEntries, (unsigned long)usage.namespaceCount);
+    } else {
+        out.println("[NVS] partition stats unavailable");
+    }
+    for (uint8_t i = 0; i < nvs->namespaceCount(); ++i) {
+        uint32_t used;
+        if (namespaceEntries(nvs->namespaceName(i), &used)) {
+            out.printf("[NVS]   %s: %lu entries\n", nvs->namespaceName(i), (unsigned long)used);
+        }
+    }
+
+    float bytesPerDay = averageBytesPerDay();
+    float entriesPerDay = averageEntriesPerDay();
+    NvsKeyWrites sorted[TELEMETRY_MAX_KEYS];
+    xSemaphoreTake(lock, portMAX_DELAY);
+    out.printf("[NVS] since day %lu: %lu writes, %lu bytes, ~%lu entries\n", (unsigned long)firstDay,
+               (unsigned long)totalWrites, (unsigned long)totalBytes, (unsigned long)totalEntries);
+    out.printf("[NVS] today %lu bytes; %lu-day average %.0f bytes, %.1f entries a day\n",
+               (unsigned long)dayRecord(today).bytes, (unsigned long)daysCounted(), bytesPerDay, entriesPerDay);
+    uint8_t count = keyCount;
+    memcpy(sorted, keys, count * sizeof(NvsKeyWrites));
+    xSemaphoreGive(lock);
+
+    float years = estimatedLifetimeYears(usage);
+    if (years > 0) {
+        out.printf("[NVS] estimated flash lifetime: %.0f years at this rate (%lu erase cycles)\n", years,
+                   (unsigned long)TELEMETRY_FLASH_ENDURANCE);
+    } else {
+        out.println("[NVS] estimated flash lifetime: no writes counted yet");
+    }
+    std::sort(sorted, sorted + count,
+              [](const NvsKeyWrites& a, const NvsKeyWrites& b) { return a.writes > b.writes; });
+    for (uint8_t i = 0; i < count; ++i) {
+        out.printf("[NVS]   %-15s %6lu writes %8lu bytes\n", sorted[i].key, (unsigned long)sorted[i].writes,
+                   (unsigned long)sorted[i].bytes);
+    }
+}
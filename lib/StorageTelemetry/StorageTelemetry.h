@@ -0,0 +1,101 @@
+#ifndef STORAGETELEMETRY_H
+#define STORAGETELEMETRY_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <vector>
+#include "NvsService.h"
+#include "TimeService.h"
+
+#define TELEMETRY_NAMESPACE "telemetry"
+#define TELEMETRY_KEY "counters"
+#define TELEMETRY_KEY_MAX 16  // NVS keys are at most 15 characters
+#define TELEMETRY_MAX_KEYS 24 // key patterns counted; any beyond share "other"
+#define TELEMETRY_DAYS 7      // daily totals kept, for the averages
+// While counters change they are saved this often (and from the shutdown
+// hook), so telemetry adds a few entries a day at most; a power cut loses
+// what was counted since the last save
+#define TELEMETRY_SAVE_INTERVAL_MS (6UL * 3600UL * 1000UL)
+#define TELEMETRY_DAY_CHECK_MS 60000UL
+#define TELEMETRY_FLASH_ENDURANCE 100000UL // erase cycles per sector, typical NOR flash
+#define NVS_ENTRY_SIZE 32
+
+// Writes to one key pattern: digits are folded to '#', so "rt.#a.#" counts
+// the chunks of every routine's A copy
+struct NvsKeyWrites {
+    char key[TELEMETRY_KEY_MAX];
+    uint32_t writes; // puts and removes
+    uint32_t bytes;
+};
+
+struct NvsDayWrites {
+    uint32_t day; // days since 1970, by the RTC
+    uint32_t writes;
+    uint32_t bytes;
+    uint32_t entries; // 32-byte NVS entries the puts took, estimated
+};
+
+// Partition occupancy from nvs_get_stats, in entries
+struct NvsUsage {
+    uint32_t usedEntries;
+    uint32_t freeEntries;
+    uint32_t totalEntries;
+    uint32_t namespaceCount;
+};
+
+// Counts every NVS write the modules report to NvsService, by key and by
+// day, keeps the counters across reboots and turns them into a partition
+// usage and flash-lifetime report for the diagnostics screen and serial.
+class StorageTelemetry {
+private:
+    NvsService* nvs;
+    TimeService* clock;
+    // Counters; taken inside the NVS lock (writes are reported under it),
+    // never the other way round
+    SemaphoreHandle_t lock;
+    NvsKeyWrites keys[TELEMETRY_MAX_KEYS];
+    uint8_t keyCount;
+    NvsDayWrites days[TELEMETRY_DAYS]; // ring, by day % TELEMETRY_DAYS
+    uint32_t today;
+    uint32_t firstDay; // first day counted; averages cover no more than that
+    uint32_t totalWrites;
+    uint32_t totalBytes;
+    uint32_t totalEntries;
+    bool dirty;
+    uint32_t lastSaveMs;
+    uint32_t lastDayCheckMs;
+
+    static void onWrite(const char* ns, const char* key, size_t bytes, void* context);
+    void count(const char* key, size_t bytes);
+    NvsDayWrites& dayRecord(uint32_t day);
+    uint32_t daysCounted() const;
+    void encode(std::vector<uint8_t>& blob);
+    bool decode(const std::vector<uint8_t>& blob);
+
+public:
+    StorageTelemetry(NvsService* nvsService, TimeService* timeService);
+
+    // Loads the saved counters and starts counting. Call before
+    // StorageManager::begin(), so that at shutdown its flush runs before the
+    // counters are saved.
+    void begin();
+    // From the main loop: day rollover and the periodic save
+    void update();
+    void save();
+
+    bool readUsage(NvsUsage& out) const;
+    // Entries one namespace holds; false if it cannot be opened
+    bool namespaceEntries(const char* ns, uint32_t* used) const;
+    uint32_t bytesToday();
+    // Over the last TELEMETRY_DAYS days, or since counting began if later
+    float averageBytesPerDay();
+    float averageEntriesPerDay();
+    // Years until NVS pages reach TELEMETRY_FLASH_ENDURANCE erases if writes
+    // go on at the average rate; 0 when nothing has been written yet
+    float estimatedLifetimeYears(const NvsUsage& usage);
+
+    void dump(Print& out);
+};
+
+#endif // STORAGETELEMETRY_H
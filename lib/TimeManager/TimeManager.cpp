@@ -1,9 +1,54 @@
 #include "TimeManager.h"
 #include "configs.h"
-#include <Preferences.h>
+#include "TimeService.h"
+#include "TimeZone.h"
+#include "StorageManager.h"
+#include "NvsService.h"
+#include <Wire.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+
+// Clock face layout: HH:MM:SS at text size 2, one 12x16 cell per character
+#define FACE_CHAR_WIDTH 12
+#define FACE_TIME_PAGES 2
+// Data bytes per I2C transaction (Wire buffer minus the control byte)
+#define OLED_I2C_CHUNK 31
+
+// SNTP discipline
+#define RTC_STEP_THRESHOLD_US 100000LL // set the RTC when it is off by more than this
+#define RTC_STEP_WINDOW_US 20000       // write within this long after an NTP second boundary
+#define RTC_STEP_MAX_WAIT_MS 5000UL
+#define RTC_ALIGN_WAIT_MS 60000UL      // wait this long for TimeService to find the rollover
+#define DRIFT_MIN_SPAN_S 21600UL       // offsets at least 6 h apart for a drift estimate
+#define DRIFT_BUDGET_US 100000.0f      // resync before drift can reach this
+#define RESYNC_MIN_S 3600UL
+#define RESYNC_MAX_S 86400UL
+#define AGING_PPM_PER_LSB 0.1f
+
+// DS3231 registers not covered by RTClib
+#define RTC_I2C_ADDRESS 0x68
+#define DS3231_AGING_REG 0x10
+#define DS3231_CONTROL_REG 0x0E
+#define DS3231_CONV_BIT 0x20
+
+// Set from the lwIP task on every SNTP sync; handled by update() in the loop
+static volatile bool sntpSyncEvent = false;
+
+static void onSntpSync(struct timeval* tv) {
+    sntpSyncEvent = true;
+}
+
+extern TimeService timeService;
+extern TimeZone timeZone;
+extern StorageManager storageManager;
+extern NvsService nvsService;
 
 TimeManager::TimeManager(RTC_DS3231* rtcInstance, Adafruit_SSD1306* displayInstance) 
-    : rtc(rtcInstance), display(displayInstance), timeSynced(false), lastSyncTime(0) {
+    : rtc(rtcInstance), display(displayInstance), timeSynced(false), rtcWasReset(false), lastSyncTime(0),
+      measurePending(false), measureSince(0), stepPending(false), stepSince(0), haveBaseline(false), baselineUnix(0),
+      baselineOffsetUs(0), stepCorrectionPending(false), preStepOffsetUs(0), driftPpm(0), resyncIntervalS(RESYNC_MIN_S),
+      sntpStarted(false), lastSyncUnix(0), nextSyncDueUnix(0), faceUnix(0), faceSynced(false) {
+    faceTime[0] = '\0';
 }
 
 bool TimeManager::initialize() {
@@ -13,86 +58,257 @@ bool TimeManager::initialize() {
         return false;
     }
     
+    // All boot-time clock settings come from one borrow of the shared handle
+    NvsHandle p(&nvsService, STORAGE_NAMESPACE);
+    bool prefsOpen = static_cast<bool>(p);
+    if (prefsOpen) loadTimezone(*p);
+
     // Check if RTC lost power and set time if needed
     if (rtc->lostPower()) {
         Serial.println("RTC lost power, setting time...");
-        // Set RTC to the date & time this sketch was compiled
-        rtc->adjust(DateTime(F(__DATE__), F(__TIME__)));
+        rtcWasReset = true;
+        // Set RTC to the date & time this sketch was compiled (local build time)
+        rtc->adjust(DateTime(timeZone.toUtc(DateTime(F(__DATE__), F(__TIME__)).unixtime())));
+    } else if (prefsOpen && !p->getBool("rtc_utc", false)) {
+        // Older firmware kept local time in the RTC
+        uint32_t local = rtc->now().unixtime();
+        rtc->adjust(DateTime(timeZone.toUtc(local)));
+        Serial.println("RTC converted from local time to UTC");
+    }
+    // When NTP last confirmed the RTC, and how fast the RTC was drifting then
+    if (prefsOpen) {
+        if (!p->getBool("rtc_utc", false) && p->putBool("rtc_utc", true)) nvsService.noteWrite(STORAGE_NAMESPACE, "rtc_utc", 1);
+        if (p->isKey("sync_unix")) {
+            lastSyncUnix = p->getUInt("sync_unix", 0);
+            driftPpm = p->getFloat("drift_ppm", 0);
+        }
+    }
+    timeService.invalidate();
+    setenv("TZ", timeZone.getPosix(), 1);
+    tzset();
+    sntp_set_time_sync_notification_cb(onSntpSync);
+
+    // A healthy RTC is trusted until drift could have used up the error budget
+    uint32_t nowUnix = timeService.nowUnix();
+    resyncIntervalS = resyncIntervalFor(driftPpm);
+    bool ntpNeeded = rtcWasReset || lastSyncUnix == 0 || nowUnix < lastSyncUnix ||
+                     nowUnix - lastSyncUnix >= resyncIntervalS;
+    if (ntpNeeded) {
+        startSntp();
+    } else {
+        timeSynced = true;
+        nextSyncDueUnix = lastSyncUnix + resyncIntervalS;
+        Serial.printf("RTC trusted: NTP sync %lu s ago at %+.2f ppm; next check in %lu s\n",
+                      (unsigned long)(nowUnix - lastSyncUnix), driftPpm, (unsigned long)(nextSyncDueUnix - nowUnix));
     }
-    
-    // Configure NTP and timezone. Load saved GMT offset from Preferences if available
-    int gmt_offset = 0;
-    Preferences p;
-    if (p.begin("storage", true, "nvs")) {
-        if (p.isKey("gmt_offset")) gmt_offset = p.getInt("gmt_offset", 0);
-        p.end();
-    }
-    configTime(0, 0, ntpServer);
-    setTimezone(gmt_offset); // Apply stored or default GMT offset
     
     return true;
 }
 
+// SNTP and the RTC both run in UTC; results arrive through onSntpSync
+void TimeManager::startSntp() {
+    sntp_set_sync_interval(resyncIntervalS * 1000UL);
+    configTime(0, 0, NTP_SERVER);
+    // configTime() rewrites TZ
+    setenv("TZ", timeZone.getPosix(), 1);
+    tzset();
+    sntpStarted = true;
+    Serial.println("[NTP] SNTP started");
+}
+
+void TimeManager::saveSyncRecord(uint32_t utcUnix) {
+    lastSyncUnix = utcUnix;
+    NvsHandle p(&nvsService, STORAGE_NAMESPACE);
+    if (p) {
+        nvsService.noteWrite(STORAGE_NAMESPACE, "sync_unix", p->putUInt("sync_unix", utcUnix));
+        nvsService.noteWrite(STORAGE_NAMESPACE, "drift_ppm", p->putFloat("drift_ppm", driftPpm));
+    }
+}
+
+// Saved POSIX zone, or the whole-hour offset older firmware stored
+void TimeManager::loadTimezone(Preferences& p) {
+    if (p.isKey("tz")) {
+        String posixTz = p.getString("tz", "UTC0");
+        if (!timeZone.set(posixTz.c_str())) Serial.printf("Saved timezone \"%s\" is invalid\n", posixTz.c_str());
+        return;
+    }
+    if (p.isKey("gmt_offset")) {
+        int hours = p.getInt("gmt_offset", 0);
+        char posixTz[16];
+        snprintf(posixTz, sizeof(posixTz), "<%+03d>%d", hours, -hours);
+        if (timeZone.set(posixTz)) nvsService.noteWrite(STORAGE_NAMESPACE, "tz", p.putString("tz", posixTz));
+        if (p.remove("gmt_offset")) nvsService.noteWrite(STORAGE_NAMESPACE, "gmt_offset", 0);
+    }
+}
+
 bool TimeManager::syncTime() {
     if (!WiFi.isConnected()) {
         Serial.println("WiFi not connected, cannot sync time");
         return false;
     }
-    
-    // Check if we need to sync (every 24 hours)
-    if (timeSynced && (millis() - lastSyncTime < syncInterval)) {
-        return true; // Already synced recently
-    }
-    
-    Serial.println("Syncing time with NTP server...");
-    
-    // Try to sync with NTP
-    if (syncWithNTP()) {
+    // SNTP runs in the background (started by configTime); each result is
+    // applied to the RTC by update()
+    if (!timeSynced) Serial.println("Waiting for SNTP...");
+    return timeSynced;
+}
+
+bool TimeManager::update() {
+    if (!sntpStarted && timeService.nowUnix() >= nextSyncDueUnix) startSntp();
+    if (sntpSyncEvent) {
+        sntpSyncEvent = false;
         timeSynced = true;
         lastSyncTime = millis();
-        Serial.println("Time synchronized successfully");
-        return true;
+        measurePending = true;
+        measureSince = millis();
     }
-    
-    Serial.println("Failed to sync time with NTP");
+    if (measurePending) {
+        // The offset is only meaningful once the RTC second rollover is known
+        if (timeService.isAligned()) {
+            measurePending = false;
+            measureRtcOffset();
+        } else if (millis() - measureSince > RTC_ALIGN_WAIT_MS) {
+            measurePending = false;
+            Serial.println("[NTP] RTC phase unknown; setting it without a drift sample");
+            haveBaseline = false;
+            stepCorrectionPending = false;
+            stepPending = true;
+            stepSince = millis();
+        }
+    }
+    if (stepPending) return stepRtcToSystemTime();
     return false;
 }
 
-bool TimeManager::syncWithNTP() {
-    // Quick check for NTP time; non-blocking: return immediately if not available
-    time_t now = time(nullptr);
-    if (now < 24 * 3600) {
-        // Not yet set by NTP
-        return false;
+// NTP time (UTC, the RTC's time base) in microseconds
+int64_t TimeManager::utcMicros(uint32_t* utcUnix) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    *utcUnix = tv.tv_sec;
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+void TimeManager::measureRtcOffset() {
+    uint32_t ntpUnix;
+    int64_t offsetUs = timeService.nowMicros() - utcMicros(&ntpUnix);
+    Serial.printf("[NTP] RTC offset %+.1f ms\n", offsetUs / 1000.0);
+    bool inSync = offsetUs <= RTC_STEP_THRESHOLD_US && offsetUs >= -RTC_STEP_THRESHOLD_US;
+    if (stepCorrectionPending) {
+        // First sample after a step: keep the drift baseline, shifted by the step
+        stepCorrectionPending = false;
+        baselineOffsetUs += offsetUs - preStepOffsetUs;
+        if (inSync) saveSyncRecord(ntpUnix);
+        return;
     }
-    
-    // Convert to DateTime and set RTC
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) {
-        return false;
+
+    // Drift = change of the offset since the baseline, in us per s (ppm)
+    if (haveBaseline && ntpUnix - baselineUnix >= DRIFT_MIN_SPAN_S) {
+        uint32_t span = ntpUnix - baselineUnix;
+        driftPpm = (float)(offsetUs - baselineOffsetUs) / (float)span;
+        Serial.printf("[NTP] RTC drift %+.2f ppm over %lu s\n", driftPpm, (unsigned long)span);
+        trimAging(driftPpm);
+        adaptResyncInterval();
+        haveBaseline = false; // the rate may have changed; measure again from here
     }
-    
-    DateTime ntpTime(
-        timeinfo.tm_year + 1900,
-        timeinfo.tm_mon + 1,
-        timeinfo.tm_mday,
-        timeinfo.tm_hour,
-        timeinfo.tm_min,
-        timeinfo.tm_sec
-    );
-    
-    setRTCTime(ntpTime);
+    // Lets the next boot skip NTP while the RTC is still within budget
+    if (inSync) saveSyncRecord(ntpUnix);
+
+    if (!inSync) {
+        stepCorrectionPending = haveBaseline;
+        preStepOffsetUs = offsetUs;
+        stepPending = true;
+        stepSince = millis();
+    } else if (!haveBaseline) {
+        baselineUnix = ntpUnix;
+        baselineOffsetUs = offsetUs;
+        haveBaseline = true;
+    }
+}
+
+// Writing the seconds register restarts the DS3231 countdown chain, so the
+// write is done just after an NTP second boundary to keep the phase
+bool TimeManager::stepRtcToSystemTime() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    bool waitedTooLong = millis() - stepSince > RTC_STEP_MAX_WAIT_MS;
+    if (tv.tv_usec > RTC_STEP_WINDOW_US && !waitedTooLong) return false;
+
+    setRTCTime(DateTime((uint32_t)tv.tv_sec));
+    stepPending = false;
+    // Re-measure once realigned; that sample becomes the new drift baseline
+    measurePending = true;
+    measureSince = millis();
     return true;
 }
 
+// Positive aging values slow the oscillator (about 0.1 ppm per step at 25 C)
+void TimeManager::trimAging(float ppm) {
+    int steps = (int)(ppm / AGING_PPM_PER_LSB); // truncated: no dithering on the last step
+    if (steps == 0) return;
+    int8_t current = readAgingOffset();
+    int target = constrain((int)current + steps, -128, 127);
+    if (target == current) return;
+    writeAgingOffset((int8_t)target);
+    Serial.printf("[NTP] DS3231 aging offset %d -> %d\n", current, target);
+}
+
+// Resync before the measured drift can put the RTC more than the budget off
+uint32_t TimeManager::resyncIntervalFor(float ppm) {
+    float rate = fabsf(ppm);
+    if (rate < 0.1f) rate = 0.1f;
+    uint32_t interval = (uint32_t)(DRIFT_BUDGET_US / rate);
+    return constrain(interval, RESYNC_MIN_S, RESYNC_MAX_S);
+}
+
+// A new interval only applies after the pending one runs out (up to
+// RESYNC_MAX_S) unless SNTP is restarted; the restart also asks the server
+// again now, which starts the next drift baseline
+void TimeManager::adaptResyncInterval() {
+    uint32_t interval = resyncIntervalFor(driftPpm);
+    if (interval == resyncIntervalS) return;
+    resyncIntervalS = interval;
+    sntp_set_sync_interval(resyncIntervalS * 1000UL);
+    sntp_restart();
+    Serial.printf("[NTP] next sync in %lu s\n", (unsigned long)resyncIntervalS);
+}
+
+int8_t TimeManager::readAgingOffset() {
+    Wire.beginTransmission(RTC_I2C_ADDRESS);
+    Wire.write((uint8_t)DS3231_AGING_REG);
+    Wire.endTransmission();
+    if (Wire.requestFrom((uint8_t)RTC_I2C_ADDRESS, (uint8_t)1) != 1) return 0;
+    return (int8_t)Wire.read();
+}
+
+void TimeManager::writeAgingOffset(int8_t value) {
+    Wire.beginTransmission(RTC_I2C_ADDRESS);
+    Wire.write((uint8_t)DS3231_AGING_REG);
+    Wire.write((uint8_t)value);
+    Wire.endTransmission();
+    // Start a temperature conversion so the new value takes effect now, not in up to 64 s
+    Wire.beginTransmission(RTC_I2C_ADDRESS);
+    Wire.write((uint8_t)DS3231_CONTROL_REG);
+    Wire.endTransmission();
+    if (Wire.requestFrom((uint8_t)RTC_I2C_ADDRESS, (uint8_t)1) != 1) return;
+    uint8_t control = Wire.read();
+    Wire.beginTransmission(RTC_I2C_ADDRESS);
+    Wire.write((uint8_t)DS3231_CONTROL_REG);
+    Wire.write((uint8_t)(control | DS3231_CONV_BIT));
+    Wire.endTransmission();
+}
+
+float TimeManager::getDriftPpm() const {
+    return driftPpm;
+}
+
 void TimeManager::setRTCTime(const DateTime& ntpTime) {
     rtc->adjust(ntpTime);
+    timeService.invalidate();
     Serial.print("RTC set to: ");
     Serial.println(formatTime(ntpTime));
 }
 
 DateTime TimeManager::getCurrentTime() {
-    return rtc->now();
+    return DateTime(timeZone.toLocal(timeService.nowUnix()));
 }
 
 String TimeManager::getCurrentTimeString() {
@@ -117,11 +333,67 @@ String TimeManager::formatDate(const DateTime& time) {
     return String(dateStr);
 }
 
+void TimeManager::invalidateClockFace() {
+    faceUnix = 0;
+}
+
 void TimeManager::displayCurrentTime() {
     if (!display) return;
-    
-    DateTime now = getCurrentTime();
-    
+
+    // The face only changes on the second boundary (faceUnix is local time)
+    uint32_t nowUnix = timeZone.toLocal(timeService.nowUnix());
+    if (nowUnix == faceUnix && timeSynced == faceSynced) return;
+
+    DateTime now(nowUnix);
+    String timeStr = formatTime(now);
+    bool fullRedraw = faceUnix == 0 || timeSynced != faceSynced || nowUnix < faceUnix ||
+                      nowUnix / 86400UL != faceUnix / 86400UL; // new date/weekday
+    if (fullRedraw) {
+        drawClockFace(now);
+    } else {
+        // Repaint just the changed digits and push only their columns
+        display->setTextSize(2);
+        display->setTextColor(SSD1306_WHITE);
+        int first = -1, last = -1;
+        for (int i = 0; i < 8; ++i) {
+            if (timeStr[i] == faceTime[i]) continue;
+            if (first < 0) first = i;
+            last = i;
+            display->fillRect(i * FACE_CHAR_WIDTH, 0, FACE_CHAR_WIDTH, FACE_TIME_PAGES * 8, SSD1306_BLACK);
+            display->setCursor(i * FACE_CHAR_WIDTH, 0);
+            display->print(timeStr[i]);
+        }
+        if (first >= 0) {
+            flushRegion(first * FACE_CHAR_WIDTH, (last + 1) * FACE_CHAR_WIDTH - 1, 0, FACE_TIME_PAGES - 1);
+        }
+    }
+    faceUnix = nowUnix;
+    faceSynced = timeSynced;
+    strncpy(faceTime, timeStr.c_str(), sizeof(faceTime) - 1);
+    faceTime[sizeof(faceTime) - 1] = '\0';
+}
+
+// Push one rectangle of the frame buffer (whole 8-px pages) instead of all 1 KB
+void TimeManager::flushRegion(uint8_t x0, uint8_t x1, uint8_t page0, uint8_t page1) {
+    display->ssd1306_command(SSD1306_PAGEADDR);
+    display->ssd1306_command(page0);
+    display->ssd1306_command(page1);
+    display->ssd1306_command(SSD1306_COLUMNADDR);
+    display->ssd1306_command(x0);
+    display->ssd1306_command(x1);
+    const uint8_t* buffer = display->getBuffer();
+    for (uint8_t page = page0; page <= page1; ++page) {
+        const uint8_t* row = buffer + page * SCREEN_WIDTH;
+        for (int x = x0; x <= x1;) {
+            Wire.beginTransmission(OLED_I2C_ADDRESS);
+            Wire.write((uint8_t)0x40); // data stream follows
+            for (int n = 0; n < OLED_I2C_CHUNK && x <= x1; ++n, ++x) Wire.write(row[x]);
+            Wire.endTransmission();
+        }
+    }
+}
+
+void TimeManager::drawClockFace(const DateTime& now) {
     display->clearDisplay();
     display->setTextSize(2);
     display->setTextColor(SSD1306_WHITE);
@@ -180,9 +452,12 @@ bool TimeManager::isTimeSynced() const {
     return timeSynced;
 }
 
+bool TimeManager::wasRtcReset() const {
+    return rtcWasReset;
+}
+
 unsigned long TimeManager::getUnixTimestamp() {
-    DateTime now = getCurrentTime();
-    return now.unixtime();
+    return timeService.nowUnix();
 }
 
 bool TimeManager::isAlarmTime(const DateTime& alarmTime) {
@@ -197,8 +472,17 @@ int TimeManager::getDayOfWeek() {
     return now.dayOfTheWeek();
 }
 
-void TimeManager::setTimezone(int gmtOffsetHours, bool daylightSaving) {
-    long gmtOffset = gmtOffsetHours * 3600;
-    int daylightOffset = daylightSaving ? 3600 : 0;
-    configTime(gmtOffset, daylightOffset, ntpServer);
+bool TimeManager::setTimezone(const char* posixTz) {
+    if (!timeZone.set(posixTz)) return false;
+    // Keep libc's localtime() in step for anything that still uses it
+    setenv("TZ", posixTz, 1);
+    tzset();
+    storageManager.queueString("tz", posixTz); // written behind, with the other settings
+    faceUnix = 0;
+    Serial.printf("Timezone set to %s\n", posixTz);
+    return true;
+}
+
+const char* TimeManager::getTimezone() const {
+    return timeZone.getPosix();
 }
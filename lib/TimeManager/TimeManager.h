@@ -6,44 +6,87 @@
 #include <RTClib.h>
 #include <time.h>
 #include <Adafruit_SSD1306.h>
+#include <Preferences.h>
 
 class TimeManager {
 private:
     RTC_DS3231* rtc;
     Adafruit_SSD1306* display;
     
-    // NTP Configuration
-    const char* ntpServer = "pool.ntp.org";
-    const long gmtOffset_sec = 0;  // Will be set based on timezone
-    const int daylightOffset_sec = 3600;
+    // NTP server is NTP_SERVER from configs.h. The RTC keeps UTC; local time
+    // comes from the global TimeZone.
     
     // Time synchronization status
     bool timeSynced;
+    bool rtcWasReset; // RTC lost power and was reset to build time
     unsigned long lastSyncTime;
-    const unsigned long syncInterval = 24 * 60 * 60 * 1000; // 24 hours
+
+    // SNTP discipline of the DS3231 (sync events come from the lwIP task)
+    bool measurePending;        // new SNTP time; measure the RTC offset once aligned
+    unsigned long measureSince;
+    bool stepPending;           // RTC too far off; write it at the next NTP second boundary
+    unsigned long stepSince;
+    bool haveBaseline;          // offset reference for the drift estimate
+    uint32_t baselineUnix;
+    int64_t baselineOffsetUs;
+    bool stepCorrectionPending; // baseline carried over a step; correct it by the step size
+    int64_t preStepOffsetUs;
+    float driftPpm;
+    uint32_t resyncIntervalS;
+    // SNTP is started only once the RTC is due for a check (see initialize)
+    bool sntpStarted;
+    uint32_t lastSyncUnix;    // last NTP-confirmed RTC time, from NVS
+    uint32_t nextSyncDueUnix;
+
+    // Clock face as last drawn, so only changed digits are redrawn
+    uint32_t faceUnix; // 0 = redraw everything
+    char faceTime[9];
+    bool faceSynced;
     
     // Internal methods
-    bool syncWithNTP();
     void setRTCTime(const DateTime& ntpTime);
+    void measureRtcOffset();
+    bool stepRtcToSystemTime();
+    void trimAging(float ppm);
+    void adaptResyncInterval();
+    static uint32_t resyncIntervalFor(float ppm);
+    void startSntp();
+    void saveSyncRecord(uint32_t utcUnix);
+    int8_t readAgingOffset();
+    void writeAgingOffset(int8_t value);
+    static int64_t utcMicros(uint32_t* utcUnix);
+    void loadTimezone(Preferences& p);
     String formatTime(const DateTime& time);
     String formatDate(const DateTime& time);
+    void drawClockFace(const DateTime& now);
+    void flushRegion(uint8_t x0, uint8_t x1, uint8_t page0, uint8_t page1);
     
 public:
     // Constructor
     TimeManager(RTC_DS3231* rtcInstance, Adafruit_SSD1306* displayInstance);
     
     // Initialization and synchronization
+    // Restores time from the RTC without touching the network. SNTP starts
+    // right away only if the RTC lost power or is due a check by its stored
+    // last-sync time and drift; otherwise update() starts it when due.
     bool initialize();
     bool syncTime();
+    // Apply SNTP results to the RTC; call from the main loop. True when the RTC was stepped.
+    bool update();
+    float getDriftPpm() const;
     bool isTimeSynced() const;
+    bool wasRtcReset() const;
     
-    // Time retrieval
+    // Time retrieval (local time; getUnixTimestamp() is UTC)
     DateTime getCurrentTime();
     String getCurrentTimeString();
     String getCurrentDateString();
     
     // Display methods
+    // Redraws only when the second changes; cheap to call every loop
     void displayCurrentTime();
+    // Next displayCurrentTime() repaints the whole face (screen was overwritten)
+    void invalidateClockFace();
     void displayTimeSyncStatus();
     
     // Utility methods
@@ -52,7 +95,10 @@ public:
     int getDayOfWeek();
     
     // Configuration
-    void setTimezone(int gmtOffsetHours, bool daylightSaving = true);
+    // POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"; applied and saved to NVS.
+    // False if it does not parse.
+    bool setTimezone(const char* posixTz);
+    const char* getTimezone() const;
 };
 
 #endif // TIMEMANAGER_H
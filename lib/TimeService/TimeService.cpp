@@ -0,0 +1,120 @@
+#include "TimeService.h"
+
+#define US_PER_SECOND 1000000LL
+// Probe reads are at least this far apart
+#define TIME_PROBE_SPACING_US 250000LL
+// Rollover bracket narrower than this counts as aligned
+#define TIME_ALIGNED_WIDTH_US 5000LL
+// Aligned: one read this often to catch drift and clock changes
+#define TIME_VERIFY_INTERVAL_US 60000000LL
+// esp_timer crystal vs DS3231, worst case
+#define TIME_DRIFT_PPM 50
+
+TimeService::TimeService(RTC_DS3231* rtcInstance)
+    : rtc(rtcInstance), anchored(false), anchorUnix(0), earliestUs(0), latestUs(0), lastProbeUs(0),
+      lastReturned(0), rtcReads(0), readsAtReport(0), lastReportUs(0) {}
+
+// All we know from a single read: the second began within the last second
+void TimeService::restartAnchor(uint32_t rtcUnix, int64_t readUs) {
+    anchored = true;
+    anchorUnix = rtcUnix;
+    earliestUs = readUs - US_PER_SECOND + 1;
+    latestUs = readUs;
+    lastReturned = 0;
+}
+
+uint32_t TimeService::sampleRtc() {
+    int64_t before = esp_timer_get_time();
+    uint32_t rtcUnix = rtc->now().unixtime();
+    int64_t readUs = (before + esp_timer_get_time()) / 2;
+    rtcReads++;
+
+    if (!anchored) {
+        restartAnchor(rtcUnix, readUs);
+        lastProbeUs = readUs;
+        return rtcUnix;
+    }
+
+    // The two clocks drift apart a little between probes
+    int64_t drift = (readUs - lastProbeUs) * TIME_DRIFT_PPM / US_PER_SECOND;
+    earliestUs -= drift;
+    latestUs += drift;
+    if (latestUs - earliestUs >= US_PER_SECOND) earliestUs = latestUs - US_PER_SECOND + 1;
+    lastProbeUs = readUs;
+
+    // Reading rtcUnix at readUs means anchorUnix began in (readUs - (k+1) s, readUs - k s]
+    int64_t k = (int64_t)rtcUnix - (int64_t)anchorUnix;
+    int64_t lo = readUs - (k + 1) * US_PER_SECOND + 1;
+    int64_t hi = readUs - k * US_PER_SECOND;
+    if (lo > latestUs || hi < earliestUs) {
+        // Clock was set behind our back (or drifted further than modelled)
+        restartAnchor(rtcUnix, readUs);
+        return rtcUnix;
+    }
+    if (lo > earliestUs) earliestUs = lo;
+    if (hi < latestUs) latestUs = hi;
+    // Move the anchor to the second just read
+    anchorUnix = rtcUnix;
+    earliestUs += k * US_PER_SECOND;
+    latestUs += k * US_PER_SECOND;
+    return rtcUnix;
+}
+
+uint32_t TimeService::nowUnix() {
+    if (!anchored) return lastReturned = sampleRtc();
+    int64_t elapsed = esp_timer_get_time() - (earliestUs + latestUs) / 2;
+    int64_t seconds = (elapsed >= 0) ? elapsed / US_PER_SECOND : -((-elapsed + US_PER_SECOND - 1) / US_PER_SECOND);
+    uint32_t value = anchorUnix + (int32_t)seconds;
+    // A narrowed bracket can move the estimate back by a fraction of a second
+    if (value < lastReturned && lastReturned - value <= 1) value = lastReturned;
+    lastReturned = value;
+    return value;
+}
+
+int64_t TimeService::nowMicros() {
+    if (!anchored) sampleRtc();
+    int64_t elapsed = esp_timer_get_time() - (earliestUs + latestUs) / 2;
+    return (int64_t)anchorUnix * US_PER_SECOND + elapsed;
+}
+
+DateTime TimeService::now() {
+    return DateTime(nowUnix());
+}
+
+void TimeService::invalidate() {
+    anchored = false;
+    lastReturned = 0;
+}
+
+void TimeService::update() {
+    int64_t nowUs = esp_timer_get_time();
+    if (!anchored) {
+        sampleRtc();
+    } else if (nowUs - lastProbeUs >= TIME_PROBE_SPACING_US) {
+        int64_t width = latestUs - earliestUs;
+        // A read is only informative while the rollover bracket is open and
+        // this pass falls inside it (modulo whole seconds)
+        bool inBracket = (nowUs - earliestUs) % US_PER_SECOND <= width;
+        bool narrowing = width > TIME_ALIGNED_WIDTH_US && inBracket;
+        if (narrowing || nowUs - lastProbeUs >= TIME_VERIFY_INTERVAL_US) sampleRtc();
+    }
+}
+
+// RTC reads since the previous dump (or boot), for the "time" serial command
+void TimeService::dump(Print& out) {
+    int64_t nowUs = esp_timer_get_time();
+    uint32_t reads = rtcReads - readsAtReport;
+    float seconds = (nowUs - lastReportUs) / 1e6f;
+    out.printf("[Time] %lu RTC reads in %.0f s (%.3f/s), rollover known to %ld us\n", (unsigned long)reads, seconds,
+               seconds > 0 ? reads / seconds : 0.0f, (long)(latestUs - earliestUs));
+    readsAtReport = rtcReads;
+    lastReportUs = nowUs;
+}
+
+bool TimeService::isAligned() const {
+    return anchored && latestUs - earliestUs <= TIME_ALIGNED_WIDTH_US;
+}
+
+uint32_t TimeService::getRtcReads() const {
+    return rtcReads;
+}
@@ -0,0 +1,51 @@
+#ifndef TIMESERVICE_H
+#define TIMESERVICE_H
+
+#include <Arduino.h>
+#include <RTClib.h>
+#include <esp_timer.h>
+
+// Cached wall clock shared by every module that needs "now". The DS3231 is
+// read once to anchor the current second, then time is interpolated from the
+// esp_timer clock. Occasional probe reads bracket the instant the RTC second
+// rolls over, so the interpolated second flips within a few ms of the RTC's.
+class TimeService {
+private:
+    RTC_DS3231* rtc;
+    bool anchored;
+    uint32_t anchorUnix; // RTC second whose start is bracketed below
+    int64_t earliestUs;  // esp_timer bounds on when anchorUnix began
+    int64_t latestUs;
+    int64_t lastProbeUs;
+    uint32_t lastReturned; // keeps re-estimates from stepping time back
+
+    // RTC read statistics
+    uint32_t rtcReads;
+    uint32_t readsAtReport;
+    int64_t lastReportUs;
+
+    void restartAnchor(uint32_t rtcUnix, int64_t readUs);
+
+public:
+    explicit TimeService(RTC_DS3231* rtcInstance);
+
+    // Cheap, consistent current time (one I2C read only before the first anchor)
+    DateTime now();
+    uint32_t nowUnix();
+    // RTC time with sub-second resolution, in microseconds (meaningful once aligned)
+    int64_t nowMicros();
+
+    // Read the RTC now and refine the anchor; returns the RTC's time
+    uint32_t sampleRtc();
+    // Forget the anchor after the RTC was set
+    void invalidate();
+    // Probe when useful; call from the main loop
+    void update();
+    // Log the RTC read rate since the previous dump
+    void dump(Print& out);
+
+    bool isAligned() const;
+    uint32_t getRtcReads() const;
+};
+
+#endif // TIMESERVICE_H
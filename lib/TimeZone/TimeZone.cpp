@@ -0,0 +1,296 @@
+#include "TimeZone.h"
+#include <RTClib.h>
+
+#define SECONDS_PER_DAY 86400UL
+#define DEFAULT_RULE_TIME 7200 // 02:00 local
+
+const TimeZonePreset TIME_ZONE_PRESETS[] = {
+    {"UTC", "UTC0"},
+    {"London", "GMT0BST,M3.5.0/1,M10.5.0"},
+    {"Lisbon", "WET0WEST,M3.5.0/1,M10.5.0"},
+    {"Berlin/Paris", "CET-1CEST,M3.5.0,M10.5.0/3"},
+    {"Athens/Kyiv", "EET-2EEST,M3.5.0/3,M10.5.0/4"},
+    {"Moscow", "MSK-3"},
+    {"Dubai", "<+04>-4"},
+    {"India", "IST-5:30"},
+    {"Nepal", "<+0545>-5:45"},
+    {"Bangkok", "<+07>-7"},
+    {"China/Singapore", "CST-8"},
+    {"Japan", "JST-9"},
+    {"Adelaide", "ACST-9:30ACDT,M10.1.0,M4.1.0/3"},
+    {"Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3"},
+    {"Auckland", "NZST-12NZDT,M9.5.0,M4.1.0/3"},
+    {"Sao Paulo", "<-03>3"},
+    {"Newfoundland", "NST3:30NDT,M3.2.0,M11.1.0"},
+    {"New York", "EST5EDT,M3.2.0,M11.1.0"},
+    {"Chicago", "CST6CDT,M3.2.0,M11.1.0"},
+    {"Denver", "MST7MDT,M3.2.0,M11.1.0"},
+    {"Phoenix", "MST7"},
+    {"Los Angeles", "PST8PDT,M3.2.0,M11.1.0"},
+    {"Anchorage", "AKST9AKDT,M3.2.0,M11.1.0"},
+    {"Honolulu", "HST10"},
+};
+const int TIME_ZONE_PRESET_COUNT = sizeof(TIME_ZONE_PRESETS) / sizeof(TIME_ZONE_PRESETS[0]);
+
+static bool isLeapYear(uint16_t year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static uint32_t startOfYear(uint16_t year) {
+    return DateTime(year, 1, 1, 0, 0, 0).unixtime();
+}
+
+TimeZone::TimeZone()
+    : stdOffset(0), dstOffset(0), hasDst(false), tableSize(0), baseOffset(0), baseDst(false), tableFrom(0),
+      tableTo(0) {
+    strcpy(posix, "UTC0");
+    strcpy(stdName, "UTC");
+    dstName[0] = '\0';
+    memset(&startRule, 0, sizeof(startRule));
+    memset(&endRule, 0, sizeof(endRule));
+}
+
+// "CET" or quoted "<+0530>"; POSIX wants at least three characters
+const char* TimeZone::parseName(const char* p, char* out) {
+    int len = 0;
+    if (*p == '<') {
+        p++;
+        while (*p && *p != '>') {
+            if (len < TZ_NAME_MAX - 1) out[len] = *p;
+            len++;
+            p++;
+        }
+        if (*p != '>') return nullptr;
+        p++;
+    } else {
+        while (isalpha((unsigned char)*p)) {
+            if (len < TZ_NAME_MAX - 1) out[len] = *p;
+            len++;
+            p++;
+        }
+    }
+    if (len < 3) return nullptr;
+    out[len < TZ_NAME_MAX - 1 ? len : TZ_NAME_MAX - 1] = '\0';
+    return p;
+}
+
+// [+-]hh[:mm[:ss]] in seconds, sign as written
+const char* TimeZone::parseOffset(const char* p, int32_t* seconds) {
+    int sign = 1;
+    if (*p == '+' || *p == '-') {
+        if (*p == '-') sign = -1;
+        p++;
+    }
+    if (!isdigit((unsigned char)*p)) return nullptr;
+    int32_t parts[3] = {0, 0, 0};
+    for (int i = 0; i < 3; i++) {
+        if (i > 0) {
+            if (*p != ':') break;
+            p++;
+            if (!isdigit((unsigned char)*p)) return nullptr;
+        }
+        int32_t value = 0;
+        int digits = 0;
+        while (isdigit((unsigned char)*p) && digits < 3) {
+            value = value * 10 + (*p - '0');
+            digits++;
+            p++;
+        }
+        parts[i] = value;
+    }
+    if (parts[0] > 167 || parts[1] > 59 || parts[2] > 59) return nullptr;
+    *seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+    return p;
+}
+
+static const char* parseNumber(const char* p, int* value) {
+    if (!isdigit((unsigned char)*p)) return nullptr;
+    *value = 0;
+    while (isdigit((unsigned char)*p)) {
+        *value = *value * 10 + (*p - '0');
+        if (*value > 1000) return nullptr;
+        p++;
+    }
+    return p;
+}
+
+// Mm.w.d, Jn or n, then an optional /time
+const char* TimeZone::parseRule(const char* p, Rule* rule) {
+    int a, b, c;
+    memset(rule, 0, sizeof(*rule));
+    if (*p == 'M') {
+        rule->kind = 'M';
+        if (!(p = parseNumber(p + 1, &a)) || *p != '.') return nullptr;
+        if (!(p = parseNumber(p + 1, &b)) || *p != '.') return nullptr;
+        if (!(p = parseNumber(p + 1, &c))) return nullptr;
+        if (a < 1 || a > 12 || b < 1 || b > 5 || c > 6) return nullptr;
+        rule->month = a;
+        rule->week = b;
+        rule->weekday = c;
+    } else if (*p == 'J') {
+        rule->kind = 'J';
+        if (!(p = parseNumber(p + 1, &a)) || a < 1 || a > 365) return nullptr;
+        rule->day = a;
+    } else {
+        rule->kind = 'D';
+        if (!(p = parseNumber(p, &a)) || a > 365) return nullptr;
+        rule->day = a;
+    }
+    rule->time = DEFAULT_RULE_TIME;
+    if (*p == '/') {
+        if (!(p = parseOffset(p + 1, &rule->time))) return nullptr;
+    }
+    return p;
+}
+
+// Local wall-clock instant (as seconds since the epoch) a rule names in a year
+uint32_t TimeZone::ruleLocalInstant(const Rule& rule, uint16_t year) {
+    if (rule.kind == 'M') {
+        DateTime first(year, rule.month, 1, 0, 0, 0);
+        uint32_t monthStart = first.unixtime();
+        uint32_t nextMonth = (rule.month == 12) ? startOfYear(year + 1)
+                                                : DateTime(year, rule.month + 1, 1, 0, 0, 0).unixtime();
+        int daysInMonth = (nextMonth - monthStart) / SECONDS_PER_DAY;
+        int day = 1 + (rule.weekday - first.dayOfTheWeek() + 7) % 7 + (rule.week - 1) * 7;
+        while (day > daysInMonth) day -= 7;
+        return monthStart + (day - 1) * SECONDS_PER_DAY + rule.time;
+    }
+    uint32_t dayIndex = rule.day;
+    if (rule.kind == 'J') {
+        dayIndex = rule.day - 1;
+        if (isLeapYear(year) && rule.day >= 60) dayIndex++;
+    }
+    return startOfYear(year) + dayIndex * SECONDS_PER_DAY + rule.time;
+}
+
+bool TimeZone::set(const char* posixTz) {
+    if (posixTz == nullptr || strlen(posixTz) >= TZ_POSIX_MAX) return false;
+
+    char newStd[TZ_NAME_MAX], newDst[TZ_NAME_MAX] = "";
+    int32_t newStdOffset, newDstOffset;
+    bool newHasDst = false;
+    Rule newStart, newEnd;
+
+    const char* p = parseName(posixTz, newStd);
+    if (!p || !(p = parseOffset(p, &newStdOffset))) return false;
+    // POSIX offsets count west of Greenwich
+    newStdOffset = -newStdOffset;
+    newDstOffset = newStdOffset;
+
+    if (*p) {
+        if (!(p = parseName(p, newDst))) return false;
+        newHasDst = true;
+        newDstOffset = newStdOffset + 3600;
+        if (*p && *p != ',') {
+            if (!(p = parseOffset(p, &newDstOffset))) return false;
+            newDstOffset = -newDstOffset;
+        }
+        if (*p == ',') {
+            if (!(p = parseRule(p + 1, &newStart)) || *p != ',') return false;
+            if (!(p = parseRule(p + 1, &newEnd))) return false;
+        } else {
+            // No rules given: the US ones, as glibc assumes
+            parseRule("M3.2.0", &newStart);
+            parseRule("M11.1.0", &newEnd);
+        }
+        if (*p) return false;
+    }
+
+    strcpy(posix, posixTz);
+    strcpy(stdName, newStd);
+    strcpy(dstName, newDst);
+    stdOffset = newStdOffset;
+    dstOffset = newDstOffset;
+    hasDst = newHasDst;
+    startRule = newStart;
+    endRule = newEnd;
+    tableSize = 0;
+    tableFrom = tableTo = 0;
+    return true;
+}
+
+const char* TimeZone::getPosix() const {
+    return posix;
+}
+
+// Transitions of firstYear and the year after, sorted by UTC instant
+void TimeZone::buildTable(uint16_t firstYear) {
+    tableSize = 0;
+    for (uint16_t year = firstYear; year <= firstYear + 1; year++) {
+        // The start rule is written in standard time, the end rule in DST
+        Transition start = {ruleLocalInstant(startRule, year) - stdOffset, dstOffset, true};
+        Transition end = {ruleLocalInstant(endRule, year) - dstOffset, stdOffset, false};
+        if (start.utc <= end.utc) {
+            table[tableSize++] = start;
+            table[tableSize++] = end;
+        } else {
+            // Southern hemisphere: DST ends early in the year
+            table[tableSize++] = end;
+            table[tableSize++] = start;
+        }
+    }
+    baseOffset = table[0].dst ? stdOffset : dstOffset;
+    baseDst = !table[0].dst;
+    // No transition falls on the last day of December, so a day of margin
+    // either side keeps the range valid whatever the offset
+    tableFrom = startOfYear(firstYear) - SECONDS_PER_DAY;
+    tableTo = startOfYear(firstYear + 2) - SECONDS_PER_DAY;
+}
+
+// Index of the last transition at or before utc, -1 if before all of them
+int TimeZone::findTransition(uint32_t utc) {
+    if (tableSize == 0 || utc < tableFrom || utc >= tableTo) buildTable(DateTime(utc).year());
+    int lo = 0, hi = tableSize - 1, found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (table[mid].utc <= utc) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+int32_t TimeZone::offsetAt(uint32_t utc) {
+    if (!hasDst) return stdOffset;
+    int i = findTransition(utc);
+    return i < 0 ? baseOffset : table[i].offset;
+}
+
+bool TimeZone::isDstAt(uint32_t utc) {
+    if (!hasDst) return false;
+    int i = findTransition(utc);
+    return i < 0 ? baseDst : table[i].dst;
+}
+
+const char* TimeZone::abbreviationAt(uint32_t utc) {
+    return isDstAt(utc) ? dstName : stdName;
+}
+
+uint32_t TimeZone::toLocal(uint32_t utc) {
+    return utc + offsetAt(utc);
+}
+
+uint32_t TimeZone::toUtc(uint32_t local) {
+    if (!hasDst) return local - stdOffset;
+    // Try the earlier UTC reading first so a repeated hour maps to its first pass
+    int32_t first = (dstOffset > stdOffset) ? dstOffset : stdOffset;
+    int32_t second = (dstOffset > stdOffset) ? stdOffset : dstOffset;
+    if (offsetAt(local - first) == first) return local - first;
+    if (offsetAt(local - second) == second) return local - second;
+    // Skipped by a forward jump: read it with the offset from before the jump
+    return local - second;
+}
+
+String TimeZone::formatOffset(int32_t seconds) {
+    char buffer[12];
+    char sign = seconds < 0 ? '-' : '+';
+    uint32_t magnitude = seconds < 0 ? 0u - (uint32_t)seconds : (uint32_t)seconds;
+    // parseOffset takes up to 167 h, and a default DST hour adds one
+    int hours = magnitude / 3600 > 168 ? 168 : (int)(magnitude / 3600);
+    int minutes = (int)(magnitude % 3600 / 60);
+    snprintf(buffer, sizeof(buffer), "UTC%c%02d:%02d", sign, hours, minutes);
+    return String(buffer);
+}
@@ -0,0 +1,79 @@
+#ifndef TIMEZONE_H
+#define TIMEZONE_H
+
+#include <Arduino.h>
+
+#define TZ_POSIX_MAX 48
+#define TZ_NAME_MAX 8
+
+// A named zone offered by the settings menu
+struct TimeZonePreset {
+    const char* name;
+    const char* posix;
+};
+extern const TimeZonePreset TIME_ZONE_PRESETS[];
+extern const int TIME_ZONE_PRESET_COUNT;
+
+// POSIX TZ rule (e.g. "CET-1CEST,M3.5.0,M10.5.0/3" or "IST-5:30") compiled
+// into the UTC instants of its DST transitions for one year and the next.
+// UTC -> local is then a binary search over at most four entries instead
+// of a tzset()/localtime() pass; the table is rebuilt when time leaves it.
+class TimeZone {
+private:
+    struct Rule {
+        char kind;       // 'M' (month.week.weekday), 'J' (1-365, no Feb 29) or 'D' (0-365)
+        uint8_t month;
+        uint8_t week;    // 1-5, 5 = last
+        uint8_t weekday; // 0 = Sunday
+        uint16_t day;
+        int32_t time;    // seconds after local midnight
+    };
+    struct Transition {
+        uint32_t utc;   // instant the new offset starts
+        int32_t offset; // seconds east of UTC from then on
+        bool dst;
+    };
+
+    char posix[TZ_POSIX_MAX];
+    char stdName[TZ_NAME_MAX];
+    char dstName[TZ_NAME_MAX];
+    int32_t stdOffset; // seconds east of UTC
+    int32_t dstOffset;
+    bool hasDst;
+    Rule startRule;
+    Rule endRule;
+
+    Transition table[4];
+    uint8_t tableSize;
+    int32_t baseOffset; // in effect before table[0]
+    bool baseDst;
+    uint32_t tableFrom; // UTC range the table is valid for
+    uint32_t tableTo;
+
+    static const char* parseName(const char* p, char* out);
+    static const char* parseOffset(const char* p, int32_t* seconds);
+    static const char* parseRule(const char* p, Rule* rule);
+    static uint32_t ruleLocalInstant(const Rule& rule, uint16_t year);
+    void buildTable(uint16_t firstYear);
+    int findTransition(uint32_t utc);
+
+public:
+    TimeZone();
+
+    // False (zone unchanged) when the string does not parse
+    bool set(const char* posixTz);
+    const char* getPosix() const;
+
+    int32_t offsetAt(uint32_t utc);
+    bool isDstAt(uint32_t utc);
+    const char* abbreviationAt(uint32_t utc);
+    uint32_t toLocal(uint32_t utc);
+    // Ambiguous local times (fall back) map to the first occurrence; skipped
+    // ones (spring forward) to the same wall-clock distance after the jump
+    uint32_t toUtc(uint32_t local);
+
+    // "UTC+05:30"
+    static String formatOffset(int32_t seconds);
+};
+
+#endif // TIMEZONE_H
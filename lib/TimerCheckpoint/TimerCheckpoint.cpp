@@ -0,0 +1,116 @@
+#include "TimerCheckpoint.h"
+
+static const uint32_t CHECKPOINT_MAGIC = 0x43545032; // "CTP2"
+static const char* CHECKPOINT_KEY = "timer_ckpt";
+
+// Survives watchdog, brownout and software resets (but not a full power loss)
+RTC_DATA_ATTR static TimerCheckpointData rtcCheckpoint;
+
+TimerCheckpoint::TimerCheckpoint(TimeService* timeServiceInstance, NvsService* nvsService)
+    : clock(timeServiceInstance), nvs(nvsService), nvsHasCheckpoint(true) {}
+
+uint32_t TimerCheckpoint::checksum(const TimerCheckpointData& data) {
+    // CRC32 over everything but the crc field itself
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&data);
+    size_t len = offsetof(TimerCheckpointData, crc);
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= bytes[i];
+        for (int b = 0; b < 8; ++b) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+bool TimerCheckpoint::isValid(const TimerCheckpointData& data) {
+    if (data.magic != CHECKPOINT_MAGIC) return false;
+    if (data.kind != CHECKPOINT_SINGLE && data.kind != CHECKPOINT_MULTI) return false;
+    return data.crc == checksum(data);
+}
+
+void TimerCheckpoint::write(TimerCheckpointData& data) {
+    data.magic = CHECKPOINT_MAGIC;
+    data.crc = checksum(data);
+    rtcCheckpoint = data;
+
+    NvsHandle prefs(nvs, "storage");
+    if (!prefs) {
+        Serial.println("TimerCheckpoint: failed to open preferences for write");
+        return;
+    }
+    nvs->noteWrite("storage", CHECKPOINT_KEY, prefs->putBytes(CHECKPOINT_KEY, &data, sizeof(data)));
+    nvsHasCheckpoint = true;
+}
+
+void TimerCheckpoint::saveSingle(uint32_t durationSeconds, uint32_t remainingSeconds, uint8_t soundTrack) {
+    if (!clock) return;
+    TimerCheckpointData data = {};
+    data.kind = CHECKPOINT_SINGLE;
+    data.sound_track = soundTrack;
+    data.duration_seconds = durationSeconds;
+    data.deadline_unix = clock->nowUnix() + remainingSeconds;
+    write(data);
+}
+
+void TimerCheckpoint::saveMulti(int routineIndex, int routinePhases, const RoutineCursor& cursor, int phaseIndex, uint32_t phaseDurationSeconds, uint32_t remainingSeconds) {
+    if (!clock) return;
+    TimerCheckpointData data = {};
+    data.kind = CHECKPOINT_MULTI;
+    data.routine_index = (uint16_t)routineIndex;
+    data.routine_phases = (uint16_t)routinePhases;
+    data.phase_index = (uint16_t)phaseIndex;
+    data.cursor = cursor;
+    data.duration_seconds = phaseDurationSeconds;
+    data.deadline_unix = clock->nowUnix() + remainingSeconds;
+    write(data);
+}
+
+void TimerCheckpoint::clear() {
+    memset(&rtcCheckpoint, 0, sizeof(rtcCheckpoint));
+    // Only touch flash if a checkpoint may actually be stored there
+    if (!nvsHasCheckpoint) return;
+    NvsHandle prefs(nvs, "storage");
+    if (!prefs) return;
+    if (prefs->isKey(CHECKPOINT_KEY) && prefs->remove(CHECKPOINT_KEY)) nvs->noteWrite("storage", CHECKPOINT_KEY, 0);
+    nvsHasCheckpoint = false;
+}
+
+bool TimerCheckpoint::hasRtcCheckpoint() const {
+    return isValid(rtcCheckpoint);
+}
+
+bool TimerCheckpoint::load(TimerCheckpointData& out) {
+    if (isValid(rtcCheckpoint)) {
+        out = rtcCheckpoint;
+        return true;
+    }
+
+    // RTC memory is lost on power-on; fall back to the copy kept in NVS
+    nvsHasCheckpoint = false;
+    NvsHandle prefs(nvs, "storage");
+    if (!prefs) return false;
+    bool found = false;
+    if (prefs->isKey(CHECKPOINT_KEY)) {
+        nvsHasCheckpoint = true;
+        TimerCheckpointData data;
+        if (prefs->getBytes(CHECKPOINT_KEY, &data, sizeof(data)) == sizeof(data) && isValid(data)) {
+            out = data;
+            rtcCheckpoint = data;
+            found = true;
+        }
+    }
+    return found;
+}
+
+uint32_t TimerCheckpoint::remainingSeconds(const TimerCheckpointData& data) {
+    if (!clock) return 0;
+    uint32_t now = clock->nowUnix();
+    if (now >= data.deadline_unix) return 0;
+    uint32_t remaining = data.deadline_unix - now;
+    return (remaining > data.duration_seconds) ? data.duration_seconds : remaining;
+}
+
+uint32_t TimerCheckpoint::overshootSeconds(const TimerCheckpointData& data) {
+    if (!clock) return 0;
+    uint32_t now = clock->nowUnix();
+    return now > data.deadline_unix ? now - data.deadline_unix : 0;
+}
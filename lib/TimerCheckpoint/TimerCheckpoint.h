@@ -0,0 +1,59 @@
+#ifndef TIMERCHECKPOINT_H
+#define TIMERCHECKPOINT_H
+
+#include <Arduino.h>
+#include "NvsService.h"
+#include "TimeService.h"
+#include "RoutineStore.h"
+
+// Which timer a checkpoint belongs to
+enum CheckpointKind : uint8_t {
+    CHECKPOINT_NONE = 0,
+    CHECKPOINT_SINGLE = 1,
+    CHECKPOINT_MULTI = 2
+};
+
+// Snapshot of a running timer. The deadline is an absolute RTC unix time so the
+// remaining time can be recomputed after any kind of reset.
+struct TimerCheckpointData {
+    uint32_t magic;
+    uint8_t kind;              // CheckpointKind
+    uint8_t sound_track;       // Single timer alert track
+    uint16_t routine_index;    // MultiTimer routine index
+    uint16_t phase_index;      // MultiTimer phase index
+    uint16_t routine_phases;   // MultiTimer routine's phase count, to catch a list changed since
+    RoutineCursor cursor;      // MultiTimer program position (repeat counters included)
+    uint32_t duration_seconds; // Duration of the running timer or phase
+    uint32_t deadline_unix;    // RTC unix time at which it expires
+    uint32_t crc;
+};
+
+class TimerCheckpoint {
+private:
+    TimeService* clock;
+    NvsService* nvs;
+    bool nvsHasCheckpoint;
+
+    void write(TimerCheckpointData& data);
+    static uint32_t checksum(const TimerCheckpointData& data);
+    static bool isValid(const TimerCheckpointData& data);
+
+public:
+    TimerCheckpoint(TimeService* timeServiceInstance, NvsService* nvsService);
+
+    // Called on timer state changes only (start, phase change, stop) - never per tick
+    void saveSingle(uint32_t durationSeconds, uint32_t remainingSeconds, uint8_t soundTrack);
+    void saveMulti(int routineIndex, int routinePhases, const RoutineCursor& cursor, int phaseIndex, uint32_t phaseDurationSeconds, uint32_t remainingSeconds);
+    void clear();
+
+    // True when RTC memory holds a checkpoint (no I/O, usable first thing at boot)
+    bool hasRtcCheckpoint() const;
+    // Load from RTC memory, falling back to the NVS copy
+    bool load(TimerCheckpointData& out);
+    // Seconds left until the checkpoint deadline according to the RTC
+    uint32_t remainingSeconds(const TimerCheckpointData& data);
+    // Seconds the RTC has run past the checkpoint deadline, 0 before it
+    uint32_t overshootSeconds(const TimerCheckpointData& data);
+};
+
+#endif // TIMERCHECKPOINT_H
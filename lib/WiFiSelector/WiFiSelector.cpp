@@ -2,13 +2,11 @@
 #include "KeyInput.h"
 #include "configs.h"
 
-WiFiSelector::WiFiSelector(Adafruit_SSD1306* disp, Preferences* pref, const String& namespace_name, int timeout) {
+WiFiSelector::WiFiSelector(Adafruit_SSD1306* disp, NvsService* nvsService, const String& namespace_name, int timeout) {
   display = disp;
-  preferences = pref;
+  nvs = nvsService;
   pref_namespace = namespace_name;
   connection_timeout = timeout;
-
-  initializeStorage();
   
   // Configure SSID scroller for 18 characters max display, smooth scrolling
   ssid_scroller.setDisplayWidth(18, 108);  // 18 chars * 6 pixels = 108 pixels
@@ -74,25 +72,19 @@ std::vector<NetworkInfo> WiFiSelector::scanNetworks() {
 }
 
 bool WiFiSelector::connectWithSavedCredentials(const std::vector<NetworkInfo>& networks) {
-  if (!preferences) return false;
-
-  if (!preferences->begin(pref_namespace.c_str(), true)) {  // read-only
-    // Namespace may not exist on fresh device; treat as no saved credentials
-    Serial.println("No saved credentials found");
-    return false;
-  }
-
-  // If the ssid key isn't present, return quickly
-  if (!preferences->isKey("ssid")) {
-    preferences->end();
-    Serial.println("No saved credentials found");
-    return false;
+  String saved_ssid;
+  String saved_password;
+  {
+    NvsHandle prefs(nvs, pref_namespace.c_str());
+    // If the namespace or the ssid key isn't there, return quickly
+    if (!prefs || !prefs->isKey("ssid")) {
+      Serial.println("No saved credentials found");
+      return false;
+    }
+    saved_ssid = prefs->getString("ssid", "");
+    saved_password = prefs->getString("password", "");
   }
 
-  String saved_ssid = preferences->getString("ssid", "");
-  String saved_password = preferences->getString("password", "");
-  preferences->end();
-
   if (saved_ssid.length() == 0) {
     Serial.println("No saved credentials found");
     return false;
@@ -131,6 +123,31 @@ bool WiFiSelector::connectWithSavedCredentials(const std::vector<NetworkInfo>& n
   return false;
 }
 
+bool WiFiSelector::beginSavedConnection() {
+  String saved_ssid;
+  String saved_password;
+  {
+    NvsHandle prefs(nvs, pref_namespace.c_str());
+    if (!prefs) return false;
+    saved_ssid = prefs->isKey("ssid") ? prefs->getString("ssid", "") : "";
+    saved_password = prefs->isKey("password") ? prefs->getString("password", "") : "";
+  }
+
+  if (saved_ssid.length() == 0) {
+    Serial.println("No saved credentials found");
+    return false;
+  }
+
+  Serial.println("Joining saved network in the background: " + saved_ssid);
+  WiFi.setAutoReconnect(true);
+  if (saved_password.length() > 0) {
+    WiFi.begin(saved_ssid.c_str(), saved_password.c_str());
+  } else {
+    WiFi.begin(saved_ssid.c_str());
+  }
+  return true;
+}
+
 bool WiFiSelector::selectAndConnectNetwork(std::vector<NetworkInfo>& networks) {
   if (networks.empty()) {
     display->clearDisplay();
@@ -335,14 +352,14 @@ bool WiFiSelector::waitForConnection() {
 }
 
 void WiFiSelector::saveCredentials(const String& ssid, const String& password) {
-  if (!preferences->begin(pref_namespace.c_str(), false)) {  // false = read-write
+  NvsHandle prefs(nvs, pref_namespace.c_str());
+  if (!prefs) {
     Serial.println("Failed to open preferences for writing");
     return;
   }
   
-  preferences->putString("ssid", ssid);
-  preferences->putString("password", password);
-  preferences->end();
+  nvs->noteWrite(pref_namespace.c_str(), "ssid", prefs->putString("ssid", ssid));
+  nvs->noteWrite(pref_namespace.c_str(), "password", prefs->putString("password", password));
   
   Serial.println("Credentials saved: " + ssid);
 }
@@ -398,12 +415,3 @@ int WiFiSelector::getSignalStrength(int32_t rssi) {
   else if (rssi >= -80) return 1; // Weak
   else return 0;                  // Very weak
 }
-
-void WiFiSelector::initializeStorage(){
-  if (!preferences) return;
-	if (!preferences->begin(pref_namespace.c_str(), false, "nvs")) {  // true = read-only
-		Serial.println("Failed to open preferences while initializing the storage");
-		return;
-  }
-	preferences->end();
-}
@@ -5,7 +5,7 @@
 #include <WiFi.h>
 #include <vector>
 #include <Adafruit_SSD1306.h>
-#include <Preferences.h>
+#include "NvsService.h"
 #include "ScrollingText.h"
 #include "configs.h"
 
@@ -18,7 +18,7 @@ struct NetworkInfo {
 class WiFiSelector {
 private:
   Adafruit_SSD1306* display;
-  Preferences* preferences;
+  NvsService* nvs;
   String pref_namespace;
   int connection_timeout;
   
@@ -31,15 +31,17 @@ private:
   void showConnectionResult(bool success, const String& ip = "");
   bool waitForConnection();
   void saveCredentials(const String& ssid, const String& password);
-  void initializeStorage();
   
 public:
   // Constructor
-  WiFiSelector(Adafruit_SSD1306* disp, Preferences* pref, const String& namespace_name = "wifi-creds", int timeout = 10000);
+  WiFiSelector(Adafruit_SSD1306* disp, NvsService* nvsService, const String& namespace_name = "wifi-creds", int timeout = 10000);
   
   // Main public methods
   std::vector<NetworkInfo> scanNetworks();
   bool connectWithSavedCredentials(const std::vector<NetworkInfo>& networks);
+  // Start joining the saved network and return at once (no scan, no screen);
+  // the WiFi stack keeps retrying. False if nothing is saved.
+  bool beginSavedConnection();
   bool selectAndConnectNetwork(std::vector<NetworkInfo>& networks);
   
   // Utility methods
@@ -31,10 +31,13 @@ def generate_config_h():
         'MOVE_DELAY': '150',
         'SLEEP_DURATION_SECONDS': '300',
         'WIFI_TIMEOUT_MS': '15000',
+        'NTP_SERVER': 'pool.ntp.org',
         # Audio and Notification
         'DFPLAYER_TX_PIN': '10',
         'DFPLAYER_RX_PIN': '7',
-        'LED_PIN': '4'
+        'LED_PIN': '4',
+        # Real-time clock (-1 = DS3231 INT/SQW not wired)
+        'RTC_INT_PIN': '-1'
     }
     
     # Read .env.local if it exists
@@ -83,6 +86,7 @@ def generate_config_h():
 // Power Management
 #define SLEEP_DURATION_SECONDS ''' + config_values['SLEEP_DURATION_SECONDS'] + '''
 #define WIFI_TIMEOUT_MS ''' + config_values['WIFI_TIMEOUT_MS'] + '''
+#define NTP_SERVER "''' + config_values['NTP_SERVER'] + '''"
 
 // Special Characters for KeyInput
 #define REMOVE_CHAR 127
@@ -95,6 +99,9 @@ def generate_config_h():
 #define DFPLAYER_RX_PIN ''' + config_values['DFPLAYER_RX_PIN'] + '''
 #define LED_PIN ''' + config_values['LED_PIN'] + '''
 
+// Real-Time Clock
+#define RTC_INT_PIN ''' + config_values['RTC_INT_PIN'] + '''
+
 #endif // CONFIG_H
 '''
     
@@ -7,34 +7,50 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <freertos/FreeRTOS.h>
-#include <Preferences.h>
 #include "KeyInput.h"
 #include "WiFiSelector.h"
 #include "TimeManager.h"
+#include "TimeService.h"
+#include "TimeZone.h"
 #include "StateMachine.h"
 #include "SingleTimer.h"
 #include "MultiTimer.h"
 #include "AlarmClock.h"
+#include "Stopwatch.h"
 #include "DataModels.h"
 #include "NotificationManager.h"
 #include "PushNotifier.h"
+#include "NvsService.h"
 #include "StorageManager.h"
+#include "TimerCheckpoint.h"
+#include "ModelRepository.h"
+#include "ExpiryScheduler.h"
+#include "FileTransfer.h"
+#include "StorageTelemetry.h"
 #include "configs.h"
 #include <nvs_flash.h>
 
 // Global objects
-Preferences pref;
+NvsService nvsService; // one open handle per NVS namespace, shared by every module
+ModelRepository models; // must be constructed before the modules that read it
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET_PIN);
 RTC_DS3231 rtc;
-WiFiSelector wifiSelector(&display, &pref, "wifi-creds", 30000);
+TimeService timeService(&rtc); // cached "now" for every module
+TimeZone timeZone;             // local time rules; RTC and schedules are UTC
+WiFiSelector wifiSelector(&display, &nvsService, "wifi-creds", 30000);
 TimeManager timeManager(&rtc, &display);
 StateMachine stateMachine(&display);
 SingleTimer singleTimer(&display);
-MultiTimer multiTimer(&display);
-PushNotifier pushNotifier(&pref);
-StorageManager storageManager(&pref);
-AlarmClock alarmClock(&display, &rtc, &pushNotifier);
+MultiTimer multiTimer(&display, &models);
+PushNotifier pushNotifier(&models);
+StorageManager storageManager(&nvsService);
+FileTransfer fileTransfer(&models, &storageManager);
+StorageTelemetry storageTelemetry(&nvsService, &timeService);
+AlarmClock alarmClock(&display, &rtc, &pushNotifier, &models);
+Stopwatch stopwatch(&display);
 NotificationManager notificationManager;
+TimerCheckpoint timerCheckpoint(&timeService, &nvsService);
+ExpiryScheduler expiryScheduler;
 
 // Editor context (for custom timers and phases)
 static CustomTimer g_editTimer;
@@ -42,10 +58,45 @@ static bool g_isCreateTimer = false;
 static int g_editTimerIndex = -1;
 static int g_editPhaseIndex = -1;
 
+// Queue just the entry that changed; a reload from storage only binds ids
+static void persistModelChange(ModelKind kind, ModelChange change, uint16_t id, void* context) {
+    storageManager.applyChange(models, kind, change, id);
+}
+
+// Routine phases stay in storage until a routine is run or edited
+static bool loadStoredRoutine(uint16_t id, RoutineStore& out, void* context) {
+    return storageManager.loadRoutine(id, out);
+}
+
+static void logTransfer(const char* what, const TransferResult& result) {
+    if (result.ok) {
+        Serial.printf("[Transfer] %s: %u routines, %u alarms, %u accounts, %lu bytes in %lu ms\n", what,
+                      result.routines, result.alarms, result.accounts, (unsigned long)result.bytes,
+                      (unsigned long)result.elapsedMs);
+    } else {
+        Serial.printf("[Transfer] %s failed: %s\n", what, result.error);
+    }
+}
+
+// Keep repeat blocks on the same phases after phase idx is deleted
+static void removePhaseFromRepeats(CustomTimer& timer, int idx) {
+    std::vector<RepeatBlock> kept;
+    for (RepeatBlock r : timer.repeats) {
+        if (idx < r.first_phase) { r.first_phase--; r.last_phase--; }
+        else if (idx <= r.last_phase) {
+            if (r.first_phase == r.last_phase) continue; // block is now empty
+            r.last_phase--;
+        }
+        kept.push_back(r);
+    }
+    timer.repeats = kept;
+}
+
 // Menu items
 MenuItem mainMenuItems[] = {
     {"Single Timer", STATE_SINGLE_TIMER_SETUP, true},
     {"Multi-Phase Timer", STATE_MULTI_TIMER_SELECT, true},
+    {"Stopwatch", STATE_STOPWATCH, true},
     {"Sleep Alarm", STATE_ALARM_LIST_MENU, true},
     {"Settings", STATE_SETTINGS_MENU, true},
     {"Time Display", STATE_TIME_DISPLAY, true}
@@ -57,13 +108,23 @@ MenuItem settingsMenuItems[] = {
     {"WiFi Setup", STATE_WIFI_SETUP, true},
     {"Set Volume", STATE_SETTINGS_VOLUME, true},
     {"Set Timezone", STATE_SETTINGS_TIMEZONE, true},
+    {"Import/Export", STATE_SETTINGS_TRANSFER, true},
+    {"Diagnostics", STATE_SETTINGS_DIAGNOSTICS, true},
     {"Back to Main", STATE_MAIN_MENU, true}
 };
 
+#define BOOT_REPORT_DELAY_MS 3000UL
+#define SETTINGS_VISIBLE_ROWS 4 // between the title and the hint line
+#define SERIAL_COMMAND_MAX 32
+
 // Global variables
 unsigned long globalmilisbuff_start;
 unsigned long globalmilisbuff_end;
 bool systemInitialized = false;
+// Boot timing (ms since app start), reported once from loop()
+unsigned long firstScreenMs = 0;
+unsigned long setupDoneMs = 0;
+uint32_t storageLoadUs = 0; // all three collections, out of NVS into the repository
 // Alarm interrupt globals
 bool isAlarmInterruptActive = false;
 AppState preAlarmState = STATE_MAIN_MENU;
@@ -72,8 +133,23 @@ AppState preAlarmState = STATE_MAIN_MENU;
 void entrypoint();
 void initializeSystem();
 void handleStateMachine();
+bool resumeCheckpointedTimer();
+void pollSerialCommands();
 
 void loop() {
+    // Reported late so a USB serial console has had time to attach
+    static bool bootReported = false;
+    if (!bootReported && millis() > BOOT_REPORT_DELAY_MS) {
+        bootReported = true;
+        Serial.printf("[Boot] first screen after %lu ms, setup done after %lu ms (since app start)\n",
+                      firstScreenMs, setupDoneMs);
+        const NvsServiceStats& nvsStats = nvsService.getStats();
+        Serial.printf("[Boot] collections loaded in %lu us; NVS namespaces opened %lu times, %lu borrows\n",
+                      (unsigned long)storageLoadUs, (unsigned long)nvsStats.opens, (unsigned long)nvsStats.acquires);
+        Serial.printf("[Boot] routine index: %u routines in %u bytes (phases load on demand)\n",
+                      (unsigned)models.getRoutines().size(), (unsigned)models.getRoutines().heapBytes());
+    }
+
     // Main loop - handle state machine and timer updates
     if (systemInitialized) {
         // --- START NEW ALARM INTERRUPT LOGIC ---
@@ -87,8 +163,19 @@ void loop() {
         // --- END NEW ALARM INTERRUPT LOGIC ---
 
         handleStateMachine();
+        pollSerialCommands();
+        storageTelemetry.update();
+
+        // Leaving a screen persists its edits now instead of after the quiet period
+        static AppState lastState = stateMachine.getCurrentState();
+        if (stateMachine.getCurrentState() != lastState) {
+            lastState = stateMachine.getCurrentState();
+            storageManager.requestFlush();
+        }
         
-        // Update alarm clock (runs continuously)
+        // Keep the cached clock aligned, then update alarm clock (runs continuously)
+        timeService.update();
+        if (timeManager.update()) alarmClock.rescheduleAlarms(); // RTC was set from SNTP
         alarmClock.updateAlarm();
         
         // Handle alarm acknowledgment (legacy single-check removed)
@@ -150,6 +237,19 @@ void handleStateMachine() {
             }
             break;
             
+        case STATE_STOPWATCH:
+            // Keeps counting after leaving the screen; only drawn while shown
+            if (select_button_pressed()) stopwatch.handleButton();
+            if (can_move()) {
+                int x_move = get_x_movement();
+                if (x_move == 1) stopwatch.toggleRunning();
+                else if (x_move == -1) { stateMachine.setState(STATE_MAIN_MENU); break; }
+                int y_move = get_y_movement();
+                if (y_move != 0) stopwatch.scrollLaps(-y_move);
+            }
+            stopwatch.updateDisplay(stateMachine.isStateEntry());
+            break;
+
         case STATE_MULTI_TIMER_SELECT:
             if (!multiTimer.isRoutineRunning() && !multiTimer.isRoutineFinished()) {
                 multiTimer.handleTimerSelectionInput();
@@ -192,8 +292,10 @@ void handleStateMachine() {
                     a.minute = (uint8_t)alarmClock.getSetupMinute();
                     a.enabled = true;
                     a.sound_track = (uint8_t)alarmClock.getSetupSoundTrack();
+                    a.days = alarmClock.getSetupDays();
+                    a.one_shot = alarmClock.getSetupOneShot();
+                    a.snooze_minutes = alarmClock.getSetupSnooze();
                     alarmClock.addAlarm(a);
-                    storageManager.saveAlarms(alarmClock.getAlarms());
                     stateMachine.setState(STATE_ALARM_LIST_MENU);
                 } else {
                     stateMachine.setState(STATE_ALARM_LIST_MENU);
@@ -202,7 +304,7 @@ void handleStateMachine() {
             break;
             
         case STATE_TIME_DISPLAY:
-            timeManager.displayCurrentTime();
+            // Clock face is drawn by StateMachine::handleTimeDisplay
             if (select_button_pressed()) {
                 stateMachine.setState(STATE_MAIN_MENU);
             }
@@ -244,6 +346,8 @@ void handleStateMachine() {
                         int idx = i - 1;
                         char buf[8]; sprintf(buf, "%02d:%02d", alarms[idx].hour, alarms[idx].minute);
                         display.print(buf);
+                        display.print(" ");
+                        display.print(AlarmClock::describeDays(alarms[idx]));
                         display.print(alarms[idx].enabled ? " *" : "");
                     }
                 }
@@ -274,14 +378,7 @@ void handleStateMachine() {
                     stateMachine.setState(STATE_MAIN_MENU);
                 } else {
                     // Toggle enable/disable the selected alarm
-                    int idx = sel - 1;
-                    auto alarms = alarmClock.getAlarms();
-                    if (idx >= 0 && idx < (int)alarms.size()) {
-                        alarms[idx].enabled = !alarms[idx].enabled;
-                        // persist
-                        storageManager.saveAlarms(alarms);
-                        alarmClock.loadAlarms(storageManager);
-                    }
+                    alarmClock.toggleAlarm(sel - 1);
                     drawn = false;
                 }
             }
@@ -334,7 +431,6 @@ void handleStateMachine() {
                     stateMachine.setState(STATE_ALARM_LIST_MENU);
                 } else {
                     alarmClock.removeAlarm(sel);
-                    storageManager.saveAlarms(alarmClock.getAlarms());
                     stateMachine.setState(STATE_ALARM_LIST_MENU);
                 }
             }
@@ -351,6 +447,10 @@ void handleStateMachine() {
             display.setTextSize(1);
             display.setCursor(8, 44);
             display.println("Btn: Stop Alarm");
+            if (alarmClock.canSnooze()) {
+                display.setCursor(8, 54);
+                display.println("X: Snooze");
+            }
             display.display();
 
             // If no longer ringing, return to previous state
@@ -372,6 +472,12 @@ void handleStateMachine() {
                 alarmClock.acknowledgeAlarm();
                 notificationManager.stopAlert();
                 stateMachine.setState(preAlarmState);
+            } else if (alarmClock.canSnooze() && can_move() && get_x_movement() != 0) {
+                notificationManager.playAdvert(1);
+                isAlarmInterruptActive = false;
+                alarmClock.snoozeAlarm();
+                notificationManager.stopAlert();
+                stateMachine.setState(preAlarmState);
             }
             break;
         }
@@ -393,9 +499,11 @@ void handleStateMachine() {
                 display.println("Settings");
                 display.println("========");
 
+                // Scrolls once the selection passes the last visible row
                 int settingsCount = sizeof(settingsMenuItems) / sizeof(MenuItem);
-                for (int i = 0; i < settingsCount; i++) {
-                    int y = 16 + i * 10;
+                int first = settingsSelected >= SETTINGS_VISIBLE_ROWS ? settingsSelected - SETTINGS_VISIBLE_ROWS + 1 : 0;
+                for (int i = first; i < settingsCount && i < first + SETTINGS_VISIBLE_ROWS; i++) {
+                    int y = 16 + (i - first) * 10;
                     if (i == settingsSelected) {
                         display.fillRect(0, y - 1, SCREEN_WIDTH, 10, SSD1306_WHITE);
                         display.setTextColor(SSD1306_BLACK);
@@ -596,10 +704,7 @@ void handleStateMachine() {
                         display.println("");
                         display.println("Press button to confirm");
                         display.display();
-                        auto vec = accounts; // copy
-                        vec.erase(vec.begin() + target);
-                        storageManager.saveAlertzyAccounts(vec);
-                        pushNotifier.setAccounts(vec);
+                        models.removeAccount(models.accountId(target));
                     }
                     sel = 0;
                     drawn = false;
@@ -627,10 +732,7 @@ void handleStateMachine() {
             const char* key = prompt_keyboard();
 
             if (name && key && strlen(name) > 0 && strlen(key) > 0) {
-                auto accounts = pushNotifier.getAccounts();
-                accounts.push_back(AlertzyAccount{String(name), String(key)});
-                storageManager.saveAlertzyAccounts(accounts);
-                pushNotifier.setAccounts(accounts);
+                models.addAccount(AlertzyAccount{String(name), String(key)});
                 display.clearDisplay();
                 display.setCursor(0, 20);
                 display.println("Saved!");
@@ -664,7 +766,7 @@ void handleStateMachine() {
                     display.setCursor(2, y);
                     if (i == 0) display.print("+ Create New");
                     else if (i == total - 1) display.print("< Back");
-                    else display.print(timers[i - 1].name);
+                    else display.print(timers.name(i - 1));
                 }
                 display.setTextColor(SSD1306_WHITE);
                 display.setCursor(0, 56);
@@ -682,7 +784,7 @@ void handleStateMachine() {
             }
 
             if (select_button_pressed()) {
-                auto timers = multiTimer.getTimers();
+                const auto& timers = multiTimer.getTimers();
                 int total = (int)timers.size() + 2;
                 if (sel == 0) {
                     // Create new timer -> prompt for name then phase list
@@ -697,9 +799,12 @@ void handleStateMachine() {
                 } else if (sel == total - 1) {
                     stateMachine.setState(STATE_SETTINGS_MENU);
                 } else {
-                    // Edit existing
-                    g_editTimerIndex = sel - 1; g_isCreateTimer = false; g_editTimer = timers[g_editTimerIndex];
-                    stateMachine.setState(STATE_PHASE_LIST_EDIT);
+                    // Edit existing; its phases are loaded now
+                    const RoutineStore* body = models.routine(models.routineId(sel - 1));
+                    if (body) {
+                        g_editTimerIndex = sel - 1; g_isCreateTimer = false; g_editTimer = body->unpack(0);
+                        stateMachine.setState(STATE_PHASE_LIST_EDIT);
+                    }
                 }
             }
             break;
@@ -712,9 +817,9 @@ void handleStateMachine() {
         }
 
         case STATE_PHASE_LIST_EDIT: {
-            // Editor: list phases, add/edit/delete, save & exit
+            // Editor: list phases, add/edit/delete, repeat blocks, save & exit
             static int sel = 0; static bool drawn = false;
-            if (previousState != STATE_PHASE_LIST_EDIT) { sel = 0; drawn = false; }
+            if (stateMachine.isStateEntry()) { sel = 0; drawn = false; }
 
             auto draw = [&]() {
                 display.clearDisplay();
@@ -723,20 +828,27 @@ void handleStateMachine() {
                 display.setCursor(0, 0);
                 display.print("Edit: "); display.println(g_editTimer.name);
                 display.println("----------------");
-                int total = (int)g_editTimer.phases.size() + 3; // +Add, +Save, <Back
-                for (int i = 0; i < total && (16 + i * 10) <= 54; ++i) {
-                    int y = 16 + i * 10;
+                int total = (int)g_editTimer.phases.size() + 4; // +Add, Repeat, +Save, <Back
+                int top = (sel > 3) ? sel - 3 : 0; // keep the selection on screen
+                for (int i = top; i < total && (16 + (i - top) * 10) <= 54; ++i) {
+                    int y = 16 + (i - top) * 10;
                     bool isSel = (i == sel);
                     if (isSel) { display.fillRect(0, y - 1, SCREEN_WIDTH, 10, SSD1306_WHITE); display.setTextColor(SSD1306_BLACK); }
                     else { display.setTextColor(SSD1306_WHITE); }
                     display.setCursor(2, y);
                     if (i == 0) display.print("+ Add Phase");
+                    else if (i == total - 3) display.print("Repeat Block");
                     else if (i == total - 2) display.print("Save & Exit");
                     else if (i == total - 1) display.print("< Back");
                     else {
                         int idx = i - 1;
-                        display.print(idx + 1); display.print(". ");
+                        display.print(idx + 1); display.print(".");
+                        // "[" opens and "]xN" closes a repeat block
+                        for (const auto& r : g_editTimer.repeats) if (r.first_phase == idx) display.print("[");
                         display.print(g_editTimer.phases[idx].name);
+                        for (const auto& r : g_editTimer.repeats) {
+                            if (r.last_phase == idx) { display.print("]x"); display.print(r.count); }
+                        }
                     }
                 }
                 display.setTextColor(SSD1306_WHITE);
@@ -749,7 +861,7 @@ void handleStateMachine() {
 
             if (can_move()) {
                 int y_move = get_y_movement();
-                int maxIndex = (int)g_editTimer.phases.size() + 2;
+                int maxIndex = (int)g_editTimer.phases.size() + 3;
                 if (y_move == -1) { sel = (sel > 0) ? sel - 1 : maxIndex; draw(); }
                 if (y_move == 1)  { sel = (sel < maxIndex) ? sel + 1 : 0; draw(); }
             }
@@ -758,11 +870,12 @@ void handleStateMachine() {
                 int x_move = get_x_movement();
                 if (x_move != 0) {
                     // Delete selected phase if a phase row selected
-                    int total = (int)g_editTimer.phases.size() + 3;
-                    if (sel > 0 && sel < total - 2) {
+                    int total = (int)g_editTimer.phases.size() + 4;
+                    if (sel > 0 && sel < total - 3) {
                         int idx = sel - 1;
                         if (!g_editTimer.phases.empty()) {
                             g_editTimer.phases.erase(g_editTimer.phases.begin() + idx);
+                            removePhaseFromRepeats(g_editTimer, idx);
                             if (sel > 0) sel--;
                             draw();
                         }
@@ -771,18 +884,19 @@ void handleStateMachine() {
             }
 
             if (select_button_pressed()) {
-                int total = (int)g_editTimer.phases.size() + 3;
+                int total = (int)g_editTimer.phases.size() + 4;
                 if (sel == 0) {
                     // Add new phase -> go to phase editor
-                    g_editPhaseIndex = -1;
-                    stateMachine.setState(STATE_PHASE_EDIT);
+                    if (g_editTimer.phases.size() < ROUTINE_MAX_PHASES) {
+                        g_editPhaseIndex = -1;
+                        stateMachine.setState(STATE_PHASE_EDIT);
+                    }
+                } else if (sel == total - 3) {
+                    if (!g_editTimer.phases.empty()) stateMachine.setState(STATE_REPEAT_EDIT);
                 } else if (sel == total - 2) {
                     // Save & Exit
-                    auto timers = multiTimer.getTimers();
-                    if (g_isCreateTimer) timers.push_back(g_editTimer);
-                    else if (g_editTimerIndex >= 0 && g_editTimerIndex < (int)timers.size()) timers[g_editTimerIndex] = g_editTimer;
-                    storageManager.saveCustomTimers(timers);
-                    multiTimer.setTimers(timers);
+                    // Edit the packed store in place; the model listener persists it
+                    models.saveRoutine(g_isCreateTimer ? MODEL_INVALID_ID : models.routineId(g_editTimerIndex), g_editTimer);
                     stateMachine.setState(STATE_SETTINGS_TIMERS_MENU);
                 } else if (sel == total - 1) {
                     stateMachine.setState(STATE_SETTINGS_TIMERS_MENU);
@@ -795,6 +909,68 @@ void handleStateMachine() {
             break;
         }
 
+        case STATE_REPEAT_EDIT: {
+            // Mark phases From..To to run N times (e.g. 4x work/break)
+            static int field = 0; // 0=from,1=to,2=times,3=save,4=remove
+            static int from = 1, to = 1, times = 2;
+            int phaseCount = (int)g_editTimer.phases.size();
+            if (stateMachine.isStateEntry()) { field = 0; from = 1; to = phaseCount; times = 2; }
+
+            auto draw = [&]() {
+                display.clearDisplay();
+                display.setTextSize(1);
+                display.setTextColor(SSD1306_WHITE);
+                display.setCursor(0, 0);
+                display.println("Repeat Block");
+                display.println("------------");
+                const char* labels[] = {"From phase: ", "To phase:   ", "Times:      ", "Save block", "Remove blocks"};
+                int values[] = {from, to, times};
+                for (int i = 0; i < 5; ++i) {
+                    int y = 16 + i * 8;
+                    if (i == field) { display.fillRect(0, y - 1, SCREEN_WIDTH, 9, SSD1306_WHITE); display.setTextColor(SSD1306_BLACK); }
+                    else { display.setTextColor(SSD1306_WHITE); }
+                    display.setCursor(2, y);
+                    display.print(labels[i]);
+                    if (i < 3) display.print(values[i]);
+                }
+                display.setTextColor(SSD1306_WHITE);
+                display.setCursor(0, 56);
+                display.print(field < 3 ? "Y:Field X:+- " : "Y:Field Btn:OK");
+                display.display();
+            };
+
+            if (stateMachine.isStateEntry()) draw();
+
+            if (can_move()) {
+                int y_move = get_y_movement();
+                if (y_move == -1) { field = (field == 0) ? 4 : field - 1; draw(); }
+                if (y_move == 1)  { field = (field == 4) ? 0 : field + 1; draw(); }
+                int x_move = get_x_movement();
+                if (x_move != 0) {
+                    if (field == 0) { from += x_move; if (from < 1) from = phaseCount; if (from > phaseCount) from = 1; if (to < from) to = from; }
+                    else if (field == 1) { to += x_move; if (to < from) to = phaseCount; if (to > phaseCount) to = from; }
+                    else if (field == 2) { times += x_move; if (times < 2) times = 99; if (times > 99) times = 2; }
+                    draw();
+                }
+            }
+
+            if (select_button_pressed() && field >= 3) {
+                uint8_t f = (uint8_t)(from - 1), l = (uint8_t)(to - 1);
+                // Drop blocks the new range would cross (and any with the same range)
+                std::vector<RepeatBlock> kept;
+                for (const auto& r : g_editTimer.repeats) {
+                    bool disjoint = r.last_phase < f || r.first_phase > l;
+                    bool nested = (r.first_phase >= f && r.last_phase <= l) || (r.first_phase <= f && r.last_phase >= l);
+                    bool same = r.first_phase == f && r.last_phase == l;
+                    if (field == 4 ? disjoint : (disjoint || (nested && !same))) kept.push_back(r);
+                }
+                if (field == 3) kept.push_back(RepeatBlock{f, l, (uint8_t)times});
+                g_editTimer.repeats = RoutineStore::sanitizeRepeats(kept, phaseCount);
+                stateMachine.setState(STATE_PHASE_LIST_EDIT);
+            }
+            break;
+        }
+
         case STATE_PHASE_EDIT: {
             // Phase editor: name, duration (H/M/S), sound, notifications (accounts)
             static int field = 0; // 0=name,1=H,2=M,3=S,4=sound,5=notify,6=confirm
@@ -954,6 +1130,120 @@ void handleStateMachine() {
             break;
         }
 
+        case STATE_SETTINGS_TRANSFER: {
+            // Routines, alarms and accounts to or from files on the LittleFS partition
+            static int sel = 0; // 0 export, 1 import, 2 back
+            static bool drawn = false;
+            static bool confirmImport = false; // import replaces everything, so it takes a second press
+            static char status[24];
+            if (stateMachine.isStateEntry()) {
+                sel = 0;
+                drawn = false;
+                confirmImport = false;
+                status[0] = '\0';
+            }
+
+            auto draw = [&]() {
+                const char* rows[] = {"Export to flash", confirmImport ? "Import: press again" : "Import from flash", "Back"};
+                display.clearDisplay();
+                display.setTextSize(1);
+                display.setTextColor(SSD1306_WHITE);
+                display.setCursor(0, 0);
+                display.println("Import/Export");
+                display.println("=============");
+                for (int i = 0; i < 3; i++) {
+                    int y = 16 + i * 10;
+                    if (i == sel) {
+                        display.fillRect(0, y - 1, SCREEN_WIDTH, 10, SSD1306_WHITE);
+                        display.setTextColor(SSD1306_BLACK);
+                    } else {
+                        display.setTextColor(SSD1306_WHITE);
+                    }
+                    display.setCursor(2, y);
+                    display.print(rows[i]);
+                }
+                display.setTextColor(SSD1306_WHITE);
+                display.setCursor(0, 46);
+                display.print(status);
+                display.setCursor(0, 56);
+                display.print("Move:Y Sel:Btn");
+                display.display();
+            };
+
+            // Runs with the screen showing what it is doing; the result replaces it
+            auto run = [&](bool import) {
+                snprintf(status, sizeof(status), import ? "Importing..." : "Exporting...");
+                draw();
+                TransferResult result = import ? fileTransfer.importAll() : fileTransfer.exportAll();
+                logTransfer(import ? "import" : "export", result);
+                if (result.ok) {
+                    snprintf(status, sizeof(status), "%u rt %u al %u keys", result.routines, result.alarms, result.accounts);
+                } else {
+                    snprintf(status, sizeof(status), "%s", result.error);
+                }
+            };
+
+            if (!drawn) { draw(); drawn = true; }
+
+            if (can_move()) {
+                int y_move = get_y_movement();
+                if (y_move != 0) {
+                    sel = (sel + (y_move == 1 ? 1 : 2)) % 3;
+                    confirmImport = false;
+                    draw();
+                }
+            }
+
+            if (select_button_pressed()) {
+                if (sel == 0) {
+                    run(false);
+                } else if (sel == 1 && !confirmImport) {
+                    confirmImport = true;
+                } else if (sel == 1) {
+                    confirmImport = false;
+                    run(true);
+                } else {
+                    stateMachine.setState(STATE_SETTINGS_MENU);
+                    break;
+                }
+                draw();
+            }
+            break;
+        }
+
+        case STATE_SETTINGS_DIAGNOSTICS: {
+            // NVS occupancy and write rate, from nvs_get_stats and the telemetry counters
+            static uint32_t lastDrawMs = 0;
+            if (stateMachine.isStateEntry() || millis() - lastDrawMs >= 2000) {
+                lastDrawMs = millis();
+                NvsUsage usage;
+                bool haveUsage = storageTelemetry.readUsage(usage);
+                display.clearDisplay();
+                display.setTextSize(1);
+                display.setTextColor(SSD1306_WHITE);
+                display.setCursor(0, 0);
+                display.println("NVS Diagnostics");
+                display.println("===============");
+                if (haveUsage) {
+                    display.printf("Used %lu/%lu (%lu%%)\n", (unsigned long)usage.usedEntries, (unsigned long)usage.totalEntries,
+                                   (unsigned long)(usage.totalEntries ? usage.usedEntries * 100 / usage.totalEntries : 0));
+                } else {
+                    display.println("Used: unavailable");
+                }
+                display.printf("Today %luB avg %.0fB\n", (unsigned long)storageTelemetry.bytesToday(),
+                               storageTelemetry.averageBytesPerDay());
+                float years = haveUsage ? storageTelemetry.estimatedLifetimeYears(usage) : 0;
+                if (years >= 1000) display.println("Life: >1000 years");
+                else if (years > 0) display.printf("Life: ~%.0f years\n", years);
+                else display.println("Life: no writes yet");
+                display.setCursor(0, 56);
+                display.print("Btn:Back");
+                display.display();
+            }
+            if (select_button_pressed()) stateMachine.setState(STATE_SETTINGS_MENU);
+            break;
+        }
+
         case STATE_SETTINGS_ALERTS_MENU:
         case STATE_CUSTOM_TIMER_START: {
             display.clearDisplay();
@@ -974,77 +1264,136 @@ void handleStateMachine() {
 }
 
 void setup() {
-    // Short yield to allow USB serial to enumerate; avoid long blocking delay
-    unsigned long startup_wait_until = millis() + 1000;
-    while (millis() < startup_wait_until) yield();
-
+    // No wait for USB serial: the boot report is printed from loop() instead
     entrypoint();
 
     // Initialize system components
     initializeSystem();
-    
-    // Initialize notification manager
+
+    // Time comes straight from the RTC; NTP (if needed at all) runs later in
+    // the background, so a running timer or the clock is on screen right away
+    bool timeReady = timeManager.initialize();
+    if (timeReady) {
+        Serial.println("Time manager initialized");
+    }
+    // A checkpoint in RTC memory means we are coming back from a reset mid-timer;
+    // otherwise show the clock now and finish setting up behind it
+    bool resumingTimer = timerCheckpoint.hasRtcCheckpoint();
+    if (timeReady && !resumingTimer) {
+        timeManager.displayCurrentTime();
+        firstScreenMs = millis();
+    }
+
+    // NVS writes are counted from here on. Started before storage so that its
+    // shutdown hook, run after the storage flush, saves the final counts.
+    storageTelemetry.begin();
+
+    // Load persisted data (moved straight into the model repository); the
+    // listener is registered first so storage learns the ids of what it loaded.
+    // Edits after this are written behind by the storage flush task.
+    storageManager.begin();
+    models.addListener(persistModelChange);
+    models.setRoutineLoader(loadStoredRoutine);
+    uint32_t loadStartUs = micros();
+    {
+        // One borrow of the storage namespace for the whole batch of reads
+        NvsHandle batch(&nvsService, STORAGE_NAMESPACE);
+        models.setRoutines(storageManager.loadRoutineIndex());
+        models.setAlarms(storageManager.loadAlarms());
+        models.setAccounts(storageManager.loadAlertzyAccounts());
+    }
+    storageLoadUs = micros() - loadStartUs;
+
+    // Initialize notification manager and the deadline-fired alerts before
+    // a restored timer can expire
     notificationManager.begin();
+    expiryScheduler.begin();
+    alarmClock.begin();
+    resumingTimer = timeReady && resumeCheckpointedTimer();
+    if (resumingTimer && firstScreenMs == 0) firstScreenMs = millis();
+
     // Initialize push notifier
     pushNotifier.begin();
-    // Load persisted data
-    auto alertzyAccounts = storageManager.loadAlertzyAccounts();
-    pushNotifier.setAccounts(alertzyAccounts);
-    auto customTimers = storageManager.loadCustomTimers();
-    multiTimer.setTimers(customTimers);
 
     Serial.println("Starting in offline-first mode.");
-    // Non-blocking attempt to connect with saved credentials
-    bool wifiConnected = wifiSelector.connectWithSavedCredentials(wifiSelector.scanNetworks());
+    // Joins the saved network in the background; SNTP and push notifications
+    // pick it up once connected
+    if (!wifiSelector.beginSavedConnection()) {
+        Serial.println("No saved Wi-Fi credentials. Starting in offline mode.");
+    }
 
-    if (wifiConnected) {
-        Serial.println("Connected to Wi-Fi using saved credentials.");
-    } else {
-        Serial.println("No saved Wi-Fi credentials or connection failed. Starting in offline mode.");
+    if (!resumingTimer) {
+        // Start on the clock; press button to open menu
+        stateMachine.setState(STATE_TIME_DISPLAY);
     }
+    setupDoneMs = millis();
+    systemInitialized = true;
+}
 
-    // Initialize time management (RTC always available)
-    if (timeManager.initialize()) {
-        Serial.println("Time manager initialized");
-        if (wifiConnected) {
-            if (timeManager.syncTime()) {
-                Serial.println("Time synchronized with NTP");
+bool resumeCheckpointedTimer() {
+    TimerCheckpointData cp;
+    if (!timerCheckpoint.load(cp)) return false;
+
+    // Deadlines are RTC-relative; they mean nothing if the RTC itself was reset
+    if (!timeManager.wasRtcReset()) {
+        uint32_t remaining = timerCheckpoint.remainingSeconds(cp);
+        if (cp.kind == CHECKPOINT_SINGLE &&
+            singleTimer.restoreRunning(cp.duration_seconds, remaining, cp.sound_track)) {
+            Serial.printf("Resumed single timer: %lus left\n", (unsigned long)remaining);
+            stateMachine.setState(STATE_SINGLE_TIMER_RUNNING);
+            return true;
+        }
+        if (cp.kind == CHECKPOINT_MULTI &&
+            multiTimer.restoreRunning(cp.routine_index, cp.routine_phases, cp.cursor, cp.phase_index, remaining,
+                                      timerCheckpoint.overshootSeconds(cp))) {
+            if (multiTimer.isRoutineFinished()) {
+                Serial.printf("Routine %u finished during the reset\n", cp.routine_index);
             } else {
-                Serial.println("NTP sync failed; using RTC time");
+                Serial.printf("Resumed routine %u phase %d: %lus left\n", cp.routine_index, multiTimer.getCurrentPhaseIndex(),
+                              multiTimer.getRemainingTime());
             }
-        } else {
-            Serial.println("Offline; using RTC time");
+            stateMachine.setState(STATE_MULTI_TIMER_RUNNING);
+            return true;
         }
     }
-    
-    // Display final status
-    display.clearDisplay();
-    display.setTextSize(1);
-    display.setTextColor(SSD1306_WHITE);
-    display.setCursor(0, 0);
-    display.println("Chrono-Cubo Ready!");
-    if (wifiConnected) {
-    display.print("IP: ");
-    display.println(WiFi.localIP());
-    } else {
-        display.println("Offline mode (no WiFi)");
-    }
-    display.println();
-    display.println("Time: " + timeManager.getCurrentTimeString());
-    display.println();
-    display.println("Press button to start");
-    display.display();
 
-    // Wait for button press to start (non-blocking yield)
-    unsigned long start_wait_begin = millis();
-    const unsigned long start_wait_timeout = 30000; // 30s max before auto-start
-    while (!select_button_pressed() && (millis() - start_wait_begin) < start_wait_timeout) {
-        yield();
-    }
+    // Stale or unusable checkpoint
+    timerCheckpoint.clear();
+    return false;
+}
 
-    // Start by showing the clock; press button to open menu
-    stateMachine.setState(STATE_TIME_DISPLAY);
-    systemInitialized = true;
+// Line commands typed on the serial console
+void pollSerialCommands() {
+    static char line[SERIAL_COMMAND_MAX];
+    static uint8_t length = 0;
+    while (Serial.available() > 0) {
+        char c = Serial.read();
+        if (c != '\n' && c != '\r') {
+            if (length < sizeof(line) - 1) line[length++] = c;
+            continue;
+        }
+        if (length == 0) continue;
+        line[length] = '\0';
+        length = 0;
+
+        if (strcmp(line, "export") == 0) {
+            logTransfer("export", fileTransfer.exportAll());
+        } else if (strcmp(line, "import") == 0) {
+            AppState state = stateMachine.getCurrentState();
+            // Not under an open editor or a running routine, which hold indexes into the lists
+            if (state == STATE_MAIN_MENU || state == STATE_SETTINGS_MENU || state == STATE_TIME_DISPLAY) {
+                logTransfer("import", fileTransfer.importAll());
+            } else {
+                Serial.println("[Transfer] import: go to the main or settings menu first");
+            }
+        } else if (strcmp(line, "nvs") == 0) {
+            storageTelemetry.dump(Serial);
+        } else if (strcmp(line, "time") == 0) {
+            timeService.dump(Serial);
+        } else {
+            Serial.printf("Unknown command '%s' (export, import, nvs, time)\n", line);
+        }
+    }
 }
 
 void initializeSystem() {
@@ -1064,6 +1413,7 @@ void initializeSystem() {
 
 void entrypoint(){
     Serial.begin(115200);
+    nvsService.begin();
 
     // // Initialize NVS (required by Preferences). If partition needs erase, do that and retry.
     // esp_err_t nvs_err = nvs_flash_init();
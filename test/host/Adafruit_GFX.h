@@ -0,0 +1,59 @@
+#ifndef HOST_ADAFRUIT_GFX_H
+#define HOST_ADAFRUIT_GFX_H
+
+// Drawing calls are accepted and dropped; text goes nowhere
+
+#include <Arduino.h>
+
+class Adafruit_GFX : public Print {
+protected:
+    int16_t widthPx;
+    int16_t heightPx;
+    int16_t cursorX = 0;
+    int16_t cursorY = 0;
+
+public:
+    Adafruit_GFX(int16_t w, int16_t h) : widthPx(w), heightPx(h) {}
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+
+    int16_t width() const { return widthPx; }
+    int16_t height() const { return heightPx; }
+    void setCursor(int16_t x, int16_t y) {
+        cursorX = x;
+        cursorY = y;
+    }
+    int16_t getCursorX() const { return cursorX; }
+    int16_t getCursorY() const { return cursorY; }
+    void setTextSize(uint8_t) {}
+    void setTextColor(uint16_t) {}
+    void setTextColor(uint16_t, uint16_t) {}
+    void setTextWrap(bool) {}
+    void setRotation(uint8_t) {}
+    void cp437(bool = true) {}
+    void getTextBounds(const char* text, int16_t x, int16_t y, int16_t* x1, int16_t* y1, uint16_t* w, uint16_t* h) {
+        *x1 = x;
+        *y1 = y;
+        *w = 6 * strlen(text);
+        *h = 8;
+    }
+    void getTextBounds(const String& text, int16_t x, int16_t y, int16_t* x1, int16_t* y1, uint16_t* w, uint16_t* h) {
+        getTextBounds(text.c_str(), x, y, x1, y1, w, h);
+    }
+    void drawPixel(int16_t, int16_t, uint16_t) {}
+    void drawFastHLine(int16_t, int16_t, int16_t, uint16_t) {}
+    void drawFastVLine(int16_t, int16_t, int16_t, uint16_t) {}
+    void drawLine(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+    void drawRect(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+    void fillRect(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+    void drawRoundRect(int16_t, int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+    void fillRoundRect(int16_t, int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+    void drawCircle(int16_t, int16_t, int16_t, uint16_t) {}
+    void fillCircle(int16_t, int16_t, int16_t, uint16_t) {}
+    void drawTriangle(int16_t, int16_t, int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+    void fillTriangle(int16_t, int16_t, int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+    void drawBitmap(int16_t, int16_t, const uint8_t*, int16_t, int16_t, uint16_t) {}
+    void fillScreen(uint16_t) {}
+};
+
+#endif // HOST_ADAFRUIT_GFX_H
@@ -0,0 +1,44 @@
+#ifndef HOST_ADAFRUIT_SSD1306_H
+#define HOST_ADAFRUIT_SSD1306_H
+
+// An SSD1306 that draws nothing
+
+#include <Adafruit_GFX.h>
+#include <Wire.h>
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+#define BLACK SSD1306_BLACK
+#define WHITE SSD1306_WHITE
+#define INVERSE SSD1306_INVERSE
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+
+class Adafruit_SSD1306 : public Adafruit_GFX {
+public:
+    Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire* twi = &Wire, int8_t resetPin = -1, uint32_t clkDuring = 400000UL,
+                     uint32_t clkAfter = 100000UL)
+        : Adafruit_GFX(w, h) {
+        (void)twi;
+        (void)resetPin;
+        (void)clkDuring;
+        (void)clkAfter;
+    }
+    bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t address = 0, bool reset = true, bool periphBegin = true) {
+        (void)switchvcc;
+        (void)address;
+        (void)reset;
+        (void)periphBegin;
+        return true;
+    }
+    void display() {}
+    void clearDisplay() {}
+    void invertDisplay(bool) {}
+    void dim(bool) {}
+    void ssd1306_command(uint8_t) {}
+};
+
+#endif // HOST_ADAFRUIT_SSD1306_H
@@ -0,0 +1,277 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Just enough of the ESP32 Arduino core for the libraries under test to
+// build and run on the host ([env:native]). Time is simulated: millis(),
+// micros() and esp_timer_get_time() only move when a test advances them.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define F(x) x
+#define PROGMEM
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define ADC_11db 3
+#define SERIAL_8N1 0x800001c
+#define DEC 10
+#define HEX 16
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+namespace host {
+// Simulated time since boot
+inline int64_t clockUs = 0;
+inline void advanceMs(uint32_t ms) { clockUs += (int64_t)ms * 1000; }
+inline void advanceUs(int64_t us) { clockUs += us; }
+// Serial output is printed unless a test that logs a lot turns it off
+inline bool serialQuiet = false;
+// Interrupt handlers by pin, so a test can raise one
+inline void (*isr[64])() = {};
+inline int pinLevel[64] = {};
+}
+
+class String {
+private:
+    std::string s;
+
+public:
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& c) : s(c) {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(int v, int base = 10) : s(format(v, base)) {}
+    explicit String(unsigned v, int base = 10) : s(format(v, base)) {}
+    explicit String(long v, int base = 10) : s(format(v, base)) {}
+    explicit String(unsigned long v, int base = 10) : s(format(v, base)) {}
+    explicit String(long long v) : s(std::to_string(v)) {}
+    explicit String(unsigned long long v) : s(std::to_string(v)) {}
+    explicit String(double v, unsigned decimals = 2) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        s = buf;
+    }
+
+    static std::string format(long long v, int base) {
+        if (base == 10) return std::to_string(v);
+        std::string out;
+        unsigned long long u = (unsigned long long)v;
+        do {
+            out.insert(out.begin(), "0123456789abcdef"[u % base]);
+            u /= base;
+        } while (u);
+        return out;
+    }
+
+    unsigned int length() const { return s.size(); }
+    const char* c_str() const { return s.c_str(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+    char charAt(unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    void setCharAt(unsigned int i, char c) { if (i < s.size()) s[i] = c; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    char& operator[](unsigned int i) { return s[i]; }
+
+    bool equals(const String& o) const { return s == o.s; }
+    bool equalsIgnoreCase(const String& o) const {
+        if (s.size() != o.s.size()) return false;
+        for (size_t i = 0; i < s.size(); ++i) if (tolower((unsigned char)s[i]) != tolower((unsigned char)o.s[i])) return false;
+        return true;
+    }
+    bool operator==(const String& o) const { return s == o.s; }
+    bool operator==(const char* o) const { return s == (o ? o : ""); }
+    bool operator!=(const String& o) const { return s != o.s; }
+    bool operator!=(const char* o) const { return !(*this == o); }
+    bool operator<(const String& o) const { return s < o.s; }
+    int compareTo(const String& o) const { return s.compare(o.s); }
+    bool startsWith(const String& p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+    bool endsWith(const String& p) const {
+        return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0;
+    }
+
+    bool concat(const String& o) { s += o.s; return true; }
+    bool concat(const char* c) { if (c) s += c; return true; }
+    bool concat(const char* c, unsigned int n) { s.append(c, n); return true; }
+    bool concat(char c) { s += c; return true; }
+    String& operator+=(const String& o) { s += o.s; return *this; }
+    String& operator+=(const char* o) { if (o) s += o; return *this; }
+    String& operator+=(char o) { s += o; return *this; }
+    String& operator+=(int o) { s += std::to_string(o); return *this; }
+    String& operator+=(unsigned o) { s += std::to_string(o); return *this; }
+    String& operator+=(long o) { s += std::to_string(o); return *this; }
+    String& operator+=(unsigned long o) { s += std::to_string(o); return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + (b ? b : "")); }
+    friend String operator+(const char* a, const String& b) { return String(std::string(a ? a : "") + b.s); }
+    friend String operator+(const String& a, char b) { return String(a.s + b); }
+    friend String operator+(const String& a, int b) { return String(a.s + std::to_string(b)); }
+    friend String operator+(const String& a, unsigned b) { return String(a.s + std::to_string(b)); }
+    friend String operator+(const String& a, long b) { return String(a.s + std::to_string(b)); }
+    friend String operator+(const String& a, unsigned long b) { return String(a.s + std::to_string(b)); }
+
+    int indexOf(char c, unsigned int from = 0) const { return found(s.find(c, from)); }
+    int indexOf(const String& o, unsigned int from = 0) const { return found(s.find(o.s, from)); }
+    int lastIndexOf(char c) const { return found(s.rfind(c)); }
+    int lastIndexOf(const String& o) const { return found(s.rfind(o.s)); }
+    String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        return from < s.size() ? String(s.substr(from, to - from)) : String();
+    }
+    void replace(const String& from, const String& to) {
+        if (from.s.empty()) return;
+        for (size_t p = s.find(from.s); p != std::string::npos; p = s.find(from.s, p + to.s.size())) s.replace(p, from.s.size(), to.s);
+    }
+    void remove(unsigned int index) { if (index < s.size()) s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < s.size()) s.erase(index, count); }
+    void toLowerCase() { for (auto& c : s) c = tolower((unsigned char)c); }
+    void toUpperCase() { for (auto& c : s) c = toupper((unsigned char)c); }
+    void trim() {
+        size_t b = 0, e = s.size();
+        while (b < e && isspace((unsigned char)s[b])) b++;
+        while (e > b && isspace((unsigned char)s[e - 1])) e--;
+        s = s.substr(b, e - b);
+    }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+
+private:
+    static int found(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
+
+// What a String + String expression yields on the real core
+class StringSumHelper : public String {
+public:
+    StringSumHelper(const String& s) : String(s) {}
+    StringSumHelper(const char* p) : String(p) {}
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+    size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char small[128];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(small, sizeof(small), format, args);
+        va_end(args);
+        if (len < 0) return 0;
+        if ((size_t)len < sizeof(small)) return write((const uint8_t*)small, len);
+        std::vector<char> big(len + 1);
+        va_start(args, format);
+        vsnprintf(big.data(), big.size(), format, args);
+        va_end(args);
+        return write((const uint8_t*)big.data(), len);
+    }
+
+    size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base = DEC) { return print(String(v, base)); }
+    size_t print(unsigned v, int base = DEC) { return print(String(v, base)); }
+    size_t print(long v, int base = DEC) { return print(String(v, base)); }
+    size_t print(unsigned long v, int base = DEC) { return print(String(v, base)); }
+    size_t print(long long v, int = DEC) { return print(String(v)); }
+    size_t print(unsigned long long v, int = DEC) { return print(String(v)); }
+    size_t print(double v, int digits = 2) { return print(String(v, (unsigned)digits)); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& v) { return print(v) + println(); }
+    template <typename T> size_t println(const T& v, int format) { return print(v, format) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    void setTimeout(unsigned long) {}
+    size_t readBytes(char* buffer, size_t length) {
+        size_t n = 0;
+        for (int c; n < length && (c = read()) >= 0; ++n) buffer[n] = (char)c;
+        return n;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+    String readStringUntil(char terminator) {
+        String out;
+        for (int c; (c = read()) >= 0 && c != terminator;) out += (char)c;
+        return out;
+    }
+};
+
+// Serial goes to stdout; the other UARTs go nowhere
+class HardwareSerial : public Stream {
+private:
+    int uart;
+
+public:
+    explicit HardwareSerial(int uartNumber = 0) : uart(uartNumber) {}
+    void begin(unsigned long, uint32_t = SERIAL_8N1, int8_t = -1, int8_t = -1) {}
+    void end() {}
+    operator bool() const { return true; }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (uart == 0 && !host::serialQuiet) fwrite(buffer, 1, size, stdout);
+        return size;
+    }
+    using Print::write;
+};
+
+inline HardwareSerial Serial(0);
+
+inline unsigned long millis() { return (unsigned long)(host::clockUs / 1000); }
+inline unsigned long micros() { return (unsigned long)host::clockUs; }
+inline void delay(uint32_t ms) { host::advanceMs(ms); }
+inline void delayMicroseconds(uint32_t us) { host::advanceUs(us); }
+inline void yield() {}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) { host::pinLevel[pin & 63] = value; }
+inline int digitalRead(uint8_t pin) { return host::pinLevel[pin & 63]; }
+inline uint16_t analogRead(uint8_t) { return 2048; }
+inline void analogReadResolution(uint8_t) {}
+inline void analogSetPinAttenuation(uint8_t, int) {}
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int pin, void (*handler)(), int) { host::isr[pin & 63] = handler; }
+inline void detachInterrupt(int pin) { host::isr[pin & 63] = nullptr; }
+
+inline long random(long howBig) { return howBig > 0 ? rand() % howBig : 0; }
+inline long random(long howSmall, long howBig) { return howSmall >= howBig ? howSmall : howSmall + random(howBig - howSmall); }
+inline void randomSeed(unsigned long seed) { srand(seed); }
+
+using std::max;
+using std::min;
+template <class A, class B, class C> A constrain(A a, B low, C high) { return a < low ? low : (a > high ? high : a); }
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+#endif // HOST_ARDUINO_H
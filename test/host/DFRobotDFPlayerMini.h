@@ -0,0 +1,42 @@
+#ifndef HOST_DFROBOTDFPLAYERMINI_H
+#define HOST_DFROBOTDFPLAYERMINI_H
+
+// A DFPlayer that remembers what it was last asked to play
+
+#include <Arduino.h>
+
+#define DFPLAYER_EQ_NORMAL 0
+#define DFPLAYER_EQ_POP 1
+#define DFPLAYER_EQ_ROCK 2
+#define DFPLAYER_EQ_JAZZ 3
+#define DFPLAYER_EQ_CLASSIC 4
+#define DFPLAYER_EQ_BASS 5
+
+namespace host {
+inline int playerTrack = 0; // 0 = stopped
+inline uint32_t playerStarts = 0;
+}
+
+class DFRobotDFPlayerMini {
+public:
+    bool begin(Stream&, bool isACK = true, bool doReset = true) {
+        (void)isACK;
+        (void)doReset;
+        return true;
+    }
+    void setTimeOut(unsigned long) {}
+    void volume(uint8_t) {}
+    void EQ(uint8_t) {}
+    bool available() { return false; }
+    uint8_t readType() { return 0; }
+    uint16_t read() { return 0; }
+    void playMp3Folder(int track) {
+        host::playerTrack = track;
+        host::playerStarts++;
+    }
+    void play(int track = 1) { playMp3Folder(track); }
+    void advertise(int track) { playMp3Folder(track); }
+    void stop() { host::playerTrack = 0; }
+};
+
+#endif // HOST_DFROBOTDFPLAYERMINI_H
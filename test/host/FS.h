@@ -0,0 +1,112 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+// In-memory stand-in for the Arduino FS layer: a file system is a map from
+// path to contents (a flash image a test can fill or inspect), and a File
+// reads or writes straight into its entry.
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+typedef std::map<std::string, std::vector<uint8_t>> Image;
+
+class File : public Stream {
+private:
+    struct Handle {
+        Image* image;
+        std::string path;
+        size_t pos;
+        bool writable;
+    };
+    std::shared_ptr<Handle> handle;
+
+    std::vector<uint8_t>* data() const {
+        if (!handle) return nullptr;
+        auto it = handle->image->find(handle->path);
+        return it == handle->image->end() ? nullptr : &it->second;
+    }
+
+public:
+    File() {}
+    File(Image* image, const std::string& path, bool writable, size_t pos)
+        : handle(new Handle{image, path, pos, writable}) {}
+
+    explicit operator bool() const { return data() != nullptr; }
+    const char* path() const { return handle ? handle->path.c_str() : ""; }
+    size_t size() const { return data() ? data()->size() : 0; }
+    size_t position() const { return handle ? handle->pos : 0; }
+    bool seek(uint32_t pos) {
+        if (!data() || pos > size()) return false;
+        handle->pos = pos;
+        return true;
+    }
+    void close() { handle.reset(); }
+
+    size_t read(uint8_t* buffer, size_t size) {
+        std::vector<uint8_t>* d = data();
+        if (!d || handle->pos >= d->size()) return 0;
+        size_t n = std::min(size, d->size() - handle->pos);
+        memcpy(buffer, d->data() + handle->pos, n);
+        handle->pos += n;
+        return n;
+    }
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+    int available() override { return (int)(size() - position()); }
+    int peek() override {
+        std::vector<uint8_t>* d = data();
+        return d && handle->pos < d->size() ? (*d)[handle->pos] : -1;
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        std::vector<uint8_t>* d = data();
+        if (!d || !handle->writable) return 0;
+        if (d->size() < handle->pos + size) d->resize(handle->pos + size);
+        memcpy(d->data() + handle->pos, buffer, size);
+        handle->pos += size;
+        return size;
+    }
+    using Print::write;
+};
+
+class FS {
+public:
+    Image files;
+
+    File open(const char* path, const char* mode = FILE_READ) {
+        bool write = mode[0] == 'w' || mode[0] == 'a';
+        if (!write && !exists(path)) return File();
+        if (mode[0] == 'w') files[path].clear();
+        std::vector<uint8_t>& d = files[path];
+        return File(&files, path, write, mode[0] == 'a' ? d.size() : 0);
+    }
+    bool exists(const char* path) const { return files.count(path) > 0; }
+    bool remove(const char* path) { return files.erase(path) > 0; }
+    // Replaces an existing file at to, as LittleFS does
+    bool rename(const char* from, const char* to) {
+        auto it = files.find(from);
+        if (it == files.end()) return false;
+        std::vector<uint8_t> contents = std::move(it->second);
+        files.erase(it);
+        files[to] = std::move(contents);
+        return true;
+    }
+};
+
+} // namespace fs
+
+using fs::File;
+
+#endif // HOST_FS_H
@@ -0,0 +1,22 @@
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+// Requests fail without reaching any server
+
+#include <Arduino.h>
+
+#define HTTP_CODE_OK 200
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+class HTTPClient {
+public:
+    bool begin(const String&) { return false; }
+    void addHeader(const String&, const String&) {}
+    void setTimeout(uint16_t) {}
+    int GET() { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    int POST(const String&) { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    String getString() { return String(); }
+    void end() {}
+};
+
+#endif // HOST_HTTPCLIENT_H
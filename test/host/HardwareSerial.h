@@ -0,0 +1,7 @@
+#ifndef HOST_HARDWARESERIAL_H
+#define HOST_HARDWARESERIAL_H
+
+// HardwareSerial lives in Arduino.h
+#include <Arduino.h>
+
+#endif // HOST_HARDWARESERIAL_H
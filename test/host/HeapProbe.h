@@ -0,0 +1,57 @@
+#ifndef HOST_HEAP_PROBE_H
+#define HOST_HEAP_PROBE_H
+
+// Heap accounting for benchmarks: every operator new is counted, with live
+// and peak bytes. The simulated flash allocates under host::BackendScope and
+// is left out. Replaces the global operator new, so include it from one
+// source file of a suite only.
+
+#include <Preferences.h>
+#include <chrono>
+#include <new>
+
+namespace host {
+inline size_t allocations = 0;
+inline size_t liveBytes = 0;
+inline size_t peakBytes = 0;
+}
+
+void* operator new(size_t n) {
+    size_t* p = (size_t*)malloc(n + 16);
+    if (!p) throw std::bad_alloc();
+    p[0] = host::backendDepth ? 0 : n;
+    if (p[0]) {
+        host::allocations++;
+        host::liveBytes += n;
+        if (host::liveBytes > host::peakBytes) host::peakBytes = host::liveBytes;
+    }
+    return (char*)p + 16;
+}
+void operator delete(void* q) noexcept {
+    if (!q) return;
+    size_t* p = (size_t*)((char*)q - 16);
+    host::liveBytes -= p[0];
+    free(p);
+}
+void operator delete(void* q, size_t) noexcept { operator delete(q); }
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete[](void* q) noexcept { operator delete(q); }
+void operator delete[](void* q, size_t) noexcept { operator delete(q); }
+
+// Time, allocations and peak heap above the starting point of one step
+struct HeapProbe {
+    size_t startAllocations;
+    size_t startBytes;
+    std::chrono::steady_clock::time_point start;
+
+    HeapProbe() : startAllocations(host::allocations), startBytes(host::liveBytes), start(std::chrono::steady_clock::now()) {
+        host::peakBytes = host::liveBytes;
+    }
+    double micros() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    size_t count() const { return host::allocations - startAllocations; }
+    size_t peak() const { return host::peakBytes - startBytes; }
+};
+
+#endif // HOST_HEAP_PROBE_H
@@ -0,0 +1,31 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+// The LittleFS partition, held in memory (LittleFS.files) by FS.h
+
+#include <FS.h>
+
+namespace fs {
+
+class LittleFSFS : public FS {
+public:
+    bool mounted = false;
+    bool failMount = false; // begin() fails, as on a missing partition
+
+    bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+               const char* partitionLabel = "spiffs") {
+        (void)formatOnFail;
+        (void)basePath;
+        (void)maxOpenFiles;
+        (void)partitionLabel;
+        mounted = !failMount;
+        return mounted;
+    }
+    void end() { mounted = false; }
+};
+
+} // namespace fs
+
+inline fs::LittleFSFS LittleFS;
+
+#endif // HOST_LITTLEFS_H
@@ -0,0 +1,296 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+// In-memory stand-in for the ESP32 Preferences library. Every instance works
+// on one shared partition (host::flash), which keeps each value's type and
+// bytes per namespace, the way NVS does, and counts what it is asked to do.
+// Keys over 15 characters and strings over 4000 bytes fail as they do on NVS.
+//
+// Power cuts: with a budget set, writes stop once that many value bytes
+// (1 per remove) have gone to "flash". The write that crosses the budget
+// keeps only the bytes that fit, a torn value, and every later write is
+// lost. Calls still return success, as the firmware would never see them fail.
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define HOST_NVS_KEY_MAX 15
+#define HOST_NVS_STRING_MAX 4000
+#define HOST_NVS_ENTRIES_PER_PAGE 126
+#define HOST_NVS_PAGES 25 // the 0x19000 nvs partition in partitions.csv
+
+typedef enum {
+    PT_I8,
+    PT_U8,
+    PT_I16,
+    PT_U16,
+    PT_I32,
+    PT_U32,
+    PT_I64,
+    PT_U64,
+    PT_STR,
+    PT_BLOB,
+    PT_INVALID
+} PreferenceType;
+
+namespace host {
+
+struct NvsValue {
+    PreferenceType type;
+    std::vector<uint8_t> bytes; // a string keeps its NUL
+};
+
+struct NvsCounters {
+    uint32_t opens;
+    uint32_t closes;
+    uint32_t writes; // puts that stored a value
+    uint32_t bytesWritten;
+    uint32_t removes;
+    uint32_t reads; // gets that found a value
+    uint32_t bytesRead;
+};
+
+// Allocations the backend makes for its own storage are not the firmware's
+// heap; a test counting allocations skips them while this is above zero
+inline int backendDepth = 0;
+struct BackendScope {
+    BackendScope() { backendDepth++; }
+    ~BackendScope() { backendDepth--; }
+};
+
+struct NvsPartition {
+    std::map<std::string, std::map<std::string, NvsValue>> namespaces;
+    NvsCounters counters = {};
+    long budget = -1; // value bytes left before the power fails; -1 = no limit
+    bool powerLost = false;
+    bool failOpen = false; // begin() fails, as on a corrupt or missing partition
+
+    // Power fails after bytes more bytes have been written
+    void cutPowerAfter(long bytes) {
+        budget = bytes;
+        powerLost = false;
+    }
+    // Power back: writes reach flash again
+    void restorePower() {
+        budget = -1;
+        powerLost = false;
+    }
+    // Whether the next n bytes reach flash; false from the first one that does not
+    bool spend(size_t n) {
+        if (powerLost) return false;
+        if (budget < 0) return true;
+        if ((long)n > budget) {
+            powerLost = true;
+            return false;
+        }
+        budget -= n;
+        return true;
+    }
+    void erase() {
+        BackendScope scope;
+        namespaces.clear();
+        counters = {};
+        restorePower();
+        failOpen = false;
+    }
+
+    // Entries as NVS would use them: one for a primitive, a header plus one
+    // per 32 data bytes for a string, and a blob index on top for a blob
+    static size_t entriesOf(const NvsValue& v) {
+        if (v.type == PT_STR) return 1 + (v.bytes.size() + 31) / 32;
+        if (v.type == PT_BLOB) return 2 + (v.bytes.size() + 31) / 32;
+        return 1;
+    }
+    size_t usedEntries(const std::string* ns = nullptr) const {
+        size_t used = 0;
+        for (const auto& n : namespaces) {
+            if (ns && n.first != *ns) continue;
+            for (const auto& kv : n.second) used += entriesOf(kv.second);
+        }
+        return used;
+    }
+    size_t storedBytes() const {
+        size_t bytes = 0;
+        for (const auto& n : namespaces) for (const auto& kv : n.second) bytes += kv.second.bytes.size();
+        return bytes;
+    }
+    size_t keyCount() const {
+        size_t keys = 0;
+        for (const auto& n : namespaces) keys += n.second.size();
+        return keys;
+    }
+};
+
+inline NvsPartition flash;
+
+} // namespace host
+
+class Preferences {
+private:
+    std::string ns;
+    bool started;
+    bool readOnly;
+
+    std::map<std::string, host::NvsValue>* values() { return started ? &host::flash.namespaces[ns] : nullptr; }
+
+    const host::NvsValue* find(const char* key) {
+        if (!started || !key) return nullptr;
+        auto& m = host::flash.namespaces[ns];
+        auto it = m.find(key);
+        return it == m.end() ? nullptr : &it->second;
+    }
+
+    size_t put(const char* key, PreferenceType type, const void* value, size_t len) {
+        if (!started || readOnly || !key || strlen(key) > HOST_NVS_KEY_MAX) return 0;
+        if (type == PT_STR && len > HOST_NVS_STRING_MAX) return 0;
+        host::BackendScope scope;
+        host::NvsPartition& f = host::flash;
+        if (f.powerLost) return len;
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        size_t stored = len;
+        if (!f.spend(len)) stored = f.budget > 0 ? (size_t)f.budget : 0;
+        host::NvsValue& v = (*values())[key];
+        v.type = type;
+        v.bytes.assign(bytes, bytes + stored);
+        if (stored == len) {
+            f.counters.writes++;
+            f.counters.bytesWritten += len;
+        }
+        return len;
+    }
+
+    size_t get(const char* key, PreferenceType type, void* out, size_t len) {
+        const host::NvsValue* v = find(key);
+        if (!v || v->type != type || v->bytes.size() != len) return 0;
+        memcpy(out, v->bytes.data(), len);
+        host::flash.counters.reads++;
+        host::flash.counters.bytesRead += len;
+        return len;
+    }
+
+    template <typename T> T getValue(const char* key, PreferenceType type, T defaultValue) {
+        T value = defaultValue;
+        return get(key, type, &value, sizeof(T)) ? value : defaultValue;
+    }
+
+public:
+    Preferences() : started(false), readOnly(false) {}
+    ~Preferences() { end(); }
+
+    bool begin(const char* name, bool readOnlyMode = false, const char* partitionLabel = nullptr) {
+        (void)partitionLabel;
+        if (started) return false;
+        if (host::flash.failOpen || !name || strlen(name) > HOST_NVS_KEY_MAX) return false;
+        host::BackendScope scope;
+        ns = name;
+        readOnly = readOnlyMode;
+        started = true;
+        host::flash.namespaces[ns];
+        host::flash.counters.opens++;
+        return true;
+    }
+    void end() {
+        if (!started) return;
+        started = false;
+        host::flash.counters.closes++;
+    }
+
+    bool clear() {
+        if (!started || readOnly) return false;
+        host::BackendScope scope;
+        if (!host::flash.spend(1)) return true;
+        values()->clear();
+        return true;
+    }
+    bool remove(const char* key) {
+        if (!started || readOnly || !key) return false;
+        host::BackendScope scope;
+        if (!host::flash.spend(1)) return true;
+        if (values()->erase(key) == 0) return false;
+        host::flash.counters.removes++;
+        return true;
+    }
+
+    bool isKey(const char* key) { return find(key) != nullptr; }
+    PreferenceType getType(const char* key) {
+        const host::NvsValue* v = find(key);
+        return v ? v->type : PT_INVALID;
+    }
+    size_t freeEntries() {
+        size_t total = HOST_NVS_ENTRIES_PER_PAGE * (HOST_NVS_PAGES - 1);
+        size_t used = host::flash.usedEntries();
+        return used < total ? total - used : 0;
+    }
+
+    size_t putChar(const char* key, int8_t value) { return put(key, PT_I8, &value, 1); }
+    size_t putUChar(const char* key, uint8_t value) { return put(key, PT_U8, &value, 1); }
+    size_t putShort(const char* key, int16_t value) { return put(key, PT_I16, &value, 2); }
+    size_t putUShort(const char* key, uint16_t value) { return put(key, PT_U16, &value, 2); }
+    size_t putInt(const char* key, int32_t value) { return put(key, PT_I32, &value, 4); }
+    size_t putUInt(const char* key, uint32_t value) { return put(key, PT_U32, &value, 4); }
+    size_t putLong(const char* key, int32_t value) { return putInt(key, value); }
+    size_t putULong(const char* key, uint32_t value) { return putUInt(key, value); }
+    size_t putLong64(const char* key, int64_t value) { return put(key, PT_I64, &value, 8); }
+    size_t putULong64(const char* key, uint64_t value) { return put(key, PT_U64, &value, 8); }
+    // Floats and doubles are blobs on the real library too
+    size_t putFloat(const char* key, float value) { return put(key, PT_BLOB, &value, sizeof(value)); }
+    size_t putDouble(const char* key, double value) { return put(key, PT_BLOB, &value, sizeof(value)); }
+    size_t putBool(const char* key, bool value) { return putUChar(key, value ? 1 : 0); }
+    size_t putString(const char* key, const char* value) {
+        if (!value) return 0;
+        size_t len = strlen(value);
+        return put(key, PT_STR, value, len + 1) ? len : 0;
+    }
+    size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+    size_t putBytes(const char* key, const void* value, size_t len) {
+        if (!value || !len) return 0;
+        return put(key, PT_BLOB, value, len);
+    }
+
+    int8_t getChar(const char* key, int8_t defaultValue = 0) { return getValue(key, PT_I8, defaultValue); }
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return getValue(key, PT_U8, defaultValue); }
+    int16_t getShort(const char* key, int16_t defaultValue = 0) { return getValue(key, PT_I16, defaultValue); }
+    uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return getValue(key, PT_U16, defaultValue); }
+    int32_t getInt(const char* key, int32_t defaultValue = 0) { return getValue(key, PT_I32, defaultValue); }
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return getValue(key, PT_U32, defaultValue); }
+    int32_t getLong(const char* key, int32_t defaultValue = 0) { return getInt(key, defaultValue); }
+    uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getUInt(key, defaultValue); }
+    int64_t getLong64(const char* key, int64_t defaultValue = 0) { return getValue(key, PT_I64, defaultValue); }
+    uint64_t getULong64(const char* key, uint64_t defaultValue = 0) { return getValue(key, PT_U64, defaultValue); }
+    float getFloat(const char* key, float defaultValue = NAN) { return getValue(key, PT_BLOB, defaultValue); }
+    double getDouble(const char* key, double defaultValue = NAN) { return getValue(key, PT_BLOB, defaultValue); }
+    bool getBool(const char* key, bool defaultValue = false) { return getUChar(key, defaultValue ? 1 : 0) == 1; }
+
+    size_t getString(const char* key, char* value, size_t maxLen) {
+        const host::NvsValue* v = find(key);
+        if (!v || v->type != PT_STR || v->bytes.size() > maxLen) return 0;
+        memcpy(value, v->bytes.data(), v->bytes.size());
+        host::flash.counters.reads++;
+        host::flash.counters.bytesRead += v->bytes.size();
+        return v->bytes.size();
+    }
+    String getString(const char* key, String defaultValue = String()) {
+        const host::NvsValue* v = find(key);
+        if (!v || v->type != PT_STR) return defaultValue;
+        host::flash.counters.reads++;
+        host::flash.counters.bytesRead += v->bytes.size();
+        // A torn string has lost its NUL
+        return String(std::string(v->bytes.begin(), v->bytes.end()).c_str());
+    }
+    size_t getBytesLength(const char* key) {
+        const host::NvsValue* v = find(key);
+        return v && v->type == PT_BLOB ? v->bytes.size() : 0;
+    }
+    size_t getBytes(const char* key, void* buf, size_t maxLen) {
+        const host::NvsValue* v = find(key);
+        if (!v || v->type != PT_BLOB || v->bytes.size() > maxLen) return 0;
+        memcpy(buf, v->bytes.data(), v->bytes.size());
+        host::flash.counters.reads++;
+        host::flash.counters.bytesRead += v->bytes.size();
+        return v->bytes.size();
+    }
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,158 @@
+#ifndef HOST_RTCLIB_H
+#define HOST_RTCLIB_H
+
+// RTClib's DateTime and a DS3231 whose clock runs on the simulated time of
+// Arduino.h: host::rtcSet() sets it, host::advanceMs() moves it on. Alarm1
+// is kept, not signalled; a test raises the INT pin itself.
+
+#include <Arduino.h>
+#include <Wire.h>
+
+class TimeSpan {
+private:
+    int32_t total;
+
+public:
+    TimeSpan(int32_t s = 0) : total(s) {}
+    TimeSpan(int16_t days, int8_t hours, int8_t minutes, int8_t s)
+        : total((int32_t)days * 86400L + (int32_t)hours * 3600 + (int32_t)minutes * 60 + s) {}
+    int16_t days() const { return total / 86400L; }
+    int8_t hours() const { return total / 3600 % 24; }
+    int8_t minutes() const { return total / 60 % 60; }
+    int8_t seconds() const { return total % 60; }
+    int32_t totalseconds() const { return total; }
+};
+
+class DateTime {
+private:
+    uint32_t seconds;
+
+    // Days since 1970-01-01 of a proleptic Gregorian date
+    static int32_t daysFromCivil(int32_t y, unsigned m, unsigned d) {
+        y -= m <= 2;
+        int32_t era = (y >= 0 ? y : y - 399) / 400;
+        unsigned yoe = (unsigned)(y - era * 400);
+        unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (int32_t)doe - 719468;
+    }
+    void civil(uint16_t* year, uint8_t* month, uint8_t* day) const {
+        int32_t z = seconds / 86400 + 719468;
+        int32_t era = z / 146097;
+        unsigned doe = (unsigned)(z - era * 146097);
+        unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        unsigned mp = (5 * doy + 2) / 153;
+        unsigned d = doy - (153 * mp + 2) / 5 + 1;
+        unsigned m = mp < 10 ? mp + 3 : mp - 9;
+        *year = (uint16_t)(yoe + era * 400 + (m <= 2));
+        *month = (uint8_t)m;
+        *day = (uint8_t)d;
+    }
+
+public:
+    DateTime(uint32_t t = 946684800) : seconds(t) {}
+    DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t minute = 0, uint8_t second = 0) {
+        if (year < 100) year += 2000;
+        seconds = (uint32_t)daysFromCivil(year, month, day) * 86400 + hour * 3600UL + minute * 60UL + second;
+    }
+
+    uint16_t year() const {
+        uint16_t y;
+        uint8_t m, d;
+        civil(&y, &m, &d);
+        return y;
+    }
+    uint8_t month() const {
+        uint16_t y;
+        uint8_t m, d;
+        civil(&y, &m, &d);
+        return m;
+    }
+    uint8_t day() const {
+        uint16_t y;
+        uint8_t m, d;
+        civil(&y, &m, &d);
+        return d;
+    }
+    uint8_t hour() const { return seconds / 3600 % 24; }
+    uint8_t twelveHour() const { return hour() % 12 == 0 ? 12 : hour() % 12; }
+    bool isPM() const { return hour() >= 12; }
+    uint8_t minute() const { return seconds / 60 % 60; }
+    uint8_t second() const { return seconds % 60; }
+    // 0 = Sunday; 1970-01-01 was a Thursday
+    uint8_t dayOfTheWeek() const { return (seconds / 86400 + 4) % 7; }
+    uint32_t unixtime() const { return seconds; }
+    uint32_t secondstime() const { return seconds - 946684800; }
+    bool isValid() const { return seconds >= 946684800; }
+
+    DateTime operator+(const TimeSpan& span) const { return DateTime(seconds + span.totalseconds()); }
+    DateTime operator-(const TimeSpan& span) const { return DateTime(seconds - span.totalseconds()); }
+    TimeSpan operator-(const DateTime& right) const { return TimeSpan((int32_t)(seconds - right.seconds)); }
+    bool operator<(const DateTime& right) const { return seconds < right.seconds; }
+    bool operator>(const DateTime& right) const { return seconds > right.seconds; }
+    bool operator<=(const DateTime& right) const { return seconds <= right.seconds; }
+    bool operator>=(const DateTime& right) const { return seconds >= right.seconds; }
+    bool operator==(const DateTime& right) const { return seconds == right.seconds; }
+    bool operator!=(const DateTime& right) const { return seconds != right.seconds; }
+};
+
+enum Ds3231SqwPinMode { DS3231_OFF = 0x1C, DS3231_SquareWave1Hz = 0x00 };
+enum Ds3231Alarm1Mode {
+    DS3231_A1_PerSecond = 0x0F,
+    DS3231_A1_Second = 0x0E,
+    DS3231_A1_Minute = 0x0C,
+    DS3231_A1_Hour = 0x08,
+    DS3231_A1_Date = 0x00,
+    DS3231_A1_Day = 0x10
+};
+enum Ds3231Alarm2Mode { DS3231_A2_PerMinute = 0x7, DS3231_A2_Minute = 0x6, DS3231_A2_Hour = 0x4, DS3231_A2_Date = 0x0 };
+
+namespace host {
+// RTC time at clockUs == 0; the RTC counts whole seconds of simulated time
+inline int64_t rtcEpoch = 1704067200; // 2024-01-01 00:00:00 UTC
+inline uint32_t rtcUnix() { return (uint32_t)(rtcEpoch + clockUs / 1000000); }
+// Sets the RTC to unix time at the start of its second
+inline void rtcSet(uint32_t seconds) {
+    clockUs = (clockUs / 1000000 + 1) * 1000000;
+    rtcEpoch = (int64_t)seconds - clockUs / 1000000;
+}
+inline uint32_t rtcReads = 0;
+}
+
+class RTC_DS3231 {
+public:
+    uint32_t alarm1 = 0; // programmed Alarm1 time, 0 = off
+    bool alarm1Fired = false;
+    bool powerLost = false;
+
+    bool begin(TwoWire* = &Wire) { return true; }
+    void adjust(const DateTime& dt) {
+        host::rtcSet(dt.unixtime());
+        powerLost = false;
+    }
+    bool lostPower() { return powerLost; }
+    DateTime now() {
+        host::rtcReads++;
+        return DateTime(host::rtcUnix());
+    }
+    bool setAlarm1(const DateTime& dt, Ds3231Alarm1Mode) {
+        alarm1 = dt.unixtime();
+        return true;
+    }
+    bool setAlarm2(const DateTime&, Ds3231Alarm2Mode) { return true; }
+    void disableAlarm(uint8_t n) {
+        if (n == 1) alarm1 = 0;
+    }
+    void clearAlarm(uint8_t n) {
+        if (n == 1) alarm1Fired = false;
+    }
+    bool alarmFired(uint8_t n) { return n == 1 && alarm1Fired; }
+    void writeSqwPinMode(Ds3231SqwPinMode) {}
+    Ds3231SqwPinMode readSqwPinMode() { return DS3231_OFF; }
+    float getTemperature() { return 25.0f; }
+    void enable32K() {}
+    void disable32K() {}
+};
+
+#endif // HOST_RTCLIB_H
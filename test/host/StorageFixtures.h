@@ -0,0 +1,141 @@
+#ifndef HOST_STORAGE_FIXTURES_H
+#define HOST_STORAGE_FIXTURES_H
+
+// Sample collections and a device with storage wired up the way main.cpp
+// does it, shared by the storage tests
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_system.h>
+#include <string>
+#include <vector>
+#include "DataModels.h"
+#include "RoutineStore.h"
+#include "ModelRepository.h"
+#include "NvsService.h"
+#include "StorageManager.h"
+
+// count routines of 4-8 phases, every other one with a repeat block
+inline RoutineStore makeRoutines(int count) {
+    static const char* names[] = {"Work", "Break", "Long break", "Warm up", "Sprint", "Cool down", "Stretch", "Rest"};
+    RoutineStore routines;
+    for (int r = 0; r < count; ++r) {
+        char name[32];
+        snprintf(name, sizeof(name), "Routine %d", r);
+        routines.beginRoutine(name);
+        int phases = 4 + r % 5;
+        for (int i = 0; i < phases; ++i) {
+            routines.addPhase(names[(r + i) % 8], 60 * (5 + (r * 7 + i * 13) % 55), 1 + i % 10, i % 3 == 0 ? 0x5u : 0u);
+        }
+        if (r % 2 == 0) routines.addRepeat(0, 1, 4);
+        routines.endRoutine();
+    }
+    return routines;
+}
+
+inline std::vector<Alarm> makeAlarms(int count) {
+    std::vector<Alarm> alarms;
+    for (int i = 0; i < count; ++i) {
+        Alarm a;
+        a.hour = (5 + i) % 24;
+        a.minute = (i * 5) % 60;
+        a.enabled = i % 2;
+        a.sound_track = 1 + i % 50;
+        a.days = 0x3E;
+        a.one_shot = i % 10 == 3;
+        a.snooze_minutes = 9;
+        alarms.push_back(a);
+    }
+    return alarms;
+}
+
+inline std::vector<AlertzyAccount> makeAccounts(int count) {
+    std::vector<AlertzyAccount> accounts;
+    for (int i = 0; i < count; ++i) {
+        char name[24], key[32];
+        snprintf(name, sizeof(name), "Device %d", i);
+        snprintf(key, sizeof(key), "k%08dabcdefabcdef", i);
+        accounts.push_back(AlertzyAccount{String(name), String(key)});
+    }
+    return accounts;
+}
+
+// One line per entry, for comparing what went in with what came back
+inline std::string describe(RoutineView routine) {
+    std::string s = routine.name();
+    s += "|";
+    for (int i = 0; i < routine.phaseCount(); ++i) {
+        PhaseView p = routine.phase(i);
+        s += std::string(p.name()) + "," + std::to_string(p.durationSeconds()) + "," + std::to_string(p.soundTrack()) +
+             "," + std::to_string(p.notifyMask()) + ";";
+    }
+    for (const auto& b : routine.repeats()) {
+        s += "R" + std::to_string(b.first_phase) + "-" + std::to_string(b.last_phase) + "x" + std::to_string(b.count);
+    }
+    return s + "\n";
+}
+
+inline std::string describe(const RoutineStore& routines) {
+    std::string s;
+    for (size_t i = 0; i < routines.size(); ++i) s += describe(routines[i]);
+    return s;
+}
+
+inline std::string describe(const std::vector<Alarm>& alarms) {
+    std::string s;
+    for (const auto& a : alarms) {
+        char line[64];
+        snprintf(line, sizeof(line), "%02d:%02d e%d o%d d%02x t%d s%d\n", a.hour, a.minute, a.enabled, a.one_shot, a.days,
+                 a.sound_track, a.snooze_minutes);
+        s += line;
+    }
+    return s;
+}
+
+inline std::string describe(const std::vector<AlertzyAccount>& accounts) {
+    std::string s;
+    for (const auto& a : accounts) s += std::string(a.name.c_str()) + "=" + a.key.c_str() + "\n";
+    return s;
+}
+
+// Storage, the NVS service and the model repository of one boot. Changes
+// reach storage through the repository listener, as in main.cpp; begin()
+// is left to the test, so without it every change is written at once.
+struct StoredDevice {
+    NvsService nvs;
+    ModelRepository models;
+    StorageManager storage;
+
+    StoredDevice() : storage(&nvs) {
+        host::shutdownHandlers.clear();
+        models.addListener(&StoredDevice::persist, this);
+        models.setRoutineLoader(&StoredDevice::loadRoutine, this);
+    }
+
+    void boot() {
+        models.setRoutines(storage.loadRoutineIndex());
+        models.setAlarms(storage.loadAlarms());
+        models.setAccounts(storage.loadAlertzyAccounts());
+    }
+
+    // Every routine with its phases, loaded the way running one would
+    std::string routines() {
+        std::string s;
+        const RoutineIndex& index = models.getRoutines();
+        for (size_t i = 0; i < index.size(); ++i) {
+            const RoutineStore* body = models.routine(models.routineId((int)i));
+            s += body ? describe(*body) : std::string("<unreadable>\n");
+        }
+        return s;
+    }
+
+    static void persist(ModelKind kind, ModelChange change, uint16_t id, void* context) {
+        StoredDevice* d = static_cast<StoredDevice*>(context);
+        d->storage.applyChange(d->models, kind, change, id);
+    }
+    static bool loadRoutine(uint16_t id, RoutineStore& out, void* context) {
+        return static_cast<StoredDevice*>(context)->storage.loadRoutine(id, out);
+    }
+};
+
+#endif // HOST_STORAGE_FIXTURES_H
@@ -0,0 +1,26 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+// The radio is never connected, so nothing tries the network
+
+#include <Arduino.h>
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+public:
+    wl_status_t status() { return WL_DISCONNECTED; }
+    bool isConnected() { return false; }
+};
+
+inline WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
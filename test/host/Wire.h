@@ -0,0 +1,22 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+// I2C bus with nothing on it; the devices the firmware talks to are faked
+// at the library level (RTClib.h, Adafruit_SSD1306.h)
+
+#include <Arduino.h>
+
+class TwoWire {
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) {
+        (void)sda;
+        (void)scl;
+        (void)frequency;
+        return true;
+    }
+    bool setClock(uint32_t) { return true; }
+};
+
+inline TwoWire Wire;
+
+#endif // HOST_WIRE_H
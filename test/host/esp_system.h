@@ -0,0 +1,29 @@
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <Arduino.h>
+
+typedef void (*shutdown_handler_t)(void);
+
+namespace host {
+inline std::vector<shutdown_handler_t> shutdownHandlers;
+// What esp_restart() does before the reset: the handlers, newest first
+inline void runShutdownHandlers() {
+    for (size_t i = shutdownHandlers.size(); i-- > 0;) shutdownHandlers[i]();
+}
+}
+
+inline esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    for (shutdown_handler_t h : host::shutdownHandlers) if (h == handler) return ESP_ERR_INVALID_STATE;
+    host::shutdownHandlers.push_back(handler);
+    return ESP_OK;
+}
+inline esp_err_t esp_unregister_shutdown_handler(shutdown_handler_t handler) {
+    auto& v = host::shutdownHandlers;
+    auto it = std::find(v.begin(), v.end(), handler);
+    if (it == v.end()) return ESP_ERR_INVALID_STATE;
+    v.erase(it);
+    return ESP_OK;
+}
+
+#endif // HOST_ESP_SYSTEM_H
@@ -0,0 +1,45 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+// Reads the simulated clock; timers are accepted but never fire on their own
+#include <Arduino.h>
+
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef enum { ESP_TIMER_TASK, ESP_TIMER_ISR } esp_timer_dispatch_t;
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer {
+    esp_timer_create_args_t args;
+    int64_t deadlineUs; // 0 = stopped
+};
+typedef struct esp_timer* esp_timer_handle_t;
+
+inline int64_t esp_timer_get_time() { return host::clockUs; }
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+    *out = new esp_timer{*args, 0};
+    return ESP_OK;
+}
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+    timer->deadlineUs = host::clockUs + (int64_t)timeoutUs;
+    return ESP_OK;
+}
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+    return esp_timer_start_once(timer, periodUs);
+}
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer->deadlineUs == 0) return ESP_ERR_INVALID_STATE;
+    timer->deadlineUs = 0;
+    return ESP_OK;
+}
+inline esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    delete timer;
+    return ESP_OK;
+}
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,39 @@
+#ifndef HOST_QUEUE_H
+#define HOST_QUEUE_H
+
+#include "FreeRTOS.h"
+#include <deque>
+#include <vector>
+#include <string.h>
+
+namespace host {
+struct Queue {
+    size_t itemSize;
+    size_t capacity;
+    std::deque<std::vector<uint8_t>> items;
+};
+}
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return new host::Queue{itemSize, length, {}};
+}
+inline BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t) {
+    host::Queue* q = static_cast<host::Queue*>(handle);
+    if (q->items.size() >= q->capacity) return pdFALSE;
+    const uint8_t* bytes = static_cast<const uint8_t*>(item);
+    q->items.emplace_back(bytes, bytes + q->itemSize);
+    return pdTRUE;
+}
+inline BaseType_t xQueueSendFromISR(QueueHandle_t handle, const void* item, BaseType_t* woken) {
+    if (woken) *woken = pdFALSE;
+    return xQueueSend(handle, item, 0);
+}
+inline BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t) {
+    host::Queue* q = static_cast<host::Queue*>(handle);
+    if (q->items.empty()) return pdFALSE;
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    return pdTRUE;
+}
+
+#endif // HOST_QUEUE_H
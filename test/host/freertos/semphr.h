@@ -0,0 +1,18 @@
+#ifndef HOST_SEMPHR_H
+#define HOST_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+namespace host {
+inline int semaphoreToken;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return &host::semaphoreToken; }
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return &host::semaphoreToken; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t) { return pdTRUE; }
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
+
+#endif // HOST_SEMPHR_H
@@ -0,0 +1,28 @@
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+
+#include "FreeRTOS.h"
+#include <Arduino.h>
+
+namespace host {
+inline int taskToken;
+// Notifications given to created tasks, which never run to take them
+inline uint32_t taskNotifications = 0;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle) {
+    if (handle) *handle = &host::taskToken;
+    return pdPASS;
+}
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                                          UBaseType_t priority, TaskHandle_t* handle, BaseType_t) {
+    return xTaskCreate(fn, name, stack, arg, priority, handle);
+}
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t ticks) { host::advanceMs(ticks); }
+inline TickType_t xTaskGetTickCount() { return (TickType_t)millis(); }
+inline void xTaskNotifyGive(TaskHandle_t) { host::taskNotifications++; }
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) { host::taskNotifications++; }
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+
+#endif // HOST_TASK_H
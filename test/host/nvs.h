@@ -0,0 +1,49 @@
+#ifndef HOST_NVS_H
+#define HOST_NVS_H
+
+// The nvs_* calls StorageTelemetry makes, answered from the Preferences stand-in
+#include <Preferences.h>
+
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+typedef struct {
+    size_t used_entries;
+    size_t free_entries;
+    size_t total_entries;
+    size_t namespace_count;
+} nvs_stats_t;
+
+namespace host {
+inline std::vector<std::string> nvsHandles; // index + 1 is the handle
+}
+
+inline esp_err_t nvs_get_stats(const char*, nvs_stats_t* stats) {
+    stats->total_entries = HOST_NVS_ENTRIES_PER_PAGE * HOST_NVS_PAGES;
+    stats->used_entries = host::flash.usedEntries();
+    stats->free_entries = stats->total_entries > stats->used_entries ? stats->total_entries - stats->used_entries : 0;
+    stats->namespace_count = host::flash.namespaces.size();
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_open_from_partition(const char*, const char* name, nvs_open_mode_t mode, nvs_handle_t* out) {
+    if (host::flash.failOpen) return ESP_FAIL;
+    if (mode == NVS_READONLY && !host::flash.namespaces.count(name)) return ESP_ERR_NVS_NOT_FOUND;
+    host::nvsHandles.push_back(name);
+    *out = host::nvsHandles.size();
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* out) {
+    return nvs_open_from_partition("nvs", name, mode, out);
+}
+
+inline esp_err_t nvs_get_used_entry_count(nvs_handle_t handle, size_t* count) {
+    if (handle == 0 || handle > host::nvsHandles.size()) return ESP_ERR_INVALID_ARG;
+    *count = host::flash.usedEntries(&host::nvsHandles[handle - 1]);
+    return ESP_OK;
+}
+
+inline void nvs_close(nvs_handle_t) {}
+
+#endif // HOST_NVS_H
@@ -0,0 +1,323 @@
+// The alarm schedule on a simulated DS3231: weekday masks, catching up on
+// alarms missed across a reset or an RTC step, edits that must not ring for
+// a minute already past, DST transitions, and weeks of checks at random
+// intervals in which every alarm rings exactly once per occurrence.
+//
+//   pio test -e native -f test_alarm_schedule -v
+
+#include <unity.h>
+#include <map>
+#include <Adafruit_SSD1306.h>
+#include <RTClib.h>
+#include "configs.h"
+#include "AlarmClock.h"
+#include "ExpiryScheduler.h"
+#include "NotificationManager.h"
+#include "TimeService.h"
+#include "TimeZone.h"
+
+// What main.cpp defines and AlarmClock reaches through extern
+RTC_DS3231 rtc;
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET_PIN);
+NotificationManager notificationManager;
+ExpiryScheduler expiryScheduler;
+TimeService timeService(&rtc);
+TimeZone timeZone;
+
+static const uint32_t MINUTE = 60;
+static const uint32_t HOUR = 3600;
+static const uint32_t DAY = 86400;
+
+static uint32_t utc(int year, int month, int day, int hour, int minute, int second = 0) {
+    return DateTime(year, month, day, hour, minute, second).unixtime();
+}
+
+static Alarm makeAlarm(int hour, int minute, int track, uint8_t days = ALARM_EVERY_DAY, bool oneShot = false) {
+    Alarm a;
+    a.hour = hour;
+    a.minute = minute;
+    a.enabled = true;
+    a.sound_track = track;
+    a.days = days;
+    a.one_shot = oneShot;
+    a.snooze_minutes = 9;
+    return a;
+}
+
+// Sets the RTC, as the settings screen or an NTP sync does
+static void setClock(uint32_t unixTime) {
+    host::rtcSet(unixTime);
+    timeService.invalidate();
+}
+
+// One boot: the repository and the alarm engine, alarms loaded as from NVS
+struct Device {
+    ModelRepository models;
+    AlarmClock clock;
+    std::map<int, std::vector<uint32_t>> rings; // RTC time of each ring, by sound track
+
+    explicit Device(const std::vector<Alarm>& alarms) : clock(&display, &rtc, nullptr, &models) {
+        models.setAlarms(std::vector<Alarm>(alarms));
+    }
+
+    // One pass of the main loop; a ring is acknowledged at once
+    bool poll() {
+        clock.updateAlarm();
+        if (!clock.isRinging) return false;
+        rings[clock.getAlarmSoundTrack()].push_back(host::rtcUnix());
+        clock.acknowledgeAlarm();
+        return true;
+    }
+
+    void runUntil(uint32_t unixTime, uint32_t stepSeconds) {
+        while (host::rtcUnix() < unixTime) {
+            host::advanceMs(std::min(stepSeconds, unixTime - host::rtcUnix()) * 1000);
+            poll();
+        }
+    }
+
+    size_t ringCount() const {
+        size_t n = 0;
+        for (const auto& kv : rings) n += kv.second.size();
+        return n;
+    }
+};
+
+// Each ring came on or after its occurrence and at most slack seconds late
+static void assertRings(const std::vector<uint32_t>& expected, const std::vector<uint32_t>& got, uint32_t slack,
+                        const char* what) {
+    char message[96];
+    snprintf(message, sizeof(message), "%s: %zu rings, expected %zu", what, got.size(), expected.size());
+    TEST_ASSERT_EQUAL_MESSAGE(expected.size(), got.size(), message);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        snprintf(message, sizeof(message), "%s: ring %zu at %u, due %u", what, i, got[i], expected[i]);
+        TEST_ASSERT_TRUE_MESSAGE(got[i] >= expected[i] && got[i] - expected[i] <= slack, message);
+    }
+}
+
+// Occurrences of a UTC alarm in (from, to]
+static std::vector<uint32_t> occurrences(const Alarm& a, uint32_t from, uint32_t to) {
+    std::vector<uint32_t> out;
+    uint8_t mask = a.days & ALARM_EVERY_DAY;
+    for (uint32_t day = from / DAY * DAY; day <= to; day += DAY) {
+        uint32_t t = day + a.hour * HOUR + a.minute * MINUTE;
+        if (t > from && t <= to && (mask >> DateTime(t).dayOfTheWeek() & 1)) out.push_back(t);
+    }
+    return out;
+}
+
+// Every test starts a month after the previous one, so the last check the
+// engine keeps across resets (RTC memory) is never inside a catch-up window
+static uint32_t freshDay() {
+    static uint32_t next = utc(2024, 1, 7, 0, 0); // a Sunday
+    uint32_t day = next;
+    next += 35 * DAY;
+    return day;
+}
+
+void setUp() {
+    host::serialQuiet = true;
+    timeZone.set("UTC0");
+}
+
+void tearDown() {
+    host::serialQuiet = false;
+}
+
+// Bit d of the mask is weekday d, whatever weekday the engine starts on
+static void test_weekday_masks() {
+    static const uint8_t MASKS[] = {0x01, 0x02, ALARM_WEEKDAYS, ALARM_WEEKEND, ALARM_EVERY_DAY, 0x28, 0x40};
+    for (uint8_t mask : MASKS) {
+        for (int startWeekday = 0; startWeekday < 7; ++startWeekday) {
+            uint32_t start = freshDay() + startWeekday * DAY + 12 * HOUR;
+            setClock(start);
+            Alarm alarm = makeAlarm(6, 30, 1, mask);
+            Device d({alarm});
+            d.poll();
+            d.runUntil(start + 15 * DAY, 15 * MINUTE);
+            char what[32];
+            snprintf(what, sizeof(what), "mask %02x from weekday %d", mask, startWeekday);
+            assertRings(occurrences(alarm, start, host::rtcUnix()), d.rings[1], 15 * MINUTE, what);
+        }
+    }
+}
+
+// A reset while an alarm comes up: it rings on boot if at most 30 minutes late
+static void test_catch_up_after_reset() {
+    uint32_t day = freshDay();
+    std::vector<Alarm> alarms = {makeAlarm(7, 15, 5)};
+    setClock(day + 6 * HOUR + 50 * MINUTE);
+    {
+        Device d(alarms);
+        d.runUntil(day + 7 * HOUR, MINUTE);
+        TEST_ASSERT_EQUAL(0, d.ringCount());
+    }
+    host::advanceMs(20 * MINUTE * 1000); // off from 7:00 to 7:20
+    {
+        Device d(alarms);
+        d.poll();
+        assertRings({day + 7 * HOUR + 15 * MINUTE}, d.rings[5], 5 * MINUTE, "booted 5 minutes late");
+        d.runUntil(day + 8 * HOUR, MINUTE);
+        TEST_ASSERT_EQUAL(1, d.ringCount());
+    }
+
+    // Off from 7:00 to 7:50: too late to ring, and rings the next day
+    day += DAY;
+    setClock(day + 6 * HOUR + 50 * MINUTE);
+    {
+        Device d(alarms);
+        d.runUntil(day + 7 * HOUR, MINUTE);
+    }
+    host::advanceMs(50 * MINUTE * 1000);
+    Device d(alarms);
+    d.runUntil(day + DAY + 8 * HOUR, MINUTE);
+    assertRings({day + DAY + 7 * HOUR + 15 * MINUTE}, d.rings[5], MINUTE, "booted 35 minutes late");
+}
+
+// An alarm added or edited for a minute already past rings next time, not
+// now, however long ago the engine last looked at the clock
+static void test_edit_does_not_ring_for_a_past_minute() {
+    // Nothing scheduled: the engine has not read the clock since boot
+    uint32_t day = freshDay();
+    setClock(day + 7 * HOUR);
+    {
+        Device d({});
+        d.poll();
+        d.runUntil(day + 7 * HOUR + 20 * MINUTE, 1);
+        d.clock.addAlarm(makeAlarm(7, 15, 1));
+        d.runUntil(day + 8 * HOUR, 1);
+        TEST_ASSERT_EQUAL_MESSAGE(0, d.ringCount(), "7:15 added at 7:20 rang");
+        d.runUntil(day + DAY + 8 * HOUR, 1);
+        assertRings({day + DAY + 7 * HOUR + 15 * MINUTE}, d.rings[1], 1, "7:15 added at 7:20");
+    }
+
+    // A later alarm waiting: the clock is read every ALARM_RESYNC_MS only
+    day = freshDay();
+    setClock(day + 7 * HOUR);
+    {
+        Device d({makeAlarm(22, 0, 2)});
+        d.runUntil(day + 7 * HOUR + 20 * MINUTE, 1);
+        d.clock.addAlarm(makeAlarm(7, 15, 1));
+        d.runUntil(day + 7 * HOUR + 25 * MINUTE, 1);
+        d.clock.toggleAlarm(0); // 22:00 off and on again
+        d.clock.toggleAlarm(0);
+        d.runUntil(day + 8 * HOUR, 1);
+        TEST_ASSERT_EQUAL_MESSAGE(0, d.ringCount(), "7:15 added at 7:20 rang");
+        // And one a minute ahead still rings on time
+        d.clock.addAlarm(makeAlarm(8, 1, 3));
+        d.runUntil(day + 9 * HOUR, 1);
+        assertRings({day + 8 * HOUR + MINUTE}, d.rings[3], 1, "8:01 added at 8:00");
+    }
+
+    // Moving an alarm that already rang today to a minute just past
+    day = freshDay();
+    setClock(day + 7 * HOUR);
+    Device d({makeAlarm(7, 5, 1)});
+    d.runUntil(day + 7 * HOUR + 20 * MINUTE, 1);
+    d.models.updateAlarm(d.models.alarmId(0), [](Alarm& a) { a.minute = 15; });
+    d.runUntil(day + DAY + 7 * HOUR + 20 * MINUTE, 1);
+    assertRings({day + 7 * HOUR + 5 * MINUTE, day + DAY + 7 * HOUR + 15 * MINUTE}, d.rings[1], 1, "moved to 7:15 at 7:20");
+}
+
+// The RTC set forward across an alarm (NTP after a long sleep) rings it
+static void test_rtc_step_catches_up() {
+    uint32_t day = freshDay();
+    setClock(day + 7 * HOUR);
+    Device d({makeAlarm(7, 15, 4)});
+    d.runUntil(day + 7 * HOUR + 10 * MINUTE, MINUTE);
+    setClock(day + 7 * HOUR + 20 * MINUTE);
+    d.clock.rescheduleAlarms();
+    d.poll();
+    assertRings({day + 7 * HOUR + 15 * MINUTE}, d.rings[4], 5 * MINUTE, "stepped from 7:10 to 7:20");
+}
+
+// Berlin: 02:30 does not exist on the last Sunday of March and happens
+// twice on the last Sunday of October
+static void test_dst_transitions() {
+    std::vector<Alarm> alarms = {makeAlarm(2, 30, 1), makeAlarm(7, 0, 2)};
+
+    timeZone.set("CET-1CEST,M3.5.0,M10.5.0/3");
+    setClock(utc(2024, 3, 30, 11, 0)); // 12:00 CET
+    {
+        Device d(alarms);
+        d.runUntil(utc(2024, 4, 2, 10, 0), MINUTE);
+        // 02:30 is skipped: it rings at 03:30 CEST, as far past the jump
+        assertRings({utc(2024, 3, 31, 1, 30), utc(2024, 4, 1, 0, 30), utc(2024, 4, 2, 0, 30)}, d.rings[1], MINUTE,
+                    "02:30 in March");
+        assertRings({utc(2024, 3, 31, 5, 0), utc(2024, 4, 1, 5, 0), utc(2024, 4, 2, 5, 0)}, d.rings[2], MINUTE, "07:00 in March");
+    }
+
+    setClock(utc(2024, 10, 26, 10, 0)); // 12:00 CEST
+    Device d(alarms);
+    d.runUntil(utc(2024, 10, 28, 11, 0), MINUTE);
+    // Once, on the first pass of 02:30
+    assertRings({utc(2024, 10, 27, 0, 30), utc(2024, 10, 28, 1, 30)}, d.rings[1], MINUTE, "02:30 in October");
+    assertRings({utc(2024, 10, 27, 6, 0), utc(2024, 10, 28, 6, 0)}, d.rings[2], MINUTE, "07:00 in October");
+}
+
+// Weeks of main-loop passes 1 s to 10 min apart, with one alarm switched on
+// and off at random passes: every alarm rings once per occurrence while it
+// is on, and never for one that came before it was switched on
+static void test_random_check_intervals_over_days() {
+    randomSeed(20241018);
+    uint32_t start = freshDay() + 12 * HOUR;
+    setClock(start);
+    // Hours apart, so a ring never waits behind another
+    std::vector<Alarm> alarms;
+    static const int HOURS[] = {1, 5, 9, 13, 17, 21};
+    for (int i = 0; i < 6; ++i) {
+        uint8_t mask = random(1, 128);
+        alarms.push_back(makeAlarm(HOURS[i], random(60), i + 1, mask, i == 5));
+    }
+    Alarm toggled = makeAlarm(11, random(60), 7);
+    toggled.enabled = false;
+    alarms.push_back(toggled);
+
+    Device d(alarms);
+    d.poll();
+    std::vector<uint32_t> toggledExpected;
+    uint32_t onSince = 0;
+    uint32_t end = start + 42 * DAY;
+    while (host::rtcUnix() < end) {
+        host::advanceMs(random(1, 601) * 1000);
+        uint32_t now = host::rtcUnix();
+        if (d.poll()) continue;
+        // Switched often in the hour after its minute, where a stale catch-up
+        // window would still reach back to it
+        uint32_t sinceMinute = (now - toggled.hour * HOUR - toggled.minute * MINUTE) % DAY;
+        if (random(sinceMinute < HOUR ? 4 : 40) != 0) continue;
+        // The main loop sees the edit within milliseconds
+        d.clock.toggleAlarm(6);
+        TEST_ASSERT_FALSE_MESSAGE(d.poll(), "rang for a minute before it was switched on");
+        if (d.models.getAlarms()[6].enabled) {
+            onSince = now;
+        } else {
+            for (uint32_t t : occurrences(toggled, onSince, now)) toggledExpected.push_back(t);
+        }
+    }
+    uint32_t last = host::rtcUnix();
+    if (d.models.getAlarms()[6].enabled) {
+        for (uint32_t t : occurrences(toggled, onSince, last)) toggledExpected.push_back(t);
+    }
+
+    for (int i = 0; i < 6; ++i) {
+        std::vector<uint32_t> expected = occurrences(alarms[i], start, last);
+        if (alarms[i].one_shot && expected.size() > 1) expected.resize(1);
+        char what[32];
+        snprintf(what, sizeof(what), "alarm %d (days %02x)", i + 1, alarms[i].days);
+        assertRings(expected, d.rings[i + 1], 10 * MINUTE, what);
+    }
+    TEST_ASSERT_GREATER_THAN(10, toggledExpected.size());
+    assertRings(toggledExpected, d.rings[7], 10 * MINUTE, "switched on and off");
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_weekday_masks);
+    RUN_TEST(test_catch_up_after_reset);
+    RUN_TEST(test_edit_does_not_ring_for_a_past_minute);
+    RUN_TEST(test_rtc_step_catches_up);
+    RUN_TEST(test_dst_transitions);
+    RUN_TEST(test_random_check_intervals_over_days);
+    return UNITY_END();
+}
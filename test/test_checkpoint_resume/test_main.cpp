@@ -0,0 +1,197 @@
+// A routine resumed from its reset checkpoint: after a short reset the
+// checkpointed phase continues, after a longer one the routine picks up in
+// the phase the outage ended in (repeat blocks included), and an outage
+// past the routine's end finishes it.
+//
+//   pio test -e native -f test_checkpoint_resume -v
+
+#include <unity.h>
+#include <Adafruit_SSD1306.h>
+#include <RTClib.h>
+#include "StorageFixtures.h"
+#include "configs.h"
+#include "ExpiryScheduler.h"
+#include "MultiTimer.h"
+#include "NotificationManager.h"
+#include "PushNotifier.h"
+#include "TimeService.h"
+#include "TimerCheckpoint.h"
+
+// What main.cpp defines and MultiTimer reaches through extern. The
+// scheduler is never started, so phases end by polling.
+RTC_DS3231 rtc;
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET_PIN);
+NotificationManager notificationManager;
+ExpiryScheduler expiryScheduler;
+TimeService timeService(&rtc);
+NvsService nvsService;
+TimerCheckpoint timerCheckpoint(&timeService, &nvsService);
+static ModelRepository noAccounts;
+PushNotifier pushNotifier(&noAccounts);
+
+// One boot with the routines in NVS and a MultiTimer on top
+struct Device : StoredDevice {
+    MultiTimer multi;
+
+    Device() : multi(&display, &models) { boot(); }
+
+    void start(int routine) {
+        multi.setSelectedTimerIndex(routine);
+        multi.startTimer();
+    }
+
+    // What resumeCheckpointedTimer() in main.cpp does for a routine
+    bool resume() {
+        TimerCheckpointData cp;
+        if (!timerCheckpoint.load(cp) || cp.kind != CHECKPOINT_MULTI) return false;
+        return multi.restoreRunning(cp.routine_index, cp.routine_phases, cp.cursor, cp.phase_index,
+                                    timerCheckpoint.remainingSeconds(cp), timerCheckpoint.overshootSeconds(cp));
+    }
+
+    // Main-loop passes every 100 ms
+    void run(uint32_t seconds) {
+        for (uint32_t i = 0; i < seconds * 10; ++i) {
+            host::advanceMs(100);
+            multi.updateRoutine();
+        }
+    }
+};
+
+// Three 10-minute phases, and a warm-up, work/rest x3 and a cool-down
+static RoutineStore routines() {
+    RoutineStore r;
+    r.beginRoutine("Three tens");
+    r.addPhase("One", 600, 1, 0);
+    r.addPhase("Two", 600, 2, 0);
+    r.addPhase("Three", 600, 3, 0);
+    r.endRoutine();
+    r.beginRoutine("Intervals");
+    r.addPhase("Warm", 60, 1, 0);
+    r.addPhase("Work", 120, 2, 0);
+    r.addPhase("Rest", 30, 3, 0);
+    r.addPhase("Cool", 300, 4, 0);
+    r.addRepeat(1, 2, 3);
+    r.endRoutine();
+    return r;
+}
+
+static void powerOff(uint32_t seconds) {
+    host::advanceMs(seconds * 1000);
+}
+
+static void assertRunning(Device& d, int phase, uint32_t remaining) {
+    TEST_ASSERT_TRUE(d.multi.isRoutineRunning());
+    TEST_ASSERT_FALSE(d.multi.isRoutineFinished());
+    TEST_ASSERT_EQUAL(phase, d.multi.getCurrentPhaseIndex());
+    TEST_ASSERT_UINT32_WITHIN(1, remaining, d.multi.getRemainingTime());
+}
+
+void setUp() {
+    host::flash.erase();
+    host::serialQuiet = true;
+    timerCheckpoint.clear();
+    timeService.invalidate();
+    StoredDevice d;
+    d.storage.saveCustomTimers(routines());
+}
+
+void tearDown() {
+    host::serialQuiet = false;
+}
+
+static void test_short_reset_resumes_the_same_phase() {
+    {
+        Device d;
+        d.start(0);
+        d.run(120);
+    }
+    powerOff(60);
+    Device d;
+    TEST_ASSERT_TRUE(d.resume());
+    assertRunning(d, 0, 420);
+}
+
+// Off from 2 min into phase one for 15 min: phase one ran out 7 min ago
+static void test_reset_past_the_phase_resumes_in_a_later_one() {
+    {
+        Device d;
+        d.start(0);
+        d.run(120);
+    }
+    powerOff(15 * 60);
+    {
+        Device d;
+        TEST_ASSERT_TRUE(d.resume());
+        assertRunning(d, 1, 180);
+    }
+    // The checkpoint now holds phase two, so a second reset lands there too
+    powerOff(30);
+    Device d;
+    TEST_ASSERT_TRUE(d.resume());
+    assertRunning(d, 1, 150);
+    d.run(151);
+    d.run(3); // the transition screen
+    assertRunning(d, 2, 597);
+}
+
+// Off from 2 min in for 30 min: all three phases ended meanwhile
+static void test_reset_past_the_end_finishes_the_routine() {
+    {
+        Device d;
+        d.start(0);
+        d.run(120);
+    }
+    powerOff(30 * 60);
+    Device d;
+    TEST_ASSERT_TRUE(d.resume());
+    TEST_ASSERT_TRUE(d.multi.isRoutineFinished());
+    TEST_ASSERT_FALSE(d.multi.isRoutineRunning());
+    TEST_ASSERT_FALSE(timerCheckpoint.hasRtcCheckpoint());
+}
+
+// 30 s into the warm-up, off for 10 min: the outage covers the work/rest
+// block three times and ends 2 min into the cool-down
+static void test_reset_across_a_repeat_block() {
+    {
+        Device d;
+        d.start(1);
+        d.run(30);
+    }
+    powerOff(10 * 60);
+    Device d;
+    TEST_ASSERT_TRUE(d.resume());
+    assertRunning(d, 3, 180);
+    // The repeat counters were stepped too: the cool-down is the last phase
+    d.run(181);
+    TEST_ASSERT_TRUE(d.multi.isRoutineFinished());
+}
+
+// Off for less than one pass of the block: resumes inside the second pass
+static void test_reset_inside_a_repeat_block() {
+    {
+        Device d;
+        d.start(1);
+        d.run(30);
+    }
+    powerOff(4 * 60);
+    Device d;
+    TEST_ASSERT_TRUE(d.resume());
+    // Warm-up ended at 60 s, work 60-180, rest 180-210, work again 210-330
+    assertRunning(d, 1, 60);
+    d.run(61);
+    d.run(3);
+    assertRunning(d, 2, 27);
+    d.run(28);
+    d.run(3);
+    assertRunning(d, 1, 118); // the third pass
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_short_reset_resumes_the_same_phase);
+    RUN_TEST(test_reset_past_the_phase_resumes_in_a_later_one);
+    RUN_TEST(test_reset_past_the_end_finishes_the_routine);
+    RUN_TEST(test_reset_across_a_repeat_block);
+    RUN_TEST(test_reset_inside_a_repeat_block);
+    return UNITY_END();
+}
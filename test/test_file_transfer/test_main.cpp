@@ -0,0 +1,195 @@
+// Export and import through the LittleFS files: 100 routines out of one
+// device and into another, a file built here on the host, a corrupt file,
+// and a power cut at every byte of an import, after which each collection
+// must load as it was before the import or as the import left it.
+//
+//   pio test -e native -f test_file_transfer -v
+
+#include <unity.h>
+#include <LittleFS.h>
+#include "StorageFixtures.h"
+#include "FileTransfer.h"
+
+// A device as main.cpp boots it, with the transfer screen's FileTransfer
+struct TransferDevice : StoredDevice {
+    FileTransfer transfer;
+
+    TransferDevice() : transfer(&models, &storage) {
+        storage.begin();
+        boot();
+    }
+
+    std::string alarms() { return describe(models.getAlarms()); }
+    std::string accounts() { return describe(models.getAccounts()); }
+};
+
+// Routines that differ from makeRoutines() in every name and duration
+static RoutineStore otherRoutines(int count) {
+    RoutineStore source = makeRoutines(count);
+    RoutineStore out;
+    for (int r = 0; r < count; ++r) {
+        CustomTimer t = source.unpack(r);
+        t.name = String("Imported ") + r;
+        for (TimerPhase& p : t.phases) p.duration_seconds += 1;
+        out.add(t);
+    }
+    return out;
+}
+
+// Stores the collections in NVS, as a device that saved them would have
+static void seed(const RoutineStore& routines, const std::vector<Alarm>& alarms, const std::vector<AlertzyAccount>& accounts) {
+    StoredDevice d;
+    d.storage.saveCustomTimers(routines);
+    d.storage.saveAlarms(alarms);
+    d.storage.saveAlertzyAccounts(accounts);
+}
+
+// A collection file as the export writes it, built record by record here
+static std::vector<uint8_t> routinesFile(const RoutineStore& routines) {
+    uint32_t phases = 0;
+    for (size_t i = 0; i < routines.size(); ++i) phases += routines[i].phaseCount();
+    std::vector<uint8_t> file;
+    StorageManager::encodeCollectionHeader(file, MODEL_ROUTINE, routines.size(), phases);
+    for (size_t i = 0; i < routines.size(); ++i) StorageManager::encodeRecord(file, routines[i]);
+    uint32_t crc = recordCrc32(0, file.data(), file.size());
+    for (int i = 0; i < 4; ++i) file.push_back((uint8_t)(crc >> (8 * i)));
+    return file;
+}
+
+void setUp() {
+    host::flash.erase();
+    LittleFS.files.clear();
+    host::serialQuiet = true;
+}
+
+void tearDown() {
+    host::serialQuiet = false;
+}
+
+static void test_hundred_routines_round_trip() {
+    RoutineStore routines = makeRoutines(100);
+    std::vector<Alarm> alarms = makeAlarms(20);
+    std::vector<AlertzyAccount> accounts = makeAccounts(4);
+    seed(routines, alarms, accounts);
+    {
+        TransferDevice d;
+        TransferResult result = d.transfer.exportAll();
+        TEST_ASSERT_TRUE_MESSAGE(result.ok, result.error);
+        TEST_ASSERT_EQUAL(100, result.routines);
+        TEST_ASSERT_EQUAL(20, result.alarms);
+        TEST_ASSERT_EQUAL(4, result.accounts);
+    }
+    TEST_ASSERT_FALSE(LittleFS.exists(TRANSFER_ROUTINES_FILE ".tmp"));
+    // Byte for byte what the host builds from the same routines
+    TEST_ASSERT_TRUE(LittleFS.files[TRANSFER_ROUTINES_FILE] == routinesFile(routines));
+
+    // Into another device with its own collections
+    host::flash.erase();
+    seed(otherRoutines(30), makeAlarms(3), makeAccounts(1));
+    {
+        TransferDevice d;
+        TransferResult result = d.transfer.importAll();
+        TEST_ASSERT_TRUE_MESSAGE(result.ok, result.error);
+        TEST_ASSERT_EQUAL(100, result.routines);
+        TEST_ASSERT_EQUAL_STRING(describe(routines), d.routines());
+    }
+    TransferDevice rebooted;
+    TEST_ASSERT_EQUAL_STRING(describe(routines), rebooted.routines());
+    TEST_ASSERT_EQUAL_STRING(describe(alarms), rebooted.alarms());
+    TEST_ASSERT_EQUAL_STRING(describe(accounts), rebooted.accounts());
+}
+
+// Only the collections that have a file are replaced
+static void test_import_of_a_file_built_on_the_host() {
+    RoutineStore routines = otherRoutines(100);
+    seed(makeRoutines(8), makeAlarms(5), makeAccounts(3));
+    LittleFS.files[TRANSFER_ROUTINES_FILE] = routinesFile(routines);
+    {
+        TransferDevice d;
+        TransferResult result = d.transfer.importAll();
+        TEST_ASSERT_TRUE_MESSAGE(result.ok, result.error);
+    }
+    TransferDevice rebooted;
+    TEST_ASSERT_EQUAL_STRING(describe(routines), rebooted.routines());
+    TEST_ASSERT_EQUAL_STRING(describe(makeAlarms(5)), rebooted.alarms());
+    TEST_ASSERT_EQUAL_STRING(describe(makeAccounts(3)), rebooted.accounts());
+}
+
+static void test_corrupt_file_changes_nothing() {
+    RoutineStore before = makeRoutines(8);
+    seed(before, makeAlarms(5), makeAccounts(3));
+    std::vector<uint8_t> file = routinesFile(otherRoutines(10));
+    file[file.size() / 2] ^= 0x01;
+    LittleFS.files[TRANSFER_ROUTINES_FILE] = file;
+    {
+        TransferDevice d;
+        TransferResult result = d.transfer.importAll();
+        TEST_ASSERT_FALSE(result.ok);
+        TEST_ASSERT_EQUAL_STRING("Corrupt file", result.error);
+    }
+    TransferDevice rebooted;
+    TEST_ASSERT_EQUAL_STRING(describe(before), rebooted.routines());
+}
+
+static void test_power_cut_during_import() {
+    RoutineStore newRoutines = otherRoutines(12);
+    std::vector<Alarm> newAlarms = makeAlarms(7);
+    std::vector<AlertzyAccount> newAccounts = makeAccounts(3);
+    seed(newRoutines, newAlarms, newAccounts);
+    {
+        TransferDevice d;
+        TEST_ASSERT_TRUE(d.transfer.exportAll().ok);
+    }
+    RoutineStore oldRoutines = makeRoutines(10);
+    std::vector<Alarm> oldAlarms = makeAlarms(4);
+    std::vector<AlertzyAccount> oldAccounts = makeAccounts(2);
+    host::flash.erase();
+    seed(oldRoutines, oldAlarms, oldAccounts);
+    auto base = host::flash.namespaces;
+
+    int cuts = 0, olds = 0, news = 0;
+    for (long budget = 0;; ++budget) {
+        host::flash.namespaces = base;
+        bool lost;
+        {
+            TransferDevice d;
+            host::flash.cutPowerAfter(budget);
+            d.transfer.importAll();
+            lost = host::flash.powerLost;
+        }
+        host::flash.restorePower();
+        if (!lost) break;
+        cuts++;
+
+        char where[48];
+        snprintf(where, sizeof(where), "power cut after %ld bytes", budget);
+        {
+            TransferDevice d;
+            std::string routines = d.routines();
+            TEST_ASSERT_TRUE_MESSAGE(routines == describe(oldRoutines) || routines == describe(newRoutines), where);
+            TEST_ASSERT_TRUE_MESSAGE(d.alarms() == describe(oldAlarms) || d.alarms() == describe(newAlarms), where);
+            TEST_ASSERT_TRUE_MESSAGE(d.accounts() == describe(oldAccounts) || d.accounts() == describe(newAccounts),
+                                     where);
+            if (routines == describe(oldRoutines)) olds++;
+            else news++;
+            // Importing again over what the cut left must work
+            TransferResult result = d.transfer.importAll();
+            TEST_ASSERT_TRUE_MESSAGE(result.ok, where);
+        }
+        TransferDevice d;
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(describe(newRoutines), d.routines(), where);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(describe(newAlarms), d.alarms(), where);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(describe(newAccounts), d.accounts(), where);
+    }
+    printf("\n%d cut points: routines loaded as before %d times, as imported %d times\n", cuts, olds, news);
+    TEST_ASSERT_GREATER_THAN(0, olds);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_hundred_routines_round_trip);
+    RUN_TEST(test_import_of_a_file_built_on_the_host);
+    RUN_TEST(test_corrupt_file_changes_nothing);
+    RUN_TEST(test_power_cut_during_import);
+    return UNITY_END();
+}
@@ -0,0 +1,647 @@
+// RecordCodec and the StorageManager collections built on it: the CRC and
+// frame of each stored copy, round trips, truncated and malformed input,
+// fields appended by a newer writer, long strings, the migration from JSON
+// and from older layouts, and the encoded size, peak heap and load time of
+// 50 routines against the JSON they replaced.
+//
+//   pio test -e native -f test_record_codec -v
+
+#include <unity.h>
+#include <ArduinoJson.h>
+#include "HeapProbe.h"
+#include "StorageFixtures.h"
+#include "RecordCodec.h"
+#include "StorageManager.h"
+
+// Hands the stream out a few bytes per read, to cross every chunk boundary
+class TrickleSource : public RecordSource {
+private:
+    const uint8_t* data;
+    size_t length;
+    size_t pos;
+    size_t step;
+
+public:
+    TrickleSource(const uint8_t* buffer, size_t size, size_t bytesPerRead)
+        : data(buffer), length(size), pos(0), step(bytesPerRead) {}
+    size_t read(uint8_t* buffer, size_t size) override {
+        size_t n = std::min(std::min(step, size), length - pos);
+        memcpy(buffer, data + pos, n);
+        pos += n;
+        return n;
+    }
+    size_t totalSize() const override { return length; }
+};
+
+static const uint32_t VARINTS[] = {0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 0x0FFFFFFF, 0x10000000, UINT32_MAX};
+
+// The namespace StorageManager keeps its records in: entities under
+// "rt.<slot>", "al.<slot>" and "ac.<slot>", each list's manifest under
+// "rt.idx" and so on. A record is two copies, "<prefix>a" (even seqs) and
+// "<prefix>b", each a frame and the payload as chunk keys "<copy>.0", ...
+static std::map<std::string, host::NvsValue>& stored() {
+    return host::flash.namespaces[STORAGE_NAMESPACE];
+}
+
+static std::string chunkKey(const std::string& prefix, size_t index) {
+    return prefix + "." + std::to_string(index);
+}
+
+static std::vector<uint8_t> storedChunks(const std::string& prefix) {
+    std::vector<uint8_t> blob;
+    for (size_t i = 0; stored().count(chunkKey(prefix, i)); ++i) {
+        const std::vector<uint8_t>& chunk = stored()[chunkKey(prefix, i)].bytes;
+        blob.insert(blob.end(), chunk.begin(), chunk.end());
+    }
+    return blob;
+}
+
+static void storeChunks(const std::string& prefix, const std::vector<uint8_t>& blob) {
+    for (size_t i = 0; stored().erase(chunkKey(prefix, i)); ++i) {
+    }
+    for (size_t pos = 0, i = 0; pos < blob.size(); pos += RECORD_CHUNK_SIZE, ++i) {
+        size_t end = std::min(pos + RECORD_CHUNK_SIZE, blob.size());
+        stored()[chunkKey(prefix, i)] = host::NvsValue{PT_BLOB, std::vector<uint8_t>(blob.begin() + pos, blob.begin() + end)};
+    }
+}
+
+static std::string copyPrefix(const std::string& prefix, uint32_t seq) {
+    return prefix + ((seq & 1) ? "b" : "a");
+}
+
+static bool hasRecord(const std::string& prefix) {
+    return stored().count(prefix + "a.0") || stored().count(prefix + "b.0");
+}
+
+// The payload of a record's newest copy, and its seq
+static std::vector<uint8_t> storedRecord(const std::string& prefix, uint32_t* seq) {
+    std::vector<uint8_t> payload;
+    *seq = 0;
+    for (uint32_t parity : {0u, 1u}) {
+        std::vector<uint8_t> blob = storedChunks(copyPrefix(prefix, parity));
+        RecordFrame frame;
+        if (!readFrame(blob.data(), blob.size(), frame) || frame.seq < *seq) continue;
+        *seq = frame.seq;
+        payload.assign(blob.begin() + RECORD_FRAME_SIZE, blob.end());
+    }
+    return payload;
+}
+
+// Replaces that copy with payload under a good frame, so only the reader
+// can tell what is wrong with it
+static void storeRecord(const std::string& prefix, std::vector<uint8_t> payload, uint32_t seq) {
+    frameRecord(payload, seq);
+    storeChunks(copyPrefix(prefix, seq), payload);
+}
+
+// What StoredDevice::routines() gives when one body cannot be read
+static std::string describeUnreadable(const RoutineStore& routines, size_t unreadable) {
+    std::string s;
+    for (size_t i = 0; i < routines.size(); ++i) {
+        s += i == unreadable ? std::string("<unreadable>\n") : describe(routines[i]);
+    }
+    return s;
+}
+
+// The routines the next boot lists, each body read the way running it would
+static std::string loadedRoutines() {
+    StoredDevice device;
+    device.boot();
+    return device.routines();
+}
+
+// A manifest as the layout before copies wrote it: slots 0..count-1
+static std::vector<uint8_t> unframedManifest(RecordKind kind, size_t count) {
+    std::vector<uint8_t> blob;
+    RecordWriter out(blob);
+    out.writeHeader(RECORD_MANIFEST, 1);
+    out.writeByte(kind);
+    out.writeVarint(count);
+    for (size_t slot = 0; slot < count; ++slot) out.writeVarint(slot);
+    return blob;
+}
+
+void setUp() {
+    host::flash.erase();
+    host::serialQuiet = true;
+}
+
+void tearDown() {
+    host::serialQuiet = false;
+}
+
+static void test_crc32_matches_zlib() {
+    const uint8_t* check = (const uint8_t*)"123456789";
+    TEST_ASSERT_EQUAL_UINT32(0xCBF43926, recordCrc32(0, check, 9));
+    TEST_ASSERT_EQUAL_UINT32(0xCBF43926, recordCrc32(recordCrc32(0, check, 4), check + 4, 5));
+    TEST_ASSERT_EQUAL_UINT32(0, recordCrc32(0, check, 0));
+}
+
+static void test_frame_round_trip() {
+    std::vector<uint8_t> blob = {1, 2, 3, 4, 5};
+    frameRecord(blob, 0x01020304);
+    TEST_ASSERT_EQUAL(RECORD_FRAME_SIZE + 5, blob.size());
+    RecordFrame frame;
+    TEST_ASSERT_TRUE(readFrame(blob.data(), blob.size(), frame));
+    TEST_ASSERT_EQUAL_UINT32(0x01020304, frame.seq);
+    TEST_ASSERT_EQUAL_UINT32(5, frame.length);
+    uint32_t crc = recordCrc32(recordCrc32(0, blob.data(), 8), blob.data() + RECORD_FRAME_SIZE, 5);
+    TEST_ASSERT_EQUAL_UINT32(crc, frame.crc);
+    TEST_ASSERT_FALSE(readFrame(blob.data(), RECORD_FRAME_SIZE - 1, frame));
+}
+
+static void test_fields_round_trip() {
+    static const char* STRINGS[] = {"", "Work", "Zeit für Pause", "Pausa café ☕"};
+    std::vector<uint8_t> blob;
+    RecordWriter out(blob);
+    out.writeHeader(RECORD_ROUTINES, 7);
+    for (uint32_t v : VARINTS) out.writeVarint(v);
+    out.beginRecord();
+    for (const char* s : STRINGS) out.writeString(s);
+    out.writeByte(0xA5);
+    out.endRecord();
+    TEST_ASSERT_EQUAL(0, out.stringsCut());
+
+    for (size_t step : {(size_t)1, (size_t)3, (size_t)RECORD_CHUNK_SIZE}) {
+        TrickleSource source(blob.data(), blob.size(), step);
+        RecordReader in(source);
+        uint8_t version = 0;
+        TEST_ASSERT_TRUE(in.readHeader(RECORD_ROUTINES, &version));
+        TEST_ASSERT_EQUAL(7, version);
+        for (uint32_t v : VARINTS) TEST_ASSERT_EQUAL_UINT32(v, in.readVarint());
+        TEST_ASSERT_TRUE(in.beginRecord());
+        for (const char* s : STRINGS) {
+            char text[RECORD_MAX_STRING];
+            in.readString(text, sizeof(text));
+            TEST_ASSERT_EQUAL_STRING(s, text);
+        }
+        TEST_ASSERT_EQUAL(0xA5, in.readByte());
+        in.endRecord();
+        TEST_ASSERT_TRUE(in.ok());
+        // Nothing after the end of the stream
+        in.readByte();
+        TEST_ASSERT_FALSE(in.ok());
+    }
+}
+
+// Saved, then loaded by the StorageManager of the next boot
+static void test_collections_round_trip() {
+    RoutineStore routines = makeRoutines(12);
+    std::vector<Alarm> alarms = makeAlarms(20);
+    std::vector<AlertzyAccount> accounts = makeAccounts(5);
+    {
+        NvsService nvs;
+        StorageManager storage(&nvs);
+        storage.saveCustomTimers(routines);
+        storage.saveAlarms(alarms);
+        storage.saveAlertzyAccounts(accounts);
+    }
+    StoredDevice device;
+    device.boot();
+    TEST_ASSERT_EQUAL_STRING(describe(routines), device.routines());
+    TEST_ASSERT_EQUAL_STRING(describe(alarms), describe(device.models.getAlarms()));
+    TEST_ASSERT_EQUAL_STRING(describe(accounts), describe(device.models.getAccounts()));
+}
+
+// Cut anywhere, under a good frame or not, or missing a chunk, a routine's
+// body is unreadable on its own and the rest of the list loads. A cut manifest loads no list, or all of it
+// when only the summaries were lost (they are rebuilt from the bodies), never
+// part of one
+static void test_truncated_input_is_rejected() {
+    RoutineStore routines = makeRoutines(3);
+    routines.beginRoutine("Long");
+    for (int i = 0; i < 20; ++i) routines.addPhase("A phase with a long name", 60, 1, 0);
+    routines.endRoutine();
+    NvsService nvs;
+    StorageManager storage(&nvs);
+    storage.saveCustomTimers(routines);
+    uint32_t seq, manifestSeq;
+    std::vector<uint8_t> routine = storedRecord("rt.1", &seq);
+    std::vector<uint8_t> copy = storedChunks(copyPrefix("rt.1", seq));
+    std::vector<uint8_t> manifest = storedRecord("rt.idx", &manifestSeq);
+    for (size_t length = 0; length < routine.size(); ++length) {
+        storeRecord("rt.1", std::vector<uint8_t>(routine.begin(), routine.begin() + length), seq);
+        TEST_ASSERT_EQUAL_STRING(describeUnreadable(routines, 1), loadedRoutines());
+    }
+    for (size_t length = 0; length < copy.size(); ++length) {
+        storeChunks(copyPrefix("rt.1", seq), std::vector<uint8_t>(copy.begin(), copy.begin() + length));
+        TEST_ASSERT_EQUAL_STRING(describeUnreadable(routines, 1), loadedRoutines());
+    }
+    storeChunks(copyPrefix("rt.1", seq), copy);
+    for (size_t length = 0; length < manifest.size(); ++length) {
+        storeRecord("rt.idx", std::vector<uint8_t>(manifest.begin(), manifest.begin() + length), manifestSeq);
+        std::string loaded = loadedRoutines();
+        TEST_ASSERT_TRUE_MESSAGE(loaded.empty() || loaded == describe(routines), "a cut manifest loaded part of the list");
+    }
+    storeRecord("rt.idx", manifest, manifestSeq);
+    TEST_ASSERT_GREATER_THAN(RECORD_CHUNK_SIZE, storedRecord("rt.3", &seq).size());
+    stored().erase(chunkKey(copyPrefix("rt.3", seq), 1));
+    TEST_ASSERT_EQUAL_STRING(describeUnreadable(routines, 3), loadedRoutines());
+}
+
+static bool readsVarint(const std::vector<uint8_t>& bytes, uint32_t* value) {
+    MemoryRecordSource source(bytes.data(), bytes.size());
+    RecordReader in(source);
+    *value = in.readVarint();
+    return in.ok();
+}
+
+static void test_malformed_input_is_rejected() {
+    uint8_t version;
+    // Wrong magic, then wrong kind
+    std::vector<uint8_t> header = {RECORD_MAGIC ^ 1, RECORD_ROUTINES, 1};
+    MemoryRecordSource badMagic(header.data(), header.size());
+    RecordReader magicReader(badMagic);
+    TEST_ASSERT_FALSE(magicReader.readHeader(RECORD_ROUTINES, &version));
+    header[0] = RECORD_MAGIC;
+    MemoryRecordSource badKind(header.data(), header.size());
+    RecordReader kindReader(badKind);
+    TEST_ASSERT_FALSE(kindReader.readHeader(RECORD_ALARMS, &version));
+
+    // Varints: six bytes, and a fifth byte carrying more than 32 bits
+    uint32_t value;
+    TEST_ASSERT_FALSE(readsVarint({0x80, 0x80, 0x80, 0x80, 0x80, 0x01}, &value));
+    TEST_ASSERT_FALSE(readsVarint({0xFF, 0xFF, 0xFF, 0xFF, 0x1F}, &value));
+    TEST_ASSERT_TRUE(readsVarint({0xFF, 0xFF, 0xFF, 0xFF, 0x0F}, &value));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, value);
+
+    // A string longer than the whole stream, and one longer than what is left
+    for (uint8_t claimed : {(uint8_t)100, (uint8_t)4}) {
+        std::vector<uint8_t> text = {claimed, 'a', 'b', 'c'};
+        MemoryRecordSource source(text.data(), text.size());
+        RecordReader in(source);
+        char out[RECORD_MAX_STRING] = "x";
+        in.readString(out, sizeof(out));
+        TEST_ASSERT_FALSE(in.ok());
+        TEST_ASSERT_EQUAL_STRING("", out);
+    }
+
+    // A record whose body runs past the end of its entity
+    RoutineStore routines = makeRoutines(3);
+    NvsService nvs;
+    StorageManager storage(&nvs);
+    storage.saveCustomTimers(routines);
+    uint32_t seq;
+    std::vector<uint8_t> blob = storedRecord("rt.0", &seq);
+    size_t bodyLength = blob.size() - 5; // header 3, record length 2
+    blob[3] = (bodyLength + 1) & 0xFF;
+    blob[4] = (bodyLength + 1) >> 8;
+    storeRecord("rt.0", blob, seq);
+    TEST_ASSERT_EQUAL_STRING(describeUnreadable(routines, 0), loadedRoutines());
+
+    // A manifest listing more slots than it can hold
+    std::vector<uint8_t> counted;
+    RecordWriter out(counted);
+    out.writeHeader(RECORD_MANIFEST, 1);
+    out.writeByte(RECORD_ALARMS);
+    out.writeVarint(1000);
+    storeRecord("al.idx", counted, 1);
+    TEST_ASSERT_EQUAL(0, storage.loadAlarms().size());
+}
+
+// Appends fields a newer schema might add to every record of a stream whose
+// header has counts more varints after it
+static std::vector<uint8_t> withFutureFields(const std::vector<uint8_t>& blob, int counts) {
+    size_t pos = 3;
+    for (int i = 0; i < counts; ++i) {
+        while (blob[pos] & 0x80) pos++;
+        pos++;
+    }
+    std::vector<uint8_t> out(blob.begin(), blob.begin() + pos);
+    while (pos + 2 <= blob.size()) {
+        size_t length = blob[pos] | blob[pos + 1] << 8;
+        std::vector<uint8_t> extra;
+        RecordWriter future(extra);
+        future.writeVarint(0xBEEF);
+        future.writeString("added later");
+        future.writeByte(7);
+        size_t newLength = length + extra.size();
+        out.push_back(newLength & 0xFF);
+        out.push_back(newLength >> 8);
+        out.insert(out.end(), blob.begin() + pos + 2, blob.begin() + pos + 2 + length);
+        out.insert(out.end(), extra.begin(), extra.end());
+        pos += 2 + length;
+    }
+    return out;
+}
+
+static void test_unknown_appended_fields_are_skipped() {
+    RoutineStore routines = makeRoutines(4);
+    std::vector<Alarm> alarms = makeAlarms(4);
+    std::vector<AlertzyAccount> accounts = makeAccounts(4);
+    NvsService nvs;
+    StorageManager storage(&nvs);
+    storage.saveCustomTimers(routines);
+    storage.saveAlarms(alarms);
+    storage.saveAlertzyAccounts(accounts);
+    for (const char* kind : {"rt", "al", "ac"}) {
+        for (int slot = 0; slot < 4; ++slot) {
+            std::string prefix = std::string(kind) + "." + std::to_string(slot);
+            uint32_t seq;
+            std::vector<uint8_t> blob = storedRecord(prefix, &seq);
+            std::vector<uint8_t> future = withFutureFields(blob, 0);
+            TEST_ASSERT_GREATER_THAN(blob.size(), future.size());
+            storeRecord(prefix, future, seq);
+        }
+    }
+    StoredDevice device;
+    device.boot();
+    TEST_ASSERT_EQUAL_STRING(describe(routines), device.routines());
+    TEST_ASSERT_EQUAL_STRING(describe(alarms), describe(device.models.getAlarms()));
+    TEST_ASSERT_EQUAL_STRING(describe(accounts), describe(device.models.getAccounts()));
+}
+
+static std::string writtenString(const std::string& value, uint16_t* cut) {
+    std::vector<uint8_t> blob;
+    RecordWriter out(blob);
+    out.writeString(value.c_str());
+    *cut = out.stringsCut();
+    MemoryRecordSource source(blob.data(), blob.size());
+    RecordReader in(source);
+    char text[RECORD_MAX_STRING];
+    in.readString(text, sizeof(text));
+    TEST_ASSERT_TRUE(in.ok());
+    return text;
+}
+
+static void test_long_strings_are_cut_at_a_character_boundary() {
+    uint16_t cut;
+    std::string fits(RECORD_MAX_STRING - 1, 'a');
+    TEST_ASSERT_EQUAL_STRING(fits, writtenString(fits, &cut));
+    TEST_ASSERT_EQUAL(0, cut);
+    TEST_ASSERT_EQUAL_STRING(fits, writtenString(fits + "bcd", &cut));
+    TEST_ASSERT_EQUAL(1, cut);
+    // 2-byte characters: 63 bytes would split the 32nd, so 62 are kept
+    std::string umlauts;
+    for (int i = 0; i < 40; ++i) umlauts += "ä";
+    std::string kept = writtenString(umlauts, &cut);
+    TEST_ASSERT_EQUAL(62, kept.size());
+    TEST_ASSERT_EQUAL_STRING(umlauts.substr(0, 62), kept);
+    TEST_ASSERT_EQUAL(1, cut);
+
+    // A reader with a smaller buffer keeps a prefix and still skips the rest
+    std::vector<uint8_t> blob;
+    RecordWriter out(blob);
+    out.writeString("Long break");
+    out.writeVarint(300);
+    MemoryRecordSource source(blob.data(), blob.size());
+    RecordReader in(source);
+    char small[5];
+    in.readString(small, sizeof(small));
+    TEST_ASSERT_EQUAL_STRING("Long", small);
+    TEST_ASSERT_EQUAL_UINT32(300, in.readVarint());
+    TEST_ASSERT_TRUE(in.ok());
+}
+
+// The routine JSON before the binary format, and its loader: the text, a
+// document for all of it, then the store
+static std::string routinesJson(const RoutineStore& routines) {
+    JsonDocument doc;
+    JsonArray arr = doc.to<JsonArray>();
+    for (size_t r = 0; r < routines.size(); ++r) {
+        RoutineView routine = routines[r];
+        JsonObject o = arr.add<JsonObject>();
+        o["name"] = routine.name();
+        JsonArray phases = o["phases"].to<JsonArray>();
+        for (int i = 0; i < routine.phaseCount(); ++i) {
+            PhaseView phase = routine.phase(i);
+            JsonObject po = phases.add<JsonObject>();
+            po["name"] = phase.name();
+            po["duration_seconds"] = phase.durationSeconds();
+            po["sound_track"] = phase.soundTrack();
+            JsonArray keys = po["alertzy_key_indices"].to<JsonArray>();
+            for (int k = 0; k < ROUTINE_MAX_NOTIFY_ACCOUNTS; ++k) {
+                if (phase.notifyMask() & (1UL << k)) keys.add(k);
+            }
+        }
+        JsonArray repeats = o["repeats"].to<JsonArray>();
+        for (const RepeatBlock& b : routine.repeats()) {
+            JsonObject ro = repeats.add<JsonObject>();
+            ro["first"] = b.first_phase;
+            ro["last"] = b.last_phase;
+            ro["count"] = b.count;
+        }
+    }
+    std::string json;
+    serializeJson(doc, json);
+    return json;
+}
+
+static void loadJson(const String& json, RoutineStore& out) {
+    JsonDocument doc;
+    if (deserializeJson(doc, json)) return;
+    for (JsonVariant t : doc.as<JsonArray>()) {
+        out.beginRoutine(t["name"].as<const char*>());
+        for (JsonVariant p : t["phases"].as<JsonArray>()) {
+            uint32_t mask = 0;
+            for (JsonVariant idx : p["alertzy_key_indices"].as<JsonArray>()) mask |= 1UL << idx.as<uint8_t>();
+            out.addPhase(p["name"].as<const char*>(), p["duration_seconds"].as<uint32_t>(), p["sound_track"].as<uint8_t>(),
+                         mask);
+        }
+        for (JsonVariant r : t["repeats"].as<JsonArray>()) {
+            out.addRepeat(r["first"].as<uint8_t>(), r["last"].as<uint8_t>(), r["count"].as<uint8_t>());
+        }
+        out.endRoutine();
+    }
+}
+
+// JSON left by older firmware loads once, is stored as binary and is gone
+static void test_legacy_json_is_migrated() {
+    RoutineStore routines = makeRoutines(5);
+    std::vector<Alarm> alarms = makeAlarms(6);
+    std::string alarmsJson = "[";
+    for (Alarm& a : alarms) {
+        // The object form predates days, one-shot and snooze
+        a.days = ALARM_EVERY_DAY;
+        a.one_shot = false;
+        a.snooze_minutes = 0;
+        char item[96];
+        snprintf(item, sizeof(item), "%s{\"hour\":%d,\"minute\":%d,\"enabled\":%s,\"sound_track\":%d}",
+                 alarmsJson.size() > 1 ? "," : "", a.hour, a.minute, a.enabled ? "true" : "false", a.sound_track);
+        alarmsJson += item;
+    }
+    alarmsJson += "]";
+    {
+        Preferences prefs;
+        prefs.begin("storage");
+        prefs.putString("custom_timers", routinesJson(routines).c_str());
+        prefs.putString("alarms", alarmsJson.c_str());
+    }
+    for (int boot = 0; boot < 2; ++boot) {
+        StoredDevice device;
+        device.boot();
+        TEST_ASSERT_EQUAL_STRING(describe(routines), device.routines());
+        TEST_ASSERT_EQUAL_STRING(describe(alarms), describe(device.models.getAlarms()));
+    }
+    TEST_ASSERT_FALSE(stored().count("custom_timers"));
+    TEST_ASSERT_FALSE(stored().count("alarms"));
+    TEST_ASSERT_TRUE(hasRecord("rt.idx"));
+    TEST_ASSERT_TRUE(hasRecord("al.idx"));
+}
+
+// Every entity's payload, in slot order, as StorageManager saved it
+static std::vector<std::vector<uint8_t>> storedEntities(const char* prefix, size_t count) {
+    std::vector<std::vector<uint8_t>> entities;
+    for (size_t slot = 0; slot < count; ++slot) {
+        uint32_t seq;
+        entities.push_back(storedRecord(std::string(prefix) + "." + std::to_string(slot), &seq));
+    }
+    return entities;
+}
+
+// A whole collection the way earlier firmware stored it: one header and a
+// count (for routines also the size hints), then every entity's record
+static std::vector<uint8_t> wholeCollection(RecordKind kind, const std::vector<std::vector<uint8_t>>& entities,
+                                            const RoutineStore* routines) {
+    std::vector<uint8_t> blob;
+    RecordWriter out(blob);
+    out.writeHeader(kind, 1);
+    out.writeVarint(entities.size());
+    if (routines) {
+        size_t phases = 0, nameBytes = 0;
+        for (size_t i = 0; i < routines->size(); ++i) {
+            RoutineView routine = (*routines)[i];
+            phases += routine.phaseCount();
+            nameBytes += strlen(routine.name()) + 1;
+            for (int p = 0; p < routine.phaseCount(); ++p) nameBytes += strlen(routine.phase(p).name()) + 1;
+        }
+        out.writeVarint(phases);
+        out.writeVarint(nameBytes);
+    }
+    for (const std::vector<uint8_t>& entity : entities) blob.insert(blob.end(), entity.begin() + 3, entity.end());
+    return blob;
+}
+
+// The per-entity layout before copies: each entity and the manifest straight
+// under their chunk keys, "rt.0.0", "rt.idx.0", ...
+static void storeUnframed(RecordKind kind, const char* prefix, const std::vector<std::vector<uint8_t>>& entities) {
+    for (size_t slot = 0; slot < entities.size(); ++slot) {
+        storeChunks(std::string(prefix) + "." + std::to_string(slot), entities[slot]);
+    }
+    storeChunks(std::string(prefix) + ".idx", unframedManifest(kind, entities.size()));
+}
+
+enum OldLayout { LAYOUT_UNFRAMED, LAYOUT_CHUNKED, LAYOUT_BLOB };
+
+// Earlier layouts, whole collections chunked or as one blob and entities
+// without copies, are rewritten as A/B copies once and removed
+static void test_collection_layouts_are_migrated() {
+    RoutineStore routines = makeRoutines(12);
+    std::vector<Alarm> alarms = makeAlarms(20);
+    std::vector<AlertzyAccount> accounts = makeAccounts(5);
+    std::vector<std::vector<uint8_t>> routineRecords, alarmRecords, accountRecords;
+    {
+        NvsService nvs;
+        StorageManager storage(&nvs);
+        storage.saveCustomTimers(routines);
+        storage.saveAlarms(alarms);
+        storage.saveAlertzyAccounts(accounts);
+        routineRecords = storedEntities("rt", routines.size());
+        alarmRecords = storedEntities("al", alarms.size());
+        accountRecords = storedEntities("ac", accounts.size());
+    }
+    std::vector<uint8_t> wholeRoutines = wholeCollection(RECORD_ROUTINES, routineRecords, &routines);
+    std::vector<uint8_t> wholeAlarms = wholeCollection(RECORD_ALARMS, alarmRecords, nullptr);
+    std::vector<uint8_t> wholeAccounts = wholeCollection(RECORD_ACCOUNTS, accountRecords, nullptr);
+    for (OldLayout layout : {LAYOUT_UNFRAMED, LAYOUT_CHUNKED, LAYOUT_BLOB}) {
+        host::flash.erase();
+        if (layout == LAYOUT_UNFRAMED) {
+            storeUnframed(RECORD_ROUTINES, "rt", routineRecords);
+            storeUnframed(RECORD_ALARMS, "al", alarmRecords);
+            storeUnframed(RECORD_ACCOUNTS, "ac", accountRecords);
+        } else if (layout == LAYOUT_CHUNKED) {
+            storeChunks("tmr", wholeRoutines);
+            storeChunks("alm", wholeAlarms);
+            storeChunks("acc", wholeAccounts);
+        } else {
+            stored()["timers_bin"] = host::NvsValue{PT_BLOB, wholeRoutines};
+            stored()["alarms_bin"] = host::NvsValue{PT_BLOB, wholeAlarms};
+            stored()["accounts_bin"] = host::NvsValue{PT_BLOB, wholeAccounts};
+        }
+        for (int boot = 0; boot < 2; ++boot) {
+            StoredDevice device;
+            device.boot();
+            TEST_ASSERT_EQUAL_STRING(describe(routines), device.routines());
+            TEST_ASSERT_EQUAL_STRING(describe(alarms), describe(device.models.getAlarms()));
+            TEST_ASSERT_EQUAL_STRING(describe(accounts), describe(device.models.getAccounts()));
+        }
+        for (const char* key : {"rt.0.0", "rt.idx.0", "al.idx.0", "ac.idx.0", "tmr.0", "alm.0", "acc.0", "timers_bin",
+                                "alarms_bin", "accounts_bin"}) {
+            TEST_ASSERT_FALSE_MESSAGE(stored().count(key), key);
+        }
+        TEST_ASSERT_TRUE(hasRecord("rt.11"));
+        TEST_ASSERT_TRUE(hasRecord("rt.idx"));
+    }
+}
+
+// A phase inside four nested 255-times blocks runs 255^4 times: the total
+// the routine index stores saturates instead of wrapping
+static void test_routine_total_saturates() {
+    RoutineStore r;
+    r.beginRoutine("Short");
+    r.addPhase("A", 10, 1, 0);
+    r.addPhase("B", 20, 1, 0);
+    r.addRepeat(0, 1, 3);
+    r.endRoutine();
+    r.beginRoutine("Endless");
+    for (int i = 0; i < 5; ++i) r.addPhase("P", 3600, 1, 0);
+    for (uint8_t first = 0; first < 4; ++first) r.addRepeat(first, 4, 255);
+    r.endRoutine();
+    TEST_ASSERT_EQUAL_UINT32(90, r[0].totalDurationSeconds());
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, r[1].totalDurationSeconds());
+    RoutineIndex index;
+    index.add(r[1]);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, index.totalDurationSeconds(0));
+}
+
+static void test_fifty_routines_against_json() {
+    RoutineStore routines = makeRoutines(50);
+    std::string expected = describe(routines);
+    String json(routinesJson(routines).c_str());
+    NvsService nvs;
+    StorageManager storage(&nvs);
+    storage.saveCustomTimers(routines);
+    size_t binarySize = 0;
+    for (const auto& kv : stored()) binarySize += kv.second.bytes.size();
+
+    RoutineStore fromJson;
+    HeapProbe jsonProbe;
+    loadJson(json, fromJson);
+    double jsonUs = jsonProbe.micros();
+    size_t jsonPeak = jsonProbe.peak();
+
+    // The index, then every body once, as running each routine would
+    StoredDevice device;
+    HeapProbe binaryProbe;
+    RoutineIndex index = device.storage.loadRoutineIndex();
+    RoutineStore body;
+    for (size_t i = 0; i < index.size(); ++i) device.storage.loadRoutine(device.models.routineId((int)i), body);
+    double binaryUs = binaryProbe.micros();
+    size_t binaryPeak = binaryProbe.peak();
+
+    printf("\n50 routines  %8s %10s %8s\n", "bytes", "peak heap", "load us");
+    printf("  JSON       %8u %10zu %8.0f   (the text itself is a String on top)\n", json.length(), jsonPeak, jsonUs);
+    printf("  binary     %8zu %10zu %8.0f\n", binarySize, binaryPeak, binaryUs);
+    device.boot();
+    TEST_ASSERT_EQUAL_STRING(expected, device.routines());
+    TEST_ASSERT_EQUAL_STRING(expected, describe(fromJson));
+    TEST_ASSERT_LESS_THAN(json.length() / 3, binarySize);
+    TEST_ASSERT_LESS_THAN(jsonPeak, binaryPeak);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32_matches_zlib);
+    RUN_TEST(test_frame_round_trip);
+    RUN_TEST(test_fields_round_trip);
+    RUN_TEST(test_collections_round_trip);
+    RUN_TEST(test_truncated_input_is_rejected);
+    RUN_TEST(test_malformed_input_is_rejected);
+    RUN_TEST(test_unknown_appended_fields_are_skipped);
+    RUN_TEST(test_long_strings_are_cut_at_a_character_boundary);
+    RUN_TEST(test_routine_total_saturates);
+    RUN_TEST(test_legacy_json_is_migrated);
+    RUN_TEST(test_collection_layouts_are_migrated);
+    RUN_TEST(test_fifty_routines_against_json);
+    return UNITY_END();
+}
@@ -0,0 +1,213 @@
+// Storage cost on the host, against the in-memory Preferences: save and load
+// time, encoded bytes, allocations and peak heap for alarms, accounts and
+// routines at 1, 10, 100 and 500 entries. Then the legacy JSON each size
+// would have been, checked against the fixed ArduinoJson 6 capacities the
+// old firmware used and the NVS string limit, and migrated by this firmware.
+//
+//   pio test -e native -f test_storage_bench -v
+
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <set>
+#include "HeapProbe.h"
+#include "StorageFixtures.h"
+
+static const int SIZES[] = {1, 10, 100, 500};
+static const char* KIND_NAMES[] = {"alarms", "accounts", "routines"};
+
+void setUp() {
+    host::flash.erase();
+    host::serialQuiet = true;
+}
+
+void tearDown() {
+    host::serialQuiet = false;
+}
+
+static void test_save_and_load_cost() {
+    printf("\n%-9s %4s | %8s %6s %7s | %8s %6s %7s | %7s %5s\n", "kind", "n", "save us", "allocs", "peak B", "load us",
+           "allocs", "peak B", "NVS B", "keys");
+    for (int kind = MODEL_ALARM; kind <= MODEL_ROUTINE; ++kind) {
+        for (int n : SIZES) {
+            host::flash.erase();
+            std::vector<Alarm> alarms = makeAlarms(n);
+            std::vector<AlertzyAccount> accounts = makeAccounts(n);
+            RoutineStore routines = makeRoutines(kind == MODEL_ROUTINE ? n : 0);
+            std::string expected = kind == MODEL_ALARM ? describe(alarms)
+                                 : kind == MODEL_ACCOUNT ? describe(accounts) : describe(routines);
+
+            double saveUs;
+            size_t saveAllocs, savePeak;
+            {
+                NvsService nvs;
+                StorageManager storage(&nvs);
+                HeapProbe p;
+                if (kind == MODEL_ALARM) storage.saveAlarms(alarms);
+                else if (kind == MODEL_ACCOUNT) storage.saveAlertzyAccounts(accounts);
+                else storage.saveCustomTimers(routines);
+                saveUs = p.micros();
+                saveAllocs = p.count();
+                savePeak = p.peak();
+            }
+            size_t bytes = host::flash.storedBytes();
+            size_t keys = host::flash.keyCount();
+
+            // Boot loads the routine index; each body is then read once, as
+            // running or editing it would
+            double loadUs;
+            size_t loadAllocs, loadPeak;
+            std::string loaded;
+            {
+                StoredDevice device;
+                HeapProbe p;
+                if (kind == MODEL_ALARM) device.models.setAlarms(device.storage.loadAlarms());
+                else if (kind == MODEL_ACCOUNT) device.models.setAccounts(device.storage.loadAlertzyAccounts());
+                else {
+                    device.models.setRoutines(device.storage.loadRoutineIndex());
+                    RoutineStore body;
+                    for (size_t i = 0; i < device.models.getRoutines().size(); ++i) {
+                        device.storage.loadRoutine(device.models.routineId((int)i), body);
+                    }
+                }
+                loadUs = p.micros();
+                loadAllocs = p.count();
+                loadPeak = p.peak();
+                loaded = kind == MODEL_ALARM ? describe(device.models.getAlarms())
+                       : kind == MODEL_ACCOUNT ? describe(device.models.getAccounts()) : device.routines();
+            }
+            printf("%-9s %4d | %8.0f %6zu %7zu | %8.0f %6zu %7zu | %7zu %5zu\n", KIND_NAMES[kind], n, saveUs, saveAllocs,
+                   savePeak, loadUs, loadAllocs, loadPeak, bytes, keys);
+            TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, loaded, KIND_NAMES[kind]);
+        }
+    }
+}
+
+// The JSON the firmware stored before the binary format, key for key
+static void legacyJson(JsonDocument& doc, int kind, int n) {
+    JsonArray arr = doc.to<JsonArray>();
+    if (kind == MODEL_ALARM) {
+        for (const Alarm& a : makeAlarms(n)) {
+            JsonObject o = arr.add<JsonObject>();
+            o["hour"] = a.hour;
+            o["minute"] = a.minute;
+            o["enabled"] = (bool)a.enabled;
+            o["sound_track"] = a.sound_track;
+        }
+    } else if (kind == MODEL_ACCOUNT) {
+        for (const AlertzyAccount& a : makeAccounts(n)) {
+            JsonObject o = arr.add<JsonObject>();
+            o["name"] = a.name;
+            o["key"] = a.key;
+        }
+    } else {
+        RoutineStore routines = makeRoutines(n);
+        for (size_t r = 0; r < routines.size(); ++r) {
+            RoutineView routine = routines[r];
+            JsonObject o = arr.add<JsonObject>();
+            o["name"] = routine.name();
+            JsonArray phases = o["phases"].to<JsonArray>();
+            for (int i = 0; i < routine.phaseCount(); ++i) {
+                PhaseView phase = routine.phase(i);
+                JsonObject po = phases.add<JsonObject>();
+                po["name"] = phase.name();
+                po["duration_seconds"] = phase.durationSeconds();
+                po["sound_track"] = phase.soundTrack();
+                JsonArray keys = po["alertzy_key_indices"].to<JsonArray>();
+                for (int k = 0; k < ROUTINE_MAX_NOTIFY_ACCOUNTS; ++k) {
+                    if (phase.notifyMask() & (1UL << k)) keys.add(k);
+                }
+            }
+            JsonArray repeats = o["repeats"].to<JsonArray>();
+            for (const RepeatBlock& b : routine.repeats()) {
+                JsonObject ro = repeats.add<JsonObject>();
+                ro["first"] = b.first_phase;
+                ro["last"] = b.last_phase;
+                ro["count"] = b.count;
+            }
+        }
+    }
+}
+
+// Pool bytes ArduinoJson 6 needs on the ESP32 to parse a document out of a
+// String: a 16-byte slot per array element and object member, plus each
+// distinct string (keys included) copied once with its NUL
+static size_t v6PoolBytes(JsonVariantConst v, std::set<std::string>& strings) {
+    size_t bytes = 0;
+    if (v.is<JsonArrayConst>()) {
+        for (JsonVariantConst e : v.as<JsonArrayConst>()) bytes += 16 + v6PoolBytes(e, strings);
+    } else if (v.is<JsonObjectConst>()) {
+        for (JsonPairConst kv : v.as<JsonObjectConst>()) {
+            if (strings.insert(kv.key().c_str()).second) bytes += strlen(kv.key().c_str()) + 1;
+            bytes += 16 + v6PoolBytes(kv.value(), strings);
+        }
+    } else if (v.is<const char*>()) {
+        if (strings.insert(v.as<const char*>()).second) bytes += strlen(v.as<const char*>()) + 1;
+    }
+    return bytes;
+}
+
+// What a legacy load brings back: the alarm JSON had no days or snooze
+static std::string expectedFromJson(int kind, int n) {
+    if (kind == MODEL_ACCOUNT) return describe(makeAccounts(n));
+    if (kind == MODEL_ROUTINE) return describe(makeRoutines(n));
+    std::vector<Alarm> alarms;
+    for (const Alarm& a : makeAlarms(n)) {
+        Alarm legacy;
+        legacy.hour = a.hour;
+        legacy.minute = a.minute;
+        legacy.enabled = a.enabled;
+        legacy.sound_track = a.sound_track;
+        alarms.push_back(legacy);
+    }
+    return describe(alarms);
+}
+
+static void test_legacy_json_limits() {
+    // Capacities the old loaders and savers passed to DynamicJsonDocument
+    static const size_t CAPACITY[] = {1024, 4096, 16384};
+    static const char* LEGACY_KEY[] = {"alarms", "alertzy_accounts", "custom_timers"};
+    printf("\n%-9s %4s | %7s | %8s %6s %-8s | %-12s | %s\n", "kind", "n", "JSON B", "v6 pool", "cap", "", "NVS string",
+           "migrated");
+    for (int kind = MODEL_ALARM; kind <= MODEL_ROUTINE; ++kind) {
+        for (int n : SIZES) {
+            host::flash.erase();
+            JsonDocument doc;
+            legacyJson(doc, kind, n);
+            std::string json;
+            serializeJson(doc, json);
+            std::set<std::string> strings;
+            size_t pool = v6PoolBytes(doc.as<JsonVariantConst>(), strings);
+            bool fitsCapacity = pool <= CAPACITY[kind];
+
+            // The old saver wrote the whole text as one NVS string
+            Preferences prefs;
+            prefs.begin(STORAGE_NAMESPACE, false, NVS_PARTITION);
+            bool stored = prefs.putString(LEGACY_KEY[kind], json.c_str()) > 0;
+            prefs.end();
+            const char* nvsResult = stored ? "ok"
+                                  : strlen(LEGACY_KEY[kind]) > HOST_NVS_KEY_MAX ? "KEY TOO LONG" : "TOO LONG";
+
+            StoredDevice device;
+            device.boot();
+            std::string loaded = kind == MODEL_ALARM ? describe(device.models.getAlarms())
+                               : kind == MODEL_ACCOUNT ? describe(device.models.getAccounts()) : device.routines();
+            bool migrated = loaded == expectedFromJson(kind, n);
+
+            // Either limit lost data without an error anyone saw: a failed
+            // putString left nothing to load on the next boot, and an
+            // overflowing v6 document parsed only a prefix of the list
+            const char* note = !stored ? "  <- old firmware lost it" : !fitsCapacity ? "  <- old firmware kept a prefix" : "";
+            printf("%-9s %4d | %7zu | %8zu %6zu %-8s | %-12s | %s%s\n", KIND_NAMES[kind], n, json.size(), pool,
+                   CAPACITY[kind], fitsCapacity ? "ok" : "OVERFLOW", nvsResult, migrated ? "ok" : "no", note);
+            if (stored) TEST_ASSERT_TRUE_MESSAGE(migrated, KIND_NAMES[kind]);
+            else TEST_ASSERT_EQUAL_STRING("", loaded);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_save_and_load_cost);
+    RUN_TEST(test_legacy_json_limits);
+    return UNITY_END();
+}
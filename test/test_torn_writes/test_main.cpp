@@ -0,0 +1,245 @@
+// Power cuts during a flush: the write-behind queue is flushed with the
+// power failing after every possible number of bytes, and the next boot
+// must load, for each routine, alarm and account, either what was there
+// before the flush or what the flush wrote, never a mix inside one entity,
+// and the next write must land.
+//
+//   pio test -e native -f test_torn_writes -v
+
+#include <unity.h>
+#include <map>
+#include "StorageFixtures.h"
+
+// A device as main.cpp boots it: changes wait for flush()
+struct Device : StoredDevice {
+    Device() {
+        storage.begin();
+        boot();
+    }
+};
+
+// What a boot loaded, entity by entity
+struct Snapshot {
+    std::vector<std::string> names;
+    std::map<std::string, std::string> bodies;
+    std::string alarms;
+    std::string accounts;
+};
+
+static Snapshot snapshot(Device& d) {
+    Snapshot s;
+    const RoutineIndex& index = d.models.getRoutines();
+    for (size_t i = 0; i < index.size(); ++i) {
+        const RoutineStore* body = d.models.routine(d.models.routineId((int)i));
+        s.names.push_back(index.name((int)i));
+        s.bodies[index.name((int)i)] = body ? describe(*body) : "<unreadable>";
+    }
+    s.alarms = describe(d.models.getAlarms());
+    s.accounts = describe(d.models.getAccounts());
+    return s;
+}
+
+// Each list is the old or the new one, and each routine it names carries
+// its old or its new body
+static bool consistent(const Snapshot& got, const Snapshot& before, const Snapshot& after) {
+    if (got.names != before.names && got.names != after.names) return false;
+    if (got.alarms != before.alarms && got.alarms != after.alarms) return false;
+    if (got.accounts != before.accounts && got.accounts != after.accounts) return false;
+    for (const auto& kv : got.bodies) {
+        auto b = before.bodies.find(kv.first);
+        auto a = after.bodies.find(kv.first);
+        if (!(b != before.bodies.end() && b->second == kv.second) && !(a != after.bodies.end() && a->second == kv.second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 40 phases: a body of several chunks
+static CustomTimer bigRoutine(int version) {
+    CustomTimer t;
+    t.name = "Big";
+    for (int i = 0; i < 40; ++i) {
+        t.phases.push_back(TimerPhase{"Interval phase", (uint32_t)(60 + i + version * 1000), (uint8_t)(1 + i % 5), {}});
+    }
+    return t;
+}
+
+// Version 2 also adds and removes a routine and adds an account, so the
+// manifests change with the bodies
+static void edit(ModelRepository& m, int version) {
+    m.saveRoutine(m.routineId(1), bigRoutine(version));
+    if (version == 2) {
+        m.removeRoutine(m.routineId(5));
+        CustomTimer added;
+        added.name = "Added";
+        added.phases.push_back(TimerPhase{"A", 30, 1, {}});
+        m.saveRoutine(MODEL_INVALID_ID, added);
+        m.addAccount(AlertzyAccount{"Laptop", "new-key"});
+    }
+    m.updateAlarm(m.alarmId(2), [&](Alarm& a) { a.minute = 10 + version; });
+}
+
+typedef std::map<std::string, std::map<std::string, host::NvsValue>> Flash;
+
+// 12 routines, 10 alarms and 3 accounts, edited once so both copies exist
+static Flash baseImage() {
+    host::flash.erase();
+    {
+        StoredDevice d;
+        d.storage.saveCustomTimers(makeRoutines(12));
+        d.storage.saveAlarms(makeAlarms(10));
+        d.storage.saveAlertzyAccounts(makeAccounts(3));
+    }
+    {
+        Device d;
+        edit(d.models, 1);
+        d.storage.flush();
+    }
+    return host::flash.namespaces;
+}
+
+static void restore(const Flash& image) {
+    host::flash.namespaces = image;
+    host::flash.restorePower();
+}
+
+void setUp() {
+    host::flash.erase();
+    host::serialQuiet = true;
+}
+
+void tearDown() {
+    host::serialQuiet = false;
+}
+
+static void test_cut_at_every_offset() {
+    Flash base = baseImage();
+    Snapshot before, after;
+    {
+        Device d;
+        before = snapshot(d);
+    }
+    {
+        Device d;
+        edit(d.models, 2);
+        d.storage.flush();
+        after = snapshot(d);
+    }
+    TEST_ASSERT_TRUE(before.names != after.names);
+
+    int cuts = 0, olds = 0, news = 0, mixed = 0;
+    for (long budget = 0;; ++budget) {
+        restore(base);
+        bool lost;
+        {
+            Device d;
+            edit(d.models, 2);
+            host::flash.cutPowerAfter(budget);
+            d.storage.flush();
+            lost = host::flash.powerLost;
+        }
+        host::flash.restorePower();
+        if (!lost) break;
+        cuts++;
+
+        char where[48];
+        snprintf(where, sizeof(where), "power cut after %ld bytes", budget);
+        {
+            Device d;
+            Snapshot got = snapshot(d);
+            TEST_ASSERT_TRUE_MESSAGE(consistent(got, before, after), where);
+            if (got.names == before.names && got.bodies == before.bodies) olds++;
+            else if (got.names == after.names && got.bodies == after.bodies && got.alarms == after.alarms) news++;
+            else mixed++;
+            // The write after a cut one must land and win
+            edit(d.models, 3);
+            d.storage.flush();
+        }
+        {
+            Device d;
+            const RoutineStore* big = d.models.routine(d.models.routineId(1));
+            TEST_ASSERT_NOT_NULL_MESSAGE(big, where);
+            TEST_ASSERT_EQUAL_UINT32_MESSAGE(3099, (*big)[0].phase(39).durationSeconds(), where);
+            TEST_ASSERT_EQUAL_MESSAGE(13, d.models.getAlarms()[2].minute, where);
+        }
+    }
+    printf("\n%d cut points: %d loaded the old data, %d the new, %d old and new per entity\n", cuts, olds, news, mixed);
+    TEST_ASSERT_GREATER_THAN(100, cuts);
+}
+
+// A removed routine's erase is cut, then a new routine takes a free slot:
+// it must not come back with pieces of the removed one
+static void test_cut_erase_then_slot_reuse() {
+    Flash base = baseImage();
+    int cuts = 0;
+    for (long budget = 0;; ++budget) {
+        restore(base);
+        bool lost;
+        {
+            Device d;
+            d.models.removeRoutine(d.models.routineId(1));
+            host::flash.cutPowerAfter(budget);
+            d.storage.flush();
+            lost = host::flash.powerLost;
+        }
+        host::flash.restorePower();
+        if (!lost) break;
+        cuts++;
+
+        {
+            Device d;
+            if (d.models.getRoutines().size() == 12) d.models.removeRoutine(d.models.routineId(1));
+            CustomTimer reuse;
+            reuse.name = "Reuse";
+            reuse.phases.push_back(TimerPhase{"Only", 77, 2, {}});
+            d.models.saveRoutine(MODEL_INVALID_ID, reuse);
+            d.storage.flush();
+        }
+        char where[48];
+        snprintf(where, sizeof(where), "power cut after %ld bytes", budget);
+        Device d;
+        int last = (int)d.models.getRoutines().size() - 1;
+        TEST_ASSERT_EQUAL_STRING_MESSAGE("Reuse", d.models.getRoutines().name(last), where);
+        const RoutineStore* body = d.models.routine(d.models.routineId(last));
+        TEST_ASSERT_NOT_NULL_MESSAGE(body, where);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE("Reuse|Only,77,2,0;\n", describe(*body).c_str(), where);
+    }
+    TEST_ASSERT_GREATER_THAN(0, cuts);
+}
+
+// A flipped bit in the newest copy of an alarm: the older copy is loaded,
+// and the next edit replaces the bad one
+static void test_bit_flip_falls_back_to_other_copy() {
+    baseImage();
+    std::map<std::string, host::NvsValue>& ns = host::flash.namespaces[STORAGE_NAMESPACE];
+    std::string newest;
+    uint32_t newestSeq = 0;
+    for (const char* key : {"al.2a.0", "al.2b.0"}) {
+        auto it = ns.find(key);
+        TEST_ASSERT_TRUE_MESSAGE(it != ns.end(), key);
+        RecordFrame frame;
+        TEST_ASSERT_TRUE(readFrame(it->second.bytes.data(), it->second.bytes.size(), frame));
+        if (newest.empty() || frame.seq > newestSeq) {
+            newest = key;
+            newestSeq = frame.seq;
+        }
+    }
+    ns[newest].bytes.back() ^= 0x40;
+    {
+        Device d;
+        TEST_ASSERT_EQUAL(makeAlarms(10)[2].minute, d.models.getAlarms()[2].minute);
+        edit(d.models, 4);
+        d.storage.flush();
+    }
+    Device d;
+    TEST_ASSERT_EQUAL(14, d.models.getAlarms()[2].minute);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_cut_at_every_offset);
+    RUN_TEST(test_cut_erase_then_slot_reuse);
+    RUN_TEST(test_bit_flip_falls_back_to_other_copy);
+    return UNITY_END();
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Local NTP stand-in for testing the RTC discipline on the bench.
+
+Answers SNTP requests with this machine's clock, shifted by a fixed offset
+and running fast or slow by a given rate, so the device measures a known
+RTC offset and drift without waiting days for the DS3231 to wander.
+
+    sudo python3 tools/ntp_standin.py --offset 0.25 --drift-ppm 20
+
+Point the device at it with NTP_SERVER=<this machine's IP> in .env.local
+(pre_build.py writes it into configs.h) and rebuild. SNTP always asks port
+123, so the server needs the rights to bind it. A server running 20 ppm
+fast looks like an RTC running 20 ppm slow: the log should show the offset
+growing by about 20 us per second between syncs, the aging trim moving to
+correct it, and the sync interval adapting to the measured rate.
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+# Seconds from the NTP era (1900) to the Unix epoch
+NTP_EPOCH_OFFSET = 2208988800
+
+
+def to_ntp(unix_time):
+    seconds = int(unix_time)
+    fraction = int((unix_time - seconds) * (1 << 32)) & 0xFFFFFFFF
+    return ((seconds + NTP_EPOCH_OFFSET) & 0xFFFFFFFF) << 32 | fraction
+
+
+class StandInClock:
+    """Host time plus offset, drifting by drift_ppm from when it started."""
+
+    def __init__(self, offset, drift_ppm):
+        self.offset = offset
+        self.drift = drift_ppm * 1e-6
+        self.start = time.time()
+
+    def now(self):
+        host = time.time()
+        return host + self.offset + (host - self.start) * self.drift
+
+    def shift(self, unix_time):
+        return unix_time - time.time()
+
+
+def reply(request, received, clock):
+    first = request[0]
+    version = (first >> 3) & 0x7 or 4
+    poll = request[2]
+    client_transmit = request[40:48]
+    now = clock.now()
+    # LI 0, client's version, mode 4 (server); stratum 1 with reference "LOCL"
+    header = struct.pack(
+        "!BBbbII4s",
+        version << 3 | 4,
+        1,
+        poll,
+        -20,
+        0,
+        1 << 6,  # root dispersion, about 1 ms
+        b"LOCL",
+    )
+    return header + struct.pack("!Q", to_ntp(clock.start + clock.offset)) + client_transmit + struct.pack(
+        "!QQ", to_ntp(received), to_ntp(now)
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bind", default="0.0.0.0", help="address to listen on")
+    parser.add_argument("--port", type=int, default=123)
+    parser.add_argument("--offset", type=float, default=0.0, help="seconds added to this machine's clock")
+    parser.add_argument("--drift-ppm", type=float, default=0.0, help="rate the served clock runs fast (+) or slow (-)")
+    args = parser.parse_args()
+
+    clock = StandInClock(args.offset, args.drift_ppm)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    print(f"NTP stand-in on {args.bind}:{args.port}, offset {args.offset:+.3f} s, drift {args.drift_ppm:+.2f} ppm")
+
+    while True:
+        request, client = sock.recvfrom(512)
+        received = clock.now()
+        if len(request) < 48 or request[0] & 0x7 != 3:
+            continue  # only client-mode requests
+        sock.sendto(reply(request, received, clock), client)
+        served = clock.now()
+        print(
+            f"{time.strftime('%H:%M:%S')} {client[0]}: served {time.strftime('%H:%M:%S', time.gmtime(served))} UTC, "
+            f"{clock.shift(served) * 1000:+.3f} ms from this machine"
+        )
+
+
+if __name__ == "__main__":
+    main()